@@ -7,6 +7,8 @@
 #include "AmpIORevision.h"
 #include "AmpIO.h"
 #include "EthUdpPort.h"
+#include "ReplayPort.h"
+#include "BoardIdentity.h"
 
 #if Amp1394_HAS_RAW1394
   #include "FirewirePort.h"
@@ -167,9 +169,17 @@ uint32_t bswap32(uint32_t in);
 %apply quadlet_t& ARGOUT_QUADLET_T {quadlet_t &data};
 %apply (quadlet_t* ARGOUT_ARRAY1, unsigned int NBYTES) {(quadlet_t *rdata, unsigned int nbytes)};
 %apply (quadlet_t* IN_ARRAY1, unsigned int NBYTES) {(quadlet_t *wdata, unsigned int nbytes)};
+%include "LatencyHistogram.h"
+%include "AsyncLog.h"
+%include "TelemetryRecorder.h"
+%include "SideChannel.h"
 %include "BasePort.h"
+%include "PacketTrace.h"
+%include "FaultInjector.h"
 %include "EthBasePort.h"
 %include "EthUdpPort.h"
+%include "ReplayPort.h"
+%include "BoardIdentity.h"
 #if Amp1394_HAS_RAW1394
   %include "FirewirePort.h"
 #endif
@@ -23,6 +23,10 @@ http://www.cisst.org/cisst/license.txt.
 // Return the time in seconds
 double Amp1394_GetTime(void);
 
+// Return the time in seconds from a monotonic clock (e.g., CLOCK_MONOTONIC on Linux), which
+// is not affected by changes to the system time. The origin is arbitrary.
+double Amp1394_GetMonotonicTime(void);
+
 // Sleep for the desired number of seconds
 void Amp1394_Sleep(double sec);
 
@@ -30,4 +30,15 @@ typedef __int32          int32_t;
 #include <stdint.h>
 #endif
 
+// Compiler/memory barrier, used by the lock-free buffers that are written by one thread
+// and read by another (e.g., PacketTrace, AsyncLog).
+#if defined(__GNUC__)
+#define AMP1394_MEMORY_BARRIER() __sync_synchronize()
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define AMP1394_MEMORY_BARRIER() _ReadWriteBarrier()
+#else
+#define AMP1394_MEMORY_BARRIER()
+#endif
+
 #endif // __AMP1394_TYPES_H__
@@ -24,6 +24,7 @@ http://www.cisst.org/cisst/license.txt.
 #include "FpgaIO.h"
 #include "EncoderVelocity.h"
 #include <iostream>
+#include <vector>
 
 class ostream;
 
@@ -36,6 +37,14 @@ struct SiCurrentLoopParams {
     uint16_t dutyCycleLimit; // uint 0-1023
 };
 
+// Current-loop diagnostics (read-only) of one motor, see AmpIO::ReadSiCurrentLoopAll
+struct SiCurrentLoopState {
+    uint16_t controlMode; // AmpIO::MotorControlMode
+    int16_t dutyCycle;
+    int16_t iTerm;
+    int16_t fault;
+};
+
 /*! See Interface Spec: https://github.com/jhu-cisst/mechatronics-software/wiki/Interface-Specification */
 class AmpIO : public FpgaIO
 {
@@ -52,7 +61,35 @@ public:
     // Return number of digital outputs (4 for QLA)
     unsigned int GetNumDouts(void) const { return NumDouts; }
 
-    // Return QLA serial number (empty string if not found)
+    // Identity information at the start of the QLA PROM (25AA128), which contains a string
+    // such as "QLA 1234-567" ("dRA 1234-567" for dRA1), terminated by 0 or 0xff.
+    struct QLAIdentity {
+        enum { HEADER_SIZE = 16 };          // Number of bytes read (4 quadlets)
+        std::string boardType;              // "QLA" or "dRA" (empty if not found)
+        std::string serialNumber;           // For example, "1234-567" (empty if not found)
+        uint8_t header[HEADER_SIZE];        // Header bytes, as read from PROM
+    };
+
+    // Read the QLA identity (header) with one block read (see PromReadBlock25AA128), rather
+    // than one PROM command per byte. Only if the block read fails, or does not return a valid
+    // or blank header (see ParseQLAIdentityBlock), is the header read byte by byte instead
+    // (ReadQLAIdentityBytes). Returns false if the PROM could not be read.
+    //   chan:  0 for QLA; 1 or 2 for DQLA
+    bool ReadQLAIdentity(QLAIdentity &id, unsigned char chan = 0);
+
+    // Read the first 12 bytes of the header byte by byte (one PROM command per byte)
+    bool ReadQLAIdentityBytes(QLAIdentity &id, unsigned char chan = 0);
+
+    // Parse id.header into id.boardType and id.serialNumber. Returns false if the header
+    // does not start with a known board type and is not blank (all 0xff).
+    static bool ParseQLAIdentity(QLAIdentity &id);
+
+    // Copy the data from the block read (HEADER_SIZE bytes, as returned by ReadBlock) to
+    // id.header and parse it. The PROM bytes are expected in address order; the header is
+    // also accepted with the bytes of each quadlet swapped.
+    static bool ParseQLAIdentityBlock(QLAIdentity &id, const quadlet_t *data);
+
+    // Return QLA serial number (empty string if not found), see ReadQLAIdentity
     //   chan:  0 for QLA; 1 or 2 for DQLA
     std::string GetQLASerialNumber(unsigned char chan = 0);
     void DisplayReadBuffer(std::ostream &out = std::cout) const;
@@ -191,6 +228,14 @@ public:
     */
     double GetEncoderRunningCounterSeconds(unsigned int index) const;
 
+    /*! Returns the encoder position (counts) and velocity (counts/sec) extrapolated to the latency
+        compensation reference instant (see BasePort::SetLatencyReference), using the predicted velocity
+        and the estimated acceleration. The extrapolated velocity does not change sign. If latency
+        compensation is not enabled, these return the same values as GetEncoderPosition and
+        GetEncoderVelocityPredicted. */
+    double GetEncoderPositionCompensated(unsigned int index, double percent_threshold = 1.0) const;
+    double GetEncoderVelocityCompensated(unsigned int index, double percent_threshold = 1.0) const;
+
     /*! Returns the data available for computing encoder velocity (and acceleration). */
     bool GetEncoderVelocityData(unsigned int index, EncoderVelocity &data) const;
 
@@ -205,6 +250,56 @@ public:
         value) clears the counter for all channels. */
     bool ClearEncoderErrorCount(unsigned int index = MAX_CHANNELS);
 
+    /*! Enable or disable lazy decoding of the encoder velocity data. By default (lazy=false),
+        SetReadData (called by ReadAllBoards) decodes the velocity data for every encoder. When lazy
+        decoding is enabled, SetReadData only copies the raw feedback and the velocity data for a given
+        encoder is decoded on the first call (within that frame) to one of the velocity/acceleration
+        methods above; the result is cached until the next frame is received. This can reduce the
+        per-cycle cost for applications that only use some of the feedback (e.g., positions and status).
+        The encoder error count and firmware time are still updated for every frame. */
+    void SetLazyDecode(bool lazy);
+    bool IsLazyDecode(void) const { return lazyDecode; }
+
+    /*! Returns the frame generation counter, which is incremented every time new feedback data is
+        received (i.e., each time SetReadData is called). */
+    uint32_t GetReadFrameGeneration(void) const { return readFrameGen; }
+
+    //********************** Feedback history *****************************************************
+    // AmpIO can optionally keep a ring buffer of the most recent raw feedback frames (i.e., the
+    // contents of ReadBuffer), along with the host receive time and firmware time of each frame.
+    // The ring buffer is allocated by InitBoard (i.e., when the board is added to the port), so
+    // SetHistoryDepth should be called before BasePort::AddBoard (or call InitBoard again).
+    // In the following methods, age=0 refers to the most recent frame, age=1 to the previous
+    // frame, and so on; the methods return false (or 0) if the requested frame is not available.
+
+    /*! Set the number of frames to keep in the history buffer (0 to disable, which is the default). */
+    void SetHistoryDepth(unsigned int depth);
+    /*! Returns the capacity of the history buffer, in frames. */
+    unsigned int GetHistoryDepth(void) const { return histDepth; }
+    /*! Returns the number of valid frames in the history buffer (at most GetHistoryDepth). */
+    unsigned int GetHistoryCount(void) const { return histCount; }
+
+    /*! Returns a pointer to the raw (byteswapped) feedback frame, or 0 if not available. */
+    const quadlet_t *GetHistoryFrame(unsigned int age) const;
+    /*! Returns the host time (Amp1394_GetTime) when the frame was received, in seconds. */
+    bool GetHistoryHostTime(unsigned int age, double &hostTime) const;
+    /*! Returns the firmware time (see FpgaIO::GetFirmwareTime) of the frame, in seconds. */
+    bool GetHistoryFirmwareTime(unsigned int age, double &fwTime) const;
+    /*! Returns the timestamp (time since previous read, in seconds) of the frame. */
+    bool GetHistoryTimestampSeconds(unsigned int age, double &ts) const;
+
+    /*! Per-axis history accessors (same conversions as the corresponding GetXXX methods) */
+    bool GetHistoryEncoderPosition(unsigned int index, unsigned int age, int32_t &pos) const;
+    bool GetHistoryEncoderVelocityRaw(unsigned int index, unsigned int age, uint32_t &vel) const;
+    bool GetHistoryMotorCurrent(unsigned int index, unsigned int age, uint32_t &mcur) const;
+    bool GetHistoryAnalogInput(unsigned int index, unsigned int age, uint32_t &ain) const;
+
+    /*! Copies the encoder position history for the specified axis into pos (and optionally the
+        corresponding firmware times into fwTime), starting with the most recent frame.
+        Returns the number of samples copied, which is at most n. */
+    unsigned int GetHistoryEncoderPositions(unsigned int index, int32_t *pos, double *fwTime,
+                                            unsigned int n) const;
+
     //********************************************************************************************
 
     // GetPowerEnable: return power enable control
@@ -533,6 +628,37 @@ public:
     bool DallasReadBlock(unsigned char *data, unsigned int nbytes) const;
     bool DallasReadMemory(unsigned short addr, unsigned char *data, unsigned int nbytes);
 
+    // Incremental (background) tool read, for use while the real-time loop is running.
+    // DallasReadTool must be called repeatedly by the application, and DallasReadMemory
+    // blocks while waiting for the DS2505. Instead, after DallasReaderStart, the tool is read
+    // by the port: each call to BasePort::WriteAllBoards (i.e., once per control cycle) advances
+    // the reader of at most one board (in round-robin order) by one step, where a step is one
+    // quadlet or block transaction. The DS2505 status (register 13) is not part of the real-time
+    // feedback, so it is polled with a quadlet read.
+    //    repeatSec   if > 0, read the tool again repeatSec seconds after each read finishes,
+    //                so that a tool change is detected (see DallasReaderGetChangeCount)
+    //    timeoutSec  timeout for each read (see DallasReadTool)
+    // Returns false if not supported (firmware older than Rev 7). Do not call DallasReadTool
+    // or DallasReadMemory while the reader is active.
+    bool DallasReaderStart(double repeatSec = 0.0, double timeoutSec = 10.0);
+    void DallasReaderStop(void);
+    bool DallasReaderIsActive(void) const { return (dallasReader.state != DR_IDLE); }
+
+    // Tool information from the most recent completed read (status is DALLAS_WAIT if none)
+    struct DallasToolInfo {
+        DallasStatus status;
+        uint32_t model;
+        uint8_t version;
+        std::string name;
+        DallasToolInfo() : status(DALLAS_WAIT), model(0), version(0) {}
+    };
+    const DallasToolInfo &DallasReaderGetTool(void) const { return dallasReader.tool; }
+    // Number of completed reads
+    unsigned long DallasReaderGetReadCount(void) const { return dallasReader.numRead; }
+    // Number of completed reads with a different result than the previous read (e.g., tool
+    // inserted, removed or changed); the application can compare to its last value
+    unsigned long DallasReaderGetChangeCount(void) const { return dallasReader.numChanged; }
+
     // ********************** Si PSM/ECM Methods **************************
 
     /* \brief Writes the LED color on an Si PSM or ECM
@@ -642,6 +768,35 @@ public:
     int16_t ReadCurrentITerm(unsigned int index) const;
     int16_t ReadFault(unsigned int index) const;
 
+    // Read/write the current-loop parameters of all motors of a dRA1 board (Firmware Rev 7+), using
+    // the same quadlet transactions as ReadSiCurrentLoopParams/WriteSiCurrentLoopParams (6 per motor),
+    // plus 4 quadlet reads per motor for the diagnostics if state is specified. Unlike those methods,
+    // all parameters are range-checked before anything is written, and read errors are reported.
+    // The arrays must have at least GetNumMotors() entries. Returns false if any transaction failed.
+    enum { SI_NUM_MOTORS = 10 };
+    bool WriteSiCurrentLoopAll(const SiCurrentLoopParams *params) const;
+    bool ReadSiCurrentLoopAll(SiCurrentLoopParams *params, SiCurrentLoopState *state = 0) const;
+
+    // Current-loop parameters and diagnostics of one dRA1 board, for the port-wide methods below
+    struct SiCurrentLoopBoard {
+        unsigned char boardId;
+        bool ok;                                   // True if all transactions succeeded
+        SiCurrentLoopParams params[SI_NUM_MOTORS];
+        SiCurrentLoopState state[SI_NUM_MOTORS];   // Only read if requested (see below)
+    };
+
+    // Read the current-loop parameters (and, if readState is true, the diagnostics) of every dRA1
+    // board on the port, whether or not an AmpIO object has been added. The registers are read
+    // sequentially, one quadlet read at a time (see ReadSiCurrentLoopAll). Returns the number of
+    // boards that were read without errors (boards.size() is the number of dRA1 boards found).
+    static unsigned int ReadSiCurrentLoopPort(BasePort *port, std::vector<SiCurrentLoopBoard> &boards,
+                                              bool readState = false);
+
+    // Write the parameters of each specified board (e.g., as modified after ReadSiCurrentLoopPort),
+    // one quadlet write per parameter. Returns false if any parameter is out of range (nothing is
+    // written) or if any write failed.
+    static bool WriteSiCurrentLoopPort(BasePort *port, const std::vector<SiCurrentLoopBoard> &boards);
+
 protected:
     // NumMotors specifies the number of motors/brakes and NumEncoders specifies the
     // number of encoders. Motors and encoders are paired up to T = min(NumMotors, NumEncoders),
@@ -671,8 +826,29 @@ protected:
     // this buffer, while also byteswapping if needed.
     quadlet_t WriteBuffer[WriteBufSize_Max];
 
-    // Encoder velocity data (per axis)
-    EncoderVelocity encVelData[MAX_CHANNELS];
+    // Encoder velocity data (per axis). These are mutable because, with lazy decoding,
+    // the data is decoded by the (const) Get methods on first access within a frame.
+    mutable EncoderVelocity encVelData[MAX_CHANNELS];
+
+    // Frame generation counter, incremented by SetReadData
+    uint32_t readFrameGen;
+    // Frame generation for which encVelData was last decoded (per axis)
+    mutable uint32_t encVelGen[MAX_CHANNELS];
+    // True if encoder velocity data is decoded on demand (see SetLazyDecode)
+    bool lazyDecode;
+
+    // Feedback history (see SetHistoryDepth). The buffers are allocated by InitBoard, with
+    // ReadBufSize_Max quadlets per frame.
+    unsigned int histDepthRequested;   // Depth set by SetHistoryDepth
+    unsigned int histDepth;            // Allocated depth (frames)
+    unsigned int histCount;            // Number of valid frames
+    unsigned int histHead;             // Index of most recent frame
+    quadlet_t *histFrames;             // Raw frames (histDepth*ReadBufSize_Max quadlets)
+    double *histHostTime;              // Host receive time of each frame
+    double *histFwTime;                // Firmware time of each frame
+
+    // Returns the index into the history buffers for the specified age (-1 if not available)
+    int GetHistoryIndex(unsigned int age) const;
 
     // Counts received encoder errors
     unsigned int encErrorCount[MAX_CHANNELS];
@@ -688,6 +864,32 @@ protected:
     enum { DALLAS_START_READ = 0x80, DALLAS_MODEL_OFFSET = 0xa4, DALLAS_VERSION_OFFSET = 0xa8,
            DALLAS_NAME_OFFSET = 0x160, DALLAS_NAME_END = 0x17c };
 
+    // Parse tool information from data read at DALLAS_START_READ (256 bytes); returns false if
+    // the data is not valid (did not read "997" in copyright string)
+    static bool DallasParseTool(char *buffer, uint32_t &model, uint8_t &version, std::string &name);
+
+    // Incremental tool read (see DallasReaderStart)
+    // DR_DONE is only used as the next state of DR_WAIT, to finish the read after DR_END
+    enum DallasReaderState { DR_IDLE, DR_REPEAT, DR_START, DR_WAIT, DR_READ, DR_END,
+                             DR_DRA_MODEL, DR_DRA_VERSION, DR_DONE };
+    struct DallasReader {
+        DallasReaderState state;
+        DallasReaderState stateNext;     // Next state (only used by DR_WAIT)
+        double repeatSec;
+        double timeoutSec;
+        double waitStart;                // Start of read or wait (for timeout), or of DR_REPEAT
+        bool useDS2480B;
+        DallasToolInfo current;          // Read in progress
+        DallasToolInfo tool;             // Most recent completed read
+        unsigned long numRead;
+        unsigned long numChanged;
+        DallasReader() : state(DR_IDLE), stateNext(DR_IDLE), repeatSec(0.0), timeoutSec(10.0),
+                         waitStart(0.0), useDS2480B(false), numRead(0), numChanged(0) {}
+    };
+    DallasReader dallasReader;
+    // Finish current read, with the specified status
+    void DallasReaderFinish(DallasStatus status);
+
     // Data collection
     // The FPGA firmware contains a data collection buffer of 1024 quadlets.
     // Data collection is enabled by setting the COLLECT_BIT when writing the desired motor current.
@@ -723,11 +925,21 @@ protected:
     /*! Extract the data used for velocity estimation */
     bool SetEncoderVelocityData(unsigned int index);
 
+    /*! Decode the velocity data for the specified encoder from ReadBuffer, unless already
+        decoded for the current frame. Returns a reference to the (cached) data. */
+    const EncoderVelocity &DecodeEncoderVelocityData(unsigned int index) const;
+
     /*! \brief If user-supplied callback is not NULL, read data collection buffer and then call callback.
         \note Called by relevant Port class.
     */
     void CheckCollectCallback();
 
+    /*! \brief Advance the incremental tool read by one step (see DallasReaderStart).
+        \returns true if a transaction was performed
+        \note Called by relevant Port class.
+    */
+    bool BackgroundStep(void);
+
     // Offsets of real-time read buffer contents, in quadlets
     // Offsets from TIMESTAMP_OFFSET to ANALOG_POS_OFFSET have remained stable through
     // all releases of firmware and for both QLA1 and dRA1. The other offsets are related
@@ -797,9 +1009,24 @@ protected:
         OFF_CURRENT_I_TERM = 12 // awaiting new assignment
     };
 
+    // Check range of current-loop parameters
+    static bool CheckSiCurrentLoopParams(const SiCurrentLoopParams &params);
+
+    // Read/write current-loop registers of one motor, using one quadlet transaction per register
+    // (state is optional)
+    static bool ReadSiCurrentLoopMotor(BasePort *port, unsigned char boardId, unsigned int index,
+                                       SiCurrentLoopParams &params, SiCurrentLoopState *state);
+    static bool WriteSiCurrentLoopMotor(BasePort *port, unsigned char boardId, unsigned int index,
+                                        const SiCurrentLoopParams &params);
+
     enum {
         ADDR_MOTOR_CONTROL = 9
     };
+
+private:
+    // No copy (the history buffers are owned by each instance)
+    AmpIO(const AmpIO &);
+    AmpIO &operator=(const AmpIO &);
 };
 
 #endif // __AMPIO_H__
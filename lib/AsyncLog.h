@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __ASYNC_LOG_H__
+#define __ASYNC_LOG_H__
+
+#include <iostream>
+#include "Amp1394Types.h"
+
+// Rate-limited logging for messages that can occur in the real-time path (e.g., read errors).
+//
+// Each message site is registered once (AddSite) with a printf-style format, which can use up
+// to MAX_ARGS long arguments (e.g., %ld or %lx), and a minimum interval. Messages from the same
+// site that occur within the interval are not written, but counted; the count is appended to
+// the next message from that site ("N similar messages suppressed"), or written as a summary
+// if there is no next message.
+//
+// By default, messages are formatted and written to the stream specified in the constructor
+// when Log is called. If Start is called, Log instead copies a fixed-size record into a
+// lock-free ring buffer and a background thread formats and writes the messages to the
+// specified stream, so that the calling thread never blocks on I/O. Log must be called by a
+// single thread (the I/O thread). Messages are dropped (and counted) if the ring is full.
+
+class AsyncLog {
+public:
+    enum { MAX_ARGS = 4, MAX_SITES = 32, FORMAT_SIZE = 256 };
+
+    AsyncLog(std::ostream &ostr, unsigned int ringSize = 256);
+    ~AsyncLog();
+
+    // Register message site; returns site id (MAX_SITES if too many sites). The format string
+    // must remain valid (e.g., string literal). Sites can be added after Start, but only by
+    // the thread that calls Log.
+    unsigned int AddSite(const char *format, double minInterval = 1.0);
+
+    // Log message (see above). Invalid site ids are ignored.
+    void Log(unsigned int site, long arg0 = 0, long arg1 = 0, long arg2 = 0, long arg3 = 0);
+
+    // Start background thread that writes the messages to logStream. Because logStream is
+    // written by the background thread, it should not be used by any other thread (std::cerr
+    // is safe). Returns false if the thread could not be started.
+    bool Start(std::ostream &logStream = std::cerr);
+
+    // Stop background thread (after writing all pending messages)
+    void Stop(void);
+
+    bool IsRunning(void) const { return Running; }
+
+    // Write summaries for any suppressed messages that have not yet been reported. This is
+    // done periodically by the background thread, if running; otherwise, it can be called
+    // from the thread that calls Log.
+    void Flush(void);
+
+    // Number of messages dropped because the ring buffer was full
+    uint32_t GetNumDropped(void) const { return NumDropped; }
+
+    // Total number of messages suppressed at the specified site
+    uint32_t GetNumSuppressed(unsigned int site) const
+    { return (site < NumSites) ? Sites[site].numSuppressed : 0; }
+
+protected:
+    struct LogRecord {
+        double time;            // Time of message (Amp1394_GetMonotonicTime)
+        uint32_t site;          // Site id
+        uint32_t numSuppressed; // Total number suppressed at this site, when logged
+        long args[MAX_ARGS];
+    };
+
+    struct LogSite {
+        const char *format;
+        double minInterval;                // Minimum time between messages (seconds)
+        double lastTime;                   // Time of last message logged (written by Log)
+        volatile uint32_t numSuppressed;   // Total messages suppressed (written by Log)
+        uint32_t numReported;              // Suppressed messages reported (written by writer)
+        double lastReportTime;             // Time of last message or summary written (written by writer)
+    };
+
+    std::ostream &syncStream;     // Stream used when background thread not running
+    std::ostream *asyncStream;    // Stream used by background thread
+
+    LogSite Sites[MAX_SITES];
+    volatile unsigned int NumSites;
+
+    // Ring buffer (single producer, single consumer)
+    LogRecord *Ring;
+    unsigned int Size;            // Power of 2
+    unsigned int Mask;
+    volatile uint32_t Head;       // Next record to write (written by Log)
+    volatile uint32_t Tail;       // Next record to read (written by background thread)
+    volatile uint32_t NumDropped;
+
+    volatile bool Running;
+    volatile bool StopRequest;
+    void *ThreadHandle;           // Platform-specific thread handle
+
+    // Format and write record
+    void WriteRecord(std::ostream &outStr, const LogRecord &rec);
+    // Write summaries for sites with unreported suppressed messages, at least minInterval
+    // after the last message from that site
+    void WriteSummaries(std::ostream &outStr, double now, bool force);
+
+    // Background thread
+    void Run(void);
+#ifdef _WIN32
+    static unsigned long __stdcall ThreadEntry(void *arg);
+#else
+    static void *ThreadEntry(void *arg);
+#endif
+
+private:
+    // No copy
+    AsyncLog(const AsyncLog &);
+    AsyncLog &operator=(const AsyncLog &);
+};
+
+#endif // __ASYNC_LOG_H__
@@ -21,6 +21,10 @@ http://www.cisst.org/cisst/license.txt.
 #include <iostream>
 #include <vector>
 #include "BoardIO.h"
+#include "LatencyHistogram.h"
+#include "AsyncLog.h"
+#include "TelemetryRecorder.h"
+#include "SideChannel.h"
 
 /*
  * BasePort
@@ -43,6 +47,8 @@ http://www.cisst.org/cisst/license.txt.
  *     FirewirePort:  sends FireWire packets via FireWire
  *     EthUdpPort:    sends FireWire packets via Ethernet UDP
  *     EthRawPort:    sends FireWire packets via raw Ethernet frames (using PCAP)
+ * For testing without hardware, EthLoopbackPort emulates the boards and ReplayPort plays
+ * back a telemetry recording (see StartTelemetry).
  */
 
 // Defined here for static methods ParseOptions and DefaultPort
@@ -78,7 +84,7 @@ public:
 
     enum { MAX_NODES = 64 };     // maximum number of nodes (IEEE-1394 limit)
 
-    enum PortType { PORT_FIREWIRE, PORT_ETH_UDP, PORT_ETH_RAW };
+    enum PortType { PORT_FIREWIRE, PORT_ETH_UDP, PORT_ETH_RAW, PORT_ETH_LOOPBACK, PORT_REPLAY };
 
     // Protocol types:
     //   PROTOCOL_SEQ_RW      sequential (individual) read and write to each board
@@ -86,6 +92,40 @@ public:
     //   PROTOCOL_BC_QRW      broadcast query, read, and write to/from all boards
     enum ProtocolType { PROTOCOL_SEQ_RW, PROTOCOL_SEQ_R_BC_W, PROTOCOL_BC_QRW };
 
+    // Reference instant for latency compensation (see SetLatencyReference)
+    //   LATENCY_NONE   no compensation (default)
+    //   LATENCY_QUERY  time of the read request (broadcast query or first sequential read)
+    //   LATENCY_HOST   host time specified by SetLatencyReferenceTime (e.g., when the data
+    //                  is consumed); defaults to the end of ReadAllBoards
+    enum LatencyReference { LATENCY_NONE, LATENCY_QUERY, LATENCY_HOST };
+
+    // Phases of a real-time transaction, for timing measurements (see SetPhaseTiming)
+    //   PHASE_SEND     building and sending the request packet (or the write packet)
+    //   PHASE_WAIT     waiting for the response packet (for broadcast, includes WaitBroadcastRead)
+    //   PHASE_RECEIVE  checking and copying the response packet
+    //   PHASE_DECODE   unpacking the feedback data (BoardIO::SetReadData)
+    enum TimingPhase { PHASE_SEND, PHASE_WAIT, PHASE_RECEIVE, PHASE_DECODE, PHASE_NUM };
+
+    // Latency histograms (see GetLatencyHistogram)
+    //   HIST_READ    ReadAllBoards
+    //   HIST_WRITE   WriteAllBoards
+    //   HIST_CYCLE   round trip, from start of ReadAllBoards to end of the next WriteAllBoards
+    enum HistogramType { HIST_READ, HIST_WRITE, HIST_CYCLE, HIST_NUM };
+
+    // FPGA-reported times for each board (see GetFpgaTimingHistogram)
+    //   FPGA_ETH_RECV    time for FPGA to receive the Ethernet read request (Ethernet, sequential read)
+    //   FPGA_ETH_TOTAL   time for FPGA to receive the request and send the response; for boards other
+    //                    than the Ethernet bridge, this includes the Firewire forwarding
+    //   FPGA_UPDATE      time from broadcast query to update of hub data for this board (broadcast read, Rev 7+)
+    enum FpgaTimingType { FPGA_ETH_RECV, FPGA_ETH_TOTAL, FPGA_UPDATE, FPGA_TIMING_NUM };
+
+    // FPGA-reported times for the hub (see GetHubTimingHistogram), for broadcast read
+    //   HUB_READ_START   time from broadcast query to start of hub read (Rev 7+)
+    //   HUB_READ_FINISH  time from broadcast query to end of hub read (Rev 7+)
+    //   HUB_ETH_RECV     time for FPGA to receive the hub read request (Ethernet)
+    //   HUB_ETH_TOTAL    time for FPGA to receive the hub read request and send the response (Ethernet)
+    enum HubTimingType { HUB_READ_START, HUB_READ_FINISH, HUB_ETH_RECV, HUB_ETH_TOTAL, HUB_TIMING_NUM };
+
     // Information about broadcast read.
     // With Firmware V7+, each FPGA starts a timer when it receives the broadcast query command
     // sent by the host PC. The following times are relative to this timer.
@@ -121,7 +161,14 @@ protected:
     bool IsAllBoardsRev7_;                // TRUE if all boards are Firmware Rev 7
     bool IsAllBoardsRev8_;                // TRUE if all boards are Firmware Rev 8
 
-    size_t ReadErrorCounter_;
+    // Rate-limited log for errors in the real-time path (see AsyncLog and GetErrorLog)
+    AsyncLog ErrorLog;
+    unsigned int LogReadFailed;       // ErrorLog sites
+    unsigned int LogBcInvalidStatus;
+    unsigned int LogBcBoardMismatch;
+    unsigned int LogBcBlockSize;
+    unsigned int LogBcSequence;
+    unsigned int LogBcHubSize;
 
     // Port Index, e.g. eth0 -> PortNum = 0
     int PortNum;
@@ -154,6 +201,80 @@ protected:
     // Information about broadcast read
     BroadcastReadInfo bcReadInfo;
 
+    // Host times (Amp1394_GetMonotonicTime) when the most recent real-time read request was sent
+    // to each board and when the response was received. For the broadcast protocol, the send time
+    // is when the broadcast query was sent and the receive time is when the hub data was received.
+    double ReadHostSendTime[BoardIO::MAX_BOARDS];
+    double ReadHostRecvTime[BoardIO::MAX_BOARDS];
+    // Estimated host time when each board sampled its feedback, and host time of the read request
+    // (broadcast query or first sequential read request)
+    double ReadSampleHostTime[BoardIO::MAX_BOARDS];
+    double ReadRequestHostTime;
+
+    // Latency compensation
+    LatencyReference LatencyRef;
+
+    // Update the extrapolation time of each board for the specified reference (host) time
+    void UpdateExtrapolationTimes(double refHostTime);
+
+    // Latency histograms, always enabled (see GetLatencyHistogram and GetBoardReadHistogram), and FPGA
+    // timing statistics (see GetFpgaTimingHistogram), updated by ReadAllBoards and WriteAllBoards.
+    // Each histogram is about 4 KB, so the per-board histograms are only allocated for boards that
+    // have been added (see AddBoard); they are kept until the port is deleted, so that they remain
+    // valid for other threads.
+    LatencyHistogram LatencyHist[HIST_NUM];
+    LatencyHistogram FpgaHubHist[HUB_TIMING_NUM];
+    struct BoardHistograms {
+        LatencyHistogram read;                      // ReadBlock time (sequential read)
+        LatencyHistogram fpga[FPGA_TIMING_NUM];
+    };
+    BoardHistograms *BoardHist[BoardIO::MAX_BOARDS];   // 0 if board not added
+    double CycleStartTime;          // Start of ReadAllBoards, for HIST_CYCLE (0 if not started)
+
+    // Phase timing (see SetPhaseTiming)
+    bool PhaseTimingEnabled;
+    double PhaseTime[PHASE_NUM];    // Accumulated time in each phase (seconds)
+    double PhaseMark;               // Host time of the most recent phase boundary
+
+    // PhaseStart marks the start of a phase; PhaseEnd adds the time since the previous mark
+    // to the specified phase and sets a new mark. Both do nothing if phase timing is disabled.
+    void PhaseStart(void);
+    void PhaseEnd(TimingPhase phase);
+
+    // Record WriteAllBoards latency and, if ReadAllBoards was called, the cycle latency
+    void RecordWriteLatency(double startTime);
+
+    // Background (non-real-time) I/O, such as the incremental tool read (see AmpIO::DallasReaderStart).
+    // Called at the end of WriteAllBoards (after the latency is recorded); performs the background
+    // step (BoardIO::BackgroundStep) of at most one board per cycle, in round-robin order, so that
+    // at most one additional transaction is performed per cycle.
+    void BackgroundStep(void);
+    unsigned int BackgroundBoard;   // Board to check first in next BackgroundStep
+
+    // Side channel for transactions from other threads (0 if EnableSideChannel not called).
+    // Once created, it is kept (and only disabled) until the port is deleted, since other
+    // threads read this pointer without locking.
+    SideChannel * volatile Side;
+
+    // Returns the side channel if the transaction from the calling thread should be submitted
+    // to it (i.e., it is enabled and this is not the I/O thread), 0 otherwise
+    SideChannel *GetRoutedSide(void) const;
+
+    // Perform queued side channel requests, within the limits of the side channel (see SideChannel).
+    // Called at the end of WriteAllBoards, after BackgroundStep.
+    void ProcessSideRequests(void);
+
+    // Record the FPGA times from the most recent read response (if available, see GetFpgaResponseTimes)
+    void RecordFpgaResponseTimes(LatencyHistogram &recvHist, LatencyHistogram &totalHist);
+
+    // Telemetry recorder (0 if StartTelemetry not called)
+    TelemetryRecorder *Telemetry;
+
+    // Add the board validity flags (and BroadcastReadInfo) to the telemetry frame and end
+    // the read or write part of the frame
+    void TelemetryEndRead(double hostTime, bool ok);
+    void TelemetryEndWrite(double hostTime, bool ok);
+
     // Firmware versions
     unsigned long FirmwareVersion[BoardIO::MAX_BOARDS];
 
@@ -232,6 +353,10 @@ protected:
     // Method called by WriteAllBoards/WriteAllBoardsBroadcast if no data written
     virtual void OnNoneWritten(void) {}
 
+    // Get the FPGA times (seconds) reported in the most recent read response, if supported
+    // by the port (see EthBasePort)
+    virtual bool GetFpgaResponseTimes(double &, double &) const { return false; }
+
 public:
 
     // Constructor
@@ -373,6 +498,133 @@ public:
     BroadcastReadInfo GetBroadcastReadInfo(void) const
     { return bcReadInfo; }
 
+    // Get host times (Amp1394_GetMonotonicTime) for the most recent real-time read of the
+    // specified board (see ReadHostSendTime and ReadHostRecvTime)
+    bool GetReadHostTimes(unsigned char boardId, double &sendTime, double &recvTime) const;
+
+    /*!
+     \brief Set the reference instant for latency compensation
+     In broadcast mode, each board samples its feedback at a different time relative to the query
+     (BroadcastBoardInfo::updateTime); in sequential mode, each board samples when it receives its
+     read request. When latency compensation is enabled, the port computes, for each board, the time
+     between its sample instant and the reference instant (BoardIO::GetExtrapolationTime), which is
+     used by AmpIO::GetEncoderPositionCompensated and AmpIO::GetEncoderVelocityCompensated to provide
+     a time-consistent state across all boards.
+    */
+    void SetLatencyReference(LatencyReference ref);
+    LatencyReference GetLatencyReference(void) const { return LatencyRef; }
+
+    /*!
+     \brief Set the reference instant (host time, see Amp1394_GetMonotonicTime) for LATENCY_HOST.
+     This is typically called just before the feedback is used. Calling it with the default (negative)
+     value uses the current time.
+    */
+    void SetLatencyReferenceTime(double hostTime = -1.0);
+
+    /*!
+     \brief Enable or disable phase timing (see TimingPhase). When enabled, the time spent in each
+     phase is accumulated until ResetPhaseTimes is called. This is intended for benchmarking,
+     since it adds several calls to Amp1394_GetMonotonicTime to each transaction.
+    */
+    void SetPhaseTiming(bool enable);
+    bool IsPhaseTiming(void) const { return PhaseTimingEnabled; }
+    void ResetPhaseTimes(void);
+    // Returns accumulated time (seconds) in the specified phase
+    double GetPhaseTime(TimingPhase phase) const;
+
+    /*!
+     \brief Get latency histogram (see HistogramType). The histograms are always updated by
+     ReadAllBoards and WriteAllBoards; they can be read and reset from another thread
+     (see LatencyHistogram). Returns 0 if type is invalid.
+    */
+    LatencyHistogram *GetLatencyHistogram(HistogramType type);
+
+    /*!
+     \brief Get histogram of the ReadBlock time for the specified board, when using a
+     sequential read protocol (i.e., PROTOCOL_SEQ_RW or PROTOCOL_SEQ_R_BC_W).
+     Returns 0 if boardId is invalid or the board has not been added.
+    */
+    LatencyHistogram *GetBoardReadHistogram(unsigned char boardId);
+
+    // Reset all latency histograms
+    void ResetLatencyHistograms(void);
+
+    /*!
+     \brief Get the log used for errors in the real-time path (e.g., ReadAllBoards). These
+     messages are rate-limited and, by default, written to the debug stream. Call
+     GetErrorLog().Start() to write them from a background thread instead (see AsyncLog),
+     so that console I/O is not done in the real-time path. Because the background thread
+     writes asynchronously, its messages may be interleaved with, or appear out of order
+     relative to, other output to the same stream.
+    */
+    AsyncLog &GetErrorLog(void) { return ErrorLog; }
+
+    /*!
+     \brief Get histogram of FPGA-reported times for the specified board (see FpgaTimingType).
+     These are updated by ReadAllBoards, so they can be combined with the host times (e.g.,
+     GetBoardReadHistogram) to attribute the read latency to the host, the Ethernet interface
+     and the Firewire forwarding. Returns 0 if boardId or type is invalid, or if the board has
+     not been added.
+    */
+    LatencyHistogram *GetFpgaTimingHistogram(unsigned char boardId, FpgaTimingType type);
+
+    // Get histogram of FPGA-reported times for the hub (see HubTimingType); returns 0 if type is invalid
+    LatencyHistogram *GetHubTimingHistogram(HubTimingType type);
+
+    // Reset FPGA timing statistics
+    void ResetFpgaTimingStats(void);
+
+    // Print table of host and FPGA timing statistics (mean/p99/max, in microseconds) for the boards
+    // in use and the hub (if broadcast read is used)
+    void PrintFpgaTiming(std::ostream &outStr) const;
+
+    /*!
+     \brief Start recording the raw data of every real-time cycle (ReadAllBoards and WriteAllBoards)
+     to the segment files <fileBase>-000.tlm, <fileBase>-001.tlm, ..., which can be read with
+     TelemetryReader. The files are written by a background thread; if it cannot keep up, frames
+     are dropped rather than delaying the real-time cycle (see TelemetryRecorder). The boards should
+     be added before calling this method, since the board configuration is saved in each file.
+     \param numSlots Number of frames buffered in memory
+     \param segmentSize Maximum size of each segment file, in bytes
+     \param maxSegments Maximum number of segment files (0 = no limit)
+     \returns false if the recording could not be started
+    */
+    bool StartTelemetry(const std::string &fileBase, unsigned int numSlots = 1024,
+                        uint32_t segmentSize = 0x4000000, unsigned int maxSegments = 0);
+
+    // Stop recording (see TelemetryRecorder::Stop)
+    void StopTelemetry(void);
+
+    // Get telemetry recorder, e.g., to check the number of dropped frames (0 if not started)
+    const TelemetryRecorder *GetTelemetryRecorder(void) const { return Telemetry; }
+
+    /*!
+     \brief Enable the side channel, so that other threads can perform transactions (e.g., PROM or
+     tool reads, or parameter writes) while this thread runs the real-time cycle. The thread that
+     calls ReadAllBoards/WriteAllBoards becomes the I/O thread (initially, it is the thread that
+     calls this method, which should be done before starting the other threads); transactions from
+     other threads (ReadQuadlet, WriteQuadlet, ReadBlock, WriteBlock, broadcast writes, or
+     SubmitRequest) are queued and performed at the end of WriteAllBoards (see SideChannel).
+     \param maxPerCycle Maximum number of requests performed per cycle
+     \param budgetSec Time budget per cycle, in seconds (at least one queued request is performed)
+     \param timeoutSec Timeout for transactions from other threads, in seconds
+     \returns false if maxPerCycle is 0
+    */
+    bool EnableSideChannel(unsigned int maxPerCycle = 4, double budgetSec = 100.0e-6,
+                           double timeoutSec = 1.0);
+
+    // Disable the side channel; queued requests (and new requests from other threads) fail.
+    // The side channel is kept until the port is deleted, so this is safe while other threads
+    // are waiting for requests. Calling EnableSideChannel again re-enables it.
+    void DisableSideChannel(void);
+
+    // Get side channel, e.g., for statistics (0 if never enabled; see also SideChannel::IsEnabled)
+    SideChannel *GetSideChannel(void) { return Side; }
+
+    // Submit request to the side channel without waiting (see SideRequest::Wait).
+    // Returns false if the side channel is not enabled or the request could not be queued.
+    bool SubmitRequest(SideRequest &req);
+
     // Return string version of PortType
     static std::string PortTypeString(PortType portType);
 
@@ -383,6 +635,8 @@ public:
     // fw:N             for FireWire, where N is the port number
     // eth:N            for raw Ethernet (PCAP), where N is the port number
     // udp:xx.xx.xx.xx  for UDP, where xx.xx.xx.xx is the (optional) server IP address
+    // loop:N           for the loopback (emulated) port, where N is the number of boards
+    // replay:file      for the replay port, where file is the telemetry recording (returned in IPaddr)
     static bool ParseOptions(const char *arg, PortType &portType, int &portNum, std::string &IPaddr,
                              std::ostream &ostr = std::cerr);
 
@@ -479,6 +733,8 @@ public:
 
     /*!
      \brief Write the broadcast packet containing the DAC values and power control
+     Implementations submit the write to the side channel when called from another thread
+     (see GetRoutedSide), as for WriteBlock; the same applies to WriteBroadcastReadRequest.
     */
     virtual bool WriteBroadcastOutput(quadlet_t *buffer, unsigned int size) = 0;
 
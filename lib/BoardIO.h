@@ -50,6 +50,10 @@ protected:
     unsigned int numReadErrors;
     unsigned int numWriteErrors;
 
+    // Time (in seconds) from the sample instant of the most recent real-time read to the
+    // latency compensation reference instant (see BasePort::SetLatencyReference)
+    double extrapTime;
+
     friend class BasePort;
     friend class FirewirePort;
     friend class EthBasePort;
@@ -80,6 +84,10 @@ protected:
 
     virtual bool WriteBufferResetsWatchdog(void) const = 0;
     virtual void CheckCollectCallback() = 0;
+    // Perform one step (at most one transaction) of non-real-time I/O, if any is in progress;
+    // returns true if a transaction was performed (see BasePort::BackgroundStep). The default
+    // implementation does nothing, for boards without background I/O.
+    virtual bool BackgroundStep(void) { return false; }
 
 public:
     enum {MAX_BOARDS = 16};   // Maximum number of boards
@@ -107,7 +115,7 @@ public:
     };
 
     BoardIO(unsigned char board_id) : BoardId(board_id), port(0), readValid(false), writeValid(false),
-                                      numReadErrors(0), numWriteErrors(0) {}
+                                      numReadErrors(0), numWriteErrors(0), extrapTime(0.0) {}
     virtual ~BoardIO() {}
 
     inline unsigned char GetBoardId() const { return BoardId; }
@@ -121,6 +129,10 @@ public:
     inline unsigned int GetReadErrors() const { return numReadErrors; }
     inline unsigned int GetWriteErrors() const { return numWriteErrors; }
 
+    // Returns the time (in seconds) that the most recent feedback should be extrapolated
+    // to reach the latency compensation reference instant (0 if not enabled)
+    inline double GetExtrapolationTime() const { return extrapTime; }
+
     inline void ClearReadErrors() { numReadErrors = 0; }
     inline void ClearWriteErrors() { numWriteErrors = 0; }
 
@@ -0,0 +1,146 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __BOARD_IDENTITY_H__
+#define __BOARD_IDENTITY_H__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AmpIO.h"
+
+class BasePort;
+
+// Reads the identity of multiple boards concurrently: FPGA serial number, QLA serial
+// number(s), tool (Dallas chip on QLA, or tool information on dRA1) and, for dRA1, the
+// robot serial number. These are the same values as returned by FpgaIO::GetFPGASerialNumber,
+// AmpIO::GetQLASerialNumber, AmpIO::DallasReadTool and AmpIO::ReadRobotSerialNumber, but
+// rather than waiting (sleeping) for each operation on each board in turn, each board has a
+// small state machine that issues a command and then returns, so that one polling loop can
+// advance all boards. Each board has two independent sequences: PROM reads (FPGA, then QLA)
+// and tool reads (Dallas, then robot serial number for dRA1). Thus, the total time is
+// approximately that of the slowest board, rather than the sum of all boards.
+//
+// Typical use:
+//     BoardIdentity identity(port);
+//     for (i = 0; i < boards.size(); i++)
+//         identity.AddBoard(boards[i]);
+//     identity.Run();
+//     identity.PrintTable(std::cout);
+//
+// The boards must already have been added to the port. The port should not be used by
+// another thread while identity is being read.
+
+class BoardIdentity {
+public:
+    // Identity of one board
+    struct Result {
+        unsigned char boardId;
+        std::string hardware;             // Hardware version (e.g., "QLA1")
+        uint32_t firmwareVersion;
+        std::string fpgaSN;               // FPGA serial number (empty if not found)
+        std::string qlaSN[2];             // QLA serial number (DQLA: qlaSN[1] is second QLA)
+        AmpIO::DallasStatus toolStatus;   // Result of DallasReadTool
+        uint32_t toolModel;
+        uint8_t toolVersion;
+        std::string toolName;
+        std::string robotSN;              // Robot serial number (dRA1 only)
+        bool ioError;                     // True if any read failed
+        double elapsedTime;               // Time to read identity, in seconds
+
+        Result() : boardId(0), firmwareVersion(0), toolStatus(AmpIO::DALLAS_NONE), toolModel(0),
+                   toolVersion(0), ioError(false), elapsedTime(0.0) {}
+    };
+
+    BoardIdentity(BasePort *port);
+    ~BoardIdentity();
+
+    // Add board; returns false if board is not valid or not added to the port
+    bool AddBoard(AmpIO *board);
+
+    // Options (call before Start)
+    //   readTool:      read tool (Dallas chip or dRA1 tool information), default true
+    //   readRobot:     read robot serial number (dRA1 only), default true
+    //   dallasTimeout: timeout for DallasReadTool, in seconds, default 10
+    void SetReadTool(bool readTool) { ReadTool = readTool; }
+    void SetReadRobot(bool readRobot) { ReadRobot = readRobot; }
+    void SetDallasTimeout(double sec) { DallasTimeout = sec; }
+
+    // Start reading the identity of all boards (clears previous results)
+    void Start(void);
+
+    // Advance the state machine of each board by one step, without waiting.
+    // Returns true when all boards are done.
+    bool Poll(void);
+
+    // Start, then call Poll until all boards are done or the timeout (in seconds) expires,
+    // sleeping pollInterval (in seconds) between calls. Returns true if all boards are done
+    // without I/O errors.
+    bool Run(double timeoutSec = 15.0, double pollInterval = 0.0005);
+
+    // Results, in the order the boards were added
+    const std::vector<Result> &GetResults(void) const { return Results; }
+
+    // Time from Start until all boards done, in seconds
+    double GetElapsedTime(void) const { return ElapsedTime; }
+
+    // Print table of results
+    void PrintTable(std::ostream &out = std::cout) const;
+
+    static std::string ToolStatusString(AmpIO::DallasStatus status);
+
+protected:
+    enum PromStep { PROM_FPGA_START, PROM_FPGA_WAIT, PROM_QLA_START, PROM_QLA_WAIT, PROM_DONE };
+    enum ToolStep { TOOL_DALLAS, TOOL_ROBOT_START, TOOL_ROBOT_WAIT, TOOL_DONE };
+
+    // Robot serial number (see AmpIO::ReadRobotSerialNumber)
+    enum { ROBOT_SN_WORDS = 16 };
+
+    struct BoardState {
+        AmpIO *board;
+        PromStep promStep;
+        ToolStep toolStep;
+        double waitStart;                  // Start of PROM wait (host time)
+        unsigned int qlaIndex;             // 0 or 1 (DQLA)
+        unsigned int robotWord;            // Current word of robot serial number
+        unsigned int robotFlashEn;         // 0 or 1 (flash command is written twice)
+        double robotWaitUntil;             // End of robot flash wait (host time)
+        uint16_t robotData[ROBOT_SN_WORDS];
+    };
+
+    BasePort *Port;
+    std::vector<BoardState> Boards;
+    std::vector<Result> Results;
+    bool ReadTool;
+    bool ReadRobot;
+    double DallasTimeout;
+    double StartTime;
+    double ElapsedTime;
+
+    // QLA PROM channel and type for current QLA (see AmpIO::ReadQLAIdentity)
+    static unsigned char QLAChannel(const BoardState &state);
+    static FpgaIO::PromType QLAPromType(const BoardState &state);
+
+    // Advance PROM and tool sequences of one board; return true when done
+    bool PollProm(BoardState &state, Result &result, double now);
+    bool PollTool(BoardState &state, Result &result, double now);
+
+private:
+    // No copy
+    BoardIdentity(const BoardIdentity &);
+    BoardIdentity &operator=(const BoardIdentity &);
+};
+
+#endif // __BOARD_IDENTITY_H__
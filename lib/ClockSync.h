@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __CLOCK_SYNC_H__
+#define __CLOCK_SYNC_H__
+
+#include "Amp1394Types.h"
+#include "BoardIO.h"
+
+class BasePort;
+class FpgaIO;
+
+// Synchronization between the FPGA clock of each board and the host monotonic clock
+// (Amp1394_GetMonotonicTime).
+//
+// For each real-time read, the FPGA time of the sample is given by the 64-bit tick counter
+// accumulated by the board (FpgaIO::GetFirmwareTicks). The host time of the sample is only
+// known to be within an interval:
+//   - sequential read: between sending the read request and receiving the response
+//   - broadcast read (Firmware V7+): between sending the query plus the board update time and
+//     receiving the hub data minus the time from the board update to the end of the hub read
+//     (see BasePort::BroadcastReadInfo).
+// The class fits a linear model, host = offset + (1+drift)*fpga, to the interval midpoints,
+// weighted by the inverse of the interval width, using exponential forgetting so that slow
+// variations in drift are tracked. Each frame is then stamped with the host time predicted
+// by the model (limited to the interval) and an estimated uncertainty.
+//
+// Call Update after each ReadAllBoards.
+
+class FpgaClockSync {
+public:
+    // forgetting: exponential forgetting factor (0 < forgetting <= 1)
+    FpgaClockSync(const BasePort *port, double forgetting = 0.999);
+    ~FpgaClockSync() {}
+
+    // Add board (must also be added to the port)
+    bool AddBoard(const FpgaIO *board);
+
+    // Reset the model for the specified board (default is all boards)
+    void Reset(unsigned char boardId = BoardIO::MAX_BOARDS);
+
+    // Update the model and sample times using the most recent real-time read
+    void Update(void);
+
+    // Get the host time of the most recent sample, and its estimated uncertainty (seconds)
+    bool GetSampleTime(unsigned char boardId, double &hostTime, double &uncertainty) const;
+
+    // Convert a board tick count (FpgaIO::GetFirmwareTicks) to host time
+    bool FpgaToHostTime(unsigned char boardId, uint64_t ticks, double &hostTime) const;
+
+    // Get the estimated drift (host seconds per FPGA second, minus 1) and offset (host time
+    // at tick count 0)
+    bool GetDrift(unsigned char boardId, double &drift) const;
+    bool GetOffset(unsigned char boardId, double &offset) const;
+
+protected:
+    const BasePort *Port;
+    double Lambda;
+
+    struct BoardSync {
+        const FpgaIO *board;
+        unsigned long numSamples;
+        uint64_t ticks0;        // tick count at first sample (FPGA time origin)
+        double host0;           // host time at first sample (host time origin)
+        double period;          // FPGA clock period
+        // Exponentially-weighted statistics (relative to the origins)
+        double W;               // sum of weights
+        double mx, my;          // weighted means of FPGA time (x) and host time (y)
+        double Cxx, Cxy;        // weighted co-moments
+        double resVar;          // variance of residuals (prediction error of interval midpoint)
+        // Most recent sample
+        double sampleTime;
+        double sampleUncertainty;
+        BoardSync() : board(0) { Clear(); }
+        void Clear();
+        bool HasFit(void) const { return (numSamples >= 2) && (Cxx > 0.0); }
+        double Slope(void) const { return HasFit() ? Cxy/Cxx : 1.0; }
+        double Predict(double x) const { return my + Slope()*(x-mx); }
+    };
+    BoardSync Sync[BoardIO::MAX_BOARDS];
+
+    void UpdateBoard(unsigned char boardId);
+};
+
+#endif // __CLOCK_SYNC_H__
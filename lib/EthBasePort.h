@@ -21,6 +21,8 @@ http://www.cisst.org/cisst/license.txt.
 
 #include <iostream>
 #include "BasePort.h"
+#include "PacketTrace.h"
+#include "FaultInjector.h"
 
 // Some useful constants related to the FireWire protocol
 const unsigned int FW_QREAD_SIZE      = 16;        // Number of bytes in Firewire quadlet read request packet
@@ -87,6 +89,21 @@ protected:
     double FPGA_RecvTime;       // Time for FPGA to receive Ethernet packet (seconds)
     double FPGA_TotalTime;      // Total time for FPGA to receive packet and respond (seconds)
 
+    PacketTrace *Trace;         // Packet trace (0 if not enabled)
+    FaultInjector *Faults;      // Fault injection (0 if not enabled)
+
+    // ErrorLog sites (see BasePort::GetErrorLog)
+    unsigned int LogQuadFlushed;
+    unsigned int LogQuadReadFailed;
+    unsigned int LogBlockFlushed;
+    unsigned int LogBlockReadFailed;
+    unsigned int LogNoneRead;
+    unsigned int LogTlMismatch;
+
+    // Add packet to trace (if enabled); the FPGA times are only recorded if a response was received
+    void TraceRecord(unsigned int tcode, nodeid_t node, nodeaddr_t addr, unsigned int nbytes,
+                     double sendTime, double recvTime, unsigned char status, unsigned char flags);
+
     //! Read quadlet from node (internal method called by ReadQuadlet)
     bool ReadQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t &data, unsigned char flags = 0);
 
@@ -109,12 +126,21 @@ protected:
     // Flush all packets in receive buffer
     virtual int PacketFlushAll(void) = 0;
 
+    // Fault injection shim around PacketSend, PacketReceive and PacketFlushAll (see EnableFaultInjection)
+    bool FaultPacketSend(unsigned char *packet, size_t nbytes, bool useEthernetBroadcast);
+    int FaultPacketReceive(unsigned char *packet, size_t nbytes);
+    int FaultPacketFlushAll(void);
+
     // Method called by ReadAllBoards/ReadAllBoardsBroadcast if no data read
     void OnNoneRead(void);
 
     // Method called by WriteAllBoards/WriteAllBoardsBroadcast if no data written
     void OnNoneWritten(void);
 
+    // Returns FPGA times from the most recent read response (see GetFpgaReceiveTime, GetFpgaTotalTime)
+    bool GetFpgaResponseTimes(double &recvTime, double &totalTime) const
+    { recvTime = FPGA_RecvTime; totalTime = FPGA_TotalTime; return true; }
+
     // Method called when Firewire bus reset has caused the Firewire generation number on the FPGA
     // to be different than the one on the PC.
     virtual void OnFwBusReset(unsigned int FwBusGeneration_FPGA);
@@ -153,6 +179,27 @@ public:
     // value to the KSZ8851 or to queue the packet into the transmit buffer.
     double GetFpgaTotalTime(void) const { return FPGA_TotalTime; }
 
+    // Packet trace (see PacketTrace). When enabled, every packet sent/received by this port is
+    // recorded in a ring buffer with numRecords entries; this adds two calls to
+    // Amp1394_GetMonotonicTime per packet. Enable and disable should not be called while
+    // another thread is using the port, but the trace can be read or dumped at any time.
+    bool EnablePacketTrace(unsigned int numRecords = 4096);
+    void DisablePacketTrace(void);
+    PacketTrace *GetPacketTrace(void) const { return Trace; }
+    // Write packet trace to binary file (see tests/trace1394.cpp for decoder)
+    bool DumpPacketTrace(const std::string &fileName) const;
+
+    // Fault injection (see FaultInjector), for testing the behavior of ReadAllBoards/WriteAllBoards
+    // and the application under packet loss, late, duplicate and reordered responses, response
+    // delays and Firewire bus resets, without changing the network or the firmware. The faults
+    // are injected between the packet construction/checking in this class and the derived
+    // class that sends and receives the packets, so this works with all Ethernet ports
+    // (including EthLoopbackPort). As with the packet trace, enable and disable should not
+    // be called while another thread is using the port.
+    bool EnableFaultInjection(const FaultConfig &config);
+    void DisableFaultInjection(void);
+    FaultInjector *GetFaultInjector(void) const { return Faults; }
+
     //****************** Virtual methods ***************************
     // Implementations of pure virtual methods from BasePort
 
@@ -234,6 +281,15 @@ public:
     static void PrintDebugData(std::ostream &debugStream, const quadlet_t *data, double clockPeriod);
     static void PrintDebugDataKSZ(std::ostream &debugStream, const quadlet_t *data, double clockPeriod);
     static void PrintDebugDataRTL(std::ostream &debugStream, const quadlet_t *data, double clockPeriod);
+
+private:
+    // Send, receive and flush packets, through the fault injection shim if enabled
+    bool DoPacketSend(unsigned char *packet, size_t nbytes, bool useEthernetBroadcast)
+    { return Faults ? FaultPacketSend(packet, nbytes, useEthernetBroadcast) : PacketSend(packet, nbytes, useEthernetBroadcast); }
+    int DoPacketReceive(unsigned char *packet, size_t nbytes)
+    { return Faults ? FaultPacketReceive(packet, nbytes) : PacketReceive(packet, nbytes); }
+    int DoPacketFlushAll(void)
+    { return Faults ? FaultPacketFlushAll() : PacketFlushAll(); }
 };
 
 #endif  // __EthBasePort_H__
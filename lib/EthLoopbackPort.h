@@ -0,0 +1,189 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __EthLoopbackPort_H__
+#define __EthLoopbackPort_H__
+
+#include <iostream>
+#include "EthBasePort.h"
+
+// Ethernet port that does not use any network interface; instead, the packets are handled by
+// an in-process emulation of a chain of FPGA/QLA boards connected via Firewire, with the first
+// board (board 0) acting as the Ethernet hub. Because it derives from EthBasePort, all packet
+// construction and checking is the same as for EthUdpPort, which makes this port useful for
+// benchmarking the host-side software and for testing without hardware.
+//
+// The emulated boards are QLA1 boards with board ids 0..N-1 (node number == board id) and
+// Firmware Rev 7 or 8. The following are emulated:
+//   - quadlet read/write of the registers used by ScanNodes (see BoardIO::Registers)
+//   - block read of the real-time feedback (address 0); encoder positions increase by
+//     (axis+1) counts per read and the timestamp is the elapsed FPGA clock ticks since the
+//     previous read; other feedback fields are constant
+//   - broadcast query (address 0x1800) and hub read (address 0x1000), including the sequence
+//     number and the update/read timing information
+//   - block write (the data is discarded)
+//   - M25P16 (FPGA) PROM commands: read ID, read status, write enable/disable, sector erase,
+//     page program and read (256 bytes), via the PROM interface registers (0x08, 0x09) and
+//     buffer (0x2000). The PROM contents are initially erased (all 0xff) and are kept in memory
+//     (allocated on first use). Sector erase and page program set the WIP status bit for a
+//     (shortened) busy time.
+//   - 25AA128 (QLA) PROM commands for the three PROM channels (0x3000, 0x3010, 0x3020): read
+//     status, write enable/disable, byte read/write and block read/write (up to 16 quadlets,
+//     via the buffer at 0x3100). The contents are initially blank (all 0xff); writes take effect
+//     immediately.
+//   - DS2505 (Dallas 1-wire) tool memory read via the control/status register (13) and the
+//     block data (0x6000), for the tool specified by SetEmulatedTool (no tool by default).
+//     Each read command sets the busy status for a (shortened) busy time.
+// Read requests are processed when PacketReceive is called, after the response delay (if any,
+// see SetResponseDelay). If there is no response (e.g., no board at the specified node),
+// PacketReceive returns 0 without waiting for the receive timeout.
+
+class EthLoopbackPort : public EthBasePort
+{
+protected:
+    bool isOpen;
+    unsigned int NumEmulated;          // Number of emulated boards
+    unsigned long EmuFirmware;         // Firmware version of emulated boards
+    unsigned int EmuBusGeneration;     // Firewire bus generation on emulated FPGAs
+    double ResponseDelay;              // Delay between request and response (seconds)
+
+    enum { EMU_NUM_REGS = 16,          // Number of emulated quadlet registers per board
+           EMU_NUM_AXES = 4 };         // Number of axes (QLA1)
+
+    quadlet_t EmuRegs[BoardIO::MAX_BOARDS][EMU_NUM_REGS];
+    int32_t EmuEncPos[BoardIO::MAX_BOARDS][EMU_NUM_AXES];
+    double EmuLastRead[BoardIO::MAX_BOARDS];   // Host time of last feedback read (for timestamp)
+
+    // Broadcast query state
+    unsigned int EmuSequence;          // Sequence number from broadcast query
+    double EmuQueryTime;               // Host time of broadcast query
+    quadlet_t *EmuHubBuffer;           // Hub data (host byte order), updated by broadcast query
+    unsigned int EmuHubQuads;          // Number of valid quadlets in EmuHubBuffer (without timing)
+
+    // M25P16 PROM emulation
+    enum { EMU_PROM_SIZE = 0x200000,   // 2 MB
+           EMU_PROM_PAGE = 256 };
+    unsigned char *EmuProm[BoardIO::MAX_BOARDS];                        // PROM contents (0 until used)
+    quadlet_t EmuPromBuffer[BoardIO::MAX_BOARDS][EMU_PROM_PAGE/sizeof(quadlet_t)];  // Read data (bus byte order)
+    quadlet_t EmuPromResult[BoardIO::MAX_BOARDS];                       // Result of last command
+    bool EmuPromWEL[BoardIO::MAX_BOARDS];                               // Write enable latch
+    double EmuPromBusyUntil[BoardIO::MAX_BOARDS];                       // End of erase/program (host time)
+
+    // 25AA128 (QLA) PROM emulation, for each board and PROM channel (0 for QLA, 1-2 for DQLA)
+    enum { EMU_QLA_PROM_CHANS = 3,
+           EMU_QLA_PROM_SIZE = 0x4000,  // 16 KB
+           EMU_QLA_PROM_BLOCK = 16 };   // Maximum quadlets in block read/write
+    unsigned char *EmuQlaProm[BoardIO::MAX_BOARDS];                     // Contents of all channels (0 until used)
+    quadlet_t EmuQlaPromBuffer[BoardIO::MAX_BOARDS][EMU_QLA_PROM_BLOCK];  // Block data (bus byte order)
+    quadlet_t EmuQlaPromResult[BoardIO::MAX_BOARDS][EMU_QLA_PROM_CHANS];
+    bool EmuQlaPromWEL[BoardIO::MAX_BOARDS][EMU_QLA_PROM_CHANS];
+
+    // DS2505 (Dallas) emulation, for the tool on each board
+    enum { EMU_DALLAS_SIZE = 2048,      // DS2505 memory size
+           EMU_DALLAS_BLOCK = 256 };    // Bytes read by each command
+    unsigned char *EmuDallas[BoardIO::MAX_BOARDS];       // Memory contents (0 if no tool)
+    unsigned int EmuDallasAddr[BoardIO::MAX_BOARDS];     // Start address of current block
+    double EmuDallasBusyUntil[BoardIO::MAX_BOARDS];      // End of read command (host time)
+
+    // Pending read request, which is processed by PacketReceive so that the emulation time
+    // is counted as waiting for the response (see BasePort::PHASE_WAIT)
+    // (quadlet buffer, so that the Firewire header is aligned as in the original packet)
+    quadlet_t RequestBuffer[(FW_CTRL_SIZE+FW_BREAD_SIZE)/sizeof(quadlet_t)+1];
+    unsigned char *Request;
+    size_t RequestSize;
+
+    // Response packet
+    unsigned char *Response;
+    size_t ResponseSize;
+
+    //! Initialize loopback port
+    bool Init(void);
+
+    //! Cleanup loopback port
+    void Cleanup(void);
+
+    //! Initialize nodes on the bus; called by ScanNodes
+    // \return Maximum number of nodes on bus (0 if error)
+    nodeid_t InitNodes(void);
+
+    // Send packet to emulated boards; write packets are processed immediately
+    bool PacketSend(unsigned char *packet, size_t nbytes, bool useEthernetBroadcast);
+
+    // Process the pending read request and return the response
+    int PacketReceive(unsigned char *packet, size_t nbytes);
+
+    // Discard pending read request
+    int PacketFlushAll(void);
+
+    // Emulation of the FPGA boards
+    void EmuProcessPacket(const unsigned char *packet, size_t nbytes);
+    quadlet_t EmuReadRegister(unsigned int board, nodeaddr_t addr) const;
+    void EmuWriteRegister(unsigned int board, nodeaddr_t addr, quadlet_t data);
+    // Returns number of quadlets written to buf (host byte order)
+    unsigned int EmuGetFeedback(unsigned int board, quadlet_t *buf, double now);
+    void EmuBroadcastQuery(quadlet_t data);
+    // PROM command written to 0x08 (quadlet) or 0x2000 (block, page program)
+    void EmuPromCommand(unsigned int board, quadlet_t cmd, const unsigned char *data, unsigned int nbytes);
+    // 25AA128 PROM command written to 0x3000 (chan 0), 0x3010 (chan 1) or 0x3020 (chan 2)
+    void EmuQlaPromCommand(unsigned int board, unsigned int chan, quadlet_t cmd);
+    // DS2505 control written to register 13
+    void EmuDallasControl(unsigned int board, quadlet_t ctrl);
+    quadlet_t EmuDallasStatus(unsigned int board) const;
+    // Creates the response header, returns pointer to start of data (quadlet 3)
+    quadlet_t *EmuMakeResponse(unsigned int node, unsigned int tcode, unsigned int tl);
+    void EmuAddExtraData(size_t requestBytes);
+
+public:
+
+    // numBoards:  number of emulated boards (1-16)
+    // fwVersion:  firmware version of emulated boards (7 or 8)
+    EthLoopbackPort(int numBoards = 1, std::ostream &debugStream = std::cerr,
+                    unsigned long fwVersion = 8);
+
+    ~EthLoopbackPort();
+
+    unsigned int GetNumEmulatedBoards(void) const { return NumEmulated; }
+
+    // Set the delay between each request and the corresponding response, to emulate the
+    // network and FPGA latency. The delay is implemented as a busy wait in PacketReceive.
+    void SetResponseDelay(double timeSec) { ResponseDelay = timeSec; }
+    double GetResponseDelay(void) const { return ResponseDelay; }
+
+    // Set the tool (DS2505 contents) on the specified emulated board, which can be read with
+    // AmpIO::DallasReadTool or AmpIO::DallasReaderStart (see AmpIO::DallasParseTool for the
+    // memory layout). ClearEmulatedTool removes the tool.
+    void SetEmulatedTool(unsigned int board, uint32_t model, uint8_t version, const std::string &name);
+    void ClearEmulatedTool(unsigned int board);
+
+    //****************** BasePort virtual methods ***********************
+
+    PortType GetPortType(void) const { return PORT_ETH_LOOPBACK; }
+
+    bool IsOK(void) { return isOpen; }
+
+    // Same packet layout as EthUdpPort
+    unsigned int GetPrefixOffset(MsgType msg) const;
+    unsigned int GetWritePostfixSize(void) const  { return FW_CRC_SIZE; }
+    unsigned int GetReadPostfixSize(void) const   { return (FW_CRC_SIZE+FW_EXTRA_SIZE); }
+
+    unsigned int GetWriteQuadAlign(void) const    { return (FW_CTRL_SIZE%sizeof(quadlet_t)); }
+    unsigned int GetReadQuadAlign(void) const     { return 0; }
+
+    // Same limits as EthUdpPort with the default MTU
+    unsigned int GetMaxReadDataSize(void) const;
+    unsigned int GetMaxWriteDataSize(void) const;
+};
+
+#endif  // __EthLoopbackPort_H__
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __FAULT_INJECTOR_H__
+#define __FAULT_INJECTOR_H__
+
+#include <iostream>
+#include <string>
+#include "Amp1394Types.h"
+
+// Fault injection settings. Probabilities are per packet (0 to 1) and times are in seconds.
+struct FaultConfig {
+    double requestDrop;     // Request (or write) packet is lost; read times out
+    double responseDrop;    // Read response is lost; read times out
+    double duplicate;       // Read response is received twice (the copy is flushed by the next read)
+    double late;            // Read response arrives after the receive timeout (flushed by the next read)
+    double reorder;         // Late or duplicate response arrives after the flush, so that the next
+                            // read receives it instead of its own response
+    double delayMin;        // Response delay, uniformly distributed between delayMin and delayMax
+    double delayMax;
+    double tailProb;        // Additional (tail) delay, exponentially distributed with mean tailMean
+    double tailMean;
+    double busReset;        // Extra data reports a Firewire bus reset (and a new bus generation)
+    uint32_t seed;          // Random number generator seed
+
+    FaultConfig() : requestDrop(0.0), responseDrop(0.0), duplicate(0.0), late(0.0), reorder(0.0),
+                    delayMin(0.0), delayMax(0.0), tailProb(0.0), tailMean(0.0), busReset(0.0),
+                    seed(1) {}
+};
+
+// State of the fault injection shim in EthBasePort (see EthBasePort::EnableFaultInjection):
+// configuration, seedable random number generator, counters, and the responses that have
+// been delayed past the receive timeout or duplicated, which are held until the next flush
+// (or, if reordered, returned by the next receive).
+//
+// A response delay that exceeds the receive timeout is handled as a late response.
+// A simulated bus reset increments the bus generation reported in the extra data of all
+// subsequent responses, as would happen after a real bus reset; when fault injection is
+// disabled, the FPGA's real bus generation is reported again, which appears as another bus reset.
+//
+// The same seed (and the same sequence of packets) reproduces the same faults.
+
+class FaultInjector {
+public:
+    enum FaultType {
+        FAULT_REQUEST_DROP = 0,
+        FAULT_RESPONSE_DROP,
+        FAULT_DUPLICATE,
+        FAULT_LATE,
+        FAULT_REORDER,
+        FAULT_TAIL_DELAY,
+        FAULT_BUS_RESET,
+        FAULT_NUM
+    };
+
+    enum { MAX_PENDING = 4,             // Maximum number of held (late or duplicate) responses
+           MAX_PACKET_SIZE = 2304 };    // Maximum size of held response, in bytes
+
+    FaultInjector(const FaultConfig &config);
+    ~FaultInjector();
+
+    const FaultConfig &GetConfig(void) const { return Config; }
+
+    // Restart the random number generator
+    void Seed(uint32_t seed);
+
+    // Returns true with the specified probability
+    bool Chance(double prob);
+    // Uniform random number in [0,1)
+    double Uniform(void);
+    // Exponentially distributed random number with the specified mean
+    double Exponential(double mean);
+    // Random response delay (see FaultConfig), counts tail delays
+    double ResponseDelay(void);
+
+    void Count(FaultType type) { Counts[type]++; }
+    unsigned long GetCount(FaultType type) const { return Counts[type]; }
+    // Number of held responses discarded by a flush
+    unsigned long GetNumFlushed(void) const { return NumFlushed; }
+    void ResetCounts(void);
+    void PrintCounts(std::ostream &out) const;
+
+    static const char *FaultName(FaultType type);
+
+    // Request dropped by the most recent send, so no response expected
+    void SetRequestDropped(bool dropped) { RequestDropped = dropped; }
+    bool IsRequestDropped(void) const { return RequestDropped; }
+
+    // Held responses (oldest first)
+    bool PushPending(const unsigned char *packet, size_t nbytes);
+    size_t PopPending(unsigned char *packet, size_t nbytes);
+    unsigned int NumPending(void) const { return NumPend; }
+    // Discard the held responses, except the newest one if keepNewest is true;
+    // returns the number discarded
+    unsigned int FlushPending(bool keepNewest);
+
+    // Scratch buffer (MAX_PACKET_SIZE bytes) for receiving a response that is held
+    unsigned char *GetScratchBuffer(void) { return Scratch; }
+
+    // Offset added to the bus generation reported by the FPGA (incremented by each simulated bus reset)
+    void IncrementBusGeneration(void) { BusGenOffset++; }
+    unsigned int GetBusGenerationOffset(void) const { return BusGenOffset; }
+
+    // Parse a comma-separated list of settings, for example:
+    //     "drop=0.01,delay=50:200,tail=0.001:5000,reset=0.0001,seed=3"
+    // with keys reqdrop, drop (response), dup, late, reorder, reset (probabilities),
+    // delay=min:max and tail=prob:mean (times in microseconds), and seed.
+    static bool ParseSpec(const std::string &spec, FaultConfig &config, std::ostream &outStr);
+
+protected:
+    FaultConfig Config;
+    uint64_t RngState;
+    unsigned long Counts[FAULT_NUM];
+    unsigned long NumFlushed;
+    bool RequestDropped;
+    unsigned int BusGenOffset;
+
+    unsigned char *PendBuffer;          // MAX_PENDING packets of MAX_PACKET_SIZE bytes
+    size_t PendSize[MAX_PENDING];
+    unsigned int PendHead;              // Index of oldest held response
+    unsigned int NumPend;
+    unsigned char *Scratch;
+
+private:
+    // No copy
+    FaultInjector(const FaultInjector &);
+    FaultInjector &operator=(const FaultInjector &);
+};
+
+#endif // __FAULT_INJECTOR_H__
@@ -51,6 +51,13 @@ public:
     // This method actually performs a read (should have been called ReadFPGASerialNumber)
     std::string GetFPGASerialNumber(void);
 
+    // Address of FPGA serial number in PROM (M25P16)
+    enum { FPGA_SN_ADDR = 0x001FFF00 };
+
+    // Parse FPGA serial number from the data read at FPGA_SN_ADDR (at least 13 bytes);
+    // returns empty string if not found
+    static std::string ParseFPGASerialNumber(const uint8_t *data);
+
     // Returns FPGA clock period in seconds
     double GetFPGAClockPeriod(void) const;
 
@@ -62,8 +69,13 @@ public:
     // there are periodic calls to ReadAllBoards or ReadAllBoardsBroadcast.
     double GetFirmwareTime(void) const { return firmwareTime; }
 
-    // Set firmware time
-    void SetFirmwareTime(double newTime = 0.0) { firmwareTime = newTime; }
+    // Set firmware time (also clears the tick counter)
+    void SetFirmwareTime(double newTime = 0.0)
+    { firmwareTimeBase = newTime; firmwareTicks = 0; firmwareTime = newTime; }
+
+    // Get elapsed FPGA clock ticks since the last call to SetFirmwareTime. The firmware time is
+    // computed from this 64-bit counter, so that it does not accumulate floating point error.
+    uint64_t GetFirmwareTicks(void) const { return firmwareTicks; }
 
     // ********************** WRITE Methods **********************************
 
@@ -134,6 +146,17 @@ public:
     bool PromReadData(uint32_t addr, uint8_t *data,
                       unsigned int nbytes);
 
+    // Same as PromReadData, but faster (Firmware Rev 4+; calls PromReadData for earlier firmware).
+    // Each read command returns a full page (256 bytes), which is read with as many block
+    // reads as needed (see BasePort::GetMaxReadDataSize), and the read command for the next
+    // page is issued before the current page is copied to data, so that the PROM access overlaps
+    // the host processing. Also, the status is polled without an initial delay and the result
+    // (number of quadlets read) is only checked for the first page. nbytes does not need to be a
+    // multiple of 4. If non-zero, the callback (cb) is called after each page, or if there is an
+    // error; if it returns false, the read is aborted.
+    bool PromReadDataFast(uint32_t addr, uint8_t *data, unsigned int nbytes,
+                          const ProgressCallback cb = 0);
+
     // Enable programming commands (erase and program page) (General)
     // This sets the WEL bit in the status register.
     // This mode is automatically cleared after a programming command is executed.
@@ -158,6 +181,53 @@ public:
     int PromProgramPage(uint32_t addr, const uint8_t *bytes,
                         unsigned int nbytes, const ProgressCallback cb = 0);
 
+    // Wait for a page program command (nbytes of data) to be sent to the PROM and check the
+    // number of bytes written; if waitWIP is true, also wait for the "Write in Progress" bit
+    // to be cleared. This is called by PromProgramPage and should be called for each board
+    // after PromProgramPageAll. Returns the number of bytes programmed (-1 if error).
+    int PromProgramPageWait(unsigned int nbytes, const ProgressCallback cb = 0, bool waitWIP = true);
+
+    // Statistics for PromProgramData. These accumulate over calls that use the same object,
+    // for example to program all sectors of a PROM file.
+    struct PromProgramStats {
+        unsigned long numBytes;     // Number of bytes programmed
+        unsigned int numPages;      // Number of page program commands
+        unsigned int numPolls;      // Number of status reads while waiting for page program to finish
+        double elapsedTime;         // Time (seconds) spent in PromProgramData
+        double pageTime;            // Estimated page program time (seconds), moving average
+        PromProgramStats() : numBytes(0), numPages(0), numPolls(0), elapsedTime(0.0), pageTime(0.0) {}
+        // Programming throughput (bytes/second)
+        double GetThroughput(void) const { return (elapsedTime > 0.0) ? numBytes/elapsedTime : 0.0; }
+    };
+
+    // Program nbytes of data, starting at the specified address, using as many page program
+    // commands as needed (the sectors must already be erased). The next page is prepared while
+    // the PROM is busy writing the current page, and the "Write in Progress" bit is polled
+    // without the PromDelay used by PromGetStatus: the first poll is after most of the estimated
+    // page program time (see PromProgramStats::pageTime), and subsequent polls use exponential
+    // backoff. If non-zero, stats is updated after each page, before the callback (cb) is called,
+    // so that the callback can report the programming throughput; the callback is also called
+    // if there is an error. nbytes does not need to be a multiple of 4.
+    // Returns the number of bytes programmed (-1 if error).
+    int PromProgramData(uint32_t addr, const uint8_t *bytes, unsigned int nbytes,
+                        const ProgressCallback cb = 0, PromProgramStats *stats = 0);
+
+    // Broadcast versions of PromSectorErase and PromProgramPage (M25P16 ONLY, Firmware Rev 4+),
+    // used to program the same PROM image on multiple boards at the same time. These only send
+    // the write enable and erase/program commands to all boards. Since the commands reach every
+    // board on the port, they should only be used if all boards are to be programmed and all
+    // have passed PromProgramTest. Since broadcast writes are not
+    // acknowledged, each board must be checked before the next command (PromProgramPageWait and,
+    // for both, PromGetStatusAll/PromGetResult until the erase or write has finished), and the
+    // PROM contents should be verified afterward.
+    static bool PromSectorEraseAll(BasePort *port, uint32_t addr);
+    static bool PromProgramPageAll(BasePort *port, uint32_t addr, const uint8_t *bytes,
+                                   unsigned int nbytes);
+
+    // Broadcast the read status command (M25P16 ONLY) and wait for it to finish; the status
+    // register of each board can then be read with PromGetResult.
+    static bool PromGetStatusAll(BasePort *port);
+
 
     // ******************* Hardware (QLA) PROM ONLY Methods ***************************
     // Parameter "chan" is used to distinguish between multiple PROMs. Set to 0 for QLA
@@ -354,8 +424,18 @@ public:
 
 protected:
 
-    // Accumulated firmware time
+    // Accumulated firmware time (firmwareTimeBase + firmwareTicks*GetFPGAClockPeriod())
     double firmwareTime;
+    double firmwareTimeBase;
+    uint64_t firmwareTicks;
+
+    // Add the specified number of clock ticks to the firmware time; called by the derived class
+    void AddFirmwareTicks(uint32_t ticks)
+    { firmwareTicks += ticks; firmwareTime = firmwareTimeBase + firmwareTicks*GetFPGAClockPeriod(); }
+
+    // Wait for the PROM interface to finish the current command (4 LSB of status are 0),
+    // without delay (M25P16 ONLY)
+    bool PromWaitInterface(void);
 
 };
 
@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <iostream>
+#include "Amp1394Types.h"
+
+// Fixed-size latency histogram with logarithmic buckets (similar to HdrHistogram).
+//
+// Values are recorded in nanoseconds. Values below 2^PRECISION_BITS have their own bucket;
+// above that, each power of 2 is divided into 2^(PRECISION_BITS-1) buckets, so the bucket width
+// is at most 1/16 (6.25%) of the value. Values of 2^(MAX_MSB+1) ns or more are counted in the
+// last bucket. Recording a sample is a bit scan, a shift and an increment.
+//
+// The histogram is intended to be written by one thread (e.g., the thread calling ReadAllBoards)
+// and read by other threads. The writer only increments the counters; Reset does not modify them,
+// but instead saves a copy (baseline) that is subtracted when reading. Thus, Reset and the Get
+// methods can be called from a (single) reader thread while samples are being recorded. A reading
+// may be off by the samples recorded while it is being computed. On 32-bit targets, the 64-bit
+// sum (sumNs) is not read atomically, so GetMean may be wrong (torn read) unless it is called
+// from the writer thread; the counts (and thus the other statistics) are 32-bit and not affected.
+
+class LatencyHistogram {
+public:
+    enum { PRECISION_BITS = 5,
+           SUB_BUCKETS = (1 << PRECISION_BITS),          // 32
+           HALF_BUCKETS = (1 << (PRECISION_BITS-1)),     // 16
+           MAX_MSB = 35,                                 // largest value is 2^36-1 ns (68.7 sec)
+           NUM_BUCKETS = (MAX_MSB-PRECISION_BITS+2)*HALF_BUCKETS+HALF_BUCKETS };
+
+    LatencyHistogram();
+    ~LatencyHistogram() {}
+
+    // Record a sample (seconds); negative values are recorded as 0
+    inline void Record(double sec)
+    { RecordNs((sec > 0.0) ? static_cast<uint64_t>(sec*1.0e9) : 0); }
+
+    // Record a sample (nanoseconds)
+    inline void RecordNs(uint64_t ns)
+    {
+        counts[GetBucketIndex(ns)]++;
+        sumNs += ns;
+    }
+
+    // Reset (reader side, see above)
+    void Reset(void);
+
+    // Number of samples since last Reset
+    uint64_t GetCount(void) const;
+
+    // Statistics since last Reset (seconds). The min is given by the lowest value in its bucket;
+    // the max and percentiles are given by the highest value in the corresponding bucket.
+    double GetMin(void) const;
+    double GetMax(void) const;
+    double GetMean(void) const;
+    // Percentile, where pct is between 0 and 100 (e.g., 99.9)
+    double GetPercentile(double pct) const;
+
+    // Bucket access (e.g., for plotting)
+    unsigned int GetNumBuckets(void) const { return NUM_BUCKETS; }
+    uint32_t GetBucketCount(unsigned int index) const;
+    // Range of values (nanoseconds) for the bucket; the high value is inclusive
+    static uint64_t GetBucketLowNs(unsigned int index);
+    static uint64_t GetBucketHighNs(unsigned int index);
+
+    static unsigned int GetBucketIndex(uint64_t ns);
+
+    // Print summary (count, min, median, p99, p99.9, max, mean) in microseconds
+    void PrintSummary(std::ostream &outStr) const;
+
+protected:
+    volatile uint32_t counts[NUM_BUCKETS];
+    volatile uint64_t sumNs;              // Not atomic on 32-bit targets (see above)
+    // Baseline (counts when Reset was called)
+    uint32_t baseCounts[NUM_BUCKETS];
+    uint64_t baseSumNs;
+
+    // Returns index of most significant bit (ns must be non-zero)
+    static inline unsigned int MostSignificantBit(uint64_t ns)
+    {
+#if defined(__GNUC__)
+        return 63-__builtin_clzll(ns);
+#else
+        unsigned int msb = 0;
+        while (ns >>= 1) msb++;
+        return msb;
+#endif
+    }
+};
+
+inline unsigned int LatencyHistogram::GetBucketIndex(uint64_t ns)
+{
+    if (ns < SUB_BUCKETS)
+        return static_cast<unsigned int>(ns);
+    unsigned int msb = MostSignificantBit(ns);
+    if (msb > MAX_MSB)
+        return NUM_BUCKETS-1;
+    unsigned int shift = msb-(PRECISION_BITS-1);
+    return shift*HALF_BUCKETS + static_cast<unsigned int>(ns >> shift);
+}
+
+#endif // __LATENCY_HISTOGRAM_H__
@@ -0,0 +1,149 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __PACKET_TRACE_H__
+#define __PACKET_TRACE_H__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Amp1394Types.h"
+
+// One record per packet (or request/response pair for reads). All times are in seconds;
+// the host times are from Amp1394_GetMonotonicTime and the FPGA times are from the extra
+// data appended to the read response (see EthBasePort::ProcessExtraData).
+struct PacketTraceRecord {
+    double sendTime;            // Host time before sending the packet
+    double recvTime;            // Host time after receiving the response (0 if none)
+    uint32_t index;             // Record number (incremented for every record)
+    uint32_t addr;              // Firewire address (lower 32 bits)
+    float fpgaRecvTime;         // Time for FPGA to receive the request (0 if no response)
+    float fpgaTotalTime;        // Time for FPGA to receive and respond (0 if no response)
+    uint16_t nbytes;            // Number of data bytes (4 for quadlet read/write)
+    uint8_t tcode;              // Firewire tcode of request (see EthBasePort::TCODE)
+    uint8_t node;               // Firewire node (FW_NODE_BROADCAST for broadcast)
+    uint8_t tl;                 // Firewire transaction label
+    uint8_t status;             // PacketTrace::Status
+    uint8_t flags;              // PacketTrace::Flags
+    uint8_t busGeneration;      // Firewire bus generation (host)
+};
+
+// Binary file header (see PacketTrace::Dump); followed by numRecords records, oldest first.
+// The file is written in host byte order; the version field can be used to detect a mismatch.
+struct PacketTraceFileHeader {
+    char magic[8];              // "PKTTRACE"
+    uint32_t version;           // PacketTrace::FILE_VERSION
+    uint32_t recordSize;        // sizeof(PacketTraceRecord)
+    uint32_t numRecords;        // Number of records in file
+    uint32_t triggerIndex;      // Record index (PacketTraceRecord::index) of trigger, or NO_TRIGGER
+    uint32_t portType;          // BasePort::PortType
+    uint32_t reserved;
+};
+
+// Fixed-size ring buffer of packet trace records.
+//
+// The ring is written by a single thread (the I/O thread) without locks or memory allocation:
+// Record fills the slot at the head index and then advances the head. The ring can be read
+// (GetRecords or Dump) by another thread at any time; records that are overwritten while they
+// are being copied are discarded.
+//
+// A trigger can be used to capture the packets around an event, such as a cycle overrun.
+// The trigger is either set externally (Trigger) or by a packet whose host round-trip time
+// exceeds the threshold set by SetTriggerLatency (or whose status is not STATUS_OK, if
+// SetTriggerOnError is set). After the trigger, the specified number of additional packets
+// are recorded and then recording stops (IsFrozen), so that the trace can be dumped.
+// Call Arm to clear the trigger and resume recording.
+
+class PacketTrace {
+public:
+    enum Status {
+        STATUS_OK = 0,          // Packet sent (and response received and checked)
+        STATUS_SEND_FAIL,       // Failed to send packet
+        STATUS_RECV_FAIL,       // No response, or response with wrong size
+        STATUS_CHECK_FAIL       // Invalid response (header, tcode, node or transaction label)
+    };
+
+    enum Flags {
+        FLAG_TRIGGER = 0x01,    // This packet caused the trigger
+        FLAG_ETH_BROADCAST = 0x02 // Ethernet broadcast (see FW_NODE_ETH_BROADCAST_MASK)
+    };
+
+    enum { FILE_VERSION = 1, NO_TRIGGER = 0xffffffff };
+
+    // numRecords is rounded up to a power of 2 (minimum 16)
+    PacketTrace(unsigned int numRecords);
+    ~PacketTrace();
+
+    unsigned int GetSize(void) const { return Size; }
+
+    // Record a packet (I/O thread); does nothing if frozen (see above)
+    void Record(uint8_t tcode, uint8_t node, uint8_t tl, uint32_t addr, unsigned int nbytes,
+                double sendTime, double recvTime, double fpgaRecvTime, double fpgaTotalTime,
+                uint8_t status, uint8_t flags, uint8_t busGeneration);
+
+    // Total number of records written (including those that have been overwritten)
+    uint32_t GetNumRecorded(void) const { return Head; }
+
+    // Trigger settings: latency threshold in seconds (0 to disable), trigger on error, and
+    // number of packets to record after the trigger (default is half the ring size)
+    void SetTriggerLatency(double latencySec) { TriggerLatency = latencySec; }
+    double GetTriggerLatency(void) const { return TriggerLatency; }
+    void SetTriggerOnError(bool enable) { TriggerOnError = enable; }
+    void SetPostTriggerCount(unsigned int count) { PostTriggerCount = (count < Size) ? count : Size-1; }
+
+    // External trigger (e.g., from the thread calling ReadAllBoards, when a cycle overrun
+    // is detected); can be called from any thread.
+    void Trigger(void) { TriggerRequest = true; }
+    bool IsTriggered(void) const { return (TriggerIndex != NO_TRIGGER); }
+    // True when recording stopped after the trigger
+    bool IsFrozen(void) const { return Frozen; }
+    uint32_t GetTriggerIndex(void) const { return TriggerIndex; }
+    // Clear trigger and resume recording
+    void Arm(void);
+
+    // Copy the valid records (oldest first) into the vector
+    void GetRecords(std::vector<PacketTraceRecord> &records) const;
+
+    // Write the valid records to a binary file (see PacketTraceFileHeader)
+    bool Dump(const std::string &fileName, uint32_t portType, std::ostream &outStr) const;
+
+    // Read binary file written by Dump
+    static bool ReadFile(const std::string &fileName, PacketTraceFileHeader &header,
+                         std::vector<PacketTraceRecord> &records, std::ostream &outStr);
+
+    static const char *StatusString(uint8_t status);
+
+protected:
+    PacketTraceRecord *Ring;
+    unsigned int Size;          // Number of records (power of 2)
+    unsigned int Mask;          // Size-1
+
+    volatile uint32_t Head;     // Index of next record
+    volatile uint32_t TriggerIndex;
+    volatile bool TriggerRequest;
+    volatile bool Frozen;
+    unsigned int PostTriggerCount;
+    unsigned int PostTriggerRemaining;
+
+    double TriggerLatency;
+    bool TriggerOnError;
+
+private:
+    // No copy
+    PacketTrace(const PacketTrace &);
+    PacketTrace &operator=(const PacketTrace &);
+};
+
+#endif // __PACKET_TRACE_H__
@@ -0,0 +1,143 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __ReplayPort_H__
+#define __ReplayPort_H__
+
+#include <iostream>
+#include <string>
+#include "BasePort.h"
+#include "TelemetryRecorder.h"
+
+// Port that plays back a telemetry recording (see BasePort::StartTelemetry), so that the
+// decoding and estimation code (e.g., AmpIO, EncoderVelocity) can be tested, debugged and
+// profiled offline, with the same data as the original run.
+//
+// The boards in the recording are reported by ScanNodes with the recorded hardware, firmware
+// and FPGA versions (node number == board id), so the application adds the boards as usual;
+// the same boards as in the recording should be added (see GetBoardMask). Each call to
+// ReadAllBoards advances to the next recorded frame and then uses the normal BasePort read
+// path (sequential or broadcast, as recorded), with the block reads returning the recorded
+// data. Boards that were not read successfully in the recording are not read successfully
+// during playback. By default, the frames are played back as fast as possible; call
+// SetRealTime to play back with the original timing. All writes are discarded.
+
+class ReplayPort : public BasePort
+{
+protected:
+    std::string FileName;
+    TelemetryReader Reader;
+    bool isOpen;
+    bool RealTime;                          // Whether to play back at original timing
+    bool Loop;                              // Whether to restart at end of recording
+    bool EndOfFile;
+    uint32_t NumPlayed;                     // Number of frames played
+    const TelemetryFrameHeader *CurFrame;   // Frame returned by the most recent ReadAllBoards
+    double FirstFrameTime;                  // Recorded host time of first frame
+    double PlayStartTime;                   // Host time when first frame was played
+
+    //! Initialize replay port (open file)
+    bool Init(void);
+
+    //! Cleanup replay port
+    void Cleanup(void);
+
+    //! Initialize nodes; called by ScanNodes
+    nodeid_t InitNodes(void);
+
+    // Advance to the next frame, waiting if real-time playback
+    bool NextFrame(void);
+
+    // Quadlet reads return the registers used by ScanNodes; quadlet writes are discarded
+    bool ReadQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t &data, unsigned char flags = 0);
+    bool WriteQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t data, unsigned char flags = 0);
+
+    // Block write is discarded
+    bool WriteBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *wdata,
+                        unsigned int nbytes, unsigned char flags = 0);
+
+    // Block read returns the recorded data for the current frame (board feedback or hub data)
+    bool ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata,
+                       unsigned int nbytes, unsigned char flags = 0);
+
+public:
+
+    ReplayPort(const std::string &fileName, std::ostream &debugStream = std::cerr);
+
+    ~ReplayPort();
+
+    // Play back at the original timing (true) or as fast as possible (false, default)
+    void SetRealTime(bool realTime) { RealTime = realTime; }
+    bool IsRealTime(void) const { return RealTime; }
+
+    // Restart at the beginning when the end of the recording is reached
+    void SetLoop(bool loop) { Loop = loop; }
+    bool IsLoop(void) const { return Loop; }
+
+    // Restart at the beginning of the recording
+    bool Rewind(void);
+
+    // True if ReadAllBoards reached the end of the recording (and not looping)
+    bool IsEndOfFile(void) const { return EndOfFile; }
+
+    // Number of frames played (i.e., ReadAllBoards calls that returned a frame)
+    uint32_t GetNumPlayed(void) const { return NumPlayed; }
+
+    // Recorded frame used by the most recent ReadAllBoards (0 if none)
+    const TelemetryFrameHeader *GetCurrentFrame(void) const { return CurFrame; }
+
+    // Configuration of the recording
+    const TelemetrySegmentHeader &GetConfig(void) const { return Reader.GetConfig(); }
+
+    // Boards in the recording (bit N for board N)
+    uint32_t GetBoardMask(void) const { return Reader.GetConfig().boardMask; }
+
+    // Advance to the next recorded frame and read all boards (see above). Returns false
+    // at the end of the recording. The recorded protocol is always used; a warning is written
+    // to the debug stream if it differs from the current protocol (e.g., after SetProtocol).
+    bool ReadAllBoards(void);
+
+    //****************** BasePort pure virtual methods ***********************
+
+    PortType GetPortType(void) const { return PORT_REPLAY; }
+
+    int NumberOfUsers(void) { return 1; }
+
+    bool IsOK(void) { return isOpen; }
+
+    unsigned int GetBusGeneration(void) const { return FwBusGeneration; }
+
+    void UpdateBusGeneration(unsigned int gen) { FwBusGeneration = gen; }
+
+    unsigned int GetPrefixOffset(MsgType) const   { return 0; }
+    unsigned int GetWritePostfixSize(void) const  { return 0; }
+    unsigned int GetReadPostfixSize(void) const   { return 0; }
+
+    unsigned int GetWriteQuadAlign(void) const    { return 0; }
+    unsigned int GetReadQuadAlign(void) const     { return 0; }
+
+    unsigned int GetMaxReadDataSize(void) const  { return MAX_POSSIBLE_DATA_SIZE; }
+    unsigned int GetMaxWriteDataSize(void) const { return MAX_POSSIBLE_DATA_SIZE; }
+
+    bool WriteBroadcastOutput(quadlet_t *, unsigned int) { return isOpen; }
+
+    bool WriteBroadcastReadRequest(unsigned int) { return isOpen; }
+
+    void WaitBroadcastRead(void) {}
+
+    void PromDelay(void) const {}
+};
+
+#endif  // __ReplayPort_H__
@@ -0,0 +1,192 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __SIDE_CHANNEL_H__
+#define __SIDE_CHANNEL_H__
+
+#include "BoardIO.h"   // for quadlet_t, nodeaddr_t
+
+// Side channel for non-real-time transactions (see BasePort::EnableSideChannel).
+//
+// The port classes are not thread-safe: a transaction from another thread (e.g., ReadQuadlet,
+// or any AmpIO method that uses it, such as PROM or Dallas reads) would race with ReadAllBoards
+// and WriteAllBoards, which share the packet buffers and transaction label. When the side channel
+// is enabled, transactions from other threads are instead queued, and the thread that calls
+// ReadAllBoards/WriteAllBoards (the I/O thread) performs them at the end of WriteAllBoards:
+// at most maxPerCycle requests per cycle, and only as many as are expected to fit in the time
+// budget (based on the average transaction time), except that one request is always performed
+// if any are queued, so that requests are not delayed indefinitely.
+//
+// Requests can be submitted explicitly (SideRequest, which acts as a future), or implicitly,
+// because BasePort::ReadQuadlet, WriteQuadlet, ReadBlock, WriteBlock and the broadcast writes
+// (WriteBroadcastOutput, WriteBroadcastReadRequest) submit the transaction and wait for it to
+// finish when called from a thread other than the I/O thread.
+//
+// Once created, the side channel is kept until the port is deleted, since other threads may be
+// using it at any time; disabling it (see Enable) rejects new requests and fails queued ones,
+// so that threads waiting in Transact return.
+
+// Transaction submitted to the side channel. The request (and, for block transactions, the
+// data buffer) must remain valid until it is done (IsDone) or cancelled (SideChannel::Cancel).
+class SideRequest {
+public:
+    enum Type { QREAD, QWRITE, BREAD, BWRITE, BC_OUTPUT, BC_READ_REQUEST };
+    enum Status { IDLE, QUEUED, ACTIVE, DONE, FAILED };
+
+    SideRequest();
+
+    // Set transaction (when not queued)
+    void SetReadQuadlet(unsigned char boardId, nodeaddr_t addr);
+    void SetWriteQuadlet(unsigned char boardId, nodeaddr_t addr, quadlet_t data);
+    void SetReadBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *buf, unsigned int numBytes);
+    void SetWriteBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *buf, unsigned int numBytes);
+    // Broadcast writes (see BasePort::WriteBroadcastOutput and WriteBroadcastReadRequest)
+    void SetWriteBroadcastOutput(quadlet_t *buf, unsigned int numBytes);
+    void SetWriteBroadcastReadRequest(unsigned int seq);
+
+    Status GetStatus(void) const;
+    bool IsDone(void) const;
+    bool Succeeded(void) const { return (GetStatus() == DONE); }
+
+    // Wait until done, polling every pollSec seconds; timeoutSec < 0 waits forever.
+    // Returns true if done and successful.
+    bool Wait(double timeoutSec = -1.0, double pollSec = 0.0001) const;
+
+    // Result of quadlet read
+    quadlet_t GetQuadlet(void) const { return Quadlet; }
+
+    // Time from submit to completion, in seconds
+    double GetLatency(void) const { return DoneTime-SubmitTime; }
+
+protected:
+    friend class SideChannel;
+    friend class BasePort;
+
+    Type ReqType;
+    unsigned char BoardId;
+    nodeaddr_t Addr;
+    quadlet_t Quadlet;          // Data for quadlet write, or result of quadlet read
+    quadlet_t *Data;            // Data buffer for block read/write
+    unsigned int NumBytes;
+    volatile int State;         // Status (written by submitting thread and I/O thread)
+    double SubmitTime;
+    double DoneTime;
+};
+
+class SideChannel {
+public:
+    enum { MAX_QUEUED = 64 };
+
+    // maxPerCycle:  maximum requests performed per cycle
+    // budgetSec:    time budget per cycle, in seconds
+    // timeoutSec:   timeout for implicit requests (see Transact)
+    SideChannel(unsigned int maxPerCycle, double budgetSec, double timeoutSec = 1.0);
+    ~SideChannel();
+
+    // Change the limits (thread-safe); see constructor
+    void Configure(unsigned int maxPerCycle, double budgetSec, double timeoutSec);
+    // Get the limits used by the I/O thread (thread-safe)
+    void GetLimits(unsigned int &maxPerCycle, double &budgetSec) const;
+
+    // Enable or disable (thread-safe). When disabled, Submit fails and queued requests fail
+    // (requests being performed by the I/O thread are completed). Enabled by default.
+    void Enable(bool enable);
+    bool IsEnabled(void) const;
+
+    // True if enabled and the calling thread is not the I/O thread, i.e., if the transaction
+    // should be submitted to the side channel rather than performed directly
+    bool IsRouted(void) const { return IsEnabled() && IsOtherThread(); }
+
+    // Queue request (thread-safe). Returns false if the side channel is disabled, if the request
+    // is already queued or active, or if the queue is full.
+    bool Submit(SideRequest &req);
+
+    // Remove request from queue (thread-safe). If the request is being performed, waits until
+    // it is done. Returns true if the request was removed before being performed.
+    bool Cancel(SideRequest &req);
+
+    // Submit request and wait for it, up to the timeout specified in the constructor; if not
+    // performed by then, the request is cancelled. Returns true if successful.
+    bool Transact(SideRequest &req);
+
+    // Fail all queued requests
+    void FailAll(void);
+
+    // Methods used by the I/O thread (BasePort)
+
+    // Set the I/O thread to the calling thread
+    void SetIOThread(void);
+    // True if the I/O thread is set and the calling thread is another thread
+    bool IsOtherThread(void) const;
+
+    // Remove oldest request from queue and mark it active (0 if none)
+    SideRequest *Pop(void);
+    // Mark request done; elapsedSec is the transaction time
+    void Complete(SideRequest *req, bool ok, double elapsedSec);
+
+    // Average transaction time (exponential moving average), in seconds. This is updated by
+    // Complete without locking (and a double is not read atomically on all platforms), so it
+    // should only be read by the I/O thread.
+    double GetAverageTime(void) const { return AvgTime; }
+
+    // Statistics
+    unsigned long GetNumProcessed(void) const { return NumProcessed; }
+    unsigned long GetNumFailed(void) const { return NumFailed; }
+    unsigned long GetNumRejected(void) const { return NumRejected; }
+    unsigned long GetNumTimedOut(void) const { return NumTimedOut; }
+    unsigned int GetNumQueued(void) const;
+    unsigned int GetMaxQueued(void) const { return MaxQueued; }
+    // Cycles in which the time budget was exceeded (see above)
+    unsigned long GetNumOverBudget(void) const { return NumOverBudget; }
+    void CountOverBudget(void) { NumOverBudget++; }
+
+protected:
+    unsigned int MaxPerCycle;         // Limits, protected by mutex
+    double Budget;
+    double Timeout;
+    volatile bool Enabled;            // Written with mutex held
+
+    SideRequest *Queue[MAX_QUEUED];   // Ring buffer, protected by mutex
+    unsigned int Head;                // Index of oldest request
+    unsigned int NumQueued;
+    void *MutexHandle;                // Platform-specific mutex
+    void *IOThreadHandle;             // Platform-specific thread id
+    volatile bool IOThreadSet;        // True if IOThreadHandle is valid
+
+    double AvgTime;                         // Written by I/O thread only
+    volatile unsigned long NumProcessed;    // Written by I/O thread only
+    volatile unsigned long NumFailed;       // Written by I/O thread only
+    volatile unsigned long NumRejected;     // Protected by mutex
+    volatile unsigned long NumTimedOut;     // Protected by mutex
+    unsigned long NumOverBudget;
+    unsigned int MaxQueued;
+
+    void Lock(void) const;
+    void Unlock(void) const;
+
+    // Remove request from queue (see Cancel); if timedOut is true and the request was removed,
+    // counts it as timed out (with the mutex held, since any thread can call Transact)
+    bool Remove(SideRequest &req, bool timedOut);
+
+    // Fail all queued requests (with the mutex held)
+    void FailAllLocked(void);
+
+private:
+    // No copy
+    SideChannel(const SideChannel &);
+    SideChannel &operator=(const SideChannel &);
+};
+
+#endif // __SIDE_CHANNEL_H__
@@ -0,0 +1,279 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __TELEMETRY_RECORDER_H__
+#define __TELEMETRY_RECORDER_H__
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BoardIO.h"
+
+// Binary telemetry files, written by TelemetryRecorder (see BasePort::StartTelemetry) and read
+// by TelemetryReader.
+//
+// A recording consists of one or more segment files, <base>-000.tlm, <base>-001.tlm, ..., each
+// of which starts with a TelemetrySegmentHeader (which contains the board configuration, so that
+// each segment can be read on its own) followed by the frames. Each frame contains one real-time
+// cycle (ReadAllBoards followed by WriteAllBoards): a TelemetryFrameHeader followed by the raw
+// read data and then the raw write data, both in bus (big-endian) byte order, as sent to
+// BoardIO::SetReadData and returned by BoardIO::GetWriteData. For the broadcast read protocol,
+// the read data is the complete hub buffer (including the sequence and timing quadlets). The
+// files are written in host byte order; the version field can be used to detect a mismatch.
+
+struct TelemetrySegmentHeader {
+    char magic[8];                              // "AMPTELEM"
+    uint32_t version;                           // TelemetryRecorder::FILE_VERSION
+    uint32_t headerSize;                        // sizeof(TelemetrySegmentHeader)
+    uint32_t frameHeaderSize;                   // sizeof(TelemetryFrameHeader)
+    uint32_t segmentIndex;                      // Segment number (0, 1, ...)
+    uint32_t numFrames;                         // Number of frames in segment (0 if not closed)
+    uint32_t dataBytes;                         // Bytes of frame data (0 if not closed)
+    uint32_t portType;                          // BasePort::PortType
+    uint32_t protocol;                          // BasePort::ProtocolType (when recording started)
+    uint32_t boardMask;                         // Boards in use (bit N for board N)
+    uint32_t hubBoard;                          // Hub board (for broadcast read)
+    uint32_t firmwareVersion[BoardIO::MAX_BOARDS];
+    uint32_t hardwareVersion[BoardIO::MAX_BOARDS];
+    uint32_t fpgaVersion[BoardIO::MAX_BOARDS];
+    uint32_t readNumBytes[BoardIO::MAX_BOARDS]; // BoardIO::GetReadNumBytes
+    uint32_t writeNumBytes[BoardIO::MAX_BOARDS];// BoardIO::GetWriteNumBytes
+    double startTime;                           // Host time (Amp1394_GetMonotonicTime) of Start
+};
+
+// Per-board information in each frame
+struct TelemetryBoardRecord {
+    uint16_t readOffset;        // Offset (quadlets) of the board feedback in the read data
+    uint16_t writeOffset;       // Offset (quadlets) of the board output in the write data
+    uint16_t readQuads;         // Number of quadlets of feedback (0 if none)
+    uint16_t writeQuads;        // Number of quadlets of output (0 if none)
+    uint16_t bcSequence;        // BroadcastBoardInfo::sequence
+    uint8_t bcBlockSize;        // BroadcastBoardInfo::blockSize
+    uint8_t flags;              // TelemetryRecorder::BoardFlags
+    float bcUpdateTime;         // BroadcastBoardInfo::updateTime
+};
+
+struct TelemetryFrameHeader {
+    uint32_t frameSize;         // Bytes, including header and data (multiple of 8)
+    uint32_t frameNum;          // Frame number; a gap indicates dropped frames
+    double readStartTime;       // Host times (Amp1394_GetMonotonicTime) of start and end of
+    double readEndTime;         //   ReadAllBoards and WriteAllBoards (0 if not called)
+    double writeStartTime;
+    double writeEndTime;
+    double bcReadStartTime;     // BroadcastReadInfo::readStartTime
+    double bcReadFinishTime;    // BroadcastReadInfo::readFinishTime
+    uint32_t bcReadSequence;    // BroadcastReadInfo::readSequence
+    uint32_t protocol;          // BasePort::ProtocolType
+    uint16_t readQuads;         // Number of quadlets of read data
+    uint16_t writeQuads;        // Number of quadlets of write data
+    uint32_t flags;             // TelemetryRecorder::FrameFlags
+    TelemetryBoardRecord board[BoardIO::MAX_BOARDS];
+};
+
+// Recorder for the raw real-time data (see above). The I/O thread (i.e., the thread calling
+// ReadAllBoards and WriteAllBoards) copies each frame into a fixed-size slot of a ring buffer
+// (no locks or memory allocation), and a background thread copies the frames to memory-mapped
+// segment files. If the ring is full, the frame is dropped (and counted), so the I/O thread
+// never waits for the disk. Memory use is bounded by the number of slots (each slot holds
+// MAX_FRAME_SIZE bytes), and disk use by the number of segments, if specified.
+//
+// The methods used to build a frame are called by BasePort; applications only need to call
+// BasePort::StartTelemetry and BasePort::StopTelemetry.
+
+class TelemetryRecorder {
+public:
+    enum { FILE_VERSION = 1 };
+    enum { MAX_READ_BYTES = 4096, MAX_WRITE_BYTES = 2048 };
+    enum { MAX_FRAME_SIZE = sizeof(TelemetryFrameHeader)+MAX_READ_BYTES+MAX_WRITE_BYTES };
+
+    enum FrameFlags {
+        FRAME_READ = 0x01,          // ReadAllBoards called
+        FRAME_READ_OK = 0x02,       // ReadAllBoards successful (all boards)
+        FRAME_WRITE = 0x04,         // WriteAllBoards called
+        FRAME_WRITE_OK = 0x08,      // WriteAllBoards successful (all boards)
+        FRAME_BROADCAST = 0x10,     // Read data is the hub (broadcast read) buffer
+        FRAME_TRUNCATED = 0x20      // Some data did not fit in the frame
+    };
+
+    enum BoardFlags {
+        BOARD_READ_VALID = 0x01,    // BoardIO::ValidRead
+        BOARD_WRITE_VALID = 0x02,   // BoardIO::ValidWrite
+        BOARD_BC_IN_USE = 0x04,     // BroadcastBoardInfo::inUse
+        BOARD_BC_SEQ_ERROR = 0x08   // BroadcastBoardInfo::seq_error
+    };
+
+    TelemetryRecorder(std::ostream &ostr = std::cerr);
+    ~TelemetryRecorder();
+
+    /*!
+     \brief Create the first segment file and start the background thread.
+     \param fileBase Base name of segment files (see above)
+     \param config Board configuration, copied to each segment header
+     \param numSlots Number of frames in the ring buffer (rounded up to a power of 2)
+     \param segmentSize Maximum size of each segment file, in bytes
+     \param maxSegments Maximum number of segment files; recording stops (and subsequent
+                        frames are counted as dropped) when the last one is full (0 = no limit)
+     \returns false if the file could not be created or the thread could not be started
+    */
+    bool Start(const std::string &fileBase, const TelemetrySegmentHeader &config,
+               unsigned int numSlots = 1024, uint32_t segmentSize = 0x4000000,
+               unsigned int maxSegments = 0);
+
+    // Write the remaining frames, close the file and stop the background thread. This should
+    // be called by the I/O thread (or when it is not calling ReadAllBoards/WriteAllBoards).
+    void Stop(void);
+
+    bool IsRunning(void) const { return Running; }
+
+    // Number of frames recorded by the I/O thread (including dropped frames)
+    uint32_t GetNumFrames(void) const { return FrameNum; }
+    // Number of frames dropped because the ring buffer was full
+    uint32_t GetNumDropped(void) const { return NumDropped; }
+    // Number of frames dropped by the background thread (file error or maxSegments reached)
+    uint32_t GetNumFileDropped(void) const { return NumFileDropped; }
+    // Number of frames written to the segment files
+    uint32_t GetNumWritten(void) const { return NumWritten; }
+    // Number of segment files created
+    unsigned int GetNumSegments(void) const { return SegmentIndex; }
+
+    // Returns name of specified segment file
+    static std::string SegmentFileName(const std::string &fileBase, unsigned int index);
+
+    // Methods called by BasePort (I/O thread) to build a frame. BeginRead and BeginWrite
+    // start a new frame, if needed (BeginRead first ends the previous frame, if any, which
+    // is the case when WriteAllBoards is not called). GetFrame returns 0 if the current
+    // frame is being dropped.
+    void BeginRead(double hostTime, uint32_t protocol);
+    void AddReadData(unsigned int boardId, const quadlet_t *data, unsigned int nbytes);
+    void SetHubReadData(const quadlet_t *data, unsigned int nbytes);
+    void SetBoardReadOffset(unsigned int boardId, unsigned int offsetQuads, unsigned int numQuads);
+    void EndRead(double hostTime, bool ok);
+    void BeginWrite(double hostTime, uint32_t protocol);
+    void AddWriteData(unsigned int boardId, const quadlet_t *data, unsigned int nbytes);
+    void EndWrite(double hostTime, bool ok);
+    TelemetryFrameHeader *GetFrame(void) { return CurFrame; }
+
+protected:
+    std::ostream &outStr;
+
+    // Ring buffer of frame slots (single producer, single consumer)
+    unsigned char *Ring;
+    unsigned int NumSlots;      // Power of 2
+    volatile uint32_t Head;     // Next slot to fill (written by I/O thread)
+    volatile uint32_t Tail;     // Next slot to write to file (written by background thread)
+
+    TelemetryFrameHeader *CurFrame; // Frame being built (0 if none or dropped)
+    bool FrameOpen;                 // Whether a frame (possibly dropped) is being built
+    uint32_t FrameNum;
+    volatile uint32_t NumDropped;
+    volatile uint32_t NumFileDropped;
+    volatile uint32_t NumWritten;
+
+    // Segment files (background thread)
+    std::string FileBase;
+    TelemetrySegmentHeader Config;
+    uint32_t SegmentSize;
+    unsigned int MaxSegments;
+    unsigned int SegmentIndex;      // Number of segments created
+    FILE *SegFile;                  // Current segment file (0 if none)
+    unsigned char *SegData;         // Mapped segment (0 if none, or not mapped)
+    bool SegError;                  // True if a segment could not be created
+    uint32_t SegUsed;               // Bytes used in current segment (including header)
+    uint32_t SegFrames;             // Frames in current segment
+
+    volatile bool Running;
+    volatile bool StopRequest;
+    void *ThreadHandle;             // Platform-specific thread handle
+
+    void CommitFrame(void);
+    void StartFrame(uint32_t protocol);
+
+    bool OpenSegment(void);
+    void CloseSegment(void);
+    void WriteFrame(const TelemetryFrameHeader *frame);
+
+    // Background thread
+    void Run(void);
+#ifdef _WIN32
+    static unsigned long __stdcall ThreadEntry(void *arg);
+#else
+    static void *ThreadEntry(void *arg);
+#endif
+
+private:
+    // No copy
+    TelemetryRecorder(const TelemetryRecorder &);
+    TelemetryRecorder &operator=(const TelemetryRecorder &);
+};
+
+// Reader for the segment files written by TelemetryRecorder. Segments that were not closed
+// (e.g., if the program crashed) are read up to the last complete frame.
+
+class TelemetryReader {
+public:
+    TelemetryReader(std::ostream &ostr = std::cerr);
+    ~TelemetryReader();
+
+    // Open the recording; fileName can be the base name or the name of any segment file
+    // (in which case reading starts with that segment)
+    bool Open(const std::string &fileName);
+    void Close(void);
+
+    // Configuration from the header of the current segment
+    const TelemetrySegmentHeader &GetConfig(void) const { return Config; }
+
+    // Returns the next frame, or 0 at the end of the recording. The pointer is valid until
+    // the next call to NextFrame, Rewind or Close.
+    const TelemetryFrameHeader *NextFrame(void);
+
+    // Start again at the first segment that was opened
+    bool Rewind(void);
+
+    // Total number of frames returned by NextFrame, and number of gaps in frame numbers
+    // (i.e., frames dropped by the recorder) detected
+    uint32_t GetNumRead(void) const { return NumRead; }
+    uint32_t GetNumMissing(void) const { return NumMissing; }
+
+    // Returns pointer to read/write data of the specified board in the frame (0 if none)
+    static const quadlet_t *GetReadData(const TelemetryFrameHeader *frame, unsigned int boardId);
+    static const quadlet_t *GetWriteData(const TelemetryFrameHeader *frame, unsigned int boardId);
+    // Returns pointer to all read (e.g., hub buffer) or write data in the frame
+    static const quadlet_t *GetReadData(const TelemetryFrameHeader *frame);
+    static const quadlet_t *GetWriteData(const TelemetryFrameHeader *frame);
+
+protected:
+    std::ostream &outStr;
+    std::string FileBase;
+    unsigned int FirstSegment;
+    unsigned int SegmentIndex;
+    TelemetrySegmentHeader Config;
+    std::vector<unsigned char> SegData;  // Contents of current segment
+    uint32_t SegOffset;                  // Offset of next frame in SegData
+    uint32_t SegEnd;                     // End of frame data in SegData
+    uint32_t NumRead;
+    uint32_t NumMissing;
+    uint32_t LastFrameNum;
+
+    // Load specified segment; returns false if not found or invalid
+    bool LoadSegment(unsigned int index, bool quiet);
+
+private:
+    // No copy
+    TelemetryReader(const TelemetryReader &);
+    TelemetryReader &operator=(const TelemetryReader &);
+};
+
+#endif // __TELEMETRY_RECORDER_H__
@@ -0,0 +1,148 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __VELOCITY_ESTIMATOR_H__
+#define __VELOCITY_ESTIMATOR_H__
+
+#include <vector>
+#include "Amp1394Types.h"
+
+class AmpIO;
+
+// Host-side, multi-sample velocity estimation. The FPGA velocity estimate (see EncoderVelocity)
+// only uses data from a single frame, which can be noisy for slow axes. This class maintains
+// a bank of per-axis estimators that are updated once per frame (i.e., after each ReadAllBoards),
+// using the encoder position, the FPGA velocity (based on the measured encoder period) and the
+// time since the previous frame (GetTimestampSeconds). The following methods are available:
+//
+//   VEL_FPGA       No filtering; returns the FPGA velocity (GetEncoderVelocityPredicted)
+//   VEL_LSQ        Least-squares polynomial (order 1 or 2) fit to the positions in a sliding window
+//   VEL_ALPHA_BETA Alpha-beta filter on the position
+//   VEL_KALMAN     Constant-velocity Kalman filter that fuses the position and the FPGA velocity,
+//                  where the FPGA velocity variance is derived from the period quantization
+//   VEL_ADAPTIVE   Adaptive window: uses the shortest window (up to the window length) over which
+//                  the position range (max-min) is at least the specified threshold; the velocity
+//                  is the slope between the first and last sample of that window
+//
+// Each update is constant time per axis (amortized for VEL_ADAPTIVE, which keeps monotonic deques
+// of the window maximum and minimum, and for the periodic rebase of the sliding window).
+// The state is stored per field (rather than per axis), so that all axes of a port are updated
+// in a single pass.
+
+class VelocityEstimatorBank {
+public:
+    enum Method { VEL_FPGA, VEL_LSQ, VEL_ALPHA_BETA, VEL_KALMAN, VEL_ADAPTIVE };
+
+    enum { ALL_AXES = 0xffffffff };
+
+    // maxWindow is the maximum window length (samples) for VEL_LSQ and VEL_ADAPTIVE
+    VelocityEstimatorBank(unsigned int maxWindow = 32);
+    ~VelocityEstimatorBank() {}
+
+    // Add all encoders of the specified board (axis numbers are assigned in order). The number
+    // of encoders is queried again by Update, since it is only known once the board has been
+    // added to a port (see AmpIO::InitBoard).
+    bool AddBoard(const AmpIO *board);
+
+    // Set the number of axes (only needed when not using AddBoard)
+    void SetNumAxes(unsigned int num);
+    unsigned int GetNumAxes(void) const { return NumAxes; }
+
+    // Configuration; axis=ALL_AXES applies the setting to all axes. Changing the method
+    // or window resets the affected axes.
+    bool SetMethod(Method method, unsigned int axis = ALL_AXES);
+    bool SetWindow(unsigned int len, unsigned int axis = ALL_AXES);
+    bool SetPolyOrder(unsigned int order, unsigned int axis = ALL_AXES);
+    bool SetAlphaBeta(double alpha, double beta, unsigned int axis = ALL_AXES);
+    // q: process noise (acceleration spectral density, counts^2/s^3)
+    // rPos: position measurement variance (counts^2)
+    // rVel: velocity measurement variance (counts^2/s^2), in addition to period quantization
+    bool SetKalmanNoise(double q, double rPos, double rVel, unsigned int axis = ALL_AXES);
+    // Minimum position change (counts) for adaptive window
+    bool SetAdaptiveThreshold(double counts, unsigned int axis = ALL_AXES);
+
+    Method GetMethod(unsigned int axis) const;
+
+    // Reset the estimator state (not the configuration)
+    void Reset(unsigned int axis = ALL_AXES);
+
+    // Update all axes from the boards added via AddBoard; should be called after each ReadAllBoards
+    void Update(void);
+
+    // Update one axis
+    //   pos         encoder position (counts)
+    //   dt          time since previous sample (seconds)
+    //   fpgaVel     FPGA velocity estimate (counts/sec)
+    //   fpgaVelVar  variance of fpgaVel (negative if not valid, e.g., period overflow)
+    bool Update(unsigned int axis, double pos, double dt, double fpgaVel, double fpgaVelVar);
+
+    // Returns the estimated velocity (counts/sec) and position (counts)
+    double GetVelocity(unsigned int axis) const;
+    double GetPosition(unsigned int axis) const;
+
+protected:
+    unsigned int NumAxes;
+    unsigned int MaxWindow;
+
+    // Boards added via AddBoard
+    std::vector<const AmpIO *> Boards;
+
+    // Set the number of axes to the total number of encoders of the boards added via AddBoard
+    void UpdateNumAxes(void);
+
+    // Configuration (per axis)
+    std::vector<Method> method;
+    std::vector<unsigned int> window;
+    std::vector<unsigned int> polyOrder;
+    std::vector<double> alpha, beta;
+    std::vector<double> kalmanQ, kalmanRPos, kalmanRVel;
+    std::vector<double> adaptThreshold;
+
+    // State (per axis)
+    std::vector<bool> initialized;
+    std::vector<double> estPos, estVel;
+    std::vector<double> P00, P01, P11;       // Kalman covariance
+
+    // Sliding window (per axis, MaxWindow samples each). Times and positions are relative
+    // to an origin that is moved to the most recent sample whenever the window wraps, which
+    // also recomputes the running sums to avoid accumulating round-off error.
+    std::vector<double> winTime, winPos;
+    std::vector<unsigned int> winHead, winCount;
+    std::vector<double> tNow, posOrigin;
+    // Running sums: t^k (k=1..4) and t^k*y (k=0..2); the count is winCount
+    std::vector<double> St, Stt, Sttt, Stttt, Sy, Sty, Stty;
+    // Adaptive window: sample sequence number of the newest sample, number of samples in the
+    // adaptive window, and monotonic deques (MaxWindow entries each) of the sequence numbers of
+    // the samples that are candidates for the maximum and minimum position in the adaptive window
+    std::vector<unsigned int> winSeq, adaptLen;
+    std::vector<unsigned int> qMax, qMaxFront, qMaxCount;
+    std::vector<unsigned int> qMin, qMinFront, qMinCount;
+
+    bool CheckAxis(unsigned int axis) const;
+    void ResetAxis(unsigned int axis);
+    void Rebase(unsigned int axis);
+    void UpdateWindow(unsigned int axis, double pos, double dt);
+    void UpdateLSQ(unsigned int axis, double fpgaVel);
+    void UpdateAlphaBeta(unsigned int axis, double pos, double dt);
+    void UpdateKalman(unsigned int axis, double pos, double dt, double fpgaVel, double fpgaVelVar);
+    void UpdateAdaptive(unsigned int axis, double fpgaVel);
+    // Helpers for UpdateAdaptive (wy is the position window of the axis)
+    unsigned int AdaptIndex(unsigned int axis, unsigned int seq) const;
+    void AdaptPush(unsigned int axis, const double *wy, bool isMax);
+    void AdaptPop(unsigned int axis, bool isMax);
+    double AdaptExtremum(unsigned int axis, const double *wy, bool isMax, unsigned int maxAge) const;
+};
+
+#endif // __VELOCITY_ESTIMATOR_H__
@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#ifndef __AMP1394_PROBES_H__
+#define __AMP1394_PROBES_H__
+
+// USDT (user-level statically defined tracing) probes, provider "amp1394", which can be
+// used by perf, bpftrace, SystemTap, etc. (see util/bpftrace). A probe is a single no-op
+// instruction unless a tracer is attached. The probes are compiled out if sys/sdt.h was
+// not found (see Amp1394_HAS_USDT in CMakeLists.txt).
+//
+// Probe                        Arguments
+// read_all_boards_entry        protocol, number of boards
+// read_all_boards_return       result (1 = all boards read)
+// read_all_boards_bc_entry     number of boards
+// read_all_boards_bc_return    result, sequence number
+// board_read_entry             board id, bytes
+// board_read_return            board id, result
+// seq_error                    board id, sequence number received, sequence number expected
+// write_all_boards_entry       protocol, number of boards
+// write_all_boards_return      result (1 = all boards written)
+// write_all_boards_bc_entry    number of boards
+// write_all_boards_bc_return   result, bytes
+// wait_bc_read_entry           number of boards
+// wait_bc_read_return          (none)
+// packet_send_entry            node, bytes, transaction label
+// packet_send_return           result
+// packet_receive_entry         node, bytes
+// packet_receive_return        bytes received (negative if error)
+// rescan_nodes_entry           current bus generation, new bus generation
+// rescan_nodes_return          result
+
+#include <Amp1394/AmpIORevision.h>
+
+#if Amp1394_HAS_USDT
+#include <sys/sdt.h>
+#define AMP1394_PROBE0(name)                  DTRACE_PROBE(amp1394, name)
+#define AMP1394_PROBE1(name, a1)              DTRACE_PROBE1(amp1394, name, a1)
+#define AMP1394_PROBE2(name, a1, a2)          DTRACE_PROBE2(amp1394, name, a1, a2)
+#define AMP1394_PROBE3(name, a1, a2, a3)      DTRACE_PROBE3(amp1394, name, a1, a2, a3)
+#else
+#define AMP1394_PROBE0(name)
+#define AMP1394_PROBE1(name, a1)
+#define AMP1394_PROBE2(name, a1, a2)
+#define AMP1394_PROBE3(name, a1, a2, a3)
+#endif
+
+#endif // __AMP1394_PROBES_H__
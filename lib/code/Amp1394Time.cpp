@@ -50,6 +50,19 @@ double Amp1394_GetTime(void)
 #endif
 }
 
+double Amp1394_GetMonotonicTime(void)
+{
+#ifdef _MSC_VER
+    // QueryPerformanceCounter is already monotonic
+    return Amp1394_GetTime();
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return Amp1394_GetTime();
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+}
+
 // See osaSleep.cpp (cisstOSAbstraction) if support for other platforms needed.
 
 void Amp1394_Sleep(double sec)
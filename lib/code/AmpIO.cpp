@@ -75,6 +75,7 @@ const uint32_t ENC_OVER_MASK    = 0x01000000;  /*!< Encoder bit overflow mask */
 const uint32_t ENC_A_MASK       = 0x10000000;  /*!< Encoder A channel mask (Rev 8+) */
 const uint32_t ENC_B_MASK       = 0x20000000;  /*!< Encoder B channel mask (Rev 8+) */
 const uint32_t ENC_I_MASK       = 0x40000000;  /*!< Encoder I channel mask (Rev 8+) */
+const uint32_t ENC_ERROR_MASK   = 0x10000000;  /*!< Encoder error bit in velocity period (Rev 7+) */
 
 const double FPGA_sysclk_MHz        = 49.152;         /* FPGA sysclk in MHz (from FireWire) */
 const double VEL_PERD_ESPM          = 1.0/40000000;   /* Clock period for ESPM velocity measurements (dVRK Si) */
@@ -90,6 +91,8 @@ uint8_t BitReverse4[16] = { 0x0, 0x8, 0x4, 0xC,         // 0000, 0001, 0010, 001
                                 0x3, 0xB, 0x7, 0xF };       // 1100, 1101, 1110, 1111
 
 AmpIO::AmpIO(uint8_t board_id) : FpgaIO(board_id), NumMotors(0), NumEncoders(0), NumDouts(0),
+                                     readFrameGen(0), lazyDecode(false), histDepthRequested(0), histDepth(0),
+                                     histCount(0), histHead(0), histFrames(0), histHostTime(0), histFwTime(0),
                                      dallasState(ST_DALLAS_START), dallasTimeoutSec(10.0), collect_state(false), collect_cb(0)
 {
     memset(ReadBuffer, 0, sizeof(ReadBuffer));
@@ -106,6 +109,9 @@ AmpIO::~AmpIO()
                   << BasePort::PortTypeString(port->GetPortType()) <<" Port" << std::endl;
         port->RemoveBoard(this);
     }
+    delete [] histFrames;
+    delete [] histHostTime;
+    delete [] histFwTime;
 }
 
 unsigned int AmpIO::GetReadNumBytes() const
@@ -130,11 +136,33 @@ void AmpIO::SetReadData(const quadlet_t *buf)
     for (i = 0; i < numQuads; i++) {
         ReadBuffer[i] = bswap_32(buf[i]);
     }
-    for (i = 0; i < NumEncoders; i++) {
-        SetEncoderVelocityData(i);
+    readFrameGen++;
+    if (lazyDecode) {
+        // Velocity data is decoded on demand, but encoder errors must be counted for
+        // every frame. The error bit is only provided by Firmware Rev 7+.
+        if (GetFirmwareVersion() >= 7) {
+            for (i = 0; i < NumEncoders; i++) {
+                if (ReadBuffer[ENC_VEL_OFFSET+i] & ENC_ERROR_MASK)
+                    encErrorCount[i]++;
+            }
+        }
+    }
+    else {
+        for (i = 0; i < NumEncoders; i++) {
+            SetEncoderVelocityData(i);
+        }
     }
     // Add 1 to timestamp because block read clears counter, rather than incrementing
-    firmwareTime += (GetTimestamp()+1)*GetFPGAClockPeriod();
+    AddFirmwareTicks(GetTimestamp()+1);
+
+    if (histDepth > 0) {
+        histHead = (histHead+1)%histDepth;
+        memcpy(histFrames+histHead*ReadBufSize_Max, ReadBuffer, numQuads*sizeof(quadlet_t));
+        histHostTime[histHead] = Amp1394_GetTime();
+        histFwTime[histHead] = firmwareTime;
+        if (histCount < histDepth)
+            histCount++;
+    }
 }
 
 void AmpIO::InitBoard(void)
@@ -144,7 +172,7 @@ void AmpIO::InitBoard(void)
     // If the port is not yet valid, these methods will both return 0, so board will be
     // initialized as a 4-axis QLA and assume firmware version < 8.
     if (GetHardwareVersion() == dRA1_String) {
-        NumMotors = 10;
+        NumMotors = SI_NUM_MOTORS;
         NumEncoders = 7;
         NumDouts = 0;
     }
@@ -190,8 +218,28 @@ void AmpIO::InitBoard(void)
 
     for (size_t i = 0; i < NumEncoders; i++) {
         encVelData[i].Init();
+        encVelGen[i] = readFrameGen;
         encErrorCount[i] = 0;
     }
+
+    // (Re)allocate the history buffers, if necessary
+    if (histDepth != histDepthRequested) {
+        delete [] histFrames;
+        delete [] histHostTime;
+        delete [] histFwTime;
+        histFrames = 0;
+        histHostTime = 0;
+        histFwTime = 0;
+        histDepth = histDepthRequested;
+        if (histDepth > 0) {
+            histFrames = new quadlet_t[histDepth*ReadBufSize_Max];
+            histHostTime = new double[histDepth];
+            histFwTime = new double[histDepth];
+        }
+    }
+    histCount = 0;
+    histHead = 0;
+
     InitWriteBuffer();
 }
 
@@ -255,32 +303,86 @@ bool AmpIO::WriteBufferResetsWatchdog(void) const
     return ret;
 }
 
-std::string AmpIO::GetQLASerialNumber(unsigned char chan)
+bool AmpIO::ParseQLAIdentity(QLAIdentity &id)
 {
     // Format: QLA 1234-56 or QLA 1234-567.
     // String is terminated by 0 or 0xff.
-    uint16_t address = 0x0000;
-    uint8_t data[20];
     const size_t QLASNSize = 12;
-    std::string sn;
-
+    char data[QLASNSize+1];
+    size_t i;
+    for (i = 0; i < QLASNSize; i++)
+        data[i] = (id.header[i] == 0xff) ? 0 : static_cast<char>(id.header[i]);
     data[QLASNSize] = 0;  // make sure null-terminated
+    id.boardType.clear();
+    id.serialNumber.clear();
+    if ((strncmp(data, "QLA ", 4) == 0) || (strncmp(data, "dRA ", 4) == 0)) {
+        id.boardType.assign(data, 3);
+        id.serialNumber.assign(data+4);
+        return true;
+    }
+    for (i = 0; i < sizeof(id.header); i++) {
+        if (id.header[i] != 0xff)
+            return false;
+    }
+    return true;
+}
+
+bool AmpIO::ParseQLAIdentityBlock(QLAIdentity &id, const quadlet_t *data)
+{
+    // ReadBlock does not byte-swap, so data holds the quadlets in bus (big-endian) order; the
+    // PROM bytes are expected in address order (first byte in the MSB of the first quadlet),
+    // as for the DS2505 block data (see DallasReadBlock) and as emulated by EthLoopbackPort.
+    // The other packing (first byte in the LSB) is also accepted, so that a mismatch does not
+    // require the byte-wise read.
+    const unsigned int nquads = QLAIdentity::HEADER_SIZE/sizeof(quadlet_t);
+    memcpy(id.header, data, sizeof(id.header));
+    if (ParseQLAIdentity(id))
+        return true;
+    quadlet_t swapped[nquads];
+    for (unsigned int i = 0; i < nquads; i++)
+        swapped[i] = bswap_32(data[i]);
+    memcpy(id.header, swapped, sizeof(id.header));
+    return ParseQLAIdentity(id);
+}
+
+bool AmpIO::ReadQLAIdentity(QLAIdentity &id, unsigned char chan)
+{
+    const unsigned int nquads = QLAIdentity::HEADER_SIZE/sizeof(quadlet_t);
+    quadlet_t buffer[nquads];
+    if (PromReadBlock25AA128(0x0000, buffer, nquads, chan) && ParseQLAIdentityBlock(id, buffer))
+        return true;
+    return ReadQLAIdentityBytes(id, chan);
+}
+
+bool AmpIO::ReadQLAIdentityBytes(QLAIdentity &id, unsigned char chan)
+{
+    // Read byte by byte (only the bytes used for the serial number)
+    const size_t QLASNSize = 12;
+    memset(id.header, 0xff, sizeof(id.header));
+    uint16_t address = 0x0000;
     for (size_t i = 0; i < QLASNSize; i++) {
-        if (!PromReadByte25AA128(address, data[i], chan)) {
-            if (chan == 0)
-                std::cerr << "AmpIO::GetQLASerialNumber: failed to get QLA Serial Number" << std::endl;
-            else
-                std::cerr << "AmpIO::GetQLASerialNumber: failed to get QLA " << static_cast<unsigned int>(chan)
-                          << " Serial Number" << std::endl;
-            break;
+        if (!PromReadByte25AA128(address, id.header[i], chan)) {
+            id.boardType.clear();
+            id.serialNumber.clear();
+            return false;
         }
-        if (data[i] == 0xff)
-            data[i] = 0;
         address += 1;
     }
-    if (strncmp((char *)data, "QLA ", 4) == 0 || strncmp((char *)data, "dRA ", 4) == 0)
-        sn.assign((char *)data+4);
-    return sn;
+    ParseQLAIdentity(id);
+    return true;
+}
+
+std::string AmpIO::GetQLASerialNumber(unsigned char chan)
+{
+    QLAIdentity id;
+    if (!ReadQLAIdentity(id, chan)) {
+        if (chan == 0)
+            std::cerr << "AmpIO::GetQLASerialNumber: failed to get QLA Serial Number" << std::endl;
+        else
+            std::cerr << "AmpIO::GetQLASerialNumber: failed to get QLA " << static_cast<unsigned int>(chan)
+                      << " Serial Number" << std::endl;
+    }
+    return id.serialNumber;
 }
 
 void AmpIO::DisplayReadBuffer(std::ostream &out) const
@@ -576,7 +678,7 @@ double AmpIO::GetEncoderVelocity(unsigned int index) const
 {
     if (index >= NumEncoders)
         return 0L;
-    return encVelData[index].GetEncoderVelocity();
+    return DecodeEncoderVelocityData(index).GetEncoderVelocity();
 }
 
 // Returns predicted encoder velocity in counts/sec, taking into account
@@ -585,7 +687,7 @@ double AmpIO::GetEncoderVelocityPredicted(unsigned int index, double percent_thr
 {
     if (index >= NumEncoders)
         return 0.0;
-    return encVelData[index].GetEncoderVelocityPredicted(percent_threshold);
+    return DecodeEncoderVelocityData(index).GetEncoderVelocityPredicted(percent_threshold);
 }
 
 // Estimate acceleration from two quarters of the same type; units are counts/second**2
@@ -594,7 +696,7 @@ double AmpIO::GetEncoderAcceleration(unsigned int index, double percent_threshol
 {
     if (index >= NumEncoders)
         return 0.0;
-    return encVelData[index].GetEncoderAcceleration(percent_threshold);
+    return DecodeEncoderVelocityData(index).GetEncoderAcceleration(percent_threshold);
 }
 
 // Raw velocity field; includes period of velocity and other data, depending on firmware version.
@@ -641,7 +743,38 @@ double AmpIO::GetEncoderRunningCounterSeconds(unsigned int index) const
 {
     if (index >= NumEncoders)
         return 0.0;
-    return encVelData[index].GetEncoderRunningCounterSeconds();
+    return DecodeEncoderVelocityData(index).GetEncoderRunningCounterSeconds();
+}
+
+double AmpIO::GetEncoderPositionCompensated(unsigned int index, double percent_threshold) const
+{
+    if (index >= NumEncoders)
+        return 0.0;
+    double pos = static_cast<double>(GetEncoderPosition(index));
+    double dt = GetExtrapolationTime();
+    if (dt == 0.0)
+        return pos;
+    double vel = GetEncoderVelocityPredicted(index, percent_threshold);
+    double velAt = GetEncoderVelocityCompensated(index, percent_threshold);
+    // Integrate assuming constant acceleration (trapezoidal rule), which also handles the
+    // case where the velocity is limited to zero
+    return pos + 0.5*(vel + velAt)*dt;
+}
+
+double AmpIO::GetEncoderVelocityCompensated(unsigned int index, double percent_threshold) const
+{
+    if (index >= NumEncoders)
+        return 0.0;
+    const EncoderVelocity &encVel = DecodeEncoderVelocityData(index);
+    double vel = encVel.GetEncoderVelocityPredicted(percent_threshold);
+    double dt = GetExtrapolationTime();
+    if (dt == 0.0)
+        return vel;
+    double velAt = vel + encVel.GetEncoderAcceleration(percent_threshold)*dt;
+    // Do not allow a change of direction
+    if (((vel > 0.0) && (velAt < 0.0)) || ((vel < 0.0) && (velAt > 0.0)))
+        velAt = 0.0;
+    return velAt;
 }
 
 int32_t AmpIO::GetEncoderMidRange(void)
@@ -654,6 +787,20 @@ bool AmpIO::SetEncoderVelocityData(unsigned int index)
     if (index >= NumEncoders)
         return false;
 
+    DecodeEncoderVelocityData(index);
+
+    // Increment error counter if necessary
+    if (encVelData[index].IsEncoderError())
+        encErrorCount[index]++;
+
+    return true;
+}
+
+const EncoderVelocity &AmpIO::DecodeEncoderVelocityData(unsigned int index) const
+{
+    if (encVelGen[index] == readFrameGen)
+        return encVelData[index];
+
     uint32_t fver = GetFirmwareVersion();
     if (fver < 6) {
         encVelData[index].SetDataOld(ReadBuffer[ENC_VEL_OFFSET+index], (fver >= 4));
@@ -666,21 +813,29 @@ bool AmpIO::SetEncoderVelocityData(unsigned int index)
         encVelData[index].SetData(ReadBuffer[ENC_VEL_OFFSET+index], ReadBuffer[ENC_QTR1_OFFSET+index],
                                   ReadBuffer[ENC_QTR5_OFFSET+index], ReadBuffer[ENC_RUN_OFFSET+index], isESPM);
     }
-    // Increment error counter if necessary
-    if (encVelData[index].IsEncoderError())
-        encErrorCount[index]++;
-
-    return true;
+    encVelGen[index] = readFrameGen;
+    return encVelData[index];
 }
 
 bool AmpIO::GetEncoderVelocityData(unsigned int index, EncoderVelocity &data) const
 {
     if (index >= NumEncoders)
         return false;
-    data = encVelData[index];
+    data = DecodeEncoderVelocityData(index);
     return true;
 }
 
+void AmpIO::SetLazyDecode(bool lazy)
+{
+    // When switching back to eager decoding, bring the cache up to date so that
+    // encVelData is valid for the current frame.
+    if (lazyDecode && !lazy) {
+        for (unsigned int i = 0; i < NumEncoders; i++)
+            DecodeEncoderVelocityData(i);
+    }
+    lazyDecode = lazy;
+}
+
 unsigned int AmpIO::GetEncoderErrorCount(unsigned int index) const
 {
     if (index >= NumEncoders)
@@ -705,6 +860,104 @@ bool AmpIO::ClearEncoderErrorCount(unsigned int index)
     return ret;
 }
 
+void AmpIO::SetHistoryDepth(unsigned int depth)
+{
+    histDepthRequested = depth;
+}
+
+int AmpIO::GetHistoryIndex(unsigned int age) const
+{
+    if (age >= histCount)
+        return -1;
+    return static_cast<int>((histHead+histDepth-age)%histDepth);
+}
+
+const quadlet_t *AmpIO::GetHistoryFrame(unsigned int age) const
+{
+    int i = GetHistoryIndex(age);
+    return (i < 0) ? 0 : histFrames+i*ReadBufSize_Max;
+}
+
+bool AmpIO::GetHistoryHostTime(unsigned int age, double &hostTime) const
+{
+    int i = GetHistoryIndex(age);
+    if (i < 0)
+        return false;
+    hostTime = histHostTime[i];
+    return true;
+}
+
+bool AmpIO::GetHistoryFirmwareTime(unsigned int age, double &fwTime) const
+{
+    int i = GetHistoryIndex(age);
+    if (i < 0)
+        return false;
+    fwTime = histFwTime[i];
+    return true;
+}
+
+bool AmpIO::GetHistoryTimestampSeconds(unsigned int age, double &ts) const
+{
+    const quadlet_t *frame = GetHistoryFrame(age);
+    if (!frame)
+        return false;
+    ts = frame[TIMESTAMP_OFFSET]*GetFPGAClockPeriod();
+    return true;
+}
+
+bool AmpIO::GetHistoryEncoderPosition(unsigned int index, unsigned int age, int32_t &pos) const
+{
+    const quadlet_t *frame = GetHistoryFrame(age);
+    if (!frame || (index >= NumEncoders))
+        return false;
+    pos = static_cast<int32_t>(frame[index+ENC_POS_OFFSET] & ENC_POS_MASK) - ENC_MIDRANGE;
+    return true;
+}
+
+bool AmpIO::GetHistoryEncoderVelocityRaw(unsigned int index, unsigned int age, uint32_t &vel) const
+{
+    const quadlet_t *frame = GetHistoryFrame(age);
+    if (!frame || (index >= NumEncoders))
+        return false;
+    vel = frame[index+ENC_VEL_OFFSET];
+    return true;
+}
+
+bool AmpIO::GetHistoryMotorCurrent(unsigned int index, unsigned int age, uint32_t &mcur) const
+{
+    const quadlet_t *frame = GetHistoryFrame(age);
+    if (!frame || (index >= NumMotors))
+        return false;
+    mcur = frame[index+MOTOR_CURR_OFFSET] & MOTOR_CURR_MASK;
+    return true;
+}
+
+bool AmpIO::GetHistoryAnalogInput(unsigned int index, unsigned int age, uint32_t &ain) const
+{
+    const quadlet_t *frame = GetHistoryFrame(age);
+    if (!frame || (index >= NumMotors))
+        return false;
+    ain = (frame[index+ANALOG_POS_OFFSET] & ANALOG_POS_MASK) >> 16;
+    return true;
+}
+
+unsigned int AmpIO::GetHistoryEncoderPositions(unsigned int index, int32_t *pos, double *fwTime,
+                                               unsigned int n) const
+{
+    if (index >= NumEncoders)
+        return 0;
+    unsigned int num = std::min(n, histCount);
+    unsigned int i = histHead;
+    for (unsigned int age = 0; age < num; age++) {
+        pos[age] = static_cast<int32_t>(histFrames[i*ReadBufSize_Max+index+ENC_POS_OFFSET] & ENC_POS_MASK)
+                   - ENC_MIDRANGE;
+        if (fwTime)
+            fwTime[age] = histFwTime[i];
+        i = (i == 0) ? histDepth-1 : i-1;
+    }
+    return num;
+}
+
 bool AmpIO::GetPowerEnable(void) const
 {
     // Bit 18
@@ -1515,18 +1768,7 @@ AmpIO::DallasStatus AmpIO::DallasReadTool(uint32_t &model, uint8_t &version, std
 
         case ST_DALLAS_READ:
             if (DallasReadBlock(reinterpret_cast<unsigned char *>(buffer), sizeof(buffer))) {
-                // make sure we read the 997 from company statement
-                if (strncmp(buffer, "997", 3) == 0) {
-                    // get model and name of tool to create unique string identifier
-                    // model number uses only 3 bytes, set first one to zero just in case
-                    buffer[DALLAS_MODEL_OFFSET] = 0;
-                    model = *(reinterpret_cast<uint32_t *>(buffer + (DALLAS_MODEL_OFFSET - DALLAS_START_READ)));
-                    model = bswap_32(model);
-                    // version number
-                    version = static_cast<uint8_t>(buffer[DALLAS_VERSION_OFFSET - DALLAS_START_READ]);
-                    // name
-                    buffer[DALLAS_NAME_END - DALLAS_START_READ] = '\0';
-                    name = buffer + (DALLAS_NAME_OFFSET - DALLAS_START_READ);
+                if (DallasParseTool(buffer, model, version, name)) {
                     ret = DALLAS_OK;
                     dallasState = ST_DALLAS_START;  // Nominal; could be updated below for DS2480B
                 }
@@ -1558,6 +1800,24 @@ AmpIO::DallasStatus AmpIO::DallasReadTool(uint32_t &model, uint8_t &version, std
     return ret;
 }
 
+bool AmpIO::DallasParseTool(char *buffer, uint32_t &model, uint8_t &version, std::string &name)
+{
+    // make sure we read the 997 from company statement
+    if (strncmp(buffer, "997", 3) != 0)
+        return false;
+    // get model and name of tool to create unique string identifier
+    // model number uses only 3 bytes, set first one to zero just in case
+    buffer[DALLAS_MODEL_OFFSET] = 0;
+    model = *(reinterpret_cast<uint32_t *>(buffer + (DALLAS_MODEL_OFFSET - DALLAS_START_READ)));
+    model = bswap_32(model);
+    // version number
+    version = static_cast<uint8_t>(buffer[DALLAS_VERSION_OFFSET - DALLAS_START_READ]);
+    // name
+    buffer[DALLAS_NAME_END - DALLAS_START_READ] = '\0';
+    name = buffer + (DALLAS_NAME_OFFSET - DALLAS_START_READ);
+    return true;
+}
+
 bool AmpIO::DallasWriteControl(uint32_t ctrl)
 {
     if (GetFirmwareVersion() < 7) return false;
@@ -1646,6 +1906,152 @@ bool AmpIO::DallasReadMemory(unsigned short addr, unsigned char *data, unsigned
     return true;
 }
 
+bool AmpIO::DallasReaderStart(double repeatSec, double timeoutSec)
+{
+    if (GetFirmwareVersion() < 7) return false;
+    dallasReader.repeatSec = repeatSec;
+    dallasReader.timeoutSec = timeoutSec;
+    dallasReader.state = (GetHardwareVersion() == dRA1_String) ? DR_DRA_MODEL : DR_START;
+    dallasReader.waitStart = Amp1394_GetTime();
+    dallasReader.current = DallasToolInfo();
+    return true;
+}
+
+void AmpIO::DallasReaderStop(void)
+{
+    dallasReader.state = DR_IDLE;
+}
+
+void AmpIO::DallasReaderFinish(DallasStatus status)
+{
+    DallasToolInfo &cur = dallasReader.current;
+    DallasToolInfo &tool = dallasReader.tool;
+    cur.status = status;
+    if (dallasReader.numRead > 0) {
+        if ((cur.status != tool.status) || (cur.model != tool.model) || (cur.version != tool.version)
+            || (cur.name != tool.name))
+            dallasReader.numChanged++;
+    }
+    tool = cur;
+    dallasReader.numRead++;
+    if (dallasReader.repeatSec > 0.0) {
+        dallasReader.state = DR_REPEAT;
+        dallasReader.waitStart = Amp1394_GetTime();
+    }
+    else {
+        dallasReader.state = DR_IDLE;
+    }
+}
+
+bool AmpIO::BackgroundStep(void)
+{
+    DallasReader &dr = dallasReader;
+    if (!port || (dr.state == DR_IDLE))
+        return false;
+
+    double now = Amp1394_GetTime();
+    uint32_t status;
+    quadlet_t read_data;
+    char buffer[256];
+
+    switch (dr.state) {
+
+    case DR_IDLE:
+    case DR_DONE:
+        return false;
+
+    case DR_REPEAT:
+        if (now < dr.waitStart + dr.repeatSec)
+            return false;
+        dr.state = (GetHardwareVersion() == dRA1_String) ? DR_DRA_MODEL : DR_START;
+        dr.waitStart = now;
+        dr.current = DallasToolInfo();
+        // Perform first step now
+        return BackgroundStep();
+
+    case DR_START:
+        // Start reading at address DALLAS_START_READ (as in DallasReadTool)
+        if (DallasWriteControl((DALLAS_START_READ<<16)|2)) {
+            dr.state = DR_WAIT;
+            dr.stateNext = DR_READ;
+            dr.waitStart = now;
+        }
+        else {
+            DallasReaderFinish(DALLAS_IO_ERROR);
+        }
+        break;
+
+    case DR_WAIT:
+        if (DallasReadStatus(status)) {
+            // Idle state (see DallasReadTool)
+            if ((status&0x000020F0) == 0) {
+                dr.useDS2480B = (status & 0x00008000) == 0x00008000;
+                if (dr.stateNext == DR_DONE)
+                    DallasReaderFinish(dr.current.status);
+                else
+                    dr.state = dr.stateNext;
+            }
+            else if (now > dr.waitStart + dr.timeoutSec) {
+                // After DR_END, the data has already been read
+                DallasReaderFinish((dr.stateNext == DR_DONE) ? dr.current.status : DALLAS_TIMEOUT);
+            }
+        }
+        else {
+            DallasReaderFinish((dr.stateNext == DR_DONE) ? dr.current.status : DALLAS_IO_ERROR);
+        }
+        break;
+
+    case DR_READ:
+        if (DallasReadBlock(reinterpret_cast<unsigned char *>(buffer), sizeof(buffer))) {
+            DallasToolInfo &cur = dr.current;
+            cur.status = DallasParseTool(buffer, cur.model, cur.version, cur.name) ? DALLAS_OK : DALLAS_DATA_ERROR;
+            if (dr.useDS2480B)
+                dr.state = DR_END;
+            else
+                DallasReaderFinish(cur.status);
+        }
+        else {
+            DallasReaderFinish(DALLAS_IO_ERROR);
+        }
+        break;
+
+    case DR_END:
+        // End block reading for DS2480B interface (see DallasReadTool); the result is
+        // already known, so ignore failures
+        if (DallasWriteControl(0x09)) {
+            dr.state = DR_WAIT;
+            dr.stateNext = DR_DONE;
+            dr.waitStart = now;
+        }
+        else {
+            DallasReaderFinish(dr.current.status);
+        }
+        break;
+
+    case DR_DRA_MODEL:
+        if (port->ReadQuadlet(BoardId, 0xb012, read_data)) {
+            dr.current.model = bswap_32(read_data);
+            dr.state = DR_DRA_VERSION;
+        }
+        else {
+            DallasReaderFinish(DALLAS_IO_ERROR);
+        }
+        break;
+
+    case DR_DRA_VERSION:
+        if (port->ReadQuadlet(BoardId, 0xb013, read_data)) {
+            dr.current.version = read_data & 0x000000ff;
+            // Version 255 indicates no tool (see DallasReadTool)
+            DallasReaderFinish((dr.current.version != 255) ? DALLAS_OK : DALLAS_DATA_ERROR);
+        }
+        else {
+            DallasReaderFinish(DALLAS_IO_ERROR);
+        }
+        break;
+    }
+    return true;
+}
+
 bool AmpIO::WriteRobotLED(uint32_t rgb1, uint32_t rgb2, bool blink1, bool blink2) const
 {
     if (GetHardwareVersion() == dRA1_String) {
@@ -1878,32 +2284,9 @@ bool AmpIO::WriteSiCurrentLoopParams(unsigned int index, const SiCurrentLoopPara
         return false;
     }
     if (index >= NumMotors) return false;
-    if (params.kp >= 1 << 18) return false;
-    if (params.ki >= 1 << 18) return false;
-    if (params.kd >= 1 << 18) return false;
-    if (params.iTermLimit > 1023) return false;
-    if (params.dutyCycleLimit > 1023) return false;
+    if (!CheckSiCurrentLoopParams(params)) return false;
 
-    bool success = true;
-    success &= port->WriteQuadlet(BoardId,
-        ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 |
-        OFF_CURRENT_KP, params.kp);
-    success &= port->WriteQuadlet(BoardId,
-        ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 |
-        OFF_CURRENT_KI, params.ki);
-    success &= port->WriteQuadlet(BoardId,
-        ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 |
-        OFF_CURRENT_KD, params.kd);
-    success &= port->WriteQuadlet(BoardId,
-        ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 |
-        OFF_CURRENT_FF_RESISTIVE, params.ff_resistive);
-    success &= port->WriteQuadlet(BoardId,
-        ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 |
-        OFF_CURRENT_I_TERM_LIMIT, params.iTermLimit);
-    success &= port->WriteQuadlet(BoardId,
-        ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 |
-        OFF_DUTY_CYCLE_LIMIT, params.dutyCycleLimit);
-    return success;
+    return WriteSiCurrentLoopMotor(port, BoardId, index, params);
 }
 
 bool AmpIO::ReadSiCurrentLoopParams(unsigned int index, SiCurrentLoopParams& params) const
@@ -2008,3 +2391,141 @@ int16_t AmpIO::ReadFault(unsigned int index) const
         port->ReadQuadlet(BoardId, ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4 | OFF_FAULT, read_data);
     return static_cast<int16_t>(read_data);
 }
+
+bool AmpIO::CheckSiCurrentLoopParams(const SiCurrentLoopParams &params)
+{
+    if (params.kp >= 1 << 18) return false;
+    if (params.ki >= 1 << 18) return false;
+    if (params.kd >= 1 << 18) return false;
+    if (params.iTermLimit > 1023) return false;
+    if (params.dutyCycleLimit > 1023) return false;
+    return true;
+}
+
+bool AmpIO::ReadSiCurrentLoopMotor(BasePort *port, unsigned char boardId, unsigned int index,
+                                   SiCurrentLoopParams &params, SiCurrentLoopState *state)
+{
+    // One quadlet read per register: the same parameters as ReadSiCurrentLoopParams, followed by
+    // the diagnostics (only if requested)
+    nodeaddr_t base = ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4;
+    const unsigned int NUM_PARAMS = 6;
+    const unsigned int offsets[] = { OFF_CURRENT_KP, OFF_CURRENT_KI, OFF_CURRENT_KD, OFF_CURRENT_FF_RESISTIVE,
+                                     OFF_CURRENT_I_TERM_LIMIT, OFF_DUTY_CYCLE_LIMIT,
+                                     OFF_MOTOR_CONTROL_MODE, OFF_DUTY_CYCLE, OFF_FAULT, OFF_CURRENT_I_TERM };
+    quadlet_t data[sizeof(offsets)/sizeof(offsets[0])];
+    unsigned int numRead = state ? sizeof(offsets)/sizeof(offsets[0]) : NUM_PARAMS;
+    for (unsigned int i = 0; i < numRead; i++) {
+        if (!port->ReadQuadlet(boardId, base | offsets[i], data[i]))
+            return false;
+    }
+    params.kp = data[0];
+    params.ki = data[1];
+    params.kd = data[2];
+    params.ff_resistive = data[3];
+    params.iTermLimit = static_cast<uint16_t>(data[4]);
+    params.dutyCycleLimit = static_cast<uint16_t>(data[5]);
+    if (state) {
+        state->controlMode = static_cast<uint16_t>(data[6]);
+        state->dutyCycle = static_cast<int16_t>(data[7]);
+        state->fault = static_cast<int16_t>(data[8]);
+        state->iTerm = static_cast<int16_t>(data[9]);
+    }
+    return true;
+}
+
+bool AmpIO::WriteSiCurrentLoopMotor(BasePort *port, unsigned char boardId, unsigned int index,
+                                    const SiCurrentLoopParams &params)
+{
+    nodeaddr_t base = ADDR_MOTOR_CONTROL << 12 | (index + 1) << 4;
+    bool success = true;
+    success &= port->WriteQuadlet(boardId, base | OFF_CURRENT_KP, params.kp);
+    success &= port->WriteQuadlet(boardId, base | OFF_CURRENT_KI, params.ki);
+    success &= port->WriteQuadlet(boardId, base | OFF_CURRENT_KD, params.kd);
+    success &= port->WriteQuadlet(boardId, base | OFF_CURRENT_FF_RESISTIVE, params.ff_resistive);
+    success &= port->WriteQuadlet(boardId, base | OFF_CURRENT_I_TERM_LIMIT, params.iTermLimit);
+    success &= port->WriteQuadlet(boardId, base | OFF_DUTY_CYCLE_LIMIT, params.dutyCycleLimit);
+    return success;
+}
+
+bool AmpIO::WriteSiCurrentLoopAll(const SiCurrentLoopParams *params) const
+{
+    if (!port) return false;
+    if (GetFirmwareVersion() < 7) return false;
+    if (GetHardwareVersion() != dRA1_String) {
+        std::cerr << "AmpIO::WriteSiCurrentLoopAll not implemented for " << GetHardwareVersion() << std::endl;
+        return false;
+    }
+    unsigned int index;
+    for (index = 0; index < NumMotors; index++) {
+        if (!CheckSiCurrentLoopParams(params[index])) return false;
+    }
+    bool success = true;
+    for (index = 0; index < NumMotors; index++)
+        success &= WriteSiCurrentLoopMotor(port, BoardId, index, params[index]);
+    return success;
+}
+
+bool AmpIO::ReadSiCurrentLoopAll(SiCurrentLoopParams *params, SiCurrentLoopState *state) const
+{
+    if (!port) return false;
+    if (GetFirmwareVersion() < 7) return false;
+    if (GetHardwareVersion() != dRA1_String) {
+        std::cerr << "AmpIO::ReadSiCurrentLoopAll not implemented for " << GetHardwareVersion() << std::endl;
+        return false;
+    }
+    bool success = true;
+    for (unsigned int index = 0; index < NumMotors; index++)
+        success &= ReadSiCurrentLoopMotor(port, BoardId, index, params[index], state ? state+index : 0);
+    return success;
+}
+
+unsigned int AmpIO::ReadSiCurrentLoopPort(BasePort *port, std::vector<SiCurrentLoopBoard> &boards,
+                                          bool readState)
+{
+    boards.clear();
+    if (!port) return 0;
+    unsigned int numOK = 0;
+    for (unsigned int bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+        if ((port->GetHardwareVersion(bd) != dRA1_String) || (port->GetFirmwareVersion(bd) < 7))
+            continue;
+        boards.push_back(SiCurrentLoopBoard());
+        SiCurrentLoopBoard &cur = boards.back();
+        cur.boardId = static_cast<unsigned char>(bd);
+        cur.ok = true;
+        for (unsigned int index = 0; index < SI_NUM_MOTORS; index++)
+            cur.ok &= ReadSiCurrentLoopMotor(port, cur.boardId, index, cur.params[index],
+                                             readState ? &cur.state[index] : 0);
+        if (cur.ok)
+            numOK++;
+    }
+    return numOK;
+}
+
+bool AmpIO::WriteSiCurrentLoopPort(BasePort *port, const std::vector<SiCurrentLoopBoard> &boards)
+{
+    if (!port) return false;
+    size_t i;
+    unsigned int index;
+    // Check all parameters first, so that either all boards or none are written
+    for (i = 0; i < boards.size(); i++) {
+        if ((port->GetHardwareVersion(boards[i].boardId) != dRA1_String) ||
+            (port->GetFirmwareVersion(boards[i].boardId) < 7)) {
+            std::cerr << "AmpIO::WriteSiCurrentLoopPort: board " << static_cast<unsigned int>(boards[i].boardId)
+                      << " is not a dRA1 board" << std::endl;
+            return false;
+        }
+        for (index = 0; index < SI_NUM_MOTORS; index++) {
+            if (!CheckSiCurrentLoopParams(boards[i].params[index])) {
+                std::cerr << "AmpIO::WriteSiCurrentLoopPort: board " << static_cast<unsigned int>(boards[i].boardId)
+                          << ", motor " << index << ": parameter out of range" << std::endl;
+                return false;
+            }
+        }
+    }
+    bool success = true;
+    for (i = 0; i < boards.size(); i++) {
+        for (index = 0; index < SI_NUM_MOTORS; index++)
+            success &= WriteSiCurrentLoopMotor(port, boards[i].boardId, index, boards[i].params[index]);
+    }
+    return success;
+}
@@ -0,0 +1,221 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "AsyncLog.h"
+#include "Amp1394Time.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+AsyncLog::AsyncLog(std::ostream &ostr, unsigned int ringSize) : syncStream(ostr), asyncStream(0),
+    NumSites(0), Head(0), Tail(0), NumDropped(0), Running(false), StopRequest(false), ThreadHandle(0)
+{
+    Size = 16;
+    while ((Size < ringSize) && (Size < 0x10000))
+        Size <<= 1;
+    Mask = Size-1;
+    Ring = new LogRecord[Size];
+}
+
+AsyncLog::~AsyncLog()
+{
+    Stop();
+    Flush();
+    delete [] Ring;
+}
+
+unsigned int AsyncLog::AddSite(const char *format, double minInterval)
+{
+    if (NumSites >= MAX_SITES)
+        return MAX_SITES;
+    LogSite &site = Sites[NumSites];
+    site.format = format;
+    site.minInterval = minInterval;
+    site.lastTime = -1.0e10;
+    site.numSuppressed = 0;
+    site.numReported = 0;
+    site.lastReportTime = -1.0e10;
+    // Make sure the site is complete before it is visible to the background thread
+    AMP1394_MEMORY_BARRIER();
+    return NumSites++;
+}
+
+void AsyncLog::Log(unsigned int site, long arg0, long arg1, long arg2, long arg3)
+{
+    if (site >= NumSites)
+        return;
+    LogSite &logSite = Sites[site];
+    double now = Amp1394_GetMonotonicTime();
+    if (now-logSite.lastTime < logSite.minInterval) {
+        logSite.numSuppressed = logSite.numSuppressed+1;
+        return;
+    }
+    logSite.lastTime = now;
+
+    LogRecord rec;
+    rec.time = now;
+    rec.site = site;
+    rec.numSuppressed = logSite.numSuppressed;
+    rec.args[0] = arg0;
+    rec.args[1] = arg1;
+    rec.args[2] = arg2;
+    rec.args[3] = arg3;
+
+    if (Running) {
+        uint32_t h = Head;
+        if (h-Tail >= Size) {
+            NumDropped = NumDropped+1;
+            return;
+        }
+        Ring[h&Mask] = rec;
+        AMP1394_MEMORY_BARRIER();
+        Head = h+1;
+    }
+    else {
+        WriteRecord(syncStream, rec);
+        syncStream.flush();
+    }
+}
+
+void AsyncLog::WriteRecord(std::ostream &outStr, const LogRecord &rec)
+{
+    LogSite &logSite = Sites[rec.site];
+    char buf[FORMAT_SIZE];
+    snprintf(buf, sizeof(buf), logSite.format, rec.args[0], rec.args[1], rec.args[2], rec.args[3]);
+    outStr << buf;
+    uint32_t numNew = rec.numSuppressed-logSite.numReported;
+    if (numNew > 0)
+        outStr << " (" << numNew << " similar messages suppressed)";
+    outStr << "\n";
+    logSite.numReported = rec.numSuppressed;
+    logSite.lastReportTime = rec.time;
+}
+
+void AsyncLog::WriteSummaries(std::ostream &outStr, double now, bool force)
+{
+    for (unsigned int i = 0; i < NumSites; i++) {
+        LogSite &logSite = Sites[i];
+        uint32_t numSuppressed = logSite.numSuppressed;
+        if ((numSuppressed != logSite.numReported) &&
+            (force || (now-logSite.lastReportTime >= logSite.minInterval))) {
+            // Print the format up to the first argument
+            const char *argStart = strchr(logSite.format, '%');
+            if (argStart)
+                outStr.write(logSite.format, argStart-logSite.format) << "...";
+            else
+                outStr << logSite.format;
+            outStr << " (" << (numSuppressed-logSite.numReported) << " similar messages suppressed)\n";
+            logSite.numReported = numSuppressed;
+            logSite.lastReportTime = now;
+        }
+    }
+}
+
+void AsyncLog::Flush(void)
+{
+    if (Running)
+        return;   // done by background thread
+    WriteSummaries(syncStream, Amp1394_GetMonotonicTime(), true);
+    syncStream.flush();
+}
+
+void AsyncLog::Run(void)
+{
+    bool done = false;
+    while (!done) {
+        // Check before writing, so that all messages logged before Stop are written
+        done = StopRequest;
+        bool anyWritten = false;
+        while (Tail != Head) {
+            AMP1394_MEMORY_BARRIER();
+            LogRecord rec = Ring[Tail&Mask];
+            AMP1394_MEMORY_BARRIER();
+            Tail = Tail+1;
+            WriteRecord(*asyncStream, rec);
+            anyWritten = true;
+        }
+        WriteSummaries(*asyncStream, Amp1394_GetMonotonicTime(), done);
+        if (anyWritten || done)
+            asyncStream->flush();
+        if (!done)
+            Amp1394_Sleep(0.01);
+    }
+}
+
+#ifdef _WIN32
+unsigned long __stdcall AsyncLog::ThreadEntry(void *arg)
+{
+    static_cast<AsyncLog *>(arg)->Run();
+    return 0;
+}
+#else
+void *AsyncLog::ThreadEntry(void *arg)
+{
+    static_cast<AsyncLog *>(arg)->Run();
+    return 0;
+}
+#endif
+
+bool AsyncLog::Start(std::ostream &logStream)
+{
+    if (Running)
+        return true;
+    asyncStream = &logStream;
+    StopRequest = false;
+    // Set Running before creating the thread, so that all messages after Start are queued
+    Running = true;
+#ifdef _WIN32
+    HANDLE handle = CreateThread(0, 0, ThreadEntry, this, 0, 0);
+    if (handle == 0) {
+        Running = false;
+        syncStream << "AsyncLog::Start: failed to create thread" << std::endl;
+        return false;
+    }
+    ThreadHandle = handle;
+#else
+    pthread_t *thread = new pthread_t;
+    if (pthread_create(thread, 0, ThreadEntry, this) != 0) {
+        delete thread;
+        Running = false;
+        syncStream << "AsyncLog::Start: failed to create thread" << std::endl;
+        return false;
+    }
+    ThreadHandle = thread;
+#endif
+    return true;
+}
+
+void AsyncLog::Stop(void)
+{
+    if (!Running)
+        return;
+    StopRequest = true;
+#ifdef _WIN32
+    HANDLE handle = static_cast<HANDLE>(ThreadHandle);
+    WaitForSingleObject(handle, INFINITE);
+    CloseHandle(handle);
+#else
+    pthread_t *thread = static_cast<pthread_t *>(ThreadHandle);
+    pthread_join(*thread, 0);
+    delete thread;
+#endif
+    ThreadHandle = 0;
+    Running = false;
+}
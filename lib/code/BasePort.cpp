@@ -17,6 +17,7 @@ http://www.cisst.org/cisst/license.txt.
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <stdio.h>
 #include <string>
 #include <algorithm>   // for std::max
@@ -26,11 +27,80 @@ http://www.cisst.org/cisst/license.txt.
 #include "BasePort.h"
 #include "Amp1394Time.h"
 #include "Amp1394BSwap.h"
+#include "Amp1394Probes.h"
 
 // Starting with C++11, can initialize using an initializer list.
 // Currently, the supported hardware (e.g., QLA1) is added in the BasePort constructor.
 std::vector<unsigned long> BasePort::SupportedHardware;
 
+bool BasePort::GetReadHostTimes(unsigned char boardId, double &sendTime, double &recvTime) const
+{
+    if (boardId >= BoardIO::MAX_BOARDS)
+        return false;
+    sendTime = ReadHostSendTime[boardId];
+    recvTime = ReadHostRecvTime[boardId];
+    return true;
+}
+
+void BasePort::SetLatencyReference(LatencyReference ref)
+{
+    LatencyRef = ref;
+    if (LatencyRef == LATENCY_NONE) {
+        for (unsigned int board = 0; board < BoardIO::MAX_BOARDS; board++) {
+            if (BoardList[board])
+                BoardList[board]->extrapTime = 0.0;
+        }
+    }
+}
+
+void BasePort::SetLatencyReferenceTime(double hostTime)
+{
+    if (LatencyRef != LATENCY_HOST)
+        return;
+    UpdateExtrapolationTimes((hostTime < 0.0) ? Amp1394_GetMonotonicTime() : hostTime);
+}
+
+void BasePort::UpdateExtrapolationTimes(double refHostTime)
+{
+    for (unsigned int board = 0; board < BoardIO::MAX_BOARDS; board++) {
+        if (BoardList[board])
+            BoardList[board]->extrapTime = BoardList[board]->ValidRead() ? (refHostTime - ReadSampleHostTime[board]) : 0.0;
+    }
+}
+
+void BasePort::SetPhaseTiming(bool enable)
+{
+    PhaseTimingEnabled = enable;
+    ResetPhaseTimes();
+}
+
+void BasePort::ResetPhaseTimes(void)
+{
+    for (unsigned int i = 0; i < PHASE_NUM; i++)
+        PhaseTime[i] = 0.0;
+    PhaseMark = Amp1394_GetMonotonicTime();
+}
+
+double BasePort::GetPhaseTime(TimingPhase phase) const
+{
+    return (phase < PHASE_NUM) ? PhaseTime[phase] : 0.0;
+}
+
+void BasePort::PhaseStart(void)
+{
+    if (PhaseTimingEnabled)
+        PhaseMark = Amp1394_GetMonotonicTime();
+}
+
+void BasePort::PhaseEnd(TimingPhase phase)
+{
+    if (PhaseTimingEnabled) {
+        double t = Amp1394_GetMonotonicTime();
+        PhaseTime[phase] += t-PhaseMark;
+        PhaseMark = t;
+    }
+}
+
 void BasePort::BroadcastReadInfo::PrintTiming(std::ostream &outStr, bool newLine) const
 {
     outStr << "Updates (usec): ";
@@ -55,7 +125,7 @@ BasePort::BasePort(int portNum, std::ostream &ostr):
         IsAllBoardsRev6_(false),
         IsAllBoardsRev7_(false),
         IsAllBoardsRev8_(false),
-        ReadErrorCounter_(0),
+        ErrorLog(ostr),
         PortNum(portNum),
         FwBusGeneration(0),
         newFwBusGeneration(0),
@@ -73,7 +143,21 @@ BasePort::BasePort(int portNum, std::ostream &ostr):
         FpgaVersion[i] = 0;
         HardwareVersion[i] = 0;
         Board2Node[i] = MAX_NODES;
+        ReadHostSendTime[i] = 0.0;
+        ReadHostRecvTime[i] = 0.0;
+        ReadSampleHostTime[i] = 0.0;
+        BoardHist[i] = 0;
     }
+    ReadRequestHostTime = 0.0;
+    LatencyRef = LATENCY_NONE;
+    PhaseTimingEnabled = false;
+    for (i = 0; i < PHASE_NUM; i++)
+        PhaseTime[i] = 0.0;
+    PhaseMark = 0.0;
+    CycleStartTime = 0.0;
+    BackgroundBoard = 0;
+    Side = 0;
+    Telemetry = 0;
     ReadBufferBroadcast = 0;
     WriteBufferBroadcast = 0;
     GenericBuffer = 0;
@@ -85,10 +169,21 @@ BasePort::BasePort(int portNum, std::ostream &ostr):
     BasePort::AddHardwareVersion(DQLA_String);
     BasePort::AddHardwareVersion(BCFG_String);
     BasePort::AddHardwareVersion(0x54455354); // "TEST"
+
+    LogReadFailed = ErrorLog.AddSite("BasePort::ReadAllBoards: read failed on port %ld, board %ld");
+    LogBcInvalidStatus = ErrorLog.AddSite("BasePort::ReadAllBoardsBroadcast: invalid status (not a 4 axis board): %lx");
+    LogBcBoardMismatch = ErrorLog.AddSite("BasePort::ReadAllBoardsBroadcast: board mismatch, expecting %ld, found %ld");
+    LogBcBlockSize = ErrorLog.AddSite("BasePort::ReadAllBoardsBroadcast: board %ld, blockSize = %ld, expected = %ld");
+    LogBcSequence = ErrorLog.AddSite("BasePort::ReadAllBoardsBroadcast: board %ld, seq = %ld, expected = %ld, diff = %ld");
+    LogBcHubSize = ErrorLog.AddSite("BasePort::ReadAllBoardsBroadcast: hub read size %ld too large (max = %ld bytes)");
 }
 
 BasePort::~BasePort()
 {
+    delete Side;
+    for (size_t i = 0; i < BoardIO::MAX_BOARDS; i++)
+        delete BoardHist[i];
+    delete Telemetry;
     delete [] ReadBufferBroadcast;
     delete [] WriteBufferBroadcast;
     delete [] GenericBuffer;
@@ -374,6 +469,8 @@ bool BasePort::AddBoard(BoardIO *board)
     BoardList[id] = board;
     board->port = this;
     board->InitBoard();
+    if (!BoardHist[id])
+        BoardHist[id] = new BoardHistograms;
 
     // Make sure read/write buffers are allocated
     SetReadBufferBroadcast();
@@ -426,6 +523,10 @@ std::string BasePort::PortTypeString(PortType portType)
         return std::string("Ethernet-Raw");
     else if (portType == PORT_ETH_UDP)
         return std::string("Ethernet-UDP");
+    else if (portType == PORT_ETH_LOOPBACK)
+        return std::string("Ethernet-Loopback");
+    else if (portType == PORT_REPLAY)
+        return std::string("Replay");
     else
         return std::string("Unknown");
 }
@@ -437,6 +538,8 @@ std::string BasePort::PortTypeString(PortType portType)
 // fw:N             for FireWire, where N is the port number
 // eth:N            for raw Ethernet (PCAP), where N is the port number
 // udp:xx.xx.xx.xx  for UDP, where xx.xx.xx.xx is the (optional) server IP address
+// loop:N           for the loopback (emulated) port, where N is the number of boards
+// replay:file      for the replay port, where file is the telemetry recording (returned in IPaddr)
 bool BasePort::ParseOptions(const char *arg, PortType &portType, int &portNum, std::string &IPaddr,
                             std::ostream &ostr)
 {
@@ -489,6 +592,27 @@ bool BasePort::ParseOptions(const char *arg, PortType &portType, int &portNum, s
             sscanf(arg+4, "%d", &portNum);  // TEMP: portNum==1 for UDP means set eth1394 mode
         return true;
     }
+    else if (strncmp(arg, "loop", 4) == 0) {
+        portType = PORT_ETH_LOOPBACK;
+        // no option specified: use one board
+        portNum = 1;
+        if (strlen(arg) == 4)
+            return true;
+        if (arg[4] != ':') {
+            ostr << "ParseOptions: missing \":\" after \"loop\"" << std::endl;
+            return false;
+        }
+        return (sscanf(arg+5, "%d", &portNum) == 1);
+    }
+    else if (strncmp(arg, "replay", 6) == 0) {
+        portType = PORT_REPLAY;
+        if ((arg[6] != ':') || (strlen(arg+7) == 0)) {
+            ostr << "ParseOptions: missing file name after \"replay:\"" << std::endl;
+            return false;
+        }
+        IPaddr.assign(arg+7);
+        return true;
+    }
     // older default, fw and looking for port number
     portType = PORT_FIREWIRE;
     // scan port number
@@ -608,6 +732,7 @@ bool BasePort::CheckFwBusGeneration(const std::string &caller, bool doScan)
 
 bool BasePort::ReScanNodes(const std::string &caller)
 {
+    AMP1394_PROBE2(rescan_nodes_entry, FwBusGeneration, newFwBusGeneration);
     unsigned int oldFwBusGeneration = FwBusGeneration;
     UpdateBusGeneration(newFwBusGeneration);
     bool ret = ScanNodes();
@@ -615,17 +740,40 @@ bool BasePort::ReScanNodes(const std::string &caller)
         outStr << caller << ": failed to rescan nodes" << std::endl;
         UpdateBusGeneration(oldFwBusGeneration);
     }
+    AMP1394_PROBE1(rescan_nodes_return, ret);
     return ret;
 }
 
+SideChannel *BasePort::GetRoutedSide(void) const
+{
+    SideChannel *side = Side;
+    AMP1394_MEMORY_BARRIER();
+    return (side && side->IsRouted()) ? side : 0;
+}
+
 bool BasePort::ReadQuadlet(unsigned char boardId, nodeaddr_t addr, quadlet_t &data)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetReadQuadlet(boardId, addr);
+        bool ret = side->Transact(req);
+        if (ret)
+            data = req.GetQuadlet();
+        return ret;
+    }
     nodeid_t node = ConvertBoardToNode(boardId);
     return (node < MAX_NODES) ? ReadQuadletNode(node, addr, data, boardId&FW_NODE_MASK) : false;
 }
 
 bool BasePort::WriteQuadlet(unsigned char boardId, nodeaddr_t addr, quadlet_t data)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetWriteQuadlet(boardId, addr, data);
+        return side->Transact(req);
+    }
     nodeid_t node = ConvertBoardToNode(boardId);
     return (node < MAX_NODES) ? WriteQuadletNode(node, addr, data, boardId&FW_NODE_FLAGS_MASK) : false;
 }
@@ -633,6 +781,12 @@ bool BasePort::WriteQuadlet(unsigned char boardId, nodeaddr_t addr, quadlet_t da
 bool BasePort::ReadBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *rdata,
                              unsigned int nbytes)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetReadBlock(boardId, addr, rdata, nbytes);
+        return side->Transact(req);
+    }
     if (nbytes == 4)
         return ReadQuadlet(boardId, addr, *rdata);
     else if ((nbytes == 0) || ((nbytes%4) != 0)) {
@@ -652,6 +806,12 @@ bool BasePort::ReadBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *rdat
 bool BasePort::WriteBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *wdata,
                               unsigned int nbytes)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetWriteBlock(boardId, addr, wdata, nbytes);
+        return side->Transact(req);
+    }
     if (nbytes == 4) {
         return WriteQuadlet(boardId, addr, *wdata);
     }
@@ -671,19 +831,35 @@ bool BasePort::WriteBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *wda
 
 bool BasePort::ReadAllBoards(void)
 {
+    AMP1394_PROBE2(read_all_boards_entry, Protocol_, NumOfBoards_);
     if (!IsOK()) {
         outStr << "BasePort::ReadAllBoards: port not initialized" << std::endl;
         OnNoneRead();
+        AMP1394_PROBE1(read_all_boards_return, false);
         return false;
     }
 
+    if (Side)
+        Side->SetIOThread();
+    double startTime = Amp1394_GetMonotonicTime();
+    CycleStartTime = startTime;
+    if (Telemetry)
+        Telemetry->BeginRead(startTime, Protocol_);
+
     if (Protocol_ == BasePort::PROTOCOL_BC_QRW) {
-        return ReadAllBoardsBroadcast();
+        bool ret = ReadAllBoardsBroadcast();
+        double endTime = Amp1394_GetMonotonicTime();
+        LatencyHist[HIST_READ].Record(endTime-startTime);
+        if (Telemetry)
+            TelemetryEndRead(endTime, ret);
+        AMP1394_PROBE1(read_all_boards_return, ret);
+        return ret;
     }
 
     if (!CheckFwBusGeneration("ReadAllBoards", autoReScan)) {
         SetReadInvalid();
         OnNoneRead();
+        AMP1394_PROBE1(read_all_boards_return, false);
         return false;
     }
 
@@ -691,61 +867,77 @@ bool BasePort::ReadAllBoards(void)
     bool noneRead = true;
 
     bool rtRead = true;
+    bool firstRequest = true;
     for (unsigned int board = 0; board < max_board; board++) {
         if (BoardList[board]) {
             quadlet_t *readBuffer = reinterpret_cast<quadlet_t *>(ReadBufferBroadcast + GetReadQuadAlign() + GetPrefixOffset(RD_FW_BDATA));
+            AMP1394_PROBE2(board_read_entry, board, BoardList[board]->GetReadNumBytes());
+            ReadHostSendTime[board] = Amp1394_GetMonotonicTime();
             bool ret = ReadBlock(board, 0, readBuffer, BoardList[board]->GetReadNumBytes());
+            ReadHostRecvTime[board] = Amp1394_GetMonotonicTime();
+            AMP1394_PROBE2(board_read_return, board, ret);
+            BoardHist[board]->read.Record(ReadHostRecvTime[board]-ReadHostSendTime[board]);
+            ReadSampleHostTime[board] = (ReadHostSendTime[board] + ReadHostRecvTime[board])/2.0;
+            if (firstRequest) {
+                ReadRequestHostTime = ReadHostSendTime[board];
+                firstRequest = false;
+            }
             if (ret) {
+                RecordFpgaResponseTimes(BoardHist[board]->fpga[FPGA_ETH_RECV], BoardHist[board]->fpga[FPGA_ETH_TOTAL]);
+                if (Telemetry)
+                    Telemetry->AddReadData(board, readBuffer, BoardList[board]->GetReadNumBytes());
+                PhaseStart();
                 BoardList[board]->SetReadData(readBuffer);
+                PhaseEnd(PHASE_DECODE);
                 noneRead = false;
             } else {
                 allOK = false;
             }
             BoardList[board]->SetReadValid(ret);
-
-            if (ret) {
-                ReadErrorCounter_ = 0;
-            }
-            else {
-                if (ReadErrorCounter_ == 0) {
-                    outStr << "BasePort::ReadAllBoards: read failed on port "
-                           << PortNum << ", board " << board << std::endl;
-                }
-                ReadErrorCounter_++;
-                if (ReadErrorCounter_ == 10000) {
-                    outStr << "BasePort::ReadAllBoards: read failed on port "
-                           << PortNum << ", board " << board << " occurred 10,000 times" << std::endl;
-                    ReadErrorCounter_ = 0;
-                }
-            }
+            if (!ret)
+                ErrorLog.Log(LogReadFailed, PortNum, board);
         }
     }
     if (!rtRead)
         outStr << "BasePort::ReadAllBoards: rtRead is false" << std::endl;
 
+    if (LatencyRef == LATENCY_QUERY)
+        UpdateExtrapolationTimes(ReadRequestHostTime);
+    else if (LatencyRef == LATENCY_HOST)
+        UpdateExtrapolationTimes(Amp1394_GetMonotonicTime());
+
     if (noneRead) {
         OnNoneRead();
     }
+    double endTime = Amp1394_GetMonotonicTime();
+    LatencyHist[HIST_READ].Record(endTime-startTime);
+    if (Telemetry)
+        TelemetryEndRead(endTime, allOK);
+    AMP1394_PROBE1(read_all_boards_return, allOK);
     return allOK;
 }
 
 bool BasePort::ReadAllBoardsBroadcast(void)
 {
+    AMP1394_PROBE1(read_all_boards_bc_entry, NumOfBoards_);
     if (!IsOK()) {
         outStr << "BasePort::ReadAllBoardsBroadcast: port not initialized" << std::endl;
         OnNoneRead();
+        AMP1394_PROBE2(read_all_boards_bc_return, false, bcReadInfo.readSequence);
         return false;
     }
 
     if (!IsBroadcastFirmwareMixValid()) {
         outStr << "BasePort::ReadAllBoardsBroadcast: invalid mix of firmware" << std::endl;
         OnNoneRead();
+        AMP1394_PROBE2(read_all_boards_bc_return, false, bcReadInfo.readSequence);
         return false;
     }
 
     if (!CheckFwBusGeneration("ReadAllBoardsBroadcast", autoReScan)) {
         SetReadInvalid();
         OnNoneRead();
+        AMP1394_PROBE2(read_all_boards_bc_return, false, bcReadInfo.readSequence);
         return false;
     }
 
@@ -761,15 +953,21 @@ bool BasePort::ReadAllBoardsBroadcast(void)
         bcReadInfo.readSequence = 1;
     }
 
+    double querySendTime = Amp1394_GetMonotonicTime();
     if (!WriteBroadcastReadRequest(bcReadInfo.readSequence)) {
         outStr << "BasePort::ReadAllBoardsBroadcast: failed to send broadcast read request, seq = "
                << bcReadInfo.readSequence << std::endl;
         OnNoneRead();
+        AMP1394_PROBE2(read_all_boards_bc_return, false, bcReadInfo.readSequence);
         return false;
     }
 
     // Wait for broadcast read data
+    PhaseStart();
+    AMP1394_PROBE1(wait_bc_read_entry, NumOfBoards_);
     WaitBroadcastRead();
+    AMP1394_PROBE0(wait_bc_read_return);
+    PhaseEnd(PHASE_WAIT);
 
     unsigned int readSize;        // Block size per board (depends on firmware version)
     if (IsAllBoardsRev4_6_)
@@ -789,14 +987,28 @@ bool BasePort::ReadAllBoardsBroadcast(void)
     else
         hubReadSize = (GetBroadcastReadSize()/sizeof(quadlet_t))+1; // Rev 8 (could call this once and save result)
 
+    // Check size before clearing the buffer (ReadBufferBroadcast is sized for GetMaxReadDataSize)
+    if (hubReadSize*sizeof(quadlet_t) > GetMaxReadDataSize()) {
+        ErrorLog.Log(LogBcHubSize, hubReadSize*sizeof(quadlet_t), GetMaxReadDataSize());
+        SetReadInvalid();
+        OnNoneRead();
+        AMP1394_PROBE2(read_all_boards_bc_return, false, bcReadInfo.readSequence);
+        return false;
+    }
+
     quadlet_t *hubReadBuffer = reinterpret_cast<quadlet_t *>(ReadBufferBroadcast + GetReadQuadAlign() + GetPrefixOffset(RD_FW_BDATA));
     memset(hubReadBuffer, 0, hubReadSize*sizeof(quadlet_t));
     bool ret = ReadBlock(HubBoard, 0x1000, hubReadBuffer, hubReadSize*sizeof(quadlet_t));
+    double hubRecvTime = Amp1394_GetMonotonicTime();
     if (!ret) {
         SetReadInvalid();
         OnNoneRead();
+        AMP1394_PROBE2(read_all_boards_bc_return, false, bcReadInfo.readSequence);
         return false;
     }
+    RecordFpgaResponseTimes(FpgaHubHist[HUB_ETH_RECV], FpgaHubHist[HUB_ETH_TOTAL]);
+    if (Telemetry)
+        Telemetry->SetHubReadData(hubReadBuffer, hubReadSize*sizeof(quadlet_t));
 
     double clkPeriod = 0.0;  // will be assigned below
     quadlet_t *curPtr = hubReadBuffer;
@@ -810,12 +1022,10 @@ bool BasePort::ReadAllBoardsBroadcast(void)
             unsigned int thisBoard = (statusQuad&0x0f000000)>>24;
             bool thisOK = false;
             if (!IsAllBoardsRev8_ && (numAxes != 4)) {
-                outStr << "BasePort::ReadAllBoardsBroadcast: invalid status (not a 4 axis board): " << std::hex << statusQuad
-                       << std::dec << std::endl;
+                ErrorLog.Log(LogBcInvalidStatus, statusQuad);
             }
             else if (boardNum != thisBoard) {
-                outStr << "BasePort::ReadAllBoardsBroadcast: board mismatch, expecting "
-                       << boardNum << ", found " << thisBoard << std::endl;
+                ErrorLog.Log(LogBcBoardMismatch, boardNum, thisBoard);
             }
             else {
                 bcReadInfo.boardInfo[boardNum].sequence = bswap_32(curPtr[0]) >> 16;
@@ -829,9 +1039,7 @@ bool BasePort::ReadAllBoardsBroadcast(void)
                     bcReadInfo.boardInfo[boardNum].blockSize = (bswap_32(curPtr[0]) & 0xff000000) >> 24;
                     unsigned int bdReadSize = board->GetReadNumBytes()/sizeof(quadlet_t) + 1;
                     if (bcReadInfo.boardInfo[boardNum].blockSize != bdReadSize) {
-                        outStr << "BasePort::ReadAllBoardsBroadcast: board " << boardNum
-                               << ", blockSize = " << bcReadInfo.boardInfo[boardNum].blockSize
-                               << ", expected = " << bdReadSize << std::endl;
+                        ErrorLog.Log(LogBcBlockSize, boardNum, bcReadInfo.boardInfo[boardNum].blockSize, bdReadSize);
                     }
                 }
                 else {
@@ -842,26 +1050,39 @@ bool BasePort::ReadAllBoardsBroadcast(void)
                     unsigned int quad0_lsb = bswap_32(curPtr[0])&0x0000ffff;
                     clkPeriod = board->GetFPGAClockPeriod();
                     bcReadInfo.boardInfo[boardNum].updateTime = (quad0_lsb&0x3fff)*clkPeriod;
+                    if (BoardHist[boardNum])
+                        BoardHist[boardNum]->fpga[FPGA_UPDATE].Record(bcReadInfo.boardInfo[boardNum].updateTime);
                 }
                 if (!bcReadInfo.boardInfo[boardNum].seq_error) {
                     thisOK = true;
                 }
                 else {
-                    outStr << "BasePort::ReadAllBoardsBroadcast: board " << boardNum
-                           << ", seq = " << bcReadInfo.boardInfo[boardNum].sequence
-                           << ", expected = " << bcReadInfo.readSequence
-                           << ", diff = " << (bcReadInfo.readSequence-bcReadInfo.boardInfo[boardNum].sequence)
-                           << std::endl;
+                    AMP1394_PROBE3(seq_error, boardNum, bcReadInfo.boardInfo[boardNum].sequence, bcReadInfo.readSequence);
+                    ErrorLog.Log(LogBcSequence, boardNum, bcReadInfo.boardInfo[boardNum].sequence,
+                                 bcReadInfo.readSequence,
+                                 static_cast<long>(bcReadInfo.readSequence-bcReadInfo.boardInfo[boardNum].sequence));
                 }
             }
             board->SetReadValid(thisOK);
+            ReadHostSendTime[boardNum] = querySendTime;
+            ReadHostRecvTime[boardNum] = hubRecvTime;
+            // With Firmware V7+, the board update time is measured relative to the query
+            if (IsAllBoardsRev7_ || IsAllBoardsRev8_)
+                ReadSampleHostTime[boardNum] = querySendTime + bcReadInfo.boardInfo[boardNum].updateTime;
+            else
+                ReadSampleHostTime[boardNum] = (querySendTime + hubRecvTime)/2.0;
             if (thisOK) {
+                PhaseStart();
                 board->SetReadData(curPtr+1);
+                PhaseEnd(PHASE_DECODE);
                 noneRead = false;
             }
             else {
                 allOK = false;
             }
+            if (Telemetry)
+                Telemetry->SetBoardReadOffset(boardNum, static_cast<unsigned int>(curPtr+1-hubReadBuffer),
+                                              board->GetReadNumBytes()/sizeof(quadlet_t));
             curPtr += bcReadInfo.boardInfo[boardNum].blockSize;
         }
         else if (IsAllBoardsRev4_6_) {
@@ -874,6 +1095,8 @@ bool BasePort::ReadAllBoardsBroadcast(void)
         quadlet_t timingInfo = bswap_32(curPtr[0]);
         bcReadInfo.readStartTime = ((timingInfo&0x3fff0000) >> 16)*clkPeriod;
         bcReadInfo.readFinishTime = (timingInfo&0x00003fff)*clkPeriod;
+        FpgaHubHist[HUB_READ_START].Record(bcReadInfo.readStartTime);
+        FpgaHubHist[HUB_READ_FINISH].Record(bcReadInfo.readFinishTime);
     }
 
     if (noneRead) {
@@ -882,29 +1105,53 @@ bool BasePort::ReadAllBoardsBroadcast(void)
     if (!rtRead)
         outStr << "BasePort::ReadAllBoardsBroadcast: rtRead is false" << std::endl;
 
+    ReadRequestHostTime = querySendTime;
+    if (LatencyRef == LATENCY_QUERY)
+        UpdateExtrapolationTimes(ReadRequestHostTime);
+    else if (LatencyRef == LATENCY_HOST)
+        UpdateExtrapolationTimes(Amp1394_GetMonotonicTime());
+
 #if 0
     if (IsAllBoardsRev7_ || IsAllBoardsRev8_) {
         bcReadInfo.PrintTiming(outStr);
     }
 #endif
 
+    AMP1394_PROBE2(read_all_boards_bc_return, allOK, bcReadInfo.readSequence);
     return allOK;
 }
 
 bool BasePort::WriteAllBoards(void)
 {
+    AMP1394_PROBE2(write_all_boards_entry, Protocol_, NumOfBoards_);
     if (!IsOK()) {
         outStr << "BasePort::WriteAllBoards: port not initialized" << std::endl;
         OnNoneWritten();
+        AMP1394_PROBE1(write_all_boards_return, false);
         return false;
     }
 
+    if (Side)
+        Side->SetIOThread();
+    double startTime = Amp1394_GetMonotonicTime();
+    if (Telemetry)
+        Telemetry->BeginWrite(startTime, Protocol_);
+
     if ((Protocol_ == BasePort::PROTOCOL_SEQ_R_BC_W) || (Protocol_ == BasePort::PROTOCOL_BC_QRW)) {
-        return WriteAllBoardsBroadcast();
+        bool ret = WriteAllBoardsBroadcast();
+        RecordWriteLatency(startTime);
+        if (Telemetry)
+            TelemetryEndWrite(Amp1394_GetMonotonicTime(), ret);
+        BackgroundStep();
+        if (Side && Side->IsEnabled())
+            ProcessSideRequests();
+        AMP1394_PROBE1(write_all_boards_return, ret);
+        return ret;
     }
 
     if (!CheckFwBusGeneration("WriteAllBoards", autoReScan)) {
         OnNoneWritten();
+        AMP1394_PROBE1(write_all_boards_return, false);
         return false;
     }
 
@@ -920,6 +1167,8 @@ bool BasePort::WriteAllBoards(void)
                 // Rev 1-6 firmware: the last quadlet (Status/Control register)
                 // is done as a separate quadlet write.
                 BoardList[board]->GetWriteData(buf, 0, numQuads-1);
+                if (Telemetry)
+                    Telemetry->AddWriteData(board, buf, numBytes-sizeof(quadlet_t));
                 bool noneWrittenThisBoard = true;
                 bool ret = WriteBlock(board, 0, buf, numBytes-sizeof(quadlet_t));
                 if (ret) { noneWritten = false; noneWrittenThisBoard = false; }
@@ -946,6 +1195,8 @@ bool BasePort::WriteAllBoards(void)
             else {
                 // Rev 7 firmware: write DAC (x4) and Status/Control register
                 BoardList[board]->GetWriteData(buf, 0, numQuads);
+                if (Telemetry)
+                    Telemetry->AddWriteData(board, buf, numBytes);
                 bool ret = WriteBlock(board, 0, buf, numBytes);
                 BoardList[board]->SetWriteValid(ret);
                 // Initialize (clear) the write buffer
@@ -966,25 +1217,306 @@ bool BasePort::WriteAllBoards(void)
     }
     if (!rtWrite)
         outStr << "BasePort::WriteAllBoards: rtWrite is false" << std::endl;
+    RecordWriteLatency(startTime);
+    if (Telemetry)
+        TelemetryEndWrite(Amp1394_GetMonotonicTime(), allOK);
+    BackgroundStep();
+    if (Side && Side->IsEnabled())
+        ProcessSideRequests();
+    AMP1394_PROBE1(write_all_boards_return, allOK);
     return allOK;
 }
 
+void BasePort::RecordWriteLatency(double startTime)
+{
+    double now = Amp1394_GetMonotonicTime();
+    LatencyHist[HIST_WRITE].Record(now-startTime);
+    if (CycleStartTime > 0.0) {
+        LatencyHist[HIST_CYCLE].Record(now-CycleStartTime);
+        CycleStartTime = 0.0;
+    }
+}
+
+void BasePort::BackgroundStep(void)
+{
+    for (unsigned int i = 0; i < BoardIO::MAX_BOARDS; i++) {
+        unsigned int board = (BackgroundBoard+i)%BoardIO::MAX_BOARDS;
+        if (BoardList[board] && BoardList[board]->BackgroundStep()) {
+            BackgroundBoard = (board+1)%BoardIO::MAX_BOARDS;
+            break;
+        }
+    }
+}
+
+void BasePort::ProcessSideRequests(void)
+{
+    double startTime = Amp1394_GetMonotonicTime();
+    double elapsed = 0.0;
+    unsigned int num = 0;
+    unsigned int maxPerCycle;
+    double budget;
+    Side->GetLimits(maxPerCycle, budget);
+    // Always perform one request (if queued); perform more if they are expected to fit in the budget
+    while ((num == 0) || ((num < maxPerCycle) && (elapsed+Side->GetAverageTime() <= budget))) {
+        SideRequest *req = Side->Pop();
+        if (!req)
+            break;
+        double reqStart = Amp1394_GetMonotonicTime();
+        bool ok = false;
+        switch (req->ReqType) {
+            case SideRequest::QREAD:
+                ok = ReadQuadlet(req->BoardId, req->Addr, req->Quadlet);
+                break;
+            case SideRequest::QWRITE:
+                ok = WriteQuadlet(req->BoardId, req->Addr, req->Quadlet);
+                break;
+            case SideRequest::BREAD:
+                ok = ReadBlock(req->BoardId, req->Addr, req->Data, req->NumBytes);
+                break;
+            case SideRequest::BWRITE:
+                ok = WriteBlock(req->BoardId, req->Addr, req->Data, req->NumBytes);
+                break;
+            case SideRequest::BC_OUTPUT:
+                ok = WriteBroadcastOutput(req->Data, req->NumBytes);
+                break;
+            case SideRequest::BC_READ_REQUEST:
+                ok = WriteBroadcastReadRequest(req->Quadlet);
+                break;
+        }
+        double now = Amp1394_GetMonotonicTime();
+        Side->Complete(req, ok, now-reqStart);
+        elapsed = now-startTime;
+        num++;
+    }
+    if (elapsed > budget)
+        Side->CountOverBudget();
+}
+
+bool BasePort::EnableSideChannel(unsigned int maxPerCycle, double budgetSec, double timeoutSec)
+{
+    if (maxPerCycle == 0) {
+        outStr << "BasePort::EnableSideChannel: maxPerCycle must be at least 1" << std::endl;
+        return false;
+    }
+    if (Side) {
+        Side->Configure(maxPerCycle, budgetSec, timeoutSec);
+        Side->Enable(true);
+    }
+    else {
+        SideChannel *side = new SideChannel(maxPerCycle, budgetSec, timeoutSec);
+        // Make sure the side channel is initialized before other threads can see it
+        AMP1394_MEMORY_BARRIER();
+        Side = side;
+    }
+    // The calling thread is the I/O thread until ReadAllBoards/WriteAllBoards is called, so
+    // that other threads started afterwards do not access the port directly
+    Side->SetIOThread();
+    return true;
+}
+
+void BasePort::DisableSideChannel(void)
+{
+    // Not deleted, since other threads may be using it (see Side)
+    if (Side)
+        Side->Enable(false);
+}
+
+bool BasePort::SubmitRequest(SideRequest &req)
+{
+    SideChannel *side = Side;
+    AMP1394_MEMORY_BARRIER();
+    return side ? side->Submit(req) : false;
+}
+
+LatencyHistogram *BasePort::GetLatencyHistogram(HistogramType type)
+{
+    return ((type >= 0) && (type < HIST_NUM)) ? &LatencyHist[type] : 0;
+}
+
+LatencyHistogram *BasePort::GetBoardReadHistogram(unsigned char boardId)
+{
+    return ((boardId < BoardIO::MAX_BOARDS) && BoardHist[boardId]) ? &BoardHist[boardId]->read : 0;
+}
+
+void BasePort::ResetLatencyHistograms(void)
+{
+    unsigned int i;
+    for (i = 0; i < HIST_NUM; i++)
+        LatencyHist[i].Reset();
+    for (i = 0; i < BoardIO::MAX_BOARDS; i++) {
+        if (BoardHist[i])
+            BoardHist[i]->read.Reset();
+    }
+}
+
+void BasePort::RecordFpgaResponseTimes(LatencyHistogram &recvHist, LatencyHistogram &totalHist)
+{
+    double recvTime, totalTime;
+    if (GetFpgaResponseTimes(recvTime, totalTime)) {
+        recvHist.Record(recvTime);
+        totalHist.Record(totalTime);
+    }
+}
+
+LatencyHistogram *BasePort::GetFpgaTimingHistogram(unsigned char boardId, FpgaTimingType type)
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || !BoardHist[boardId] || (type < 0) || (type >= FPGA_TIMING_NUM))
+        return 0;
+    return &BoardHist[boardId]->fpga[type];
+}
+
+LatencyHistogram *BasePort::GetHubTimingHistogram(HubTimingType type)
+{
+    return ((type >= 0) && (type < HUB_TIMING_NUM)) ? &FpgaHubHist[type] : 0;
+}
+
+void BasePort::ResetFpgaTimingStats(void)
+{
+    unsigned int i, j;
+    for (i = 0; i < BoardIO::MAX_BOARDS; i++) {
+        if (BoardHist[i]) {
+            for (j = 0; j < FPGA_TIMING_NUM; j++)
+                BoardHist[i]->fpga[j].Reset();
+        }
+    }
+    for (i = 0; i < HUB_TIMING_NUM; i++)
+        FpgaHubHist[i].Reset();
+}
+
+// Print mean/p99/max (usec) in a 20 character field, or "-" if there are no samples
+static void PrintTimingStat(std::ostream &outStr, const LatencyHistogram &hist)
+{
+    std::ostringstream str;
+    if (hist.GetCount() == 0)
+        str << "-";
+    else
+        str << std::fixed << std::setprecision(1) << hist.GetMean()*1e6 << "/"
+            << hist.GetPercentile(99.0)*1e6 << "/" << hist.GetMax()*1e6;
+    outStr << std::left << std::setw(22) << str.str() << std::right;
+}
+
+void BasePort::PrintFpgaTiming(std::ostream &outStr) const
+{
+    unsigned int board;
+    outStr << "Timing (usec, mean/p99/max)" << std::endl
+           << "Board  Host read             Eth recv              Eth total             Update" << std::endl;
+    for (board = 0; board < BoardIO::MAX_BOARDS; board++) {
+        if (BoardList[board] && BoardHist[board]) {
+            outStr << std::setw(4) << board << "   ";
+            PrintTimingStat(outStr, BoardHist[board]->read);
+            PrintTimingStat(outStr, BoardHist[board]->fpga[FPGA_ETH_RECV]);
+            PrintTimingStat(outStr, BoardHist[board]->fpga[FPGA_ETH_TOTAL]);
+            PrintTimingStat(outStr, BoardHist[board]->fpga[FPGA_UPDATE]);
+            outStr << std::endl;
+        }
+    }
+    if (Protocol_ == PROTOCOL_BC_QRW) {
+        outStr << "Hub    Host read             Eth recv              Eth total             Read start            Read finish"
+               << std::endl << std::setw(4) << static_cast<unsigned int>(HubBoard) << "   ";
+        PrintTimingStat(outStr, LatencyHist[HIST_READ]);
+        PrintTimingStat(outStr, FpgaHubHist[HUB_ETH_RECV]);
+        PrintTimingStat(outStr, FpgaHubHist[HUB_ETH_TOTAL]);
+        PrintTimingStat(outStr, FpgaHubHist[HUB_READ_START]);
+        PrintTimingStat(outStr, FpgaHubHist[HUB_READ_FINISH]);
+        outStr << std::endl;
+    }
+}
+
+bool BasePort::StartTelemetry(const std::string &fileBase, unsigned int numSlots,
+                              uint32_t segmentSize, unsigned int maxSegments)
+{
+    if (!Telemetry)
+        Telemetry = new TelemetryRecorder(outStr);
+    else if (Telemetry->IsRunning())
+        Telemetry->Stop();
+
+    TelemetrySegmentHeader config;
+    memset(&config, 0, sizeof(config));
+    config.portType = GetPortType();
+    config.protocol = Protocol_;
+    config.hubBoard = HubBoard;
+    for (unsigned int board = 0; board < BoardIO::MAX_BOARDS; board++) {
+        if (BoardList[board]) {
+            config.boardMask |= (1 << board);
+            config.readNumBytes[board] = BoardList[board]->GetReadNumBytes();
+            config.writeNumBytes[board] = BoardList[board]->GetWriteNumBytes();
+        }
+        config.firmwareVersion[board] = static_cast<uint32_t>(FirmwareVersion[board]);
+        config.hardwareVersion[board] = static_cast<uint32_t>(HardwareVersion[board]);
+        config.fpgaVersion[board] = FpgaVersion[board];
+    }
+    return Telemetry->Start(fileBase, config, numSlots, segmentSize, maxSegments);
+}
+
+void BasePort::StopTelemetry(void)
+{
+    if (Telemetry)
+        Telemetry->Stop();
+}
+
+void BasePort::TelemetryEndRead(double hostTime, bool ok)
+{
+    TelemetryFrameHeader *frame = Telemetry->GetFrame();
+    if (frame) {
+        bool isBroadcast = (frame->flags & TelemetryRecorder::FRAME_BROADCAST);
+        if (isBroadcast) {
+            frame->bcReadSequence = bcReadInfo.readSequence;
+            frame->bcReadStartTime = bcReadInfo.readStartTime;
+            frame->bcReadFinishTime = bcReadInfo.readFinishTime;
+        }
+        for (unsigned int board = 0; board < max_board; board++) {
+            if (!BoardList[board])
+                continue;
+            TelemetryBoardRecord &rec = frame->board[board];
+            if (BoardList[board]->ValidRead())
+                rec.flags |= TelemetryRecorder::BOARD_READ_VALID;
+            if (isBroadcast) {
+                const BroadcastReadInfo::BroadcastBoardInfo &info = bcReadInfo.boardInfo[board];
+                if (info.inUse)
+                    rec.flags |= TelemetryRecorder::BOARD_BC_IN_USE;
+                if (info.seq_error)
+                    rec.flags |= TelemetryRecorder::BOARD_BC_SEQ_ERROR;
+                rec.bcSequence = static_cast<uint16_t>(info.sequence);
+                rec.bcBlockSize = static_cast<uint8_t>(info.blockSize);
+                rec.bcUpdateTime = static_cast<float>(info.updateTime);
+            }
+        }
+    }
+    Telemetry->EndRead(hostTime, ok);
+}
+
+void BasePort::TelemetryEndWrite(double hostTime, bool ok)
+{
+    TelemetryFrameHeader *frame = Telemetry->GetFrame();
+    if (frame) {
+        for (unsigned int board = 0; board < max_board; board++) {
+            if (BoardList[board] && BoardList[board]->ValidWrite())
+                frame->board[board].flags |= TelemetryRecorder::BOARD_WRITE_VALID;
+        }
+    }
+    Telemetry->EndWrite(hostTime, ok);
+}
+
 bool BasePort::WriteAllBoardsBroadcast(void)
 {
+    AMP1394_PROBE1(write_all_boards_bc_entry, NumOfBoards_);
     if (!IsOK()) {
         outStr << "BasePort::WriteAllBoardsBroadcast: port not initialized" << std::endl;
         OnNoneWritten();
+        AMP1394_PROBE2(write_all_boards_bc_return, false, 0);
         return false;
     }
 
     if (!IsBroadcastFirmwareMixValid()) {
         outStr << "BasePort::WriteAllBoardsBroadcast: invalid mix of firmware" << std::endl;
         OnNoneWritten();
+        AMP1394_PROBE2(write_all_boards_bc_return, false, 0);
         return false;
     }
 
     if (!CheckFwBusGeneration("WriteAllBoardsBroadcast", autoReScan)) {
         OnNoneWritten();
+        AMP1394_PROBE2(write_all_boards_bc_return, false, 0);
         return false;
     }
 
@@ -1011,6 +1543,8 @@ bool BasePort::WriteAllBoardsBroadcast(void)
                 unsigned int numQuads = numBytes/4;
                 BoardList[board]->GetWriteData(bcPtr, 0, numQuads);
             }
+            if (Telemetry)
+                Telemetry->AddWriteData(board, bcPtr, numBytes);
             // bcBufferOffset equals total numBytes to write, when the loop ends
             bcBufferOffset = bcBufferOffset + numBytes;
         }
@@ -1067,5 +1601,6 @@ bool BasePort::WriteAllBoardsBroadcast(void)
         outStr << "BasePort::WriteAllBoardsBroadcast: rtWrite is false" << std::endl;
 
     // return
+    AMP1394_PROBE2(write_all_boards_bc_return, allOK, bcBufferOffset);
     return allOK;
 }
@@ -0,0 +1,340 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "BoardIdentity.h"
+#include "BasePort.h"
+#include "Amp1394Time.h"
+
+#include <iomanip>
+#include <sstream>
+#include <string.h>  // for memcpy
+
+// Maximum time to wait for the M25P16 PROM read to finish (normally about 100 usec)
+const double FPGA_PROM_TIMEOUT = 0.01;
+// Time for the 25AA128 block read to finish (see BasePort::PromDelay); there is no status to poll
+const double QLA_PROM_DELAY = 0.001;
+// Wait after each robot flash command (see AmpIO::ReadRobotSerialNumber)
+const double ROBOT_FLASH_DELAY = 0.01;
+
+BoardIdentity::BoardIdentity(BasePort *port) :
+    Port(port), ReadTool(true), ReadRobot(true), DallasTimeout(10.0), StartTime(0.0), ElapsedTime(0.0)
+{
+}
+
+BoardIdentity::~BoardIdentity()
+{
+}
+
+bool BoardIdentity::AddBoard(AmpIO *board)
+{
+    if (!Port || !board || !board->IsValid() || (Port->GetBoard(board->GetBoardId()) != board))
+        return false;
+    BoardState state;
+    memset(&state, 0, sizeof(state));
+    state.board = board;
+    state.promStep = PROM_DONE;
+    state.toolStep = TOOL_DONE;
+    Boards.push_back(state);
+    Results.push_back(Result());
+    return true;
+}
+
+void BoardIdentity::Start(void)
+{
+    for (size_t i = 0; i < Boards.size(); i++) {
+        BoardState &state = Boards[i];
+        AmpIO *board = state.board;
+        Result &result = Results[i];
+        result = Result();
+        result.boardId = board->GetBoardId();
+        result.hardware = board->GetHardwareVersionString();
+        result.firmwareVersion = board->GetFirmwareVersion();
+        state.promStep = PROM_FPGA_START;
+        state.toolStep = ReadTool ? TOOL_DALLAS : TOOL_DONE;
+        state.qlaIndex = 0;
+        state.robotWord = 0;
+        state.robotFlashEn = 0;
+    }
+    StartTime = Amp1394_GetTime();
+    ElapsedTime = 0.0;
+}
+
+bool BoardIdentity::Poll(void)
+{
+    bool allDone = true;
+    for (size_t i = 0; i < Boards.size(); i++) {
+        BoardState &state = Boards[i];
+        if ((state.promStep == PROM_DONE) && (state.toolStep == TOOL_DONE))
+            continue;
+        double now = Amp1394_GetTime();
+        bool promDone = PollProm(state, Results[i], now);
+        bool toolDone = PollTool(state, Results[i], now);
+        if (promDone && toolDone)
+            Results[i].elapsedTime = Amp1394_GetTime()-StartTime;
+        else
+            allDone = false;
+    }
+    if (allDone && (ElapsedTime == 0.0))
+        ElapsedTime = Amp1394_GetTime()-StartTime;
+    return allDone;
+}
+
+bool BoardIdentity::Run(double timeoutSec, double pollInterval)
+{
+    Start();
+    bool done = Poll();
+    while (!done && (Amp1394_GetTime()-StartTime < timeoutSec)) {
+        Amp1394_Sleep(pollInterval);
+        done = Poll();
+    }
+    bool ret = done;
+    for (size_t i = 0; i < Boards.size(); i++) {
+        if ((Boards[i].promStep != PROM_DONE) || (Boards[i].toolStep != TOOL_DONE)) {
+            if (Boards[i].toolStep == TOOL_DALLAS)
+                Results[i].toolStatus = AmpIO::DALLAS_TIMEOUT;
+            Boards[i].promStep = PROM_DONE;
+            Boards[i].toolStep = TOOL_DONE;
+            Results[i].ioError = true;
+        }
+        if (Results[i].ioError)
+            ret = false;
+    }
+    if (!done)
+        ElapsedTime = Amp1394_GetTime()-StartTime;
+    return ret;
+}
+
+unsigned char BoardIdentity::QLAChannel(const BoardState &state)
+{
+    // 0 for QLA; 1 or 2 for DQLA
+    if (state.board->GetHardwareVersion() == DQLA_String)
+        return static_cast<unsigned char>(state.qlaIndex+1);
+    return 0;
+}
+
+FpgaIO::PromType BoardIdentity::QLAPromType(const BoardState &state)
+{
+    unsigned char chan = QLAChannel(state);
+    return (chan == 1) ? FpgaIO::PROM_25AA128_1 : (chan == 2) ? FpgaIO::PROM_25AA128_2 : FpgaIO::PROM_25AA128;
+}
+
+bool BoardIdentity::PollProm(BoardState &state, Result &result, double now)
+{
+    AmpIO *board = state.board;
+    unsigned char boardId = board->GetBoardId();
+    quadlet_t read_data;
+
+    switch (state.promStep) {
+
+    case PROM_FPGA_START:
+        if (board->GetFirmwareVersion() < 4) {
+            // Older firmware reads the PROM data from a different address; use the
+            // (blocking) method, since these boards are rarely used
+            result.fpgaSN = board->GetFPGASerialNumber();
+            state.promStep = PROM_QLA_START;
+        }
+        else if (Port->WriteQuadlet(boardId, 0x08, 0x03000000|FpgaIO::FPGA_SN_ADDR)) {  // 03h = Read Data Bytes
+            state.waitStart = now;
+            state.promStep = PROM_FPGA_WAIT;
+        }
+        else {
+            result.ioError = true;
+            state.promStep = PROM_QLA_START;
+        }
+        break;
+
+    case PROM_FPGA_WAIT:
+        // Command has finished when 4 LSB of status are 0 (see FpgaIO::PromReadData)
+        if (!Port->ReadQuadlet(boardId, 0x08, read_data)) {
+            result.ioError = true;
+            state.promStep = PROM_QLA_START;
+        }
+        else if ((read_data&0x000f) == 0) {
+            quadlet_t data[4];
+            if (Port->ReadBlock(boardId, 0x2000, data, sizeof(data)))
+                result.fpgaSN = FpgaIO::ParseFPGASerialNumber(reinterpret_cast<uint8_t *>(data));
+            else
+                result.ioError = true;
+            state.promStep = PROM_QLA_START;
+        }
+        else if (now > state.waitStart+FPGA_PROM_TIMEOUT) {
+            result.ioError = true;
+            state.promStep = PROM_QLA_START;
+        }
+        break;
+
+    case PROM_QLA_START:
+        {
+            // Read header with one block read, as in AmpIO::ReadQLAIdentity
+            const unsigned int nquads = AmpIO::QLAIdentity::HEADER_SIZE/sizeof(quadlet_t);
+            nodeaddr_t address = board->GetPromAddress(QLAPromType(state), true);
+            if (Port->WriteQuadlet(boardId, address, 0xFE000000|(nquads-1))) {
+                state.waitStart = now;
+                state.promStep = PROM_QLA_WAIT;
+            }
+            else {
+                result.ioError = true;
+                state.promStep = PROM_DONE;
+            }
+        }
+        break;
+
+    case PROM_QLA_WAIT:
+        if (now >= state.waitStart+QLA_PROM_DELAY) {
+            AmpIO::QLAIdentity id;
+            quadlet_t data[AmpIO::QLAIdentity::HEADER_SIZE/sizeof(quadlet_t)];
+            nodeaddr_t address = board->GetPromAddress(QLAPromType(state), true);
+            bool ok = Port->ReadBlock(boardId, address|0x0100, data, sizeof(data)) &&
+                      AmpIO::ParseQLAIdentityBlock(id, data);
+            // If the block read did not work (e.g., older firmware), read byte by byte
+            if (!ok && !board->ReadQLAIdentityBytes(id, QLAChannel(state)))
+                result.ioError = true;
+            result.qlaSN[state.qlaIndex] = id.serialNumber;
+            if ((board->GetHardwareVersion() == DQLA_String) && (state.qlaIndex == 0)) {
+                state.qlaIndex = 1;
+                state.promStep = PROM_QLA_START;
+            }
+            else {
+                state.promStep = PROM_DONE;
+            }
+        }
+        break;
+
+    case PROM_DONE:
+        break;
+    }
+    return (state.promStep == PROM_DONE);
+}
+
+bool BoardIdentity::PollTool(BoardState &state, Result &result, double now)
+{
+    AmpIO *board = state.board;
+    unsigned char boardId = board->GetBoardId();
+    bool isRobot = ReadRobot && (board->GetHardwareVersion() == dRA1_String);
+
+    switch (state.toolStep) {
+
+    case TOOL_DALLAS:
+        // DallasReadTool is already implemented as a state machine (for QLA)
+        result.toolStatus = board->DallasReadTool(result.toolModel, result.toolVersion, result.toolName,
+                                                  DallasTimeout);
+        // For dRA1, DallasReadTool returns DALLAS_WAIT until a tool is present
+        if ((result.toolStatus == AmpIO::DALLAS_WAIT) && (board->GetHardwareVersion() == dRA1_String))
+            result.toolStatus = AmpIO::DALLAS_DATA_ERROR;
+        if (result.toolStatus != AmpIO::DALLAS_WAIT) {
+            if (result.toolStatus == AmpIO::DALLAS_IO_ERROR)
+                result.ioError = true;
+            state.toolStep = isRobot ? TOOL_ROBOT_START : TOOL_DONE;
+        }
+        break;
+
+    case TOOL_ROBOT_START:
+        {
+            // Flash command is written twice (flash_en 0, then 1), waiting after each write
+            uint32_t flash_command = (state.robotFlashEn << 28) | (1 << 24) | state.robotWord;
+            if (Port->WriteQuadlet(boardId, 0xa002, flash_command)) {
+                state.robotWaitUntil = now+ROBOT_FLASH_DELAY;
+                state.toolStep = TOOL_ROBOT_WAIT;
+            }
+            else {
+                result.ioError = true;
+                state.toolStep = TOOL_DONE;
+            }
+        }
+        break;
+
+    case TOOL_ROBOT_WAIT:
+        if (now < state.robotWaitUntil)
+            break;
+        if (state.robotFlashEn == 0) {
+            state.robotFlashEn = 1;
+            state.toolStep = TOOL_ROBOT_START;
+            break;
+        }
+        {
+            quadlet_t q;
+            if (!Port->ReadQuadlet(boardId, 0xa031, q)) {
+                result.ioError = true;
+                state.toolStep = TOOL_DONE;
+                break;
+            }
+            state.robotData[state.robotWord++] = static_cast<uint16_t>(q & 0xFFFF);
+            state.robotFlashEn = 0;
+        }
+        if (state.robotWord < ROBOT_SN_WORDS) {
+            state.toolStep = TOOL_ROBOT_START;
+        }
+        else {
+            Port->WriteQuadlet(boardId, 0xa002, 0);
+            char buf[ROBOT_SN_WORDS*sizeof(uint16_t)+1];
+            memcpy(buf, state.robotData, ROBOT_SN_WORDS*sizeof(uint16_t));
+            buf[ROBOT_SN_WORDS*sizeof(uint16_t)] = 0;
+            result.robotSN = buf;
+            state.toolStep = TOOL_DONE;
+        }
+        break;
+
+    case TOOL_DONE:
+        break;
+    }
+    return (state.toolStep == TOOL_DONE);
+}
+
+std::string BoardIdentity::ToolStatusString(AmpIO::DallasStatus status)
+{
+    switch (status) {
+        case AmpIO::DALLAS_NONE:       return "none";
+        case AmpIO::DALLAS_IO_ERROR:   return "I/O error";
+        case AmpIO::DALLAS_TIMEOUT:    return "timeout";
+        case AmpIO::DALLAS_DATA_ERROR: return "no tool";
+        case AmpIO::DALLAS_WAIT:       return "wait";
+        case AmpIO::DALLAS_OK:         return "ok";
+    }
+    return "unknown";
+}
+
+void BoardIdentity::PrintTable(std::ostream &out) const
+{
+    out << "Board  HW    FW  FPGA SN    QLA SN             Tool                          Robot SN" << std::endl;
+    for (size_t i = 0; i < Results.size(); i++) {
+        const Result &res = Results[i];
+        std::string qlaSN = res.qlaSN[0];
+        if (!res.qlaSN[1].empty())
+            qlaSN += ", " + res.qlaSN[1];
+        std::ostringstream tool;
+        if (res.toolStatus == AmpIO::DALLAS_OK) {
+            tool << std::hex << res.toolModel << std::dec << "-" << static_cast<unsigned int>(res.toolVersion);
+            if (!res.toolName.empty())
+                tool << " " << res.toolName;
+        }
+        else {
+            tool << "(" << ToolStatusString(res.toolStatus) << ")";
+        }
+        out << std::left << std::setw(7) << static_cast<unsigned int>(res.boardId)
+            << std::setw(6) << res.hardware
+            << std::setw(4) << res.firmwareVersion
+            << std::setw(11) << (res.fpgaSN.empty() ? "-" : res.fpgaSN)
+            << std::setw(19) << (qlaSN.empty() ? "-" : qlaSN)
+            << std::setw(30) << tool.str()
+            << (res.robotSN.empty() ? "-" : res.robotSN)
+            << std::right;
+        if (res.ioError)
+            out << "  (I/O error)";
+        out << std::endl;
+    }
+    std::ostringstream elapsed;
+    elapsed << std::fixed << std::setprecision(3) << ElapsedTime;
+    out << "Elapsed time: " << elapsed.str() << " sec" << std::endl;
+}
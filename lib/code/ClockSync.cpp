@@ -0,0 +1,179 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include <math.h>
+
+#include "ClockSync.h"
+#include "BasePort.h"
+#include "FpgaIO.h"
+
+// Minimum interval half-width used for weighting (seconds)
+const double CLOCK_SYNC_MIN_HALFWIDTH = 1.0e-6;
+
+void FpgaClockSync::BoardSync::Clear()
+{
+    numSamples = 0;
+    ticks0 = 0;
+    host0 = 0.0;
+    period = 0.0;
+    W = 0.0;
+    mx = my = 0.0;
+    Cxx = Cxy = 0.0;
+    resVar = 0.0;
+    sampleTime = 0.0;
+    sampleUncertainty = 0.0;
+}
+
+FpgaClockSync::FpgaClockSync(const BasePort *port, double forgetting) : Port(port), Lambda(forgetting)
+{
+    if ((Lambda <= 0.0) || (Lambda > 1.0))
+        Lambda = 1.0;
+}
+
+bool FpgaClockSync::AddBoard(const FpgaIO *board)
+{
+    if (!board || !board->IsValid())
+        return false;
+    unsigned char id = board->GetBoardId();
+    Sync[id].Clear();
+    Sync[id].board = board;
+    return true;
+}
+
+void FpgaClockSync::Reset(unsigned char boardId)
+{
+    for (unsigned char id = 0; id < BoardIO::MAX_BOARDS; id++) {
+        if ((boardId == BoardIO::MAX_BOARDS) || (boardId == id))
+            Sync[id].Clear();
+    }
+}
+
+void FpgaClockSync::Update(void)
+{
+    for (unsigned char id = 0; id < BoardIO::MAX_BOARDS; id++) {
+        if (Sync[id].board && Sync[id].board->ValidRead())
+            UpdateBoard(id);
+    }
+}
+
+void FpgaClockSync::UpdateBoard(unsigned char boardId)
+{
+    BoardSync &bs = Sync[boardId];
+
+    double sendTime, recvTime;
+    if (!Port->GetReadHostTimes(boardId, sendTime, recvTime))
+        return;
+
+    // Host time interval containing the sample
+    double lo = sendTime;
+    double hi = recvTime;
+    if ((Port->GetProtocol() == BasePort::PROTOCOL_BC_QRW) && (bs.board->GetFirmwareVersion() >= 7)) {
+        BasePort::BroadcastReadInfo bcInfo = Port->GetBroadcastReadInfo();
+        double update = bcInfo.boardInfo[boardId].updateTime;
+        double afterUpdate = bcInfo.readFinishTime - update;
+        double bcLo = sendTime + update;
+        double bcHi = recvTime - ((afterUpdate > 0.0) ? afterUpdate : 0.0);
+        if (bcHi >= bcLo) {
+            lo = bcLo;
+            hi = bcHi;
+        }
+    }
+
+    uint64_t ticks = bs.board->GetFirmwareTicks();
+    // Restart if the tick counter was reset (SetFirmwareTime) or the clock period changed
+    if ((bs.numSamples > 0) && ((ticks < bs.ticks0) || (bs.period != bs.board->GetFPGAClockPeriod())))
+        bs.Clear();
+    if (bs.numSamples == 0) {
+        bs.ticks0 = ticks;
+        bs.host0 = lo;
+        bs.period = bs.board->GetFPGAClockPeriod();
+    }
+
+    // Use 64-bit integer difference before converting to double
+    double x = static_cast<double>(ticks - bs.ticks0)*bs.period;
+    double halfWidth = (hi-lo)/2.0;
+    double y = (lo + halfWidth) - bs.host0;
+
+    if (bs.HasFit()) {
+        double r = y - bs.Predict(x);
+        bs.resVar = (bs.numSamples > 2) ? (Lambda*bs.resVar + (1.0-Lambda)*r*r) : r*r;
+    }
+
+    // Exponentially-weighted update of means and co-moments
+    double hw = (halfWidth > CLOCK_SYNC_MIN_HALFWIDTH) ? halfWidth : CLOCK_SYNC_MIN_HALFWIDTH;
+    double w = 1.0/(hw*hw);
+    bs.W = Lambda*bs.W + w;
+    double dx = x - bs.mx;
+    double dy = y - bs.my;
+    bs.mx += (w/bs.W)*dx;
+    bs.my += (w/bs.W)*dy;
+    bs.Cxx = Lambda*bs.Cxx + w*dx*(x - bs.mx);
+    bs.Cxy = Lambda*bs.Cxy + w*dx*(y - bs.my);
+    bs.numSamples++;
+
+    // Stamp the sample
+    if (bs.HasFit()) {
+        double t = bs.Predict(x);
+        double loRel = lo - bs.host0;
+        double hiRel = hi - bs.host0;
+        if (t < loRel) t = loRel;
+        if (t > hiRel) t = hiRel;
+        bs.sampleTime = bs.host0 + t;
+        double sigma = sqrt(bs.resVar);
+        bs.sampleUncertainty = (sigma < halfWidth) ? sigma : halfWidth;
+    }
+    else {
+        bs.sampleTime = lo + halfWidth;
+        bs.sampleUncertainty = halfWidth;
+    }
+}
+
+bool FpgaClockSync::GetSampleTime(unsigned char boardId, double &hostTime, double &uncertainty) const
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || (Sync[boardId].numSamples == 0))
+        return false;
+    hostTime = Sync[boardId].sampleTime;
+    uncertainty = Sync[boardId].sampleUncertainty;
+    return true;
+}
+
+bool FpgaClockSync::FpgaToHostTime(unsigned char boardId, uint64_t ticks, double &hostTime) const
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || !Sync[boardId].HasFit())
+        return false;
+    const BoardSync &bs = Sync[boardId];
+    // Signed difference, since ticks may precede the origin
+    int64_t dTicks = static_cast<int64_t>(ticks - bs.ticks0);
+    hostTime = bs.host0 + bs.Predict(static_cast<double>(dTicks)*bs.period);
+    return true;
+}
+
+bool FpgaClockSync::GetDrift(unsigned char boardId, double &drift) const
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || !Sync[boardId].HasFit())
+        return false;
+    drift = Sync[boardId].Slope() - 1.0;
+    return true;
+}
+
+bool FpgaClockSync::GetOffset(unsigned char boardId, double &offset) const
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || !Sync[boardId].HasFit())
+        return false;
+    const BoardSync &bs = Sync[boardId];
+    // Host time corresponding to ticks == 0
+    offset = bs.host0 + bs.Predict(-static_cast<double>(bs.ticks0)*bs.period);
+    return true;
+}
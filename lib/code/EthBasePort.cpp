@@ -19,7 +19,9 @@ http://www.cisst.org/cisst/license.txt.
 #include "FpgaIO.h"
 #include "Amp1394Time.h"
 #include "Amp1394BSwap.h"
+#include "Amp1394Probes.h"
 #include <iomanip>
+#include <algorithm>
 
 #ifdef _MSC_VER
 #include <string>
@@ -36,12 +38,144 @@ EthBasePort::EthBasePort(int portNum, std::ostream &debugStream, EthCallbackType
     BasePort(portNum, debugStream),
     fw_tl(0),
     eth_read_callback(cb),
-    ReceiveTimeout(0.02)
+    ReceiveTimeout(0.02),
+    FPGA_RecvTime(0.0),
+    FPGA_TotalTime(0.0),
+    Trace(0),
+    Faults(0)
 {
+    LogQuadFlushed = ErrorLog.AddSite("ReadQuadlet: flushed %ld packets");
+    LogQuadReadFailed = ErrorLog.AddSite("ReadQuadlet: failed to receive read response from board %ld via UDP: return value = %ld, expected = %ld");
+    LogBlockFlushed = ErrorLog.AddSite("ReadBlock: flushed %ld packets");
+    LogBlockReadFailed = ErrorLog.AddSite("ReadBlock: failed to receive read response from board %ld: return value = %ld, expected = %ld");
+    LogNoneRead = ErrorLog.AddSite("Failed to read any board, check Ethernet physical connection");
+    LogTlMismatch = ErrorLog.AddSite("WARNING: received tl = %ld, expected tl = %ld");
 }
 
 EthBasePort::~EthBasePort()
 {
+    delete Trace;
+    delete Faults;
+}
+
+bool EthBasePort::EnablePacketTrace(unsigned int numRecords)
+{
+    if (Trace && (Trace->GetSize() >= numRecords))
+        return true;
+    delete Trace;
+    Trace = new PacketTrace(numRecords);
+    return (Trace != 0);
+}
+
+void EthBasePort::DisablePacketTrace(void)
+{
+    PacketTrace *oldTrace = Trace;
+    Trace = 0;
+    delete oldTrace;
+}
+
+bool EthBasePort::DumpPacketTrace(const std::string &fileName) const
+{
+    if (!Trace) {
+        outStr << "DumpPacketTrace: packet trace not enabled" << std::endl;
+        return false;
+    }
+    return Trace->Dump(fileName, GetPortType(), outStr);
+}
+
+bool EthBasePort::EnableFaultInjection(const FaultConfig &config)
+{
+    delete Faults;
+    Faults = new FaultInjector(config);
+    return (Faults != 0);
+}
+
+void EthBasePort::DisableFaultInjection(void)
+{
+    FaultInjector *oldFaults = Faults;
+    Faults = 0;
+    delete oldFaults;
+}
+
+bool EthBasePort::FaultPacketSend(unsigned char *packet, size_t nbytes, bool useEthernetBroadcast)
+{
+    bool drop = Faults->Chance(Faults->GetConfig().requestDrop);
+    Faults->SetRequestDropped(drop);
+    if (drop) {
+        Faults->Count(FaultInjector::FAULT_REQUEST_DROP);
+        return true;
+    }
+    return PacketSend(packet, nbytes, useEthernetBroadcast);
+}
+
+int EthBasePort::FaultPacketReceive(unsigned char *packet, size_t nbytes)
+{
+    const FaultConfig &config = Faults->GetConfig();
+
+    // No response to a lost request; wait for the timeout, as PacketReceive would
+    if (Faults->IsRequestDropped()) {
+        Faults->SetRequestDropped(false);
+        Amp1394_Sleep(ReceiveTimeout);
+        return 0;
+    }
+
+    // A held response that survived the flush (see FaultPacketFlushAll) is received first;
+    // the response to the current request is held instead
+    if (Faults->NumPending() > 0) {
+        int nRecv = PacketReceive(Faults->GetScratchBuffer(), std::min(nbytes, static_cast<size_t>(FaultInjector::MAX_PACKET_SIZE)));
+        size_t n = Faults->PopPending(packet, nbytes);
+        if (nRecv > 0)
+            Faults->PushPending(Faults->GetScratchBuffer(), nRecv);
+        Faults->Count(FaultInjector::FAULT_REORDER);
+        return static_cast<int>(n);
+    }
+
+    int nRecv = PacketReceive(packet, nbytes);
+    if (nRecv <= 0)
+        return nRecv;
+
+    if (Faults->Chance(config.responseDrop)) {
+        Faults->Count(FaultInjector::FAULT_RESPONSE_DROP);
+        Amp1394_Sleep(ReceiveTimeout);
+        return 0;
+    }
+
+    double delay = Faults->ResponseDelay();
+    bool late = Faults->Chance(config.late);
+    if (late || (delay >= ReceiveTimeout)) {
+        // Response arrives after the timeout, so it is only seen by the next flush
+        Faults->Count(FaultInjector::FAULT_LATE);
+        Amp1394_Sleep(ReceiveTimeout);
+        Faults->PushPending(packet, nRecv);
+        return 0;
+    }
+    if (delay > 0.0)
+        Amp1394_Sleep(delay);
+
+    if (Faults->Chance(config.duplicate)) {
+        Faults->Count(FaultInjector::FAULT_DUPLICATE);
+        Faults->PushPending(packet, nRecv);
+    }
+    return nRecv;
+}
+
+int EthBasePort::FaultPacketFlushAll(void)
+{
+    int numFlushed = PacketFlushAll();
+    bool reorder = (Faults->NumPending() > 0) && Faults->Chance(Faults->GetConfig().reorder);
+    return numFlushed + static_cast<int>(Faults->FlushPending(reorder));
+}
+
+void EthBasePort::TraceRecord(unsigned int tcode, nodeid_t node, nodeaddr_t addr, unsigned int nbytes,
+                              double sendTime, double recvTime, unsigned char status, unsigned char flags)
+{
+    bool hasResponse = (status == PacketTrace::STATUS_OK) || (status == PacketTrace::STATUS_CHECK_FAIL);
+    if ((tcode != QREAD) && (tcode != BREAD))
+        hasResponse = false;
+    Trace->Record(static_cast<uint8_t>(tcode), static_cast<uint8_t>(node), fw_tl, static_cast<uint32_t>(addr),
+                  nbytes, sendTime, recvTime, hasResponse ? FPGA_RecvTime : 0.0, hasResponse ? FPGA_TotalTime : 0.0,
+                  status, (flags&FW_NODE_ETH_BROADCAST_MASK) ? PacketTrace::FLAG_ETH_BROADCAST : 0,
+                  static_cast<uint8_t>(FwBusGeneration));
 }
 
 void EthBasePort::GetDestMacAddr(unsigned char *macAddr)
@@ -94,6 +228,18 @@ void EthBasePort::PrintIP(std::ostream &outStr, const char* name, const uint8_t
 
 void EthBasePort::ProcessExtraData(const unsigned char *packet)
 {
+    unsigned char faultData[FW_EXTRA_SIZE];
+    if (Faults) {
+        // Simulated bus reset: set the flag and report the next bus generation from now on
+        memcpy(faultData, packet, FW_EXTRA_SIZE);
+        if (Faults->Chance(Faults->GetConfig().busReset)) {
+            Faults->Count(FaultInjector::FAULT_BUS_RESET);
+            Faults->IncrementBusGeneration();
+            faultData[0] |= FwBusReset;
+        }
+        faultData[1] = static_cast<unsigned char>(faultData[1]+Faults->GetBusGenerationOffset());
+        packet = faultData;
+    }
     FpgaStatus.FwBusReset = (packet[0]&FwBusReset);
     FpgaStatus.FwPacketDropped = (packet[0]&FwPacketDropped);
     FpgaStatus.EthInternalError = (packet[0]&EthInternalError);
@@ -136,8 +282,7 @@ bool EthBasePort::CheckFirewirePacket(const unsigned char *packet, size_t length
     }
     unsigned int tl_recv = packet[2] >> 2;
     if (tl_recv != tl) {
-        outStr << "WARNING: received tl = " << tl_recv
-               << ", expected tl = " << tl << std::endl;
+        ErrorLog.Log(LogTlMismatch, tl_recv, tl);
     }
     // TODO: could also check QRESPONSE length
     if (tcode == BRESPONSE) {
@@ -653,10 +798,12 @@ bool EthBasePort::ReadQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t &dat
     if ((node != FW_NODE_BROADCAST) && !CheckFwBusGeneration("ReadQuadlet"))
         return false;
 
+    PhaseStart();
+
     // Flush before reading
-    int numFlushed = PacketFlushAll();
+    int numFlushed = DoPacketFlushAll();
     if (numFlushed > 0)
-        outStr << "ReadQuadlet: flushed " << numFlushed << " packets" << std::endl;
+        ErrorLog.Log(LogQuadFlushed, numFlushed);
 
     // Increment transaction label
     fw_tl = (fw_tl+1)&FW_TL_MASK;
@@ -671,40 +818,54 @@ bool EthBasePort::ReadQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t &dat
 
     // Build FireWire packet
     make_qread_packet(reinterpret_cast<quadlet_t *>(sendPacket+GetPrefixOffset(WR_FW_HEADER)), node, addr, fw_tl);
-    if (!PacketSend(sendPacket, sendPacketSize, flags&FW_NODE_ETH_BROADCAST_MASK))
+    double sendTime = Trace ? Amp1394_GetMonotonicTime() : 0.0;
+    AMP1394_PROBE3(packet_send_entry, node, sendPacketSize, fw_tl);
+    bool sendOK = DoPacketSend(sendPacket, sendPacketSize, flags&FW_NODE_ETH_BROADCAST_MASK);
+    AMP1394_PROBE1(packet_send_return, sendOK);
+    if (!sendOK) {
+        if (Trace) TraceRecord(QREAD, node, addr, 4, sendTime, 0.0, PacketTrace::STATUS_SEND_FAIL, flags);
         return false;
+    }
+    PhaseEnd(PHASE_SEND);
 
     // Invoke callback (if defined) between sending read request
     // and checking for read response. If callback returns false, we
     // skip checking for a received packet.
     if (eth_read_callback && !(*eth_read_callback)(*this, node, outStr)) {
         outStr << "ReadQuadlet: callback aborting (not reading packet)" << std::endl;
+        if (Trace) TraceRecord(QREAD, node, addr, 4, sendTime, 0.0, PacketTrace::STATUS_RECV_FAIL, flags);
         return false;
     }
 
     unsigned char *recvPacket = GenericBuffer+GetReadQuadAlign();
     unsigned int recvPacketSize = GetPrefixOffset(RD_FW_HEADER)+FW_QRESPONSE_SIZE+FW_EXTRA_SIZE;
-    int nRecv = PacketReceive(recvPacket, recvPacketSize);
+    AMP1394_PROBE2(packet_receive_entry, node, recvPacketSize);
+    int nRecv = DoPacketReceive(recvPacket, recvPacketSize);
+    AMP1394_PROBE1(packet_receive_return, nRecv);
+    PhaseEnd(PHASE_WAIT);
+    double recvTime = Trace ? Amp1394_GetMonotonicTime() : 0.0;
     if (nRecv != static_cast<int>(recvPacketSize)) {
+        if (Trace) TraceRecord(QREAD, node, addr, 4, sendTime, recvTime, PacketTrace::STATUS_RECV_FAIL, flags);
         // Only print message if Node2Board contains valid board number, to avoid unnecessary error messages during ScanNodes.
         unsigned int boardId = Node2Board[node];
         if (boardId < BoardIO::MAX_BOARDS) {
-            outStr << "ReadQuadlet: failed to receive read response from board " << boardId
-                   << " via UDP: return value = " << nRecv
-                   << ", expected = " << recvPacketSize << std::endl;
+            ErrorLog.Log(LogQuadReadFailed, boardId, nRecv, recvPacketSize);
         }
         return false;
     }
 
     ProcessExtraData(recvPacket+GetPrefixOffset(RD_FW_HEADER)+FW_QRESPONSE_SIZE);
 
-    if (!CheckEthernetHeader(recvPacket, flags&FW_NODE_ETH_BROADCAST_MASK))
-        return false;
-    if (!CheckFirewirePacket(recvPacket+GetPrefixOffset(RD_FW_HEADER), 0, node, EthBasePort::QRESPONSE, fw_tl))
+    bool ok = CheckEthernetHeader(recvPacket, flags&FW_NODE_ETH_BROADCAST_MASK) &&
+              CheckFirewirePacket(recvPacket+GetPrefixOffset(RD_FW_HEADER), 0, node, EthBasePort::QRESPONSE, fw_tl);
+    if (Trace) TraceRecord(QREAD, node, addr, 4, sendTime, recvTime,
+                           ok ? PacketTrace::STATUS_OK : PacketTrace::STATUS_CHECK_FAIL, flags);
+    if (!ok)
         return false;
 
     const quadlet_t *packet_FW = reinterpret_cast<const quadlet_t *>(recvPacket+GetPrefixOffset(RD_FW_HEADER));
     data = bswap_32(packet_FW[3]);
+    PhaseEnd(PHASE_RECEIVE);
     return true;
 }
 
@@ -713,6 +874,8 @@ bool EthBasePort::WriteQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t dat
     if ((node != FW_NODE_BROADCAST) && !CheckFwBusGeneration("WriteQuadlet"))
         return false;
 
+    PhaseStart();
+
     // Use GenericBuffer, which is much larger than needed
     SetGenericBuffer();   // Make sure buffer is allocated
     unsigned char *packet = GenericBuffer+GetWriteQuadAlign();
@@ -726,7 +889,14 @@ bool EthBasePort::WriteQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t dat
     // Build FireWire packet (also byteswaps data)
     make_qwrite_packet(reinterpret_cast<quadlet_t *>(packet+GetPrefixOffset(WR_FW_HEADER)), node, addr, data, fw_tl);
 
-    return PacketSend(packet, packetSize, flags&FW_NODE_ETH_BROADCAST_MASK);
+    double sendTime = Trace ? Amp1394_GetMonotonicTime() : 0.0;
+    AMP1394_PROBE3(packet_send_entry, node, packetSize, fw_tl);
+    bool ret = DoPacketSend(packet, packetSize, flags&FW_NODE_ETH_BROADCAST_MASK);
+    AMP1394_PROBE1(packet_send_return, ret);
+    PhaseEnd(PHASE_SEND);
+    if (Trace) TraceRecord(QWRITE, node, addr, 4, sendTime, 0.0,
+                           ret ? PacketTrace::STATUS_OK : PacketTrace::STATUS_SEND_FAIL, flags);
+    return ret;
 }
 
 bool EthBasePort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata,
@@ -735,10 +905,12 @@ bool EthBasePort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata
     if ((node != FW_NODE_BROADCAST) && !CheckFwBusGeneration("ReadBlock"))
         return false;
 
+    PhaseStart();
+
     // Flush before reading
-    int numFlushed = PacketFlushAll();
+    int numFlushed = DoPacketFlushAll();
     if (numFlushed > 0)
-        outStr << "ReadBlock: flushed " << numFlushed << " packets" << std::endl;
+        ErrorLog.Log(LogBlockFlushed, numFlushed);
 
     // Create buffer that is large enough for Firewire packet
     SetGenericBuffer();   // Make sure buffer is allocated
@@ -752,14 +924,22 @@ bool EthBasePort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata
 
     // Build FireWire packet
     make_bread_packet(reinterpret_cast<quadlet_t *>(sendPacket+GetPrefixOffset(WR_FW_HEADER)), node, addr, nbytes, fw_tl);
-    if (!PacketSend(sendPacket, sendPacketSize, flags&FW_NODE_ETH_BROADCAST_MASK))
+    double sendTime = Trace ? Amp1394_GetMonotonicTime() : 0.0;
+    AMP1394_PROBE3(packet_send_entry, node, sendPacketSize, fw_tl);
+    bool sendOK = DoPacketSend(sendPacket, sendPacketSize, flags&FW_NODE_ETH_BROADCAST_MASK);
+    AMP1394_PROBE1(packet_send_return, sendOK);
+    if (!sendOK) {
+        if (Trace) TraceRecord(BREAD, node, addr, nbytes, sendTime, 0.0, PacketTrace::STATUS_SEND_FAIL, flags);
         return false;
+    }
+    PhaseEnd(PHASE_SEND);
 
     // Invoke callback (if defined) between sending read request
     // and checking for read response. If callback returns false, we
     // skip checking for a received packet.
     if (eth_read_callback && !(*eth_read_callback)(*this, node, outStr)) {
         outStr << "ReadBlock: callback aborting (not reading packet)" << std::endl;
+        if (Trace) TraceRecord(BREAD, node, addr, nbytes, sendTime, 0.0, PacketTrace::STATUS_RECV_FAIL, flags);
         return false;
     }
 
@@ -773,20 +953,25 @@ bool EthBasePort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata
         packet = ReadBufferBroadcast;
     }
 
-    int nRecv = PacketReceive(packet, packetSize);
+    AMP1394_PROBE2(packet_receive_entry, node, packetSize);
+    int nRecv = DoPacketReceive(packet, packetSize);
+    AMP1394_PROBE1(packet_receive_return, nRecv);
+    PhaseEnd(PHASE_WAIT);
+    double recvTime = Trace ? Amp1394_GetMonotonicTime() : 0.0;
     if (nRecv != static_cast<int>(packetSize)) {
+        if (Trace) TraceRecord(BREAD, node, addr, nbytes, sendTime, recvTime, PacketTrace::STATUS_RECV_FAIL, flags);
         unsigned char boardId = Node2Board[node];
-        outStr << "ReadBlock: failed to receive read response from board " << (boardId&FW_NODE_MASK)
-               << ": return value = " << nRecv
-               << ", expected = " << packetSize << std::endl;
+        ErrorLog.Log(LogBlockReadFailed, boardId&FW_NODE_MASK, nRecv, packetSize);
         return false;
     }
 
     ProcessExtraData(packet+packetSize-FW_EXTRA_SIZE);
 
-    if (!CheckEthernetHeader(packet, false))
-        return false;
-    if (!CheckFirewirePacket(packet+GetPrefixOffset(RD_FW_HEADER), nbytes, node, EthBasePort::BRESPONSE, fw_tl))
+    bool ok = CheckEthernetHeader(packet, false) &&
+              CheckFirewirePacket(packet+GetPrefixOffset(RD_FW_HEADER), nbytes, node, EthBasePort::BRESPONSE, fw_tl);
+    if (Trace) TraceRecord(BREAD, node, addr, nbytes, sendTime, recvTime,
+                           ok ? PacketTrace::STATUS_OK : PacketTrace::STATUS_CHECK_FAIL, flags);
+    if (!ok)
         return false;
 
     const quadlet_t *packet_data = reinterpret_cast<const quadlet_t *>(packet+GetPrefixOffset(RD_FW_BDATA));
@@ -794,6 +979,7 @@ bool EthBasePort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata
         rtRead = false;
         memcpy(rdata, packet_data, nbytes);
     }
+    PhaseEnd(PHASE_RECEIVE);
     return true;
 }
 
@@ -803,6 +989,8 @@ bool EthBasePort::WriteBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *wdat
     if ((node != FW_NODE_BROADCAST) && !CheckFwBusGeneration("WriteBlock"))
         return false;
 
+    PhaseStart();
+
     // Packet to send
     SetGenericBuffer();   // Make sure buffer is allocated
     unsigned char *packet = GenericBuffer+GetWriteQuadAlign();
@@ -823,12 +1011,19 @@ bool EthBasePort::WriteBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *wdat
     make_bwrite_packet(reinterpret_cast<quadlet_t *>(packet+GetPrefixOffset(WR_FW_HEADER)), node, addr, wdata, nbytes, fw_tl);
 
     // Now, send the packet
-    return PacketSend(packet, packetSize, flags&FW_NODE_ETH_BROADCAST_MASK);
+    double sendTime = Trace ? Amp1394_GetMonotonicTime() : 0.0;
+    AMP1394_PROBE3(packet_send_entry, node, packetSize, fw_tl);
+    bool ret = DoPacketSend(packet, packetSize, flags&FW_NODE_ETH_BROADCAST_MASK);
+    AMP1394_PROBE1(packet_send_return, ret);
+    PhaseEnd(PHASE_SEND);
+    if (Trace) TraceRecord(BWRITE, node, addr, nbytes, sendTime, 0.0,
+                           ret ? PacketTrace::STATUS_OK : PacketTrace::STATUS_SEND_FAIL, flags);
+    return ret;
 }
 
 void EthBasePort::OnNoneRead(void)
 {
-    outStr << "Failed to read any board, check Ethernet physical connection" << std::endl;
+    ErrorLog.Log(LogNoneRead);
 }
 
 void EthBasePort::OnNoneWritten(void)
@@ -844,11 +1039,23 @@ void EthBasePort::OnFwBusReset(unsigned int FwBusGeneration_FPGA)
 
 bool EthBasePort::WriteBroadcastOutput(quadlet_t *buffer, unsigned int size)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetWriteBroadcastOutput(buffer, size);
+        return side->Transact(req);
+    }
     return WriteBlockNode(FW_NODE_BROADCAST, 0, buffer, size);
 }
 
 bool EthBasePort::WriteBroadcastReadRequest(unsigned int seq)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetWriteBroadcastReadRequest(seq);
+        return side->Transact(req);
+    }
     quadlet_t bcReqData = (seq << 16) | BoardInUseMask_;
     return WriteQuadlet(FW_NODE_BROADCAST, 0x1800, bcReqData);
 }
@@ -0,0 +1,661 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "EthLoopbackPort.h"
+#include "EthUdpPort.h"     // for ETH_MTU_DEFAULT and ETH_UDP_HEADER
+#include "Amp1394Time.h"
+#include "Amp1394BSwap.h"
+#include "FpgaIO.h"
+
+#include <string.h>  // for memcpy, memset
+#include <algorithm> // for std::min
+
+// CRC functions, defined in EthBasePort.cpp
+uint32_t BitReverse32(uint32_t input);
+uint32_t crc32(uint32_t crc, const void *buf, size_t size);
+
+// Emulated FPGA clock (same as FpgaIO)
+static const double EMU_SYSCLK = 49.152e6;
+
+// Emulated Ethernet speed (100 Mbps), in FPGA clock ticks per byte, used for the
+// FPGA receive/total times in the extra data
+static const double EMU_TICKS_PER_BYTE = 8.0*EMU_SYSCLK/100.0e6;
+
+// Maximum number of feedback quadlets per board (QLA1, Firmware Rev 8), see AmpIO::GetReadNumBytes
+static const unsigned int EMU_FB_QUADS = 4 + 2*4 + 5*4;
+
+// Emulated PROM busy times (seconds); the sector erase time is much shorter than on the
+// M25P16 (typically 0.6 seconds), so that programming tests do not take too long
+static const double EMU_PROM_PROGRAM_TIME = 0.0008;
+static const double EMU_PROM_ERASE_TIME = 0.02;
+
+EthLoopbackPort::EthLoopbackPort(int numBoards, std::ostream &debugStream, unsigned long fwVersion):
+    EthBasePort(0, debugStream),
+    isOpen(false),
+    NumEmulated(1),
+    EmuFirmware(fwVersion),
+    EmuBusGeneration(1),
+    ResponseDelay(0.0),
+    EmuSequence(0),
+    EmuQueryTime(0.0),
+    EmuHubQuads(0),
+    RequestSize(0),
+    ResponseSize(0)
+{
+    if ((numBoards < 1) || (numBoards > static_cast<int>(BoardIO::MAX_BOARDS)))
+        outStr << "EthLoopbackPort: invalid number of boards (" << numBoards << "), using 1" << std::endl;
+    else
+        NumEmulated = static_cast<unsigned int>(numBoards);
+    if ((EmuFirmware != 7) && (EmuFirmware != 8)) {
+        outStr << "EthLoopbackPort: unsupported firmware version (" << EmuFirmware << "), using 8" << std::endl;
+        EmuFirmware = 8;
+    }
+    for (unsigned int bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+        memset(EmuRegs[bd], 0, sizeof(EmuRegs[bd]));
+        memset(EmuEncPos[bd], 0, sizeof(EmuEncPos[bd]));
+        EmuLastRead[bd] = 0.0;
+        EmuProm[bd] = 0;
+        memset(EmuPromBuffer[bd], 0xff, sizeof(EmuPromBuffer[bd]));
+        EmuPromResult[bd] = 0;
+        EmuPromWEL[bd] = false;
+        EmuPromBusyUntil[bd] = 0.0;
+        EmuQlaProm[bd] = 0;
+        memset(EmuQlaPromBuffer[bd], 0xff, sizeof(EmuQlaPromBuffer[bd]));
+        for (unsigned int chan = 0; chan < EMU_QLA_PROM_CHANS; chan++) {
+            EmuQlaPromResult[bd][chan] = 0;
+            EmuQlaPromWEL[bd][chan] = false;
+        }
+        EmuDallas[bd] = 0;
+        EmuDallasAddr[bd] = 0;
+        EmuDallasBusyUntil[bd] = 0.0;
+    }
+    EmuHubBuffer = new quadlet_t[BoardIO::MAX_BOARDS*(EMU_FB_QUADS+1)+1];
+    Request = reinterpret_cast<unsigned char *>(RequestBuffer) + GetWriteQuadAlign();
+    Response = new unsigned char[MAX_POSSIBLE_DATA_SIZE+FW_BRESPONSE_HEADER_SIZE+FW_CRC_SIZE+FW_EXTRA_SIZE];
+    if (Init())
+        outStr << "Initialization done" << std::endl;
+    else
+        outStr << "Initialization failed" << std::endl;
+}
+
+EthLoopbackPort::~EthLoopbackPort()
+{
+    Cleanup();
+    delete [] EmuHubBuffer;
+    delete [] Response;
+    for (unsigned int bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+        delete [] EmuProm[bd];
+        delete [] EmuQlaProm[bd];
+        delete [] EmuDallas[bd];
+    }
+}
+
+bool EthLoopbackPort::Init(void)
+{
+    isOpen = true;
+    RequestSize = 0;
+
+    bool ret = ScanNodes();
+
+    if (ret)
+        SetDefaultProtocol();
+
+    return ret;
+}
+
+void EthLoopbackPort::Cleanup(void)
+{
+    isOpen = false;
+    RequestSize = 0;
+}
+
+nodeid_t EthLoopbackPort::InitNodes(void)
+{
+    // Same sequence as EthUdpPort::InitNodes, without the delays
+    if (!WriteQuadletNode(FW_NODE_BROADCAST, BoardIO::IP_ADDR, 0, FW_NODE_ETH_BROADCAST_MASK)) {
+        outStr << "InitNodes: failed to write IP address" << std::endl;
+        return 0;
+    }
+
+    quadlet_t data = 0x0;   // initialize data to 0
+
+    // Check hardware version of hub board
+    if (!ReadQuadletNode(FW_NODE_BROADCAST, BoardIO::HARDWARE_VERSION, data, FW_NODE_NOFORWARD_MASK)) {
+        outStr << "InitNodes: failed to read hardware version for hub/bridge board" << std::endl;
+        return 0;
+    }
+    if (!HardwareVersionValid(data)) {
+        outStr << "InitNodes: hub board is not a supported board, data = " << std::hex << data << std::endl;
+        return 0;
+    }
+
+    // ReadQuadletNode should have updated bus generation
+    FwBusGeneration = newFwBusGeneration;
+    outStr << "InitNodes: Firewire bus generation = " << FwBusGeneration << std::endl;
+
+    if (!WriteQuadletNode(FW_NODE_BROADCAST, BoardIO::FW_PHY_REQ, 0)) {
+        outStr << "InitNodes: failed to broadcast PHY command" << std::endl;
+        return 0;
+    }
+
+    // Find board id for hub board
+    if (!ReadQuadletNode(FW_NODE_BROADCAST, BoardIO::BOARD_STATUS, data, FW_NODE_NOFORWARD_MASK)) {
+        outStr << "InitNodes: failed to read board id for hub/bridge board" << std::endl;
+        return 0;
+    }
+    HubBoard = (data & BOARD_ID_MASK) >> 24;
+    outStr << "InitNodes: found hub board: " << static_cast<int>(HubBoard) << std::endl;
+
+    return BoardIO::MAX_BOARDS;
+}
+
+unsigned int EthLoopbackPort::GetPrefixOffset(MsgType msg) const
+{
+    switch (msg) {
+        case WR_CTRL:      return 0;
+        case WR_FW_HEADER: return FW_CTRL_SIZE;
+        case WR_FW_BDATA:  return FW_CTRL_SIZE+FW_BWRITE_HEADER_SIZE;
+        case RD_FW_HEADER: return 0;
+        case RD_FW_BDATA:  return FW_BRESPONSE_HEADER_SIZE;
+    }
+    outStr << "EthLoopbackPort::GetPrefixOffset: Invalid type: " << msg << std::endl;
+    return 0;
+}
+
+unsigned int EthLoopbackPort::GetMaxReadDataSize(void) const
+{
+    return (std::min(MAX_POSSIBLE_DATA_SIZE, ETH_MTU_DEFAULT-ETH_UDP_HEADER-FW_EXTRA_SIZE)
+            - FW_BRESPONSE_HEADER_SIZE - FW_CRC_SIZE);
+}
+
+unsigned int EthLoopbackPort::GetMaxWriteDataSize(void) const
+{
+    return (std::min(MAX_POSSIBLE_DATA_SIZE, ETH_MTU_DEFAULT-ETH_UDP_HEADER-FW_CTRL_SIZE)
+            - FW_BWRITE_HEADER_SIZE - FW_CRC_SIZE);
+}
+
+bool EthLoopbackPort::PacketSend(unsigned char *packet, size_t nbytes, bool)
+{
+    if (!isOpen) {
+        outStr << "PacketSend: loopback port not open" << std::endl;
+        return false;
+    }
+    if (nbytes < FW_CTRL_SIZE+FW_QREAD_SIZE) {
+        outStr << "PacketSend: packet too short (" << nbytes << " bytes)" << std::endl;
+        return false;
+    }
+    // Save read requests for PacketReceive
+    unsigned int tcode = packet[GetPrefixOffset(WR_FW_HEADER)+3] >> 4;
+    if ((tcode == QREAD) || (tcode == BREAD)) {
+        RequestSize = std::min(nbytes, static_cast<size_t>(FW_CTRL_SIZE+FW_BREAD_SIZE));
+        memcpy(Request, packet, RequestSize);
+    }
+    else {
+        ResponseSize = 0;
+        EmuProcessPacket(packet, nbytes);
+    }
+    return true;
+}
+
+int EthLoopbackPort::PacketReceive(unsigned char *packet, size_t nbytes)
+{
+    if (RequestSize == 0)
+        return 0;
+    if (ResponseDelay > 0.0) {
+        double tEnd = Amp1394_GetMonotonicTime()+ResponseDelay;
+        while (Amp1394_GetMonotonicTime() < tEnd);
+    }
+    ResponseSize = 0;
+    EmuProcessPacket(Request, RequestSize);
+    RequestSize = 0;
+    if (ResponseSize == 0)
+        return 0;
+    size_t n = std::min(ResponseSize, nbytes);
+    memcpy(packet, Response, n);
+    return static_cast<int>(n);
+}
+
+int EthLoopbackPort::PacketFlushAll(void)
+{
+    // Any pending request was sent before the caller started waiting for a new response,
+    // so its response (if any) is discarded
+    int numFlushed = (RequestSize > 0) ? 1 : 0;
+    RequestSize = 0;
+    return numFlushed;
+}
+
+// ---------------------------------------------------------
+// Emulation
+// ---------------------------------------------------------
+
+void EthLoopbackPort::EmuProcessPacket(const unsigned char *packet, size_t nbytes)
+{
+    // The request packet starts with the control word (FW_CTRL_SIZE), followed by the Firewire packet
+    // (see EthBasePort::make_1394_header). The Firewire packet is quadlet aligned.
+    const quadlet_t *fw = reinterpret_cast<const quadlet_t *>(packet+GetPrefixOffset(WR_FW_HEADER));
+    quadlet_t q0 = bswap_32(fw[0]);
+    quadlet_t q1 = bswap_32(fw[1]);
+    quadlet_t q2 = bswap_32(fw[2]);
+    unsigned int node = (q0 >> 16) & FW_NODE_MASK;
+    unsigned int tl = (q0 >> 10) & FW_TL_MASK;
+    unsigned int tcode = (q0 >> 4) & 0x000f;
+    nodeaddr_t addr = (static_cast<nodeaddr_t>(q1 & 0x0000ffff) << 32) | q2;
+    bool isBroadcast = (node == FW_NODE_BROADCAST);
+    // For broadcast reads (e.g., with FW_CTRL_NOFORWARD), the hub board responds
+    unsigned int respBoard = isBroadcast ? 0 : node;
+
+    // No board at the specified node
+    if (!isBroadcast && (node >= NumEmulated))
+        return;
+
+    double now = Amp1394_GetMonotonicTime();
+
+    switch (tcode) {
+
+    case QREAD:
+        {
+            quadlet_t *data = EmuMakeResponse(respBoard, QRESPONSE, tl);
+            data[0] = bswap_32(EmuReadRegister(respBoard, addr));
+            data[1] = bswap_32(BitReverse32(crc32(0U, Response, FW_QRESPONSE_SIZE-FW_CRC_SIZE)));
+            ResponseSize = FW_QRESPONSE_SIZE;
+            EmuAddExtraData(nbytes);
+        }
+        break;
+
+    case QWRITE:
+        {
+            quadlet_t data = bswap_32(fw[3]);
+            if (isBroadcast && (addr == 0x1800)) {
+                EmuBroadcastQuery(data);
+            }
+            else if (isBroadcast) {
+                for (unsigned int bd = 0; bd < NumEmulated; bd++)
+                    EmuWriteRegister(bd, addr, data);
+            }
+            else {
+                EmuWriteRegister(node, addr, data);
+            }
+        }
+        break;
+
+    case BREAD:
+        {
+            unsigned int nRead = (bswap_32(fw[3]) >> 16) & 0xffff;
+            unsigned int nQuads = nRead/sizeof(quadlet_t);
+            if ((nRead == 0) || (nRead > MAX_POSSIBLE_DATA_SIZE))
+                return;
+            quadlet_t *hdr = EmuMakeResponse(respBoard, BRESPONSE, tl);
+            hdr[0] = bswap_32(nRead << 16);
+            hdr[1] = bswap_32(BitReverse32(crc32(0U, Response, FW_BRESPONSE_HEADER_SIZE-FW_CRC_SIZE)));
+            quadlet_t *data = reinterpret_cast<quadlet_t *>(Response+FW_BRESPONSE_HEADER_SIZE);
+            memset(data, 0, nQuads*sizeof(quadlet_t));
+            unsigned int nValid = 0;
+            if (addr == 0) {
+                nValid = EmuGetFeedback(respBoard, data, now);
+            }
+            else if ((addr >= 0x2000) && (addr < 0x2000+EMU_PROM_PAGE/sizeof(quadlet_t))) {
+                // PROM read data (already in bus byte order)
+                unsigned int offset = static_cast<unsigned int>(addr-0x2000)*sizeof(quadlet_t);
+                memcpy(data, reinterpret_cast<unsigned char *>(EmuPromBuffer[respBoard])+offset,
+                       std::min(nRead, EMU_PROM_PAGE-offset));
+            }
+            else if ((addr >= 0x3100) && (addr < 0x3100+EMU_QLA_PROM_BLOCK)) {
+                // QLA PROM block read data (already in bus byte order)
+                unsigned int offset = static_cast<unsigned int>(addr-0x3100)*sizeof(quadlet_t);
+                memcpy(data, reinterpret_cast<unsigned char *>(EmuQlaPromBuffer[respBoard])+offset,
+                       std::min(nRead, static_cast<unsigned int>(sizeof(EmuQlaPromBuffer[respBoard]))-offset));
+            }
+            else if ((addr >= 0x6000) && (addr < 0x6000+EMU_DALLAS_BLOCK/sizeof(quadlet_t))) {
+                // DS2505 block data (bytes in memory order); zeros if no tool
+                if (EmuDallas[respBoard]) {
+                    unsigned int offset = static_cast<unsigned int>(addr-0x6000)*sizeof(quadlet_t);
+                    unsigned int nCopy = std::min(nRead, EMU_DALLAS_BLOCK-offset);
+                    unsigned int start = EmuDallasAddr[respBoard]+offset;
+                    if (start+nCopy <= EMU_DALLAS_SIZE)
+                        memcpy(data, EmuDallas[respBoard]+start, nCopy);
+                }
+            }
+            else if (addr == 0x1000) {
+                // Hub data, followed by timing information (read start and finish, relative to query)
+                nValid = EmuHubQuads;
+                memcpy(data, EmuHubBuffer, std::min(nValid, nQuads)*sizeof(quadlet_t));
+                if (nValid < nQuads) {
+                    unsigned int readStart = static_cast<unsigned int>((now-EmuQueryTime)*EMU_SYSCLK);
+                    unsigned int readFinish = readStart + static_cast<unsigned int>(nRead*EMU_TICKS_PER_BYTE);
+                    data[nValid++] = ((readStart & 0x3fff) << 16) | (readFinish & 0x3fff);
+                }
+            }
+            for (unsigned int i = 0; i < std::min(nValid, nQuads); i++)
+                data[i] = bswap_32(data[i]);
+            data[nQuads] = bswap_32(BitReverse32(crc32(0U, data, nRead)));
+            ResponseSize = FW_BRESPONSE_HEADER_SIZE+nRead+FW_CRC_SIZE;
+            EmuAddExtraData(nbytes);
+        }
+        break;
+
+    case BWRITE:
+        if (addr == 0x2000) {
+            // PROM page program: first quadlet is the command, followed by the data
+            unsigned int nWrite = (bswap_32(fw[3]) >> 16) & 0xffff;
+            if ((nWrite >= sizeof(quadlet_t)) && (nbytes >= GetPrefixOffset(WR_FW_BDATA)+nWrite)) {
+                const unsigned char *wdata = packet+GetPrefixOffset(WR_FW_BDATA);
+                quadlet_t cmd = bswap_32(*reinterpret_cast<const quadlet_t *>(wdata));
+                for (unsigned int bd = 0; bd < NumEmulated; bd++) {
+                    if (isBroadcast || (bd == node))
+                        EmuPromCommand(bd, cmd, wdata+sizeof(quadlet_t), nWrite-sizeof(quadlet_t));
+                }
+            }
+        }
+        else if ((addr >= 0x3100) && (addr < 0x3100+EMU_QLA_PROM_BLOCK)) {
+            // QLA PROM block write data
+            unsigned int nWrite = (bswap_32(fw[3]) >> 16) & 0xffff;
+            unsigned int offset = static_cast<unsigned int>(addr-0x3100)*sizeof(quadlet_t);
+            nWrite = std::min(nWrite, static_cast<unsigned int>(sizeof(EmuQlaPromBuffer[0]))-offset);
+            if (nbytes >= GetPrefixOffset(WR_FW_BDATA)+nWrite) {
+                for (unsigned int bd = 0; bd < NumEmulated; bd++) {
+                    if (isBroadcast || (bd == node))
+                        memcpy(reinterpret_cast<unsigned char *>(EmuQlaPromBuffer[bd])+offset,
+                               packet+GetPrefixOffset(WR_FW_BDATA), nWrite);
+                }
+            }
+        }
+        // Other write data (e.g., motor currents) is discarded
+        break;
+
+    default:
+        outStr << "EthLoopbackPort: unsupported tcode " << tcode << std::endl;
+        break;
+    }
+}
+
+quadlet_t EthLoopbackPort::EmuReadRegister(unsigned int board, nodeaddr_t addr) const
+{
+    switch (addr) {
+        case BoardIO::BOARD_STATUS:
+            // Number of axes in bits 31-28, board id in bits 27-24
+            return (EMU_NUM_AXES << 28) | (board << 24) | (EmuRegs[board][BoardIO::BOARD_STATUS] & 0x00ffffff);
+        case BoardIO::HARDWARE_VERSION:
+            return QLA1_String;
+        case BoardIO::FIRMWARE_VERSION:
+            return EmuFirmware;
+        case BoardIO::ETH_STATUS:
+            // Bit 31 set indicates FPGA V2
+            return 0x80000000 | (EmuRegs[board][BoardIO::ETH_STATUS] & 0x7fffffff);
+        case 0x08:
+            // PROM interface status: commands finish immediately
+            return 0;
+        case 0x09:
+            return EmuPromResult[board];
+        case 0x3002:
+            return EmuQlaPromResult[board][0];
+        case 0x3012:
+            return EmuQlaPromResult[board][1];
+        case 0x3022:
+            return EmuQlaPromResult[board][2];
+        case 13:
+            return EmuDallasStatus(board);
+    }
+    return (addr < EMU_NUM_REGS) ? EmuRegs[board][addr] : 0;
+}
+
+void EthLoopbackPort::EmuWriteRegister(unsigned int board, nodeaddr_t addr, quadlet_t data)
+{
+    if (addr == 0x08)
+        EmuPromCommand(board, data, 0, 0);
+    else if ((addr == 0x3000) || (addr == 0x3010) || (addr == 0x3020))
+        EmuQlaPromCommand(board, static_cast<unsigned int>((addr>>4)&0x3), data);
+    else if (addr == 13)
+        EmuDallasControl(board, data);
+    else if (addr < EMU_NUM_REGS)
+        EmuRegs[board][addr] = data;
+}
+
+unsigned int EthLoopbackPort::EmuGetFeedback(unsigned int board, quadlet_t *buf, double now)
+{
+    // Timestamp (cleared by each read)
+    double ticks = (EmuLastRead[board] > 0.0) ? (now-EmuLastRead[board])*EMU_SYSCLK : 0.0;
+    EmuLastRead[board] = now;
+    unsigned int n = 0;
+    buf[n++] = (ticks < 4294967295.0) ? static_cast<quadlet_t>(ticks) : 0xffffffff;
+    buf[n++] = EmuReadRegister(board, BoardIO::BOARD_STATUS);
+    buf[n++] = 0;                               // digital I/O
+    buf[n++] = 0;                               // temperature
+    unsigned int i;
+    // Motor current (lower half) and analog input (upper half), mid-range
+    for (i = 0; i < EMU_NUM_AXES; i++)
+        buf[n++] = 0x80008000;
+    // Encoder position (with midrange offset)
+    for (i = 0; i < EMU_NUM_AXES; i++) {
+        EmuEncPos[board][i] += static_cast<int32_t>(i+1);
+        buf[n++] = static_cast<quadlet_t>(EmuEncPos[board][i] + 0x00800000) & 0x00ffffff;
+    }
+    // Encoder velocity, quarter-cycle and running counter fields (constant)
+    for (i = 0; i < 4*EMU_NUM_AXES; i++)
+        buf[n++] = 0;
+    // Motor status (Firmware Rev 8)
+    if (EmuFirmware >= 8) {
+        for (i = 0; i < EMU_NUM_AXES; i++)
+            buf[n++] = 0;
+    }
+    return n;
+}
+
+void EthLoopbackPort::EmuBroadcastQuery(quadlet_t data)
+{
+    EmuSequence = data >> 16;
+    unsigned int mask = data & 0x0000ffff;
+    EmuQueryTime = Amp1394_GetMonotonicTime();
+    EmuHubQuads = 0;
+    for (unsigned int bd = 0; bd < NumEmulated; bd++) {
+        if (!(mask & (1 << bd)))
+            continue;
+        // Each board updates its hub data a few microseconds after the query
+        unsigned int updateTicks = static_cast<unsigned int>((5.0+5.0*bd)*1.0e-6*EMU_SYSCLK);
+        quadlet_t *quad0 = EmuHubBuffer+EmuHubQuads;
+        unsigned int nFb = EmuGetFeedback(bd, quad0+1, EmuQueryTime+updateTicks/EMU_SYSCLK);
+        if (EmuFirmware < 8) {
+            *quad0 = (EmuSequence << 16) | (updateTicks & 0x3fff);
+        }
+        else {
+            // Rev 8: block size in bits 31-24, lowest byte of sequence in bits 23-16
+            *quad0 = ((nFb+1) << 24) | ((EmuSequence & 0x00ff) << 16) | (updateTicks & 0x3fff);
+        }
+        EmuHubQuads += nFb+1;
+    }
+}
+
+void EthLoopbackPort::EmuPromCommand(unsigned int board, quadlet_t cmd, const unsigned char *data, unsigned int nbytes)
+{
+    if (!EmuProm[board]) {
+        EmuProm[board] = new unsigned char[EMU_PROM_SIZE];
+        memset(EmuProm[board], 0xff, EMU_PROM_SIZE);
+    }
+    unsigned char *prom = EmuProm[board];
+    uint32_t addr = cmd & (EMU_PROM_SIZE-1);
+    double now = Amp1394_GetMonotonicTime();
+    bool busy = (now < EmuPromBusyUntil[board]);
+    unsigned int i;
+
+    switch (cmd >> 24) {
+        case 0x9f:    // Read identification
+            EmuPromResult[board] = 0x00202015;
+            break;
+        case 0x05:    // Read status register
+            EmuPromResult[board] = (busy ? FpgaIO::MASK_WIP : 0) | (EmuPromWEL[board] ? FpgaIO::MASK_WEL : 0);
+            break;
+        case 0x06:    // Write enable
+            if (!busy) EmuPromWEL[board] = true;
+            break;
+        case 0x04:    // Write disable
+            if (!busy) EmuPromWEL[board] = false;
+            break;
+        case 0x03:    // Read data bytes (256 bytes are always read)
+            for (i = 0; i < EMU_PROM_PAGE; i++)
+                reinterpret_cast<unsigned char *>(EmuPromBuffer[board])[i] = prom[(addr+i)&(EMU_PROM_SIZE-1)];
+            EmuPromResult[board] = EMU_PROM_PAGE/sizeof(quadlet_t);
+            break;
+        case 0xd8:    // Sector erase
+            if (!busy && EmuPromWEL[board]) {
+                memset(prom+(addr&~0xffffu), 0xff, 0x10000);
+                EmuPromBusyUntil[board] = now+EMU_PROM_ERASE_TIME;
+            }
+            EmuPromWEL[board] = false;
+            break;
+        case 0x02:    // Page program (bits can only be cleared, address wraps within page)
+            if (!busy && EmuPromWEL[board]) {
+                nbytes = std::min(nbytes, static_cast<unsigned int>(EMU_PROM_PAGE));
+                uint32_t pageAddr = addr & ~(EMU_PROM_PAGE-1);
+                for (i = 0; i < nbytes; i++)
+                    prom[pageAddr+((addr+i)&(EMU_PROM_PAGE-1))] &= data[i];
+                EmuPromBusyUntil[board] = now+EMU_PROM_PROGRAM_TIME;
+                // Number of quadlets written, including the command
+                EmuPromResult[board] = nbytes/sizeof(quadlet_t)+1;
+            }
+            else {
+                EmuPromResult[board] = 0;
+            }
+            EmuPromWEL[board] = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void EthLoopbackPort::EmuQlaPromCommand(unsigned int board, unsigned int chan, quadlet_t cmd)
+{
+    if (!EmuQlaProm[board]) {
+        EmuQlaProm[board] = new unsigned char[EMU_QLA_PROM_CHANS*EMU_QLA_PROM_SIZE];
+        memset(EmuQlaProm[board], 0xff, EMU_QLA_PROM_CHANS*EMU_QLA_PROM_SIZE);
+    }
+    unsigned char *prom = EmuQlaProm[board]+chan*EMU_QLA_PROM_SIZE;
+    unsigned char *buffer = reinterpret_cast<unsigned char *>(EmuQlaPromBuffer[board]);
+    // 16-bit address (2 MSB ignored)
+    unsigned int addr = (cmd >> 8) & (EMU_QLA_PROM_SIZE-1);
+    unsigned int nBytes = ((cmd & 0x0f)+1)*sizeof(quadlet_t);   // for block read/write
+    unsigned int i;
+
+    switch (cmd >> 24) {
+        case 0x05:    // Read status register
+            EmuQlaPromResult[board][chan] = EmuQlaPromWEL[board][chan] ? FpgaIO::MASK_WEL : 0;
+            break;
+        case 0x06:    // Write enable
+            EmuQlaPromWEL[board][chan] = true;
+            break;
+        case 0x04:    // Write disable
+            EmuQlaPromWEL[board][chan] = false;
+            break;
+        case 0x03:    // Read byte
+            EmuQlaPromResult[board][chan] = prom[addr];
+            break;
+        case 0x02:    // Write byte
+            if (EmuQlaPromWEL[board][chan])
+                prom[addr] = static_cast<unsigned char>(cmd & 0xff);
+            EmuQlaPromWEL[board][chan] = false;
+            break;
+        case 0xfe:    // Block read (to buffer)
+            for (i = 0; i < nBytes; i++)
+                buffer[i] = prom[(addr+i)&(EMU_QLA_PROM_SIZE-1)];
+            break;
+        case 0xff:    // Block write (from buffer)
+            if (EmuQlaPromWEL[board][chan]) {
+                for (i = 0; i < nBytes; i++)
+                    prom[(addr+i)&(EMU_QLA_PROM_SIZE-1)] = buffer[i];
+            }
+            EmuQlaPromWEL[board][chan] = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void EthLoopbackPort::EmuDallasControl(unsigned int board, quadlet_t ctrl)
+{
+    // Shortened busy time (actual 1-wire read of one block takes much longer)
+    const double DALLAS_BUSY_TIME = 0.005;
+    switch (ctrl & 0x03) {
+        case 2:    // Start reading at address (bits 31:16)
+            EmuDallasAddr[board] = (ctrl >> 16) & (EMU_DALLAS_SIZE-1);
+            EmuDallasBusyUntil[board] = Amp1394_GetMonotonicTime()+DALLAS_BUSY_TIME;
+            break;
+        case 3:    // Read next block
+            EmuDallasAddr[board] = (EmuDallasAddr[board]+EMU_DALLAS_BLOCK) & (EMU_DALLAS_SIZE-1);
+            EmuDallasBusyUntil[board] = Amp1394_GetMonotonicTime()+DALLAS_BUSY_TIME;
+            break;
+        default:   // End of reading (DS2480B), not emulated
+            break;
+    }
+}
+
+quadlet_t EthLoopbackPort::EmuDallasStatus(unsigned int board) const
+{
+    // Bit 0: interface enabled; bits 2:1: reset result (1 = ACK received, 3 = no ACK);
+    // bit 13: busy (Firmware Rev 8); bits 31:24: family code (0x0B for DS2505)
+    if (Amp1394_GetMonotonicTime() < EmuDallasBusyUntil[board])
+        return (EmuFirmware >= 8) ? 0x00002011 : 0x00000011;
+    if (!EmuDallas[board])
+        return 0x00000007;
+    return 0x0B000003;
+}
+
+void EthLoopbackPort::SetEmulatedTool(unsigned int board, uint32_t model, uint8_t version, const std::string &name)
+{
+    if (board >= BoardIO::MAX_BOARDS)
+        return;
+    if (!EmuDallas[board])
+        EmuDallas[board] = new unsigned char[EMU_DALLAS_SIZE];
+    unsigned char *mem = EmuDallas[board];
+    memset(mem, 0, EMU_DALLAS_SIZE);
+    // Offsets as in AmpIO (DALLAS_START_READ, DALLAS_MODEL_OFFSET, etc.)
+    memcpy(mem+0x80, "997", 3);
+    mem[0xa4] = static_cast<unsigned char>(model >> 24);
+    mem[0xa5] = static_cast<unsigned char>(model >> 16);
+    mem[0xa6] = static_cast<unsigned char>(model >> 8);
+    mem[0xa7] = static_cast<unsigned char>(model);
+    mem[0xa8] = version;
+    memcpy(mem+0x160, name.c_str(), std::min(name.size(), static_cast<size_t>(0x17c-0x160)));
+}
+
+void EthLoopbackPort::ClearEmulatedTool(unsigned int board)
+{
+    if (board >= BoardIO::MAX_BOARDS)
+        return;
+    delete [] EmuDallas[board];
+    EmuDallas[board] = 0;
+}
+
+quadlet_t *EthLoopbackPort::EmuMakeResponse(unsigned int node, unsigned int tcode, unsigned int tl)
+{
+    // Destination is the PC (source node 0x10 in request), source is the responding node
+    quadlet_t *packet = reinterpret_cast<quadlet_t *>(Response);
+    packet[0] = bswap_32((0xFFD0 << 16) | ((tl & FW_TL_MASK) << 10) | ((tcode & 0x000F) << 4));
+    packet[1] = bswap_32((0xFFC0 | (node & FW_NODE_MASK)) << 16);
+    packet[2] = 0;
+    return packet+3;
+}
+
+void EthLoopbackPort::EmuAddExtraData(size_t requestBytes)
+{
+    unsigned char *extra = Response+ResponseSize;
+    extra[0] = 0;                                         // flags
+    extra[1] = static_cast<unsigned char>(EmuBusGeneration);
+    extra[2] = 0;                                         // numStateInvalid
+    extra[3] = 0;                                         // numPacketError
+    unsigned int recvTicks = static_cast<unsigned int>(requestBytes*EMU_TICKS_PER_BYTE);
+    unsigned int totalTicks = recvTicks + static_cast<unsigned int>(ResponseSize*EMU_TICKS_PER_BYTE);
+    unsigned short *extraW = reinterpret_cast<unsigned short *>(extra);
+    extraW[2] = bswap_16(static_cast<unsigned short>(std::min(recvTicks, 0xffffu)));
+    extraW[3] = bswap_16(static_cast<unsigned short>(std::min(totalTicks, 0xffffu)));
+    ResponseSize += FW_EXTRA_SIZE;
+}
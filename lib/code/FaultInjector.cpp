@@ -0,0 +1,219 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "FaultInjector.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>  // for memcpy
+
+FaultInjector::FaultInjector(const FaultConfig &config) :
+    Config(config), RngState(0), NumFlushed(0), RequestDropped(false), BusGenOffset(0),
+    PendHead(0), NumPend(0)
+{
+    PendBuffer = new unsigned char[MAX_PENDING*MAX_PACKET_SIZE];
+    Scratch = new unsigned char[MAX_PACKET_SIZE];
+    for (unsigned int i = 0; i < MAX_PENDING; i++)
+        PendSize[i] = 0;
+    ResetCounts();
+    Seed(Config.seed);
+}
+
+FaultInjector::~FaultInjector()
+{
+    delete [] PendBuffer;
+    delete [] Scratch;
+}
+
+void FaultInjector::Seed(uint32_t seed)
+{
+    // SplitMix64 to spread the seed over the state (which must not be 0)
+    uint64_t z = static_cast<uint64_t>(seed) + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    RngState = z ^ (z >> 31);
+    if (RngState == 0)
+        RngState = 0x9e3779b97f4a7c15ULL;
+}
+
+double FaultInjector::Uniform(void)
+{
+    // xorshift64*
+    RngState ^= RngState >> 12;
+    RngState ^= RngState << 25;
+    RngState ^= RngState >> 27;
+    uint64_t r = RngState * 0x2545f4914f6cdd1dULL;
+    // Upper 53 bits
+    return static_cast<double>(r >> 11) * (1.0/9007199254740992.0);
+}
+
+bool FaultInjector::Chance(double prob)
+{
+    // Do not advance the generator for disabled faults, so that enabling one fault
+    // does not change the sequence of the others more than necessary
+    if (prob <= 0.0)
+        return false;
+    return (Uniform() < prob);
+}
+
+double FaultInjector::Exponential(double mean)
+{
+    return -mean*log(1.0-Uniform());
+}
+
+double FaultInjector::ResponseDelay(void)
+{
+    double delay = Config.delayMin;
+    if (Config.delayMax > Config.delayMin)
+        delay += (Config.delayMax-Config.delayMin)*Uniform();
+    if (Chance(Config.tailProb)) {
+        delay += Exponential(Config.tailMean);
+        Count(FAULT_TAIL_DELAY);
+    }
+    return delay;
+}
+
+void FaultInjector::ResetCounts(void)
+{
+    for (unsigned int i = 0; i < FAULT_NUM; i++)
+        Counts[i] = 0;
+    NumFlushed = 0;
+}
+
+void FaultInjector::PrintCounts(std::ostream &out) const
+{
+    for (unsigned int i = 0; i < FAULT_NUM; i++)
+        out << ((i == 0) ? "" : ", ") << FaultName(static_cast<FaultType>(i)) << " " << Counts[i];
+    out << ", flushed " << NumFlushed;
+}
+
+const char *FaultInjector::FaultName(FaultType type)
+{
+    switch (type) {
+        case FAULT_REQUEST_DROP:   return "request-drop";
+        case FAULT_RESPONSE_DROP:  return "response-drop";
+        case FAULT_DUPLICATE:      return "duplicate";
+        case FAULT_LATE:           return "late";
+        case FAULT_REORDER:        return "reorder";
+        case FAULT_TAIL_DELAY:     return "tail-delay";
+        case FAULT_BUS_RESET:      return "bus-reset";
+        default:                   break;
+    }
+    return "unknown";
+}
+
+bool FaultInjector::PushPending(const unsigned char *packet, size_t nbytes)
+{
+    if ((NumPend == MAX_PENDING) || (nbytes > MAX_PACKET_SIZE))
+        return false;
+    unsigned int idx = (PendHead+NumPend)%MAX_PENDING;
+    memcpy(PendBuffer+idx*MAX_PACKET_SIZE, packet, nbytes);
+    PendSize[idx] = nbytes;
+    NumPend++;
+    return true;
+}
+
+size_t FaultInjector::PopPending(unsigned char *packet, size_t nbytes)
+{
+    if (NumPend == 0)
+        return 0;
+    size_t n = (PendSize[PendHead] < nbytes) ? PendSize[PendHead] : nbytes;
+    memcpy(packet, PendBuffer+PendHead*MAX_PACKET_SIZE, n);
+    PendHead = (PendHead+1)%MAX_PENDING;
+    NumPend--;
+    return n;
+}
+
+unsigned int FaultInjector::FlushPending(bool keepNewest)
+{
+    unsigned int numDiscard = NumPend;
+    if (keepNewest && (numDiscard > 0))
+        numDiscard--;
+    PendHead = (PendHead+numDiscard)%MAX_PENDING;
+    NumPend -= numDiscard;
+    NumFlushed += numDiscard;
+    return numDiscard;
+}
+
+// Parses "a:b" (b optional); returns false if a is missing
+static bool ParsePair(const std::string &value, double &a, double &b)
+{
+    const char *str = value.c_str();
+    char *end;
+    a = strtod(str, &end);
+    if (end == str)
+        return false;
+    if (*end == ':') {
+        const char *str2 = end+1;
+        b = strtod(str2, &end);
+        if (end == str2)
+            return false;
+    }
+    return (*end == 0);
+}
+
+bool FaultInjector::ParseSpec(const std::string &spec, FaultConfig &config, std::ostream &outStr)
+{
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string item = spec.substr(start, end-start);
+        start = end+1;
+        if (item.empty())
+            continue;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            outStr << "FaultInjector::ParseSpec: missing value for " << item << std::endl;
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        std::string value = item.substr(eq+1);
+        double a = 0.0;
+        double b = 0.0;
+        if (!ParsePair(value, a, b)) {
+            outStr << "FaultInjector::ParseSpec: invalid value for " << key << ": " << value << std::endl;
+            return false;
+        }
+        if (key == "reqdrop")
+            config.requestDrop = a;
+        else if (key == "drop")
+            config.responseDrop = a;
+        else if (key == "dup")
+            config.duplicate = a;
+        else if (key == "late")
+            config.late = a;
+        else if (key == "reorder")
+            config.reorder = a;
+        else if (key == "reset")
+            config.busReset = a;
+        else if (key == "delay") {
+            config.delayMin = a*1e-6;
+            config.delayMax = ((value.find(':') != std::string::npos) ? b : a)*1e-6;
+        }
+        else if (key == "tail") {
+            config.tailProb = a;
+            config.tailMean = b*1e-6;
+        }
+        else if (key == "seed")
+            config.seed = static_cast<uint32_t>(a);
+        else {
+            outStr << "FaultInjector::ParseSpec: unknown setting " << key << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
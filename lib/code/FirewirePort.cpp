@@ -256,6 +256,12 @@ bool FirewirePort::RemoveBoard(unsigned char boardId)
 
 bool FirewirePort::WriteBroadcastOutput(quadlet_t *buffer, unsigned int size)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetWriteBroadcastOutput(buffer, size);
+        return side->Transact(req);
+    }
 #if 1
     return WriteBlockNode(0, 0xffffffff0000, buffer, size);
 #else
@@ -266,6 +272,12 @@ bool FirewirePort::WriteBroadcastOutput(quadlet_t *buffer, unsigned int size)
 
 bool FirewirePort::WriteBroadcastReadRequest(unsigned int seq)
 {
+    SideChannel *side = GetRoutedSide();
+    if (side) {
+        SideRequest req;
+        req.SetWriteBroadcastReadRequest(seq);
+        return side->Transact(req);
+    }
     quadlet_t bcReqData = (seq << 16);
     if (IsAllBoardsRev4_5_ || IsBroadcastShorterWait())
         bcReqData += BoardInUseMask_;
@@ -350,7 +362,11 @@ bool FirewirePort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdat
         return false;
 
     rtRead = true;   // for debugging
-    return !raw1394_read(handle, baseNodeId+node, addr, nbytes, rdata);
+    // The raw1394 read is a single (blocking) transaction, so it is counted as PHASE_WAIT
+    PhaseStart();
+    bool ret = !raw1394_read(handle, baseNodeId+node, addr, nbytes, rdata);
+    PhaseEnd(PHASE_WAIT);
+    return ret;
 }
 
 bool FirewirePort::WriteBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *wdata,
@@ -360,5 +376,8 @@ bool FirewirePort::WriteBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *wda
         return false;
 
     rtWrite = true;   // for debugging
-    return !raw1394_write(handle, baseNodeId+node, addr, nbytes, wdata);
+    PhaseStart();
+    bool ret = !raw1394_write(handle, baseNodeId+node, addr, nbytes, wdata);
+    PhaseEnd(PHASE_SEND);
+    return ret;
 }
@@ -44,7 +44,8 @@ const double FPGA_sysclk_MHz        = 49.152;         /* FPGA sysclk in MHz (fro
     else { std::cerr << MSG.str() << std::endl; }
 
 
-FpgaIO::FpgaIO(uint8_t board_id) : BoardIO(board_id), firmwareTime(0.0)
+FpgaIO::FpgaIO(uint8_t board_id) : BoardIO(board_id), firmwareTime(0.0), firmwareTimeBase(0.0),
+                                   firmwareTicks(0)
 {
 }
 
@@ -61,26 +62,31 @@ FpgaIO::~FpgaIO()
 }
 
 std::string FpgaIO::GetFPGASerialNumber(void)
+{
+    uint8_t data[16];   // must be multiple of 4
+    std::string sn;
+    if (PromReadData(FPGA_SN_ADDR, data, sizeof(data)))
+        sn = ParseFPGASerialNumber(data);
+    else
+        std::cerr << "FpgaIO::GetFPGASerialNumber: failed to read FPGA Serial Number" << std::endl;
+    return sn;
+}
+
+std::string FpgaIO::ParseFPGASerialNumber(const uint8_t *data)
 {
     // Format: FPGA 1234-56 (12 bytes) or FPGA 1234-567 (13 bytes).
     // Note that on PROM, the string is terminated by 0xff because the sector
     // is first erased (all bytes set to 0xff) before the string is written.
-    uint32_t address = 0x001FFF00;
-    char data[20];
-    std::string sn;
     const size_t FPGASNSize = 13;
-    const size_t bytesToRead = (FPGASNSize+3)&0xFC;  // must be multiple of 4
-
-    data[FPGASNSize] = 0;    // Make sure null-terminated
-    if (PromReadData(address, (uint8_t *)data, bytesToRead)) {
-        if (strncmp(data, "FPGA ", 5) == 0) {
-            char *p = strchr(data+5, 0xff);
-            if (p) *p = 0;      // Null terminate at first 0xff
-            sn.assign(data+5);
-        }
+    char str[FPGASNSize+1];
+    memcpy(str, data, FPGASNSize);
+    str[FPGASNSize] = 0;    // Make sure null-terminated
+    std::string sn;
+    if (strncmp(str, "FPGA ", 5) == 0) {
+        char *p = strchr(str+5, 0xff);
+        if (p) *p = 0;      // Null terminate at first 0xff
+        sn.assign(str+5);
     }
-    else
-        std::cerr << "FpgaIO::GetFPGASerialNumber: failed to read FPGA Serial Number" << std::endl;
     return sn;
 }
 
@@ -240,6 +246,72 @@ bool FpgaIO::PromReadData(uint32_t addr, uint8_t *data,
     return true;
 }
 
+bool FpgaIO::PromReadDataFast(uint32_t addr, uint8_t *data, unsigned int nbytes,
+                              const ProgressCallback cb)
+{
+    uint32_t addr24 = addr&0x00ffffff;
+    if (addr24+nbytes > 0x00ffffff)
+        return false;
+    if (GetFirmwareVersion() < 4)
+        return PromReadData(addr, data, nbytes);
+
+    const unsigned int PAGE_SIZE = 256;
+    quadlet_t pageBuffer[PAGE_SIZE/sizeof(quadlet_t)];
+    unsigned int maxRead = port->GetMaxReadDataSize() & ~(sizeof(quadlet_t)-1);
+    if (maxRead > PAGE_SIZE) maxRead = PAGE_SIZE;
+    std::stringstream msg;
+
+    if ((nbytes > 0) && !port->WriteQuadlet(BoardId, 0x08, 0x03000000|addr24))  // 03h = Read Data Bytes
+        return false;
+    uint32_t page = 0;
+    while (page < nbytes) {
+        // Wait for read command to finish (4 LSB of status are 0). The PROM read (about 83 usec
+        // per page) overlaps the previous page's host processing, so check status before waiting.
+        quadlet_t read_data = 0x000f;
+        int i;
+        const int MAX_LOOP_CNT = 8;
+        for (i = 0; (i < MAX_LOOP_CNT) && read_data; i++) {
+            if (i > 0)
+                Amp1394_Sleep(0.00001);   // 10 usec
+            if (!port->ReadQuadlet(BoardId, 0x08, read_data)) return false;
+            read_data = read_data&0x000f;
+        }
+        if (read_data) {
+            msg << "PromReadDataFast: command failed to finish, status = " << std::hex << read_data;
+            ERROR_CALLBACK(cb, msg);
+            return false;
+        }
+        if (page == 0) {
+            // Firmware always reads 256 bytes (64 quadlets)
+            uint32_t nRead;
+            if (!PromGetResult(nRead) || (nRead*4 != PAGE_SIZE)) {
+                msg << "PromReadDataFast: failed to get PROM result or incorrect number of bytes";
+                ERROR_CALLBACK(cb, msg);
+                return false;
+            }
+        }
+
+        unsigned int bytesThisPage = ((nbytes-page) < PAGE_SIZE) ? (nbytes-page) : PAGE_SIZE;
+        unsigned int bytesToRead = (bytesThisPage+3)&~3u;
+        for (unsigned int offset = 0; offset < bytesToRead; offset += maxRead) {
+            unsigned int n = ((bytesToRead-offset) < maxRead) ? (bytesToRead-offset) : maxRead;
+            if (!port->ReadBlock(BoardId, 0x2000+offset/sizeof(quadlet_t), pageBuffer+offset/sizeof(quadlet_t), n))
+                return false;
+        }
+
+        // Start reading next page before processing this one
+        if ((page+PAGE_SIZE < nbytes) &&
+            !port->WriteQuadlet(BoardId, 0x08, 0x03000000|(addr24+page+PAGE_SIZE)))
+            return false;
+
+        memcpy(data+page, pageBuffer, bytesThisPage);
+        page += bytesThisPage;
+        if (cb && !(*cb)(0))
+            return false;
+    }
+    return true;
+}
+
 bool FpgaIO::PromWriteEnable(PromType type)
 {
     quadlet_t write_data = 0x06000000;
@@ -272,6 +344,24 @@ bool FpgaIO::PromSectorErase(uint32_t addr, const ProgressCallback cb)
     return true;
 }
 
+bool FpgaIO::PromSectorEraseAll(BasePort *port, uint32_t addr)
+{
+    if (!port)
+        return false;
+    // Same as PromWriteEnable, followed by sector erase command
+    if (!port->WriteQuadlet(FW_NODE_BROADCAST, 0x08, 0x06000000))
+        return false;
+    return port->WriteQuadlet(FW_NODE_BROADCAST, 0x08, 0xd8000000 | (addr&0x00ffffff));
+}
+
+bool FpgaIO::PromGetStatusAll(BasePort *port)
+{
+    if (!port || !port->WriteQuadlet(FW_NODE_BROADCAST, 0x08, 0x05000000))
+        return false;
+    port->PromDelay();
+    return true;
+}
+
 int FpgaIO::PromProgramPage(uint32_t addr, const uint8_t *bytes,
                            unsigned int nbytes, const ProgressCallback cb)
 {
@@ -304,6 +394,153 @@ int FpgaIO::PromProgramPage(uint32_t addr, const uint8_t *bytes,
         ERROR_CALLBACK(cb, msg);
         return -1;
     }
+    return PromProgramPageWait(nbytes, cb);
+}
+
+bool FpgaIO::PromWaitInterface(void)
+{
+    const int MAX_LOOP_CNT = 100;
+    quadlet_t read_data = 0x000f;
+    for (int i = 0; (i < MAX_LOOP_CNT) && (read_data&0x000f); i++) {
+        if (!port->ReadQuadlet(BoardId, 0x08, read_data))
+            return false;
+    }
+    return !(read_data&0x000f);
+}
+
+// Fill buffer with the page program command followed by the data (padded with FF,
+// which does not change the erased PROM, to a multiple of 4 bytes). Returns the size
+// (in bytes) of the data, including padding.
+static unsigned int PromPreparePage(quadlet_t *buffer, uint32_t addr, const uint8_t *bytes,
+                                    unsigned int nbytes)
+{
+    buffer[0] = bswap_32(0x02000000 | (addr & 0x00ffffff));
+    unsigned char *data = reinterpret_cast<unsigned char *>(buffer+1);
+    memcpy(data, bytes, nbytes);
+    unsigned int npadded = (nbytes+3)&~3u;
+    for (unsigned int i = nbytes; i < npadded; i++)
+        data[i] = 0xff;
+    return npadded;
+}
+
+int FpgaIO::PromProgramData(uint32_t addr, const uint8_t *bytes, unsigned int nbytes,
+                            const ProgressCallback cb, PromProgramStats *stats)
+{
+    const unsigned int PAGE_SIZE = 256;           // 64 quadlets
+    const double PAGE_TIME_TYPICAL = 0.00064;     // M25P16 typical page program time (max 5 msec)
+    const double PAGE_TIMEOUT = 0.1;
+    const double BACKOFF_MIN = 0.00002;           // 20 usec
+    const double BACKOFF_MAX = 0.0005;            // 500 usec
+
+    PromProgramStats localStats;
+    if (!stats)
+        stats = &localStats;
+    if (stats->pageTime <= 0.0)
+        stats->pageTime = PAGE_TIME_TYPICAL;
+
+    uint32_t fver = GetFirmwareVersion();
+    nodeaddr_t address = (fver >= 4) ? 0x2000 : 0xc0;
+    std::ostringstream msg;
+
+    // Two page buffers (command + data): one being programmed and one being prepared
+    quadlet_t pageBuffer[2][PAGE_SIZE/sizeof(quadlet_t)+1];
+    unsigned int cur = 0;
+    double startTime = Amp1394_GetTime();
+    double elapsedStart = stats->elapsedTime;
+
+    // Pages cannot cross a 256-byte boundary
+    unsigned int offset = 0;
+    unsigned int curBytes = PAGE_SIZE - (addr%PAGE_SIZE);
+    if (curBytes > nbytes) curBytes = nbytes;
+    unsigned int curPadded = PromPreparePage(pageBuffer[cur], addr, bytes, curBytes);
+
+    while (curBytes > 0) {
+        if (!PromWriteEnable() ||
+            !port->WriteBlock(BoardId, address, pageBuffer[cur], curPadded+sizeof(quadlet_t))) {
+            msg << "FpgaIO::PromProgramData: failed to write page at " << std::hex << addr+offset;
+            ERROR_CALLBACK(cb, msg);
+            return -1;
+        }
+        double sendTime = Amp1394_GetTime();
+
+        // Prepare next page while the PROM is busy
+        unsigned int nextOffset = offset+curBytes;
+        unsigned int nextBytes = ((nbytes-nextOffset) < PAGE_SIZE) ? (nbytes-nextOffset) : PAGE_SIZE;
+        unsigned int nextPadded = 0;
+        if (nextBytes > 0)
+            nextPadded = PromPreparePage(pageBuffer[1-cur], addr+nextOffset, bytes+nextOffset, nextBytes);
+
+        // Check that the page was written to the PROM; the result is the number of
+        // quadlets written, including the command
+        uint32_t nWritten = 0;
+        if (!PromWaitInterface() || !PromGetResult(nWritten) ||
+            (nWritten != curPadded/sizeof(quadlet_t)+1)) {
+            msg << "FpgaIO::PromProgramData: failed to program page at " << std::hex << addr+offset
+                << ", result = " << std::dec << nWritten;
+            ERROR_CALLBACK(cb, msg);
+            return -1;
+        }
+
+        // Wait for "Write in Progress" bit to be cleared: first wait for most of the
+        // estimated page program time, then poll with exponential backoff
+        double firstWait = 0.75*stats->pageTime - (Amp1394_GetTime()-sendTime);
+        if (firstWait > 0.0)
+            Amp1394_Sleep(firstWait);
+        double backoff = BACKOFF_MIN;
+        uint32_t status = MASK_WIP;
+        while (status&MASK_WIP) {
+            if (!port->WriteQuadlet(BoardId, 0x08, 0x05000000) || !PromWaitInterface() ||
+                !PromGetResult(status)) {
+                msg << "FpgaIO::PromProgramData: could not get PROM status";
+                ERROR_CALLBACK(cb, msg);
+                return -1;
+            }
+            stats->numPolls++;
+            if (!(status&MASK_WIP))
+                break;
+            if ((Amp1394_GetTime()-sendTime) > PAGE_TIMEOUT) {
+                msg << "FpgaIO::PromProgramData: timeout programming page at " << std::hex << addr+offset;
+                ERROR_CALLBACK(cb, msg);
+                return -1;
+            }
+            Amp1394_Sleep(backoff);
+            backoff = (2.0*backoff < BACKOFF_MAX) ? 2.0*backoff : BACKOFF_MAX;
+        }
+        double now = Amp1394_GetTime();
+        stats->pageTime = 0.875*stats->pageTime + 0.125*(now-sendTime);
+        stats->numBytes += curBytes;
+        stats->numPages++;
+        stats->elapsedTime = elapsedStart + (now-startTime);
+
+        offset = nextOffset;
+        curBytes = nextBytes;
+        curPadded = nextPadded;
+        cur = 1-cur;
+        if (cb && !(*cb)(0))
+            break;
+    }
+    return static_cast<int>(offset);
+}
+
+bool FpgaIO::PromProgramPageAll(BasePort *port, uint32_t addr, const uint8_t *bytes,
+                                unsigned int nbytes)
+{
+    const unsigned int MAX_PAGE = 256;  // 64 quadlets
+    if (!port || (nbytes > MAX_PAGE))
+        return false;
+    // Same as PromWriteEnable
+    if (!port->WriteQuadlet(FW_NODE_BROADCAST, 0x08, 0x06000000))
+        return false;
+    // Same format as PromProgramPage (Firmware Rev 4+ address)
+    uint8_t page_data[MAX_PAGE+sizeof(quadlet_t)];
+    quadlet_t *data_ptr = reinterpret_cast<quadlet_t *>(page_data);
+    data_ptr[0] = bswap_32(0x02000000 | (addr & 0x00ffffff));
+    memcpy(page_data+sizeof(quadlet_t), bytes, nbytes);
+    return port->WriteBlock(FW_NODE_BROADCAST, 0x2000, data_ptr, nbytes+sizeof(quadlet_t));
+}
+
+int FpgaIO::PromProgramPageWait(unsigned int nbytes, const ProgressCallback cb, bool waitWIP)
+{
     // Read FPGA status register; if 4 LSB are 0, command has finished
     quadlet_t read_data;
     if (!port->ReadQuadlet(BoardId, 0x08, read_data)) return -1;
@@ -313,24 +550,26 @@ int FpgaIO::PromProgramPage(uint32_t addr, const uint8_t *bytes,
     }
     if (read_data & 0xff000000) { // shouldn't happen
         std::ostringstream msg;
-        msg << "FpgaIO::PromProgramPage: FPGA error = " << read_data;
+        msg << "FpgaIO::PromProgramPageWait: FPGA error = " << read_data;
         ERROR_CALLBACK(cb, msg);
     }
     // Now, read result. This should be the number of quadlets written.
     uint32_t nWritten;
     if (!PromGetResult(nWritten)) {
         std::ostringstream msg;
-        msg << "FpgaIO::PromProgramPage: could not get PROM result";
+        msg << "FpgaIO::PromProgramPageWait: could not get PROM result";
         ERROR_CALLBACK(cb, msg);
     }
     if (nWritten > 0)
         nWritten = 4*(nWritten-1);  // convert from quadlets to bytes
     if (nWritten != nbytes) {
         std::ostringstream msg;
-        msg << "FpgaIO::PromProgramPage: wrote " << nWritten << " of "
+        msg << "FpgaIO::PromProgramPageWait: wrote " << nWritten << " of "
             << nbytes << " bytes";
         ERROR_CALLBACK(cb, msg);
     }
+    if (!waitWIP)
+        return nWritten;
     // Wait for "Write in Progress" bit to be cleared
     uint32_t status;
     bool ret = PromGetStatus(status);
@@ -340,7 +579,7 @@ int FpgaIO::PromProgramPage(uint32_t addr, const uint8_t *bytes,
         }
         else {
             std::ostringstream msg;
-            msg << "FpgaIO::PromProgramPage: could not get PROM status" << std::endl;
+            msg << "FpgaIO::PromProgramPageWait: could not get PROM status" << std::endl;
             ERROR_CALLBACK(cb, msg);
         }
         ret = PromGetStatus(status);
@@ -434,6 +673,8 @@ bool FpgaIO::PromReadBlock25AA128(uint16_t addr, quadlet_t *data, unsigned int n
     nodeaddr_t address = GetPromAddress(prom_type, true);
     if (!port->WriteQuadlet(BoardId, address, write_data))
         return false;
+    // Wait for read to finish, as in PromReadByte25AA128
+    port->PromDelay();
 
     // get result
     if (!port->ReadBlock(BoardId, (address|0x0100), data, nquads * 4))
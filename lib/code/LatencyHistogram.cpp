@@ -0,0 +1,118 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "LatencyHistogram.h"
+#include <iomanip>
+
+LatencyHistogram::LatencyHistogram() : sumNs(0), baseSumNs(0)
+{
+    for (unsigned int i = 0; i < NUM_BUCKETS; i++) {
+        counts[i] = 0;
+        baseCounts[i] = 0;
+    }
+}
+
+void LatencyHistogram::Reset(void)
+{
+    for (unsigned int i = 0; i < NUM_BUCKETS; i++)
+        baseCounts[i] = counts[i];
+    baseSumNs = sumNs;
+}
+
+uint32_t LatencyHistogram::GetBucketCount(unsigned int index) const
+{
+    // Unsigned subtraction also handles wrap-around of the counter
+    return (index < NUM_BUCKETS) ? (counts[index]-baseCounts[index]) : 0;
+}
+
+uint64_t LatencyHistogram::GetCount(void) const
+{
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < NUM_BUCKETS; i++)
+        total += GetBucketCount(i);
+    return total;
+}
+
+uint64_t LatencyHistogram::GetBucketLowNs(unsigned int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+    unsigned int shift = index/HALF_BUCKETS - 1;
+    return static_cast<uint64_t>(index - shift*HALF_BUCKETS) << shift;
+}
+
+uint64_t LatencyHistogram::GetBucketHighNs(unsigned int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+    unsigned int shift = index/HALF_BUCKETS - 1;
+    return GetBucketLowNs(index) + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+double LatencyHistogram::GetMin(void) const
+{
+    for (unsigned int i = 0; i < NUM_BUCKETS; i++) {
+        if (GetBucketCount(i) > 0)
+            return GetBucketLowNs(i)*1.0e-9;
+    }
+    return 0.0;
+}
+
+double LatencyHistogram::GetMax(void) const
+{
+    for (unsigned int i = NUM_BUCKETS; i > 0; i--) {
+        if (GetBucketCount(i-1) > 0)
+            return GetBucketHighNs(i-1)*1.0e-9;
+    }
+    return 0.0;
+}
+
+double LatencyHistogram::GetMean(void) const
+{
+    uint64_t num = GetCount();
+    return (num > 0) ? ((sumNs-baseSumNs)*1.0e-9)/num : 0.0;
+}
+
+double LatencyHistogram::GetPercentile(double pct) const
+{
+    uint64_t num = GetCount();
+    if (num == 0)
+        return 0.0;
+    if (pct < 0.0) pct = 0.0;
+    if (pct > 100.0) pct = 100.0;
+    // Nearest rank (at least 1)
+    uint64_t rank = static_cast<uint64_t>(pct*num/100.0);
+    if (rank*100.0 < pct*num) rank++;
+    if (rank < 1) rank = 1;
+    uint64_t cum = 0;
+    for (unsigned int i = 0; i < NUM_BUCKETS; i++) {
+        cum += GetBucketCount(i);
+        if (cum >= rank)
+            return GetBucketHighNs(i)*1.0e-9;
+    }
+    return GetMax();
+}
+
+void LatencyHistogram::PrintSummary(std::ostream &outStr) const
+{
+    std::ios_base::fmtflags flags = outStr.flags();
+    std::streamsize prec = outStr.precision();
+    outStr << "n: " << GetCount() << std::fixed << std::setprecision(2)
+           << ", min: " << GetMin()*1e6 << ", median: " << GetPercentile(50.0)*1e6
+           << ", p99: " << GetPercentile(99.0)*1e6 << ", p99.9: " << GetPercentile(99.9)*1e6
+           << ", max: " << GetMax()*1e6 << ", mean: " << GetMean()*1e6 << " (usec)";
+    outStr.flags(flags);
+    outStr.precision(prec);
+}
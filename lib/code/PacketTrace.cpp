@@ -0,0 +1,191 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "PacketTrace.h"
+#include <fstream>
+#include <string.h>
+
+static const char PacketTraceMagic[8] = { 'P', 'K', 'T', 'T', 'R', 'A', 'C', 'E' };
+
+PacketTrace::PacketTrace(unsigned int numRecords) : Head(0), TriggerIndex(NO_TRIGGER),
+    TriggerRequest(false), Frozen(false), PostTriggerRemaining(0), TriggerLatency(0.0),
+    TriggerOnError(false)
+{
+    Size = 16;
+    while ((Size < numRecords) && (Size < 0x80000000))
+        Size <<= 1;
+    Mask = Size-1;
+    PostTriggerCount = Size/2;
+    Ring = new PacketTraceRecord[Size];
+    memset(Ring, 0, Size*sizeof(PacketTraceRecord));
+}
+
+PacketTrace::~PacketTrace()
+{
+    delete [] Ring;
+}
+
+void PacketTrace::Record(uint8_t tcode, uint8_t node, uint8_t tl, uint32_t addr, unsigned int nbytes,
+                         double sendTime, double recvTime, double fpgaRecvTime, double fpgaTotalTime,
+                         uint8_t status, uint8_t flags, uint8_t busGeneration)
+{
+    if (Frozen)
+        return;
+
+    uint32_t h = Head;
+    PacketTraceRecord &rec = Ring[h&Mask];
+    rec.sendTime = sendTime;
+    rec.recvTime = recvTime;
+    rec.index = h;
+    rec.addr = addr;
+    rec.fpgaRecvTime = static_cast<float>(fpgaRecvTime);
+    rec.fpgaTotalTime = static_cast<float>(fpgaTotalTime);
+    rec.nbytes = static_cast<uint16_t>(nbytes);
+    rec.tcode = tcode;
+    rec.node = node;
+    rec.tl = tl;
+    rec.status = status;
+    rec.busGeneration = busGeneration;
+
+    bool trigger = false;
+    if (TriggerIndex == NO_TRIGGER) {
+        if (TriggerRequest)
+            trigger = true;
+        else if ((TriggerLatency > 0.0) && (recvTime > 0.0) && (recvTime-sendTime > TriggerLatency))
+            trigger = true;
+        else if (TriggerOnError && (status != STATUS_OK))
+            trigger = true;
+    }
+    rec.flags = trigger ? (flags|FLAG_TRIGGER) : flags;
+
+    AMP1394_MEMORY_BARRIER();
+    Head = h+1;
+
+    if (trigger) {
+        TriggerRequest = false;
+        TriggerIndex = h;
+        PostTriggerRemaining = PostTriggerCount;
+        if (PostTriggerRemaining == 0)
+            Frozen = true;
+    }
+    else if (TriggerIndex != NO_TRIGGER) {
+        if (--PostTriggerRemaining == 0)
+            Frozen = true;
+    }
+}
+
+void PacketTrace::Arm(void)
+{
+    TriggerRequest = false;
+    TriggerIndex = NO_TRIGGER;
+    AMP1394_MEMORY_BARRIER();
+    Frozen = false;
+}
+
+void PacketTrace::GetRecords(std::vector<PacketTraceRecord> &records) const
+{
+    uint32_t h1 = Head;
+    AMP1394_MEMORY_BARRIER();
+    uint32_t num = (h1 < Size) ? h1 : Size;
+    uint32_t start = h1-num;
+    records.resize(num);
+    for (uint32_t i = 0; i < num; i++)
+        records[i] = Ring[(start+i)&Mask];
+    AMP1394_MEMORY_BARRIER();
+    uint32_t h2 = Head;
+
+    // Discard the records that may have been overwritten during the copy; this includes the
+    // slot at h2, which the writer may be filling. Unsigned arithmetic handles wrap-around.
+    uint32_t numValid = 0;
+    for (uint32_t i = 0; i < num; i++) {
+        uint32_t index = start+i;
+        if ((h2-index < Size) && (records[i].index == index))
+            records[numValid++] = records[i];
+    }
+    records.resize(numValid);
+}
+
+bool PacketTrace::Dump(const std::string &fileName, uint32_t portType, std::ostream &outStr) const
+{
+    std::vector<PacketTraceRecord> records;
+    GetRecords(records);
+
+    std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+    if (!file.good()) {
+        outStr << "PacketTrace::Dump: failed to open " << fileName << std::endl;
+        return false;
+    }
+
+    PacketTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PacketTraceMagic, sizeof(header.magic));
+    header.version = FILE_VERSION;
+    header.recordSize = sizeof(PacketTraceRecord);
+    header.numRecords = static_cast<uint32_t>(records.size());
+    header.triggerIndex = TriggerIndex;
+    header.portType = portType;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!records.empty())
+        file.write(reinterpret_cast<const char *>(&records[0]), records.size()*sizeof(PacketTraceRecord));
+    if (!file.good()) {
+        outStr << "PacketTrace::Dump: failed to write " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PacketTrace::ReadFile(const std::string &fileName, PacketTraceFileHeader &header,
+                           std::vector<PacketTraceRecord> &records, std::ostream &outStr)
+{
+    std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!file.good()) {
+        outStr << "PacketTrace::ReadFile: failed to open " << fileName << std::endl;
+        return false;
+    }
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file.good() || (memcmp(header.magic, PacketTraceMagic, sizeof(header.magic)) != 0)) {
+        outStr << "PacketTrace::ReadFile: " << fileName << " is not a packet trace file" << std::endl;
+        return false;
+    }
+    if (header.version != FILE_VERSION) {
+        outStr << "PacketTrace::ReadFile: unsupported version " << std::hex << header.version << std::dec
+               << " (different byte order?)" << std::endl;
+        return false;
+    }
+    if (header.recordSize != sizeof(PacketTraceRecord)) {
+        outStr << "PacketTrace::ReadFile: record size " << header.recordSize << ", expected "
+               << sizeof(PacketTraceRecord) << std::endl;
+        return false;
+    }
+    records.resize(header.numRecords);
+    if (header.numRecords > 0)
+        file.read(reinterpret_cast<char *>(&records[0]), header.numRecords*sizeof(PacketTraceRecord));
+    if (!file.good()) {
+        outStr << "PacketTrace::ReadFile: failed to read " << header.numRecords << " records" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const char *PacketTrace::StatusString(uint8_t status)
+{
+    switch (status) {
+        case STATUS_OK:         return "ok";
+        case STATUS_SEND_FAIL:  return "send-fail";
+        case STATUS_RECV_FAIL:  return "recv-fail";
+        case STATUS_CHECK_FAIL: return "check-fail";
+    }
+    return "unknown";
+}
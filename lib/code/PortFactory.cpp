@@ -25,6 +25,8 @@ http://www.cisst.org/cisst/license.txt.
 #include "EthRawPort.h"
 #endif
 #include "EthUdpPort.h"
+#include "EthLoopbackPort.h"
+#include "ReplayPort.h"
 
 BasePort * PortFactory(const char * args, std::ostream & debugStream)
 {
@@ -65,6 +67,14 @@ BasePort * PortFactory(const char * args, std::ostream & debugStream)
 #endif
         break;
 
+    case BasePort::PORT_ETH_LOOPBACK:
+        port = new EthLoopbackPort(portNumber, debugStream);
+        break;
+
+    case BasePort::PORT_REPLAY:
+        port = new ReplayPort(IPaddr, debugStream);
+        break;
+
     default:
         debugStream << "PortFactory: Unsupported port type" << std::endl;
         break;
@@ -0,0 +1,202 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "ReplayPort.h"
+#include "Amp1394Time.h"
+
+#include <string.h>  // for memcpy, memset
+
+ReplayPort::ReplayPort(const std::string &fileName, std::ostream &debugStream):
+    BasePort(0, debugStream),
+    FileName(fileName),
+    Reader(debugStream),
+    isOpen(false),
+    RealTime(false),
+    Loop(false),
+    EndOfFile(false),
+    NumPlayed(0),
+    CurFrame(0),
+    FirstFrameTime(0.0),
+    PlayStartTime(0.0)
+{
+    if (Init())
+        outStr << "Initialization done" << std::endl;
+    else
+        outStr << "Initialization failed" << std::endl;
+}
+
+ReplayPort::~ReplayPort()
+{
+    Cleanup();
+}
+
+bool ReplayPort::Init(void)
+{
+    if (!Reader.Open(FileName))
+        return false;
+    isOpen = true;
+    EndOfFile = false;
+    CurFrame = 0;
+
+    bool ret = ScanNodes();
+    if (ret) {
+        HubBoard = static_cast<unsigned char>(GetConfig().hubBoard);
+        Protocol_ = static_cast<ProtocolType>(GetConfig().protocol);
+    }
+    return ret;
+}
+
+void ReplayPort::Cleanup(void)
+{
+    isOpen = false;
+    CurFrame = 0;
+    Reader.Close();
+}
+
+nodeid_t ReplayPort::InitNodes(void)
+{
+    outStr << "InitNodes: replaying " << FileName << std::endl;
+    return BoardIO::MAX_BOARDS;
+}
+
+bool ReplayPort::Rewind(void)
+{
+    CurFrame = 0;
+    EndOfFile = false;
+    NumPlayed = 0;
+    return Reader.Rewind();
+}
+
+bool ReplayPort::NextFrame(void)
+{
+    // Skip frames without read data (i.e., WriteAllBoards without ReadAllBoards)
+    bool rewound = false;
+    for (;;) {
+        CurFrame = Reader.NextFrame();
+        if (CurFrame) {
+            if (CurFrame->flags & TelemetryRecorder::FRAME_READ)
+                break;
+        }
+        else if (Loop && !rewound && Reader.Rewind()) {
+            rewound = true;
+            NumPlayed = 0;
+        }
+        else {
+            EndOfFile = true;
+            return false;
+        }
+    }
+
+    double frameTime = CurFrame->readStartTime;
+    if (NumPlayed == 0) {
+        FirstFrameTime = frameTime;
+        PlayStartTime = Amp1394_GetMonotonicTime();
+    }
+    else if (RealTime) {
+        // Sleep for most of the remaining time, then busy wait for better accuracy
+        double remaining = (frameTime-FirstFrameTime) - (Amp1394_GetMonotonicTime()-PlayStartTime);
+        if (remaining > 0.002)
+            Amp1394_Sleep(remaining-0.001);
+        while ((Amp1394_GetMonotonicTime()-PlayStartTime) < (frameTime-FirstFrameTime)) {}
+    }
+    NumPlayed++;
+    return true;
+}
+
+bool ReplayPort::ReadAllBoards(void)
+{
+    if (!isOpen || !NextFrame()) {
+        SetReadInvalid();
+        return false;
+    }
+    // Use the recorded protocol, and set the sequence number so that BasePort::ReadAllBoardsBroadcast
+    // sends (and expects) the recorded one
+    ProtocolType recProtocol = static_cast<ProtocolType>(CurFrame->protocol);
+    if (Protocol_ != recProtocol) {
+        outStr << "ReplayPort::ReadAllBoards: using recorded protocol " << ProtocolString(recProtocol)
+               << " instead of " << ProtocolString(Protocol_) << std::endl;
+        Protocol_ = recProtocol;
+    }
+    if (CurFrame->flags & TelemetryRecorder::FRAME_BROADCAST)
+        bcReadInfo.readSequence = (CurFrame->bcReadSequence == 1) ? 65535 : CurFrame->bcReadSequence-1;
+    return BasePort::ReadAllBoards();
+}
+
+bool ReplayPort::ReadQuadletNode(nodeid_t node, nodeaddr_t addr, quadlet_t &data, unsigned char)
+{
+    const TelemetrySegmentHeader &config = GetConfig();
+    if (!isOpen || (node >= BoardIO::MAX_BOARDS) || !(config.boardMask & (1 << node)))
+        return false;
+    switch (addr) {
+        case BoardIO::BOARD_STATUS:
+            data = static_cast<quadlet_t>(node) << 24;
+            return true;
+        case BoardIO::HARDWARE_VERSION:
+            data = config.hardwareVersion[node];
+            return true;
+        case BoardIO::FIRMWARE_VERSION:
+            data = config.firmwareVersion[node];
+            return true;
+        case BoardIO::ETH_STATUS:
+            // See BoardIO::GetFpgaVersionMajorFromStatus
+            if (config.fpgaVersion[node] == 2)
+                data = 0x80000000;
+            else if (config.fpgaVersion[node] == 3)
+                data = 0x40000000;
+            else
+                data = 0;
+            return true;
+    }
+    return false;
+}
+
+bool ReplayPort::WriteQuadletNode(nodeid_t, nodeaddr_t, quadlet_t, unsigned char)
+{
+    return isOpen;
+}
+
+bool ReplayPort::WriteBlockNode(nodeid_t, nodeaddr_t, quadlet_t *, unsigned int, unsigned char)
+{
+    return isOpen;
+}
+
+bool ReplayPort::ReadBlockNode(nodeid_t node, nodeaddr_t addr, quadlet_t *rdata,
+                               unsigned int nbytes, unsigned char)
+{
+    if (!CurFrame)
+        return false;
+    unsigned int nquads = nbytes/sizeof(quadlet_t);
+    if (addr == 0x1000) {
+        // Hub data (broadcast read)
+        if (!(CurFrame->flags & TelemetryRecorder::FRAME_BROADCAST) || (node != GetNodeId(HubBoard)))
+            return false;
+        unsigned int numCopy = (nquads < CurFrame->readQuads) ? nquads : CurFrame->readQuads;
+        memcpy(rdata, TelemetryReader::GetReadData(CurFrame), numCopy*sizeof(quadlet_t));
+        if (numCopy < nquads)
+            memset(rdata+numCopy, 0, (nquads-numCopy)*sizeof(quadlet_t));
+        return true;
+    }
+    else if (addr == 0) {
+        // Board feedback (sequential read)
+        if ((node >= BoardIO::MAX_BOARDS) || (CurFrame->flags & TelemetryRecorder::FRAME_BROADCAST))
+            return false;
+        const TelemetryBoardRecord &rec = CurFrame->board[node];
+        if (!(rec.flags & TelemetryRecorder::BOARD_READ_VALID) || (rec.readQuads != nquads))
+            return false;
+        memcpy(rdata, TelemetryReader::GetReadData(CurFrame, node), nbytes);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,352 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "SideChannel.h"
+#include "Amp1394Time.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// ********************************** SideRequest ****************************************
+
+SideRequest::SideRequest() : ReqType(QREAD), BoardId(0), Addr(0), Quadlet(0), Data(0), NumBytes(0),
+    State(IDLE), SubmitTime(0.0), DoneTime(0.0)
+{
+}
+
+void SideRequest::SetReadQuadlet(unsigned char boardId, nodeaddr_t addr)
+{
+    ReqType = QREAD;
+    BoardId = boardId;
+    Addr = addr;
+    Quadlet = 0;
+    Data = 0;
+    NumBytes = sizeof(quadlet_t);
+}
+
+void SideRequest::SetWriteQuadlet(unsigned char boardId, nodeaddr_t addr, quadlet_t data)
+{
+    ReqType = QWRITE;
+    BoardId = boardId;
+    Addr = addr;
+    Quadlet = data;
+    Data = 0;
+    NumBytes = sizeof(quadlet_t);
+}
+
+void SideRequest::SetReadBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *buf, unsigned int numBytes)
+{
+    ReqType = BREAD;
+    BoardId = boardId;
+    Addr = addr;
+    Data = buf;
+    NumBytes = numBytes;
+}
+
+void SideRequest::SetWriteBlock(unsigned char boardId, nodeaddr_t addr, quadlet_t *buf, unsigned int numBytes)
+{
+    ReqType = BWRITE;
+    BoardId = boardId;
+    Addr = addr;
+    Data = buf;
+    NumBytes = numBytes;
+}
+
+void SideRequest::SetWriteBroadcastOutput(quadlet_t *buf, unsigned int numBytes)
+{
+    ReqType = BC_OUTPUT;
+    BoardId = 0;
+    Addr = 0;
+    Data = buf;
+    NumBytes = numBytes;
+}
+
+void SideRequest::SetWriteBroadcastReadRequest(unsigned int seq)
+{
+    ReqType = BC_READ_REQUEST;
+    BoardId = 0;
+    Addr = 0;
+    Quadlet = seq;
+    Data = 0;
+    NumBytes = sizeof(quadlet_t);
+}
+
+SideRequest::Status SideRequest::GetStatus(void) const
+{
+    int state = State;
+    AMP1394_MEMORY_BARRIER();
+    return static_cast<Status>(state);
+}
+
+bool SideRequest::IsDone(void) const
+{
+    Status status = GetStatus();
+    return (status == DONE) || (status == FAILED);
+}
+
+bool SideRequest::Wait(double timeoutSec, double pollSec) const
+{
+    double start = Amp1394_GetMonotonicTime();
+    while (!IsDone()) {
+        if ((timeoutSec >= 0.0) && (Amp1394_GetMonotonicTime()-start > timeoutSec))
+            return false;
+        Amp1394_Sleep(pollSec);
+    }
+    return Succeeded();
+}
+
+// ********************************** SideChannel ****************************************
+
+SideChannel::SideChannel(unsigned int maxPerCycle, double budgetSec, double timeoutSec) :
+    MaxPerCycle(maxPerCycle), Budget(budgetSec), Timeout(timeoutSec), Enabled(true), Head(0), NumQueued(0),
+    IOThreadSet(false), AvgTime(0.0), NumProcessed(0), NumFailed(0), NumRejected(0), NumTimedOut(0),
+    NumOverBudget(0), MaxQueued(0)
+{
+    if (MaxPerCycle == 0)
+        MaxPerCycle = 1;
+#ifdef _WIN32
+    CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+    InitializeCriticalSection(cs);
+    MutexHandle = cs;
+    IOThreadHandle = new DWORD(0);
+#else
+    pthread_mutex_t *mutex = new pthread_mutex_t;
+    pthread_mutex_init(mutex, 0);
+    MutexHandle = mutex;
+    IOThreadHandle = new pthread_t;
+#endif
+    for (unsigned int i = 0; i < MAX_QUEUED; i++)
+        Queue[i] = 0;
+}
+
+SideChannel::~SideChannel()
+{
+    FailAll();
+#ifdef _WIN32
+    CRITICAL_SECTION *cs = static_cast<CRITICAL_SECTION *>(MutexHandle);
+    DeleteCriticalSection(cs);
+    delete cs;
+    delete static_cast<DWORD *>(IOThreadHandle);
+#else
+    pthread_mutex_t *mutex = static_cast<pthread_mutex_t *>(MutexHandle);
+    pthread_mutex_destroy(mutex);
+    delete mutex;
+    delete static_cast<pthread_t *>(IOThreadHandle);
+#endif
+}
+
+void SideChannel::Lock(void) const
+{
+#ifdef _WIN32
+    EnterCriticalSection(static_cast<CRITICAL_SECTION *>(MutexHandle));
+#else
+    pthread_mutex_lock(static_cast<pthread_mutex_t *>(MutexHandle));
+#endif
+}
+
+void SideChannel::Unlock(void) const
+{
+#ifdef _WIN32
+    LeaveCriticalSection(static_cast<CRITICAL_SECTION *>(MutexHandle));
+#else
+    pthread_mutex_unlock(static_cast<pthread_mutex_t *>(MutexHandle));
+#endif
+}
+
+void SideChannel::Configure(unsigned int maxPerCycle, double budgetSec, double timeoutSec)
+{
+    Lock();
+    MaxPerCycle = (maxPerCycle == 0) ? 1 : maxPerCycle;
+    Budget = budgetSec;
+    Timeout = timeoutSec;
+    Unlock();
+}
+
+void SideChannel::GetLimits(unsigned int &maxPerCycle, double &budgetSec) const
+{
+    Lock();
+    maxPerCycle = MaxPerCycle;
+    budgetSec = Budget;
+    Unlock();
+}
+
+void SideChannel::Enable(bool enable)
+{
+    Lock();
+    Enabled = enable;
+    if (!enable)
+        FailAllLocked();
+    Unlock();
+}
+
+bool SideChannel::IsEnabled(void) const
+{
+    bool enabled = Enabled;
+    AMP1394_MEMORY_BARRIER();
+    return enabled;
+}
+
+void SideChannel::SetIOThread(void)
+{
+    // Normally, only set once (or if the I/O thread changes)
+#ifdef _WIN32
+    DWORD *id = static_cast<DWORD *>(IOThreadHandle);
+    DWORD self = GetCurrentThreadId();
+    if (IOThreadSet && (*id == self))
+        return;
+    *id = self;
+#else
+    pthread_t *id = static_cast<pthread_t *>(IOThreadHandle);
+    pthread_t self = pthread_self();
+    if (IOThreadSet && pthread_equal(*id, self))
+        return;
+    *id = self;
+#endif
+    AMP1394_MEMORY_BARRIER();
+    IOThreadSet = true;
+}
+
+bool SideChannel::IsOtherThread(void) const
+{
+    if (!IOThreadSet)
+        return false;
+    AMP1394_MEMORY_BARRIER();
+#ifdef _WIN32
+    return (*static_cast<DWORD *>(IOThreadHandle) != GetCurrentThreadId());
+#else
+    return !pthread_equal(*static_cast<pthread_t *>(IOThreadHandle), pthread_self());
+#endif
+}
+
+bool SideChannel::Submit(SideRequest &req)
+{
+    bool ret = false;
+    Lock();
+    if (!Enabled) {
+        // Disabled
+    }
+    else if ((req.State == SideRequest::QUEUED) || (req.State == SideRequest::ACTIVE)) {
+        // Already submitted
+    }
+    else if (NumQueued == MAX_QUEUED) {
+        NumRejected++;
+    }
+    else {
+        req.SubmitTime = Amp1394_GetMonotonicTime();
+        req.DoneTime = 0.0;
+        req.State = SideRequest::QUEUED;
+        Queue[(Head+NumQueued)%MAX_QUEUED] = &req;
+        NumQueued++;
+        if (NumQueued > MaxQueued)
+            MaxQueued = NumQueued;
+        ret = true;
+    }
+    Unlock();
+    return ret;
+}
+
+bool SideChannel::Cancel(SideRequest &req)
+{
+    return Remove(req, false);
+}
+
+bool SideChannel::Remove(SideRequest &req, bool timedOut)
+{
+    bool removed = false;
+    Lock();
+    for (unsigned int i = 0; i < NumQueued; i++) {
+        if (Queue[(Head+i)%MAX_QUEUED] == &req) {
+            // Shift later requests to keep the queue in order
+            for (unsigned int j = i; j+1 < NumQueued; j++)
+                Queue[(Head+j)%MAX_QUEUED] = Queue[(Head+j+1)%MAX_QUEUED];
+            NumQueued--;
+            req.State = SideRequest::FAILED;
+            if (timedOut)
+                NumTimedOut++;
+            removed = true;
+            break;
+        }
+    }
+    Unlock();
+    // If being performed, wait until done (the I/O thread uses the request and data buffer)
+    while (req.GetStatus() == SideRequest::ACTIVE)
+        Amp1394_Sleep(0.0001);
+    return removed;
+}
+
+bool SideChannel::Transact(SideRequest &req)
+{
+    Lock();
+    double timeout = Timeout;
+    Unlock();
+    if (!Submit(req))
+        return false;
+    if (req.Wait(timeout))
+        return true;
+    if (Remove(req, true))
+        return false;
+    return req.Succeeded();
+}
+
+void SideChannel::FailAll(void)
+{
+    Lock();
+    FailAllLocked();
+    Unlock();
+}
+
+void SideChannel::FailAllLocked(void)
+{
+    for (unsigned int i = 0; i < NumQueued; i++)
+        Queue[(Head+i)%MAX_QUEUED]->State = SideRequest::FAILED;
+    NumQueued = 0;
+}
+
+SideRequest *SideChannel::Pop(void)
+{
+    SideRequest *req = 0;
+    Lock();
+    if (NumQueued > 0) {
+        req = Queue[Head];
+        Head = (Head+1)%MAX_QUEUED;
+        NumQueued--;
+        req->State = SideRequest::ACTIVE;
+    }
+    Unlock();
+    return req;
+}
+
+void SideChannel::Complete(SideRequest *req, bool ok, double elapsedSec)
+{
+    AvgTime = (NumProcessed == 0) ? elapsedSec : 0.9*AvgTime + 0.1*elapsedSec;
+    NumProcessed++;
+    if (!ok)
+        NumFailed++;
+    req->DoneTime = Amp1394_GetMonotonicTime();
+    // Make sure result is visible before the state
+    AMP1394_MEMORY_BARRIER();
+    req->State = ok ? SideRequest::DONE : SideRequest::FAILED;
+}
+
+unsigned int SideChannel::GetNumQueued(void) const
+{
+    Lock();
+    unsigned int n = NumQueued;
+    Unlock();
+    return n;
+}
@@ -0,0 +1,549 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include "TelemetryRecorder.h"
+#include "Amp1394Time.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const char TelemetryMagic[8] = { 'A', 'M', 'P', 'T', 'E', 'L', 'E', 'M' };
+
+TelemetryRecorder::TelemetryRecorder(std::ostream &ostr) : outStr(ostr), Ring(0), NumSlots(0),
+    Head(0), Tail(0), CurFrame(0), FrameOpen(false), FrameNum(0), NumDropped(0), NumFileDropped(0),
+    NumWritten(0), SegmentSize(0), MaxSegments(0), SegmentIndex(0), SegFile(0), SegData(0),
+    SegError(false), SegUsed(0), SegFrames(0), Running(false), StopRequest(false), ThreadHandle(0)
+{
+    memset(&Config, 0, sizeof(Config));
+}
+
+TelemetryRecorder::~TelemetryRecorder()
+{
+    Stop();
+    delete [] Ring;
+}
+
+std::string TelemetryRecorder::SegmentFileName(const std::string &fileBase, unsigned int index)
+{
+    std::stringstream name;
+    name << fileBase << "-" << std::setw(3) << std::setfill('0') << index << ".tlm";
+    return name.str();
+}
+
+bool TelemetryRecorder::Start(const std::string &fileBase, const TelemetrySegmentHeader &config,
+                              unsigned int numSlots, uint32_t segmentSize, unsigned int maxSegments)
+{
+    if (Running) {
+        outStr << "TelemetryRecorder::Start: already running" << std::endl;
+        return false;
+    }
+    if (segmentSize < sizeof(TelemetrySegmentHeader)+MAX_FRAME_SIZE) {
+        outStr << "TelemetryRecorder::Start: segment size " << segmentSize << " too small (min = "
+               << sizeof(TelemetrySegmentHeader)+MAX_FRAME_SIZE << " bytes)" << std::endl;
+        return false;
+    }
+
+    unsigned int size = 4;
+    while ((size < numSlots) && (size < 0x10000))
+        size <<= 1;
+    if (size != NumSlots) {
+        delete [] Ring;
+        NumSlots = size;
+        Ring = new unsigned char[static_cast<size_t>(NumSlots)*MAX_FRAME_SIZE];
+    }
+    Head = 0;
+    Tail = 0;
+    CurFrame = 0;
+    FrameOpen = false;
+    FrameNum = 0;
+    NumDropped = 0;
+    NumFileDropped = 0;
+    NumWritten = 0;
+
+    FileBase = fileBase;
+    Config = config;
+    memcpy(Config.magic, TelemetryMagic, sizeof(Config.magic));
+    Config.version = FILE_VERSION;
+    Config.headerSize = sizeof(TelemetrySegmentHeader);
+    Config.frameHeaderSize = sizeof(TelemetryFrameHeader);
+    Config.startTime = Amp1394_GetMonotonicTime();
+    SegmentSize = segmentSize;
+    MaxSegments = maxSegments;
+    SegmentIndex = 0;
+    SegError = false;
+    if (!OpenSegment())
+        return false;
+
+    StopRequest = false;
+    Running = true;
+#ifdef _WIN32
+    HANDLE handle = CreateThread(0, 0, ThreadEntry, this, 0, 0);
+    if (handle == 0) {
+        Running = false;
+        CloseSegment();
+        outStr << "TelemetryRecorder::Start: failed to create thread" << std::endl;
+        return false;
+    }
+    ThreadHandle = handle;
+#else
+    pthread_t *thread = new pthread_t;
+    if (pthread_create(thread, 0, ThreadEntry, this) != 0) {
+        delete thread;
+        Running = false;
+        CloseSegment();
+        outStr << "TelemetryRecorder::Start: failed to create thread" << std::endl;
+        return false;
+    }
+    ThreadHandle = thread;
+#endif
+    return true;
+}
+
+void TelemetryRecorder::Stop(void)
+{
+    if (!Running)
+        return;
+    if (FrameOpen)
+        CommitFrame();
+    StopRequest = true;
+#ifdef _WIN32
+    HANDLE handle = static_cast<HANDLE>(ThreadHandle);
+    WaitForSingleObject(handle, INFINITE);
+    CloseHandle(handle);
+#else
+    pthread_t *thread = static_cast<pthread_t *>(ThreadHandle);
+    pthread_join(*thread, 0);
+    delete thread;
+#endif
+    ThreadHandle = 0;
+    Running = false;
+    CloseSegment();
+}
+
+// The slot layout is: frame header, read data (MAX_READ_BYTES), write data (MAX_WRITE_BYTES).
+// CommitFrame moves the write data to follow the read data.
+
+static quadlet_t *FrameReadData(TelemetryFrameHeader *frame)
+{
+    return reinterpret_cast<quadlet_t *>(reinterpret_cast<unsigned char *>(frame)+sizeof(TelemetryFrameHeader));
+}
+
+static quadlet_t *FrameWriteData(TelemetryFrameHeader *frame)
+{
+    return FrameReadData(frame)+TelemetryRecorder::MAX_READ_BYTES/sizeof(quadlet_t);
+}
+
+void TelemetryRecorder::StartFrame(uint32_t protocol)
+{
+    FrameOpen = true;
+    if (Head-Tail >= NumSlots) {
+        CurFrame = 0;
+        NumDropped = NumDropped+1;
+    }
+    else {
+        CurFrame = reinterpret_cast<TelemetryFrameHeader *>(Ring+static_cast<size_t>(Head&(NumSlots-1))*MAX_FRAME_SIZE);
+        memset(CurFrame, 0, sizeof(TelemetryFrameHeader));
+        CurFrame->frameNum = FrameNum;
+        CurFrame->protocol = protocol;
+    }
+    FrameNum++;
+}
+
+void TelemetryRecorder::CommitFrame(void)
+{
+    FrameOpen = false;
+    if (!CurFrame)
+        return;
+    unsigned int numQuads = CurFrame->readQuads+CurFrame->writeQuads;
+    if (CurFrame->writeQuads > 0)
+        memmove(FrameReadData(CurFrame)+CurFrame->readQuads, FrameWriteData(CurFrame),
+                CurFrame->writeQuads*sizeof(quadlet_t));
+    if (numQuads&1)
+        FrameReadData(CurFrame)[numQuads++] = 0;   // pad to multiple of 8 bytes
+    CurFrame->frameSize = sizeof(TelemetryFrameHeader)+numQuads*sizeof(quadlet_t);
+    CurFrame = 0;
+    AMP1394_MEMORY_BARRIER();
+    Head = Head+1;
+}
+
+void TelemetryRecorder::BeginRead(double hostTime, uint32_t protocol)
+{
+    if (!Running)
+        return;
+    if (FrameOpen)
+        CommitFrame();
+    StartFrame(protocol);
+    if (CurFrame) {
+        CurFrame->readStartTime = hostTime;
+        CurFrame->flags |= FRAME_READ;
+    }
+}
+
+void TelemetryRecorder::AddReadData(unsigned int boardId, const quadlet_t *data, unsigned int nbytes)
+{
+    if (!CurFrame || (boardId >= BoardIO::MAX_BOARDS))
+        return;
+    unsigned int numQuads = nbytes/sizeof(quadlet_t);
+    if ((CurFrame->readQuads+numQuads)*sizeof(quadlet_t) > MAX_READ_BYTES) {
+        CurFrame->flags |= FRAME_TRUNCATED;
+        return;
+    }
+    memcpy(FrameReadData(CurFrame)+CurFrame->readQuads, data, numQuads*sizeof(quadlet_t));
+    CurFrame->board[boardId].readOffset = CurFrame->readQuads;
+    CurFrame->board[boardId].readQuads = numQuads;
+    CurFrame->readQuads += numQuads;
+}
+
+void TelemetryRecorder::SetHubReadData(const quadlet_t *data, unsigned int nbytes)
+{
+    if (!CurFrame)
+        return;
+    unsigned int numQuads = nbytes/sizeof(quadlet_t);
+    if (numQuads*sizeof(quadlet_t) > MAX_READ_BYTES) {
+        CurFrame->flags |= FRAME_TRUNCATED;
+        return;
+    }
+    memcpy(FrameReadData(CurFrame), data, numQuads*sizeof(quadlet_t));
+    CurFrame->readQuads = numQuads;
+    CurFrame->flags |= FRAME_BROADCAST;
+}
+
+void TelemetryRecorder::SetBoardReadOffset(unsigned int boardId, unsigned int offsetQuads, unsigned int numQuads)
+{
+    if (!CurFrame || (boardId >= BoardIO::MAX_BOARDS) || (offsetQuads+numQuads > CurFrame->readQuads))
+        return;
+    CurFrame->board[boardId].readOffset = offsetQuads;
+    CurFrame->board[boardId].readQuads = numQuads;
+}
+
+void TelemetryRecorder::EndRead(double hostTime, bool ok)
+{
+    if (!CurFrame)
+        return;
+    CurFrame->readEndTime = hostTime;
+    if (ok)
+        CurFrame->flags |= FRAME_READ_OK;
+}
+
+void TelemetryRecorder::BeginWrite(double hostTime, uint32_t protocol)
+{
+    if (!Running)
+        return;
+    if (!FrameOpen)
+        StartFrame(protocol);
+    if (CurFrame) {
+        CurFrame->writeStartTime = hostTime;
+        CurFrame->flags |= FRAME_WRITE;
+    }
+}
+
+void TelemetryRecorder::AddWriteData(unsigned int boardId, const quadlet_t *data, unsigned int nbytes)
+{
+    if (!CurFrame || (boardId >= BoardIO::MAX_BOARDS))
+        return;
+    unsigned int numQuads = nbytes/sizeof(quadlet_t);
+    if ((CurFrame->writeQuads+numQuads)*sizeof(quadlet_t) > MAX_WRITE_BYTES) {
+        CurFrame->flags |= FRAME_TRUNCATED;
+        return;
+    }
+    memcpy(FrameWriteData(CurFrame)+CurFrame->writeQuads, data, numQuads*sizeof(quadlet_t));
+    CurFrame->board[boardId].writeOffset = CurFrame->writeQuads;
+    CurFrame->board[boardId].writeQuads = numQuads;
+    CurFrame->writeQuads += numQuads;
+}
+
+void TelemetryRecorder::EndWrite(double hostTime, bool ok)
+{
+    if (!FrameOpen)
+        return;
+    if (CurFrame) {
+        CurFrame->writeEndTime = hostTime;
+        if (ok)
+            CurFrame->flags |= FRAME_WRITE_OK;
+    }
+    CommitFrame();
+}
+
+bool TelemetryRecorder::OpenSegment(void)
+{
+    if (SegError)
+        return false;
+    if (MaxSegments && (SegmentIndex >= MaxSegments)) {
+        outStr << "TelemetryRecorder: maximum number of segments (" << MaxSegments
+               << ") reached, recording stopped" << std::endl;
+        SegError = true;
+        return false;
+    }
+    std::string fileName = SegmentFileName(FileBase, SegmentIndex);
+    SegFile = fopen(fileName.c_str(), "w+b");
+    if (!SegFile) {
+        outStr << "TelemetryRecorder: failed to create " << fileName << std::endl;
+        SegError = true;
+        return false;
+    }
+    Config.segmentIndex = SegmentIndex;
+    Config.numFrames = 0;
+    Config.dataBytes = 0;
+#ifdef _WIN32
+    // Memory-mapped files are not implemented for Windows; use buffered writes instead
+    SegData = 0;
+    fwrite(&Config, sizeof(Config), 1, SegFile);
+#else
+    // Size the file for the maximum segment size, so that it can be mapped; CloseSegment
+    // truncates it to the size actually used.
+    int fd = fileno(SegFile);
+    void *addr = MAP_FAILED;
+    if (ftruncate(fd, SegmentSize) == 0)
+        addr = mmap(0, SegmentSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        outStr << "TelemetryRecorder: failed to map " << fileName << std::endl;
+        fclose(SegFile);
+        SegFile = 0;
+        SegError = true;
+        return false;
+    }
+    SegData = static_cast<unsigned char *>(addr);
+    memcpy(SegData, &Config, sizeof(Config));
+#endif
+    SegUsed = sizeof(TelemetrySegmentHeader);
+    SegFrames = 0;
+    SegmentIndex++;
+    return true;
+}
+
+void TelemetryRecorder::CloseSegment(void)
+{
+    if (!SegFile)
+        return;
+    Config.numFrames = SegFrames;
+    Config.dataBytes = SegUsed-sizeof(TelemetrySegmentHeader);
+#ifdef _WIN32
+    fseek(SegFile, 0, SEEK_SET);
+    fwrite(&Config, sizeof(Config), 1, SegFile);
+#else
+    memcpy(SegData, &Config, sizeof(Config));
+    munmap(SegData, SegmentSize);
+    SegData = 0;
+    if (ftruncate(fileno(SegFile), SegUsed) != 0)
+        outStr << "TelemetryRecorder: failed to truncate segment " << Config.segmentIndex << std::endl;
+#endif
+    fclose(SegFile);
+    SegFile = 0;
+}
+
+void TelemetryRecorder::WriteFrame(const TelemetryFrameHeader *frame)
+{
+    if (!SegFile || (SegUsed+frame->frameSize > SegmentSize)) {
+        CloseSegment();
+        if (!OpenSegment()) {
+            NumFileDropped = NumFileDropped+1;
+            return;
+        }
+    }
+#ifdef _WIN32
+    fwrite(frame, frame->frameSize, 1, SegFile);
+#else
+    memcpy(SegData+SegUsed, frame, frame->frameSize);
+#endif
+    SegUsed += frame->frameSize;
+    SegFrames++;
+    NumWritten = NumWritten+1;
+}
+
+void TelemetryRecorder::Run(void)
+{
+    bool done = false;
+    while (!done) {
+        // Check before writing, so that all frames committed before Stop are written
+        done = StopRequest;
+        while (Tail != Head) {
+            AMP1394_MEMORY_BARRIER();
+            WriteFrame(reinterpret_cast<const TelemetryFrameHeader *>(Ring+static_cast<size_t>(Tail&(NumSlots-1))*MAX_FRAME_SIZE));
+            AMP1394_MEMORY_BARRIER();
+            Tail = Tail+1;
+        }
+        if (!done)
+            Amp1394_Sleep(0.001);
+    }
+}
+
+#ifdef _WIN32
+unsigned long __stdcall TelemetryRecorder::ThreadEntry(void *arg)
+{
+    static_cast<TelemetryRecorder *>(arg)->Run();
+    return 0;
+}
+#else
+void *TelemetryRecorder::ThreadEntry(void *arg)
+{
+    static_cast<TelemetryRecorder *>(arg)->Run();
+    return 0;
+}
+#endif
+
+//************************************ TelemetryReader ****************************************
+
+TelemetryReader::TelemetryReader(std::ostream &ostr) : outStr(ostr), FirstSegment(0), SegmentIndex(0),
+    SegOffset(0), SegEnd(0), NumRead(0), NumMissing(0), LastFrameNum(0)
+{
+    memset(&Config, 0, sizeof(Config));
+}
+
+TelemetryReader::~TelemetryReader()
+{
+}
+
+bool TelemetryReader::Open(const std::string &fileName)
+{
+    Close();
+    // Check for segment file name (<base>-NNN.tlm)
+    FileBase = fileName;
+    FirstSegment = 0;
+    size_t len = fileName.size();
+    if ((len > 8) && (fileName.compare(len-4, 4, ".tlm") == 0) && (fileName[len-8] == '-')) {
+        FileBase = fileName.substr(0, len-8);
+        FirstSegment = atoi(fileName.substr(len-7, 3).c_str());
+    }
+    return Rewind();
+}
+
+void TelemetryReader::Close(void)
+{
+    SegData.clear();
+    SegOffset = 0;
+    SegEnd = 0;
+}
+
+bool TelemetryReader::Rewind(void)
+{
+    NumRead = 0;
+    NumMissing = 0;
+    LastFrameNum = 0;
+    return LoadSegment(FirstSegment, false);
+}
+
+bool TelemetryReader::LoadSegment(unsigned int index, bool quiet)
+{
+    SegData.clear();
+    SegOffset = 0;
+    SegEnd = 0;
+    std::string fileName = TelemetryRecorder::SegmentFileName(FileBase, index);
+    std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!file.good()) {
+        if (!quiet)
+            outStr << "TelemetryReader: failed to open " << fileName << std::endl;
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff fileSize = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (fileSize < static_cast<std::streamoff>(sizeof(TelemetrySegmentHeader))) {
+        outStr << "TelemetryReader: " << fileName << " is not a telemetry file" << std::endl;
+        return false;
+    }
+    SegData.resize(static_cast<size_t>(fileSize));
+    file.read(reinterpret_cast<char *>(&SegData[0]), fileSize);
+    if (!file.good()) {
+        outStr << "TelemetryReader: failed to read " << fileName << std::endl;
+        SegData.clear();
+        return false;
+    }
+
+    const TelemetrySegmentHeader *header = reinterpret_cast<const TelemetrySegmentHeader *>(&SegData[0]);
+    if (memcmp(header->magic, TelemetryMagic, sizeof(header->magic)) != 0) {
+        outStr << "TelemetryReader: " << fileName << " is not a telemetry file" << std::endl;
+        SegData.clear();
+        return false;
+    }
+    if (header->version != TelemetryRecorder::FILE_VERSION) {
+        outStr << "TelemetryReader: unsupported version " << std::hex << header->version << std::dec
+               << " (different byte order?)" << std::endl;
+        SegData.clear();
+        return false;
+    }
+    if ((header->headerSize != sizeof(TelemetrySegmentHeader)) ||
+        (header->frameHeaderSize != sizeof(TelemetryFrameHeader))) {
+        outStr << "TelemetryReader: header sizes " << header->headerSize << "/" << header->frameHeaderSize
+               << ", expected " << sizeof(TelemetrySegmentHeader) << "/" << sizeof(TelemetryFrameHeader) << std::endl;
+        SegData.clear();
+        return false;
+    }
+    Config = *header;
+    SegOffset = sizeof(TelemetrySegmentHeader);
+    // If the segment was not closed, dataBytes is 0 and the frames are read until the first
+    // empty (zero) frame header
+    if ((header->dataBytes > 0) && (SegOffset+header->dataBytes <= SegData.size()))
+        SegEnd = SegOffset+header->dataBytes;
+    else
+        SegEnd = static_cast<uint32_t>(SegData.size());
+    SegmentIndex = index;
+    return true;
+}
+
+const TelemetryFrameHeader *TelemetryReader::NextFrame(void)
+{
+    while (!SegData.empty()) {
+        if (SegOffset+sizeof(TelemetryFrameHeader) <= SegEnd) {
+            const TelemetryFrameHeader *frame = reinterpret_cast<const TelemetryFrameHeader *>(&SegData[SegOffset]);
+            if ((frame->frameSize >= sizeof(TelemetryFrameHeader)) && (SegOffset+frame->frameSize <= SegEnd) &&
+                (frame->frameSize == sizeof(TelemetryFrameHeader)+((frame->readQuads+frame->writeQuads+1)/2)*8)) {
+                SegOffset += frame->frameSize;
+                if ((NumRead > 0) && (frame->frameNum != LastFrameNum+1))
+                    NumMissing += frame->frameNum-LastFrameNum-1;
+                LastFrameNum = frame->frameNum;
+                NumRead++;
+                return frame;
+            }
+        }
+        // End of segment (or incomplete frame); go to next segment, if any
+        if (!LoadSegment(SegmentIndex+1, true))
+            break;
+    }
+    return 0;
+}
+
+const quadlet_t *TelemetryReader::GetReadData(const TelemetryFrameHeader *frame)
+{
+    return reinterpret_cast<const quadlet_t *>(reinterpret_cast<const unsigned char *>(frame)+sizeof(TelemetryFrameHeader));
+}
+
+const quadlet_t *TelemetryReader::GetWriteData(const TelemetryFrameHeader *frame)
+{
+    return GetReadData(frame)+frame->readQuads;
+}
+
+const quadlet_t *TelemetryReader::GetReadData(const TelemetryFrameHeader *frame, unsigned int boardId)
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || (frame->board[boardId].readQuads == 0))
+        return 0;
+    return GetReadData(frame)+frame->board[boardId].readOffset;
+}
+
+const quadlet_t *TelemetryReader::GetWriteData(const TelemetryFrameHeader *frame, unsigned int boardId)
+{
+    if ((boardId >= BoardIO::MAX_BOARDS) || (frame->board[boardId].writeQuads == 0))
+        return 0;
+    return GetWriteData(frame)+frame->board[boardId].writeOffset;
+}
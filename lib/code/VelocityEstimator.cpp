@@ -0,0 +1,550 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "VelocityEstimator.h"
+#include "AmpIO.h"
+
+// Default parameters
+const unsigned int VEL_DEFAULT_WINDOW    = 8;
+const double VEL_DEFAULT_ALPHA           = 0.5;
+const double VEL_DEFAULT_BETA            = 0.1;
+const double VEL_DEFAULT_KALMAN_Q        = 1.0e7;      // counts^2/s^3
+const double VEL_DEFAULT_KALMAN_RPOS     = 1.0/12.0;   // position quantization (counts^2)
+const double VEL_DEFAULT_KALMAN_RVEL     = 0.0;        // counts^2/s^2
+const double VEL_DEFAULT_KALMAN_PVEL     = 1.0e8;      // initial velocity variance (counts^2/s^2)
+const double VEL_DEFAULT_ADAPT_THRESHOLD = 2.0;        // counts
+
+VelocityEstimatorBank::VelocityEstimatorBank(unsigned int maxWindow) : NumAxes(0),
+    MaxWindow(std::max(maxWindow, 2u))
+{
+}
+
+bool VelocityEstimatorBank::AddBoard(const AmpIO *board)
+{
+    if (!board)
+        return false;
+    Boards.push_back(board);
+    UpdateNumAxes();
+    return true;
+}
+
+void VelocityEstimatorBank::UpdateNumAxes(void)
+{
+    unsigned int num = 0;
+    for (size_t b = 0; b < Boards.size(); b++)
+        num += Boards[b]->GetNumEncoders();
+    if (num != NumAxes)
+        SetNumAxes(num);
+}
+
+void VelocityEstimatorBank::SetNumAxes(unsigned int num)
+{
+    unsigned int oldNum = NumAxes;
+    NumAxes = num;
+    method.resize(num, VEL_FPGA);
+    window.resize(num, std::min(VEL_DEFAULT_WINDOW, MaxWindow));
+    polyOrder.resize(num, 1);
+    alpha.resize(num, VEL_DEFAULT_ALPHA);
+    beta.resize(num, VEL_DEFAULT_BETA);
+    kalmanQ.resize(num, VEL_DEFAULT_KALMAN_Q);
+    kalmanRPos.resize(num, VEL_DEFAULT_KALMAN_RPOS);
+    kalmanRVel.resize(num, VEL_DEFAULT_KALMAN_RVEL);
+    adaptThreshold.resize(num, VEL_DEFAULT_ADAPT_THRESHOLD);
+
+    initialized.resize(num, false);
+    estPos.resize(num, 0.0);
+    estVel.resize(num, 0.0);
+    P00.resize(num, 0.0);
+    P01.resize(num, 0.0);
+    P11.resize(num, 0.0);
+
+    winTime.resize(num*MaxWindow, 0.0);
+    winPos.resize(num*MaxWindow, 0.0);
+    winHead.resize(num, 0);
+    winCount.resize(num, 0);
+    tNow.resize(num, 0.0);
+    posOrigin.resize(num, 0.0);
+    St.resize(num, 0.0);
+    Stt.resize(num, 0.0);
+    Sttt.resize(num, 0.0);
+    Stttt.resize(num, 0.0);
+    Sy.resize(num, 0.0);
+    Sty.resize(num, 0.0);
+    Stty.resize(num, 0.0);
+    winSeq.resize(num, 0);
+    adaptLen.resize(num, 0);
+    qMax.resize(num*MaxWindow, 0);
+    qMaxFront.resize(num, 0);
+    qMaxCount.resize(num, 0);
+    qMin.resize(num*MaxWindow, 0);
+    qMinFront.resize(num, 0);
+    qMinCount.resize(num, 0);
+
+    for (unsigned int i = oldNum; i < num; i++)
+        ResetAxis(i);
+}
+
+bool VelocityEstimatorBank::CheckAxis(unsigned int axis) const
+{
+    return (axis == ALL_AXES) || (axis < NumAxes);
+}
+
+bool VelocityEstimatorBank::SetMethod(Method newMethod, unsigned int axis)
+{
+    if (!CheckAxis(axis))
+        return false;
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i)) {
+            method[i] = newMethod;
+            ResetAxis(i);
+        }
+    }
+    return true;
+}
+
+bool VelocityEstimatorBank::SetWindow(unsigned int len, unsigned int axis)
+{
+    if (!CheckAxis(axis) || (len < 2) || (len > MaxWindow))
+        return false;
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i)) {
+            window[i] = len;
+            ResetAxis(i);
+        }
+    }
+    return true;
+}
+
+bool VelocityEstimatorBank::SetPolyOrder(unsigned int order, unsigned int axis)
+{
+    if (!CheckAxis(axis) || (order < 1) || (order > 2))
+        return false;
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i))
+            polyOrder[i] = order;
+    }
+    return true;
+}
+
+bool VelocityEstimatorBank::SetAlphaBeta(double a, double b, unsigned int axis)
+{
+    if (!CheckAxis(axis))
+        return false;
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i)) {
+            alpha[i] = a;
+            beta[i] = b;
+        }
+    }
+    return true;
+}
+
+bool VelocityEstimatorBank::SetKalmanNoise(double q, double rPos, double rVel, unsigned int axis)
+{
+    if (!CheckAxis(axis) || (rPos <= 0.0))
+        return false;
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i)) {
+            kalmanQ[i] = q;
+            kalmanRPos[i] = rPos;
+            kalmanRVel[i] = rVel;
+        }
+    }
+    return true;
+}
+
+bool VelocityEstimatorBank::SetAdaptiveThreshold(double counts, unsigned int axis)
+{
+    if (!CheckAxis(axis))
+        return false;
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i))
+            adaptThreshold[i] = counts;
+    }
+    return true;
+}
+
+VelocityEstimatorBank::Method VelocityEstimatorBank::GetMethod(unsigned int axis) const
+{
+    return (axis < NumAxes) ? method[axis] : VEL_FPGA;
+}
+
+void VelocityEstimatorBank::Reset(unsigned int axis)
+{
+    for (unsigned int i = 0; i < NumAxes; i++) {
+        if ((axis == ALL_AXES) || (axis == i))
+            ResetAxis(i);
+    }
+}
+
+void VelocityEstimatorBank::ResetAxis(unsigned int axis)
+{
+    initialized[axis] = false;
+    estPos[axis] = 0.0;
+    estVel[axis] = 0.0;
+    P00[axis] = P01[axis] = P11[axis] = 0.0;
+    winHead[axis] = 0;
+    winCount[axis] = 0;
+    tNow[axis] = 0.0;
+    posOrigin[axis] = 0.0;
+    St[axis] = Stt[axis] = Sttt[axis] = Stttt[axis] = 0.0;
+    Sy[axis] = Sty[axis] = Stty[axis] = 0.0;
+    winSeq[axis] = 0;
+    adaptLen[axis] = 0;
+    qMaxFront[axis] = qMaxCount[axis] = 0;
+    qMinFront[axis] = qMinCount[axis] = 0;
+}
+
+void VelocityEstimatorBank::Update(void)
+{
+    UpdateNumAxes();
+    unsigned int axis = 0;
+    for (size_t b = 0; b < Boards.size(); b++) {
+        const AmpIO *board = Boards[b];
+        double dt = board->GetTimestampSeconds();
+        double clk = board->GetEncoderClockPeriod();
+        for (unsigned int i = 0; i < board->GetNumEncoders(); i++, axis++) {
+            double vel = board->GetEncoderVelocityPredicted(i);
+            // Velocity is set to 0 when the period counter overflows; in that case, the FPGA
+            // velocity is not used as a measurement. Otherwise, the variance is based on
+            // the quantization of the period (one clock tick), i.e., dv = clk*v^2/4.
+            double velVar = -1.0;
+            if (vel != 0.0) {
+                double dv = clk*vel*vel/4.0;
+                velVar = dv*dv;
+            }
+            Update(axis, static_cast<double>(board->GetEncoderPosition(i)), dt, vel, velVar);
+        }
+    }
+}
+
+bool VelocityEstimatorBank::Update(unsigned int axis, double pos, double dt, double fpgaVel, double fpgaVelVar)
+{
+    if (axis >= NumAxes)
+        return false;
+
+    switch (method[axis]) {
+    case VEL_LSQ:
+        UpdateWindow(axis, pos, dt);
+        UpdateLSQ(axis, fpgaVel);
+        break;
+    case VEL_ALPHA_BETA:
+        UpdateAlphaBeta(axis, pos, dt);
+        break;
+    case VEL_KALMAN:
+        UpdateKalman(axis, pos, dt, fpgaVel, fpgaVelVar);
+        break;
+    case VEL_ADAPTIVE:
+        UpdateWindow(axis, pos, dt);
+        UpdateAdaptive(axis, fpgaVel);
+        break;
+    default:
+        estPos[axis] = pos;
+        estVel[axis] = fpgaVel;
+        break;
+    }
+    initialized[axis] = true;
+    return true;
+}
+
+double VelocityEstimatorBank::GetVelocity(unsigned int axis) const
+{
+    return (axis < NumAxes) ? estVel[axis] : 0.0;
+}
+
+double VelocityEstimatorBank::GetPosition(unsigned int axis) const
+{
+    return (axis < NumAxes) ? estPos[axis] : 0.0;
+}
+
+void VelocityEstimatorBank::Rebase(unsigned int axis)
+{
+    unsigned int len = window[axis];
+    unsigned int newest = (winHead[axis]+len-1)%len;
+    double *wt = &winTime[axis*MaxWindow];
+    double *wy = &winPos[axis*MaxWindow];
+    double t0 = tNow[axis];
+    double y0 = wy[newest];
+    St[axis] = Stt[axis] = Sttt[axis] = Stttt[axis] = 0.0;
+    Sy[axis] = Sty[axis] = Stty[axis] = 0.0;
+    for (unsigned int i = 0; i < winCount[axis]; i++) {
+        double t = (wt[i] -= t0);
+        double y = (wy[i] -= y0);
+        double t2 = t*t;
+        St[axis] += t;
+        Stt[axis] += t2;
+        Sttt[axis] += t2*t;
+        Stttt[axis] += t2*t2;
+        Sy[axis] += y;
+        Sty[axis] += t*y;
+        Stty[axis] += t2*y;
+    }
+    tNow[axis] = 0.0;
+    posOrigin[axis] += y0;
+}
+
+void VelocityEstimatorBank::UpdateWindow(unsigned int axis, double pos, double dt)
+{
+    unsigned int len = window[axis];
+    double *wt = &winTime[axis*MaxWindow];
+    double *wy = &winPos[axis*MaxWindow];
+
+    if (!initialized[axis]) {
+        posOrigin[axis] = pos;
+        tNow[axis] = 0.0;
+    }
+    else {
+        tNow[axis] += dt;
+    }
+
+    unsigned int head = winHead[axis];
+    if (winCount[axis] == len) {
+        // Remove oldest sample (which is at the head)
+        double t = wt[head];
+        double y = wy[head];
+        double t2 = t*t;
+        St[axis] -= t;
+        Stt[axis] -= t2;
+        Sttt[axis] -= t2*t;
+        Stttt[axis] -= t2*t2;
+        Sy[axis] -= y;
+        Sty[axis] -= t*y;
+        Stty[axis] -= t2*y;
+    }
+    else {
+        winCount[axis]++;
+    }
+
+    double t = tNow[axis];
+    double y = pos - posOrigin[axis];
+    double t2 = t*t;
+    wt[head] = t;
+    wy[head] = y;
+    St[axis] += t;
+    Stt[axis] += t2;
+    Sttt[axis] += t2*t;
+    Stttt[axis] += t2*t2;
+    Sy[axis] += y;
+    Sty[axis] += t*y;
+    Stty[axis] += t2*y;
+
+    winHead[axis] = (head+1)%len;
+    if (winHead[axis] == 0)
+        Rebase(axis);
+}
+
+void VelocityEstimatorBank::UpdateLSQ(unsigned int axis, double fpgaVel)
+{
+    double n = static_cast<double>(winCount[axis]);
+    double t = tNow[axis];
+
+    if ((polyOrder[axis] == 2) && (winCount[axis] >= 3)) {
+        // Solve normal equations for y = a + b*t + c*t^2 (Cramer's rule)
+        double m00 = n,         m01 = St[axis],   m02 = Stt[axis];
+        double m11 = Stt[axis], m12 = Sttt[axis], m22 = Stttt[axis];
+        double r0 = Sy[axis], r1 = Sty[axis], r2 = Stty[axis];
+        double det = m00*(m11*m22-m12*m12) - m01*(m01*m22-m12*m02) + m02*(m01*m12-m11*m02);
+        if (fabs(det) > 1e-30) {
+            double a = (r0*(m11*m22-m12*m12) - m01*(r1*m22-m12*r2) + m02*(r1*m12-m11*r2))/det;
+            double b = (m00*(r1*m22-m12*r2) - r0*(m01*m22-m12*m02) + m02*(m01*r2-r1*m02))/det;
+            double c = (m00*(m11*r2-r1*m12) - m01*(m01*r2-r1*m02) + r0*(m01*m12-m11*m02))/det;
+            estVel[axis] = b + 2.0*c*t;
+            estPos[axis] = posOrigin[axis] + a + b*t + c*t*t;
+            return;
+        }
+    }
+    if (winCount[axis] >= 2) {
+        double den = n*Stt[axis] - St[axis]*St[axis];
+        if (den > 1e-30) {
+            double b = (n*Sty[axis] - St[axis]*Sy[axis])/den;
+            double a = (Sy[axis] - b*St[axis])/n;
+            estVel[axis] = b;
+            estPos[axis] = posOrigin[axis] + a + b*t;
+            return;
+        }
+    }
+    // Not enough data
+    unsigned int len = window[axis];
+    estPos[axis] = posOrigin[axis] + winPos[axis*MaxWindow + (winHead[axis]+len-1)%len];
+    estVel[axis] = fpgaVel;
+}
+
+void VelocityEstimatorBank::UpdateAlphaBeta(unsigned int axis, double pos, double dt)
+{
+    if (!initialized[axis] || (dt <= 0.0)) {
+        estPos[axis] = pos;
+        if (!initialized[axis])
+            estVel[axis] = 0.0;
+        return;
+    }
+    double pPred = estPos[axis] + estVel[axis]*dt;
+    double r = pos - pPred;
+    estPos[axis] = pPred + alpha[axis]*r;
+    estVel[axis] += (beta[axis]/dt)*r;
+}
+
+void VelocityEstimatorBank::UpdateKalman(unsigned int axis, double pos, double dt, double fpgaVel, double fpgaVelVar)
+{
+    double rPos = kalmanRPos[axis];
+    if (!initialized[axis]) {
+        estPos[axis] = pos;
+        estVel[axis] = (fpgaVelVar >= 0.0) ? fpgaVel : 0.0;
+        P00[axis] = rPos;
+        P01[axis] = 0.0;
+        P11[axis] = (fpgaVelVar >= 0.0) ? (fpgaVelVar + kalmanRVel[axis]) : VEL_DEFAULT_KALMAN_PVEL;
+        return;
+    }
+
+    double p = estPos[axis];
+    double v = estVel[axis];
+    double p00 = P00[axis];
+    double p01 = P01[axis];
+    double p11 = P11[axis];
+
+    // Predict (constant velocity model, white noise acceleration)
+    if (dt > 0.0) {
+        double q = kalmanQ[axis];
+        p += v*dt;
+        p00 += dt*(2.0*p01 + dt*p11) + q*dt*dt*dt/3.0;
+        p01 += dt*p11 + q*dt*dt/2.0;
+        p11 += q*dt;
+    }
+
+    // Position measurement
+    double S = p00 + rPos;
+    double k0 = p00/S;
+    double k1 = p01/S;
+    double y = pos - p;
+    p += k0*y;
+    v += k1*y;
+    p11 -= k1*p01;
+    p00 -= k0*p00;
+    p01 -= k0*p01;
+
+    // Velocity measurement (FPGA period), if valid
+    if (fpgaVelVar >= 0.0) {
+        S = p11 + fpgaVelVar + kalmanRVel[axis];
+        if (S > 0.0) {
+            k0 = p01/S;
+            k1 = p11/S;
+            y = fpgaVel - v;
+            p += k0*y;
+            v += k1*y;
+            p00 -= k0*p01;
+            p01 -= k0*p11;
+            p11 -= k1*p11;
+        }
+    }
+
+    estPos[axis] = p;
+    estVel[axis] = v;
+    P00[axis] = p00;
+    P01[axis] = p01;
+    P11[axis] = p11;
+}
+
+unsigned int VelocityEstimatorBank::AdaptIndex(unsigned int axis, unsigned int seq) const
+{
+    unsigned int len = window[axis];
+    unsigned int age = winSeq[axis] - seq;
+    return (winHead[axis] + 2*len - 1 - age)%len;
+}
+
+void VelocityEstimatorBank::AdaptPop(unsigned int axis, bool isMax)
+{
+    // Remove samples (from the front, i.e., oldest) that are no longer in the adaptive window
+    const unsigned int *q = isMax ? &qMax[axis*MaxWindow] : &qMin[axis*MaxWindow];
+    unsigned int &front = isMax ? qMaxFront[axis] : qMinFront[axis];
+    unsigned int &count = isMax ? qMaxCount[axis] : qMinCount[axis];
+    while ((count > 0) && (winSeq[axis] - q[front] >= adaptLen[axis])) {
+        front = (front+1)%MaxWindow;
+        count--;
+    }
+}
+
+void VelocityEstimatorBank::AdaptPush(unsigned int axis, const double *wy, bool isMax)
+{
+    // Remove samples (from the back) that can no longer be the extremum, then add the newest
+    unsigned int *q = isMax ? &qMax[axis*MaxWindow] : &qMin[axis*MaxWindow];
+    unsigned int front = isMax ? qMaxFront[axis] : qMinFront[axis];
+    unsigned int &count = isMax ? qMaxCount[axis] : qMinCount[axis];
+    double y = wy[AdaptIndex(axis, winSeq[axis])];
+    while (count > 0) {
+        double yBack = wy[AdaptIndex(axis, q[(front+count-1)%MaxWindow])];
+        if (isMax ? (yBack > y) : (yBack < y))
+            break;
+        count--;
+    }
+    q[(front+count)%MaxWindow] = winSeq[axis];
+    count++;
+}
+
+double VelocityEstimatorBank::AdaptExtremum(unsigned int axis, const double *wy, bool isMax,
+                                            unsigned int maxAge) const
+{
+    // Returns the extremum of the samples that are at most maxAge old; since the deque is
+    // sorted by age (oldest first), this is the first entry that is young enough. The newest
+    // sample is always in the deque.
+    const unsigned int *q = isMax ? &qMax[axis*MaxWindow] : &qMin[axis*MaxWindow];
+    unsigned int front = isMax ? qMaxFront[axis] : qMinFront[axis];
+    unsigned int count = isMax ? qMaxCount[axis] : qMinCount[axis];
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int seq = q[(front+i)%MaxWindow];
+        if (winSeq[axis] - seq <= maxAge)
+            return wy[AdaptIndex(axis, seq)];
+    }
+    return wy[AdaptIndex(axis, winSeq[axis])];
+}
+
+void VelocityEstimatorBank::UpdateAdaptive(unsigned int axis, double fpgaVel)
+{
+    unsigned int len = window[axis];
+    const double *wt = &winTime[axis*MaxWindow];
+    const double *wy = &winPos[axis*MaxWindow];
+    unsigned int newest = (winHead[axis]+len-1)%len;
+    estPos[axis] = posOrigin[axis] + wy[newest];
+
+    // Add the newest sample; the adaptive window grows by one sample (up to the window length)
+    if (initialized[axis])
+        winSeq[axis]++;
+    adaptLen[axis] = std::min(adaptLen[axis]+1, winCount[axis]);
+    AdaptPop(axis, true);
+    AdaptPop(axis, false);
+    AdaptPush(axis, wy, true);
+    AdaptPush(axis, wy, false);
+
+    // Shrink the adaptive window while the position range without its oldest sample is still
+    // at least the threshold. Since adding a sample can only increase the range of a window,
+    // the start of the adaptive window never moves backward, so each sample is removed at most
+    // once. If the full window does not reach the threshold, it is used as is.
+    while ((adaptLen[axis] > 2) &&
+           (AdaptExtremum(axis, wy, true, adaptLen[axis]-2) -
+            AdaptExtremum(axis, wy, false, adaptLen[axis]-2) >= adaptThreshold[axis])) {
+        adaptLen[axis]--;
+        AdaptPop(axis, true);
+        AdaptPop(axis, false);
+    }
+
+    if (adaptLen[axis] < 2) {
+        estVel[axis] = fpgaVel;
+        return;
+    }
+    unsigned int k = AdaptIndex(axis, winSeq[axis]-(adaptLen[axis]-1));
+    double dt = wt[newest] - wt[k];
+    estVel[axis] = (dt > 0.0) ? (wy[newest]-wy[k])/dt : fpgaVel;
+}
@@ -3,11 +3,19 @@
 
 #include <iostream>
 #include <iomanip>
+#include <iterator>
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "mcsFile.h"
 
-mcsFile::mcsFile() : line_num(0), startAddr(0L)
+mcsFile::mcsFile() : line_num(0), useCache(false), startAddr(0L), numBytes(0L), curSector(0),
+                     nextSector(0)
 {
 }
 
@@ -15,60 +23,75 @@ mcsFile::~mcsFile()
 {
 }
 
-bool mcsFile::ProcessNextLine(RecInfo &rec)
+mcsFile::LineStatus mcsFile::ProcessNextLine(const char *&p, const char *end, RecInfo &rec)
 {
     // MCS file generated by ISE has line lengths no larger than 43 bytes
     const int MCS_LINE_MAX = 64;
-    char buffer[MCS_LINE_MAX];
 
-    file.getline(buffer, sizeof(buffer));
+    if (p >= end) return LINE_END;
+    const char *buffer = p;
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end-p));
+    if (!eol) eol = end;
+    p = (eol < end) ? eol+1 : end;
     line_num++;
-    if (file.eof()) return false;
 
-    if (buffer[0] != ':') return false;
-    int nbytes = static_cast<int>(file.gcount());
+    int nbytes = static_cast<int>(eol-buffer);
+    if ((nbytes > 0) && (buffer[nbytes-1] == '\r')) nbytes--;
+    if (nbytes == 0) return LINE_BLANK;
+    if (buffer[0] != ':') {
+        std::cerr << "ProcessNextLine: line " << line_num << " does not start with ':'" << std::endl;
+        return LINE_ERROR;
+    }
     if (nbytes >= MCS_LINE_MAX) {
         // If this error occurs, increase MCS_LINE_MAX
         std::cerr << "ProcessNextLine: line " << line_num
                   << " has too many characters, nbytes = " << nbytes << std::endl;
-        return false;
+        return LINE_ERROR;
     }
-    if (!buffer[nbytes-1]) nbytes--;
 
+    // Minimum record is ':', length, address, type and checksum
+    if (nbytes < 11) {
+        std::cerr << "ProcessNextLine: line " << line_num << " is too short" << std::endl;
+        return LINE_ERROR;
+    }
     unsigned long csum_computed = 0L;
-    if (!toHex(buffer+1, rec.ndata)) return false;
+    if (!toHex(buffer+1, rec.ndata)) return InvalidHex();
     csum_computed += rec.ndata;
     if (rec.ndata > sizeof(rec.data)) {
         // If this error occurs, increase RecInfo::DATA_MAX
         std::cerr << "ProcessNextLine: line " << line_num
-                  << " has too much data, num bytes = " << rec.ndata << std::endl;
-        return false;
+                  << " has too much data, num bytes = " << static_cast<unsigned int>(rec.ndata) << std::endl;
+        return LINE_ERROR;
+    }
+    if (nbytes < 11+2*rec.ndata) {
+        std::cerr << "ProcessNextLine: line " << line_num << " is too short" << std::endl;
+        return LINE_ERROR;
     }
     unsigned char addr_high, addr_low;
-    if (!toHex(buffer+3, addr_high)) return false;
+    if (!toHex(buffer+3, addr_high)) return InvalidHex();
     csum_computed += addr_high;
-    if (!toHex(buffer+5, addr_low)) return false;
+    if (!toHex(buffer+5, addr_low)) return InvalidHex();
     csum_computed += addr_low;
     rec.addr = (addr_high<<8)+addr_low;
-    if (!toHex(buffer+7, rec.type)) return false;
+    if (!toHex(buffer+7, rec.type)) return InvalidHex();
     csum_computed += rec.type;
 
     // convert to binary and compute checksum
     for (unsigned int i = 0; i < rec.ndata; i++) {
-        if (!toHex(buffer+9+2*i, rec.data[i])) return false;
+        if (!toHex(buffer+9+2*i, rec.data[i])) return InvalidHex();
         csum_computed += rec.data[i];
     }
     unsigned char cksum;
-    if (!toHex(buffer+9+2*rec.ndata, cksum)) return false;
+    if (!toHex(buffer+9+2*rec.ndata, cksum)) return InvalidHex();
     csum_computed += cksum;
-    
+
     csum_computed &= 0x000000ff;
     if (csum_computed) {
         std::cerr << "ProcessNextLine: line " << line_num
                   << " checksum error = " << csum_computed << std::endl;
-        return false;
+        return LINE_ERROR;
     }
-    return true;
+    return LINE_OK;
 }
 
 bool mcsFile::toHex(const char *p2, unsigned char &result) const
@@ -88,63 +111,233 @@ bool mcsFile::toHex(const char *p2, unsigned char &result) const
     return true;
 }
 
-bool mcsFile::OpenFile(const std::string &fileName)
+mcsFile::LineStatus mcsFile::InvalidHex(void) const
 {
-    file.open(fileName.c_str());
-    if (!file.is_open()) {
-        std::cerr << "mcsFile: could not open input file " << fileName << std::endl;
-        return false;
-    }
-    line_num = 0;
-    return true;
+    std::cerr << "ProcessNextLine: line " << line_num << " has invalid hex digit" << std::endl;
+    return LINE_ERROR;
 }
 
-bool mcsFile::ReadNextSector()
+bool mcsFile::Parse(const char *text, size_t len)
 {
+    const char *p = text;
+    const char *end = text+len;
     RecInfo rec;
-    if (!ProcessNextLine(rec)) return false;
-    if (rec.type != RECORD_EXT_LINEAR) {
-        std::cerr << "ReadNextSector: line " << line_num << " does not start a sector" << std::endl;
-        return false;
-    }
-    if (rec.ndata != 2) {
-        std::cerr << "ReadNextSector: line " << line_num << " has invalid data length = "
-                  << rec.ndata << std::endl;
-        return false;
-    }
-    startAddr = ((rec.data[0]<<16)+rec.data[1]) << 16;
-    numBytes = 0L;
-    while ((numBytes < sizeof(curSector)) && ProcessNextLine(rec)) {
-        if (rec.type == RECORD_DATA) {
-            if (numBytes != rec.addr) {
-                std::cerr << "ReadNextSector: line " << line_num
-                          << ", expected offset " << numBytes << ", got offset "
+    SectorInfo *sector = 0;
+    unsigned char *sectorData = 0;
+    line_num = 0;
+    sectors.clear();
+    image.clear();
+    for (;;) {
+        LineStatus status = ProcessNextLine(p, end, rec);
+        if (status == LINE_BLANK)
+            continue;
+        if (status == LINE_ERROR)
+            return false;
+        if (status == LINE_END) {
+            // The EOF record is required, so that a truncated file is not accepted
+            std::cerr << "Parse: missing EOF record after line " << line_num << std::endl;
+            return false;
+        }
+        if (rec.type == RECORD_EXT_LINEAR) {
+            // Start new sector
+            if (rec.ndata != 2) {
+                std::cerr << "Parse: line " << line_num << " has invalid data length = "
+                          << static_cast<unsigned int>(rec.ndata) << std::endl;
+                return false;
+            }
+            SectorInfo info;
+            info.startAddr = ((rec.data[0]<<16)+rec.data[1]) << 16;
+            info.numBytes = 0;
+            sectors.push_back(info);
+            sector = &sectors.back();
+            // Pad sector with 0xff
+            image.resize(sectors.size()*SECTOR_SIZE, 0xff);
+            sectorData = &image[(sectors.size()-1)*SECTOR_SIZE];
+        }
+        else if (rec.type == RECORD_DATA) {
+            if (!sector) {
+                std::cerr << "Parse: line " << line_num << " is not in a sector" << std::endl;
+                return false;
+            }
+            if (sector->numBytes != rec.addr) {
+                std::cerr << "Parse: line " << line_num
+                          << ", expected offset " << sector->numBytes << ", got offset "
                           << rec.addr << std::endl;
                 return false;
             }
-            memcpy(curSector+numBytes, rec.data, rec.ndata);
-            numBytes += rec.ndata;
+            if (sector->numBytes+rec.ndata > SECTOR_SIZE) {
+                std::cerr << "Parse: line " << line_num << ", too many bytes in sector" << std::endl;
+                return false;
+            }
+            memcpy(sectorData+sector->numBytes, rec.data, rec.ndata);
+            sector->numBytes += rec.ndata;
         }
         else if (rec.type == RECORD_EOF)
             break;
         else
-            std::cerr << "ReadNextSector: line " << line_num 
-                      << " ignoring record type " << rec.type << std::endl;
+            std::cerr << "Parse: line " << line_num
+                      << " ignoring record type " << static_cast<unsigned int>(rec.type) << std::endl;
+    }
+    if (sectors.empty()) {
+        std::cerr << "Parse: no sectors found" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t mcsFile::ComputeHash(const char *text, size_t len)
+{
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(text[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Binary cache file format (host byte order):
+//    magic (8 bytes), MCS file hash (8 bytes), MCS file size (8 bytes),
+//    number of lines (4 bytes), number of sectors (4 bytes),
+//    for each sector: start address (4 bytes), number of bytes (4 bytes),
+//    followed by the sector data (number of bytes for each sector)
+static const char MCS_CACHE_MAGIC[8] = { 'M', 'C', 'S', 'B', 'I', 'N', '0', '2' };
+
+bool mcsFile::ReadCache(const std::string &cacheName, uint64_t hash, uint64_t len)
+{
+    std::ifstream cache(cacheName.c_str(), std::ios_base::binary);
+    if (!cache.is_open())
+        return false;
+    char magic[sizeof(MCS_CACHE_MAGIC)];
+    uint64_t cacheHash, cacheLen;
+    uint32_t numLines, numSectors;
+    cache.read(magic, sizeof(magic));
+    cache.read(reinterpret_cast<char *>(&cacheHash), sizeof(cacheHash));
+    cache.read(reinterpret_cast<char *>(&cacheLen), sizeof(cacheLen));
+    cache.read(reinterpret_cast<char *>(&numLines), sizeof(numLines));
+    cache.read(reinterpret_cast<char *>(&numSectors), sizeof(numSectors));
+    if (!cache || (memcmp(magic, MCS_CACHE_MAGIC, sizeof(magic)) != 0) ||
+        (cacheHash != hash) || (cacheLen != len) || (numSectors == 0))
+        return false;
+    std::vector<SectorInfo> cacheSectors(numSectors);
+    cache.read(reinterpret_cast<char *>(&cacheSectors[0]), numSectors*sizeof(SectorInfo));
+    if (!cache)
+        return false;
+    std::vector<unsigned char> cacheImage(numSectors*SECTOR_SIZE, 0xff);
+    for (uint32_t i = 0; i < numSectors; i++) {
+        if (cacheSectors[i].numBytes > SECTOR_SIZE)
+            return false;
+        cache.read(reinterpret_cast<char *>(&cacheImage[i*SECTOR_SIZE]), cacheSectors[i].numBytes);
+    }
+    if (!cache)
+        return false;
+    sectors.swap(cacheSectors);
+    image.swap(cacheImage);
+    line_num = numLines;
+    return true;
+}
+
+bool mcsFile::WriteCache(const std::string &cacheName, uint64_t hash, uint64_t len) const
+{
+    std::ofstream cache(cacheName.c_str(), std::ios_base::binary|std::ios_base::trunc);
+    if (!cache.is_open())
+        return false;
+    uint32_t numLines = static_cast<uint32_t>(line_num);
+    uint32_t numSectors = static_cast<uint32_t>(sectors.size());
+    cache.write(MCS_CACHE_MAGIC, sizeof(MCS_CACHE_MAGIC));
+    cache.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    cache.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    cache.write(reinterpret_cast<const char *>(&numLines), sizeof(numLines));
+    cache.write(reinterpret_cast<const char *>(&numSectors), sizeof(numSectors));
+    cache.write(reinterpret_cast<const char *>(&sectors[0]), numSectors*sizeof(SectorInfo));
+    for (uint32_t i = 0; i < numSectors; i++)
+        cache.write(reinterpret_cast<const char *>(&image[i*SECTOR_SIZE]), sectors[i].numBytes);
+    return cache.good();
+}
+
+bool mcsFile::OpenFile(const std::string &fileName)
+{
+    CloseFile();
+    const char *text = 0;
+    size_t len = 0;
+#ifdef _WIN32
+    // Read entire file
+    std::ifstream file(fileName.c_str(), std::ios_base::binary);
+    if (!file.is_open()) {
+        std::cerr << "mcsFile: could not open input file " << fileName << std::endl;
+        return false;
+    }
+    std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    len = buffer.size();
+    text = len ? &buffer[0] : 0;
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        std::cerr << "mcsFile: could not open input file " << fileName << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
     }
-    // Pad sector with 0xff, just in case
-    if (numBytes < sizeof(curSector)) {
-        memset(curSector+numBytes, 0xff, sizeof(curSector)-numBytes);
+    len = static_cast<size_t>(st.st_size);
+    void *map = 0;
+    if (len > 0) {
+        map = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "mcsFile: could not map input file " << fileName << std::endl;
+            close(fd);
+            return false;
+        }
+        text = static_cast<const char *>(map);
+    }
+#endif
+
+    bool ret = false;
+    uint64_t hash = ComputeHash(text, len);
+    std::string cacheName = fileName + ".bin";
+    if (useCache && ReadCache(cacheName, hash, len)) {
+        std::cout << "mcsFile: using cached image " << cacheName << std::endl;
+        ret = true;
     }
-    else if (numBytes > sizeof(curSector))
-        std::cerr << "ReadNextSector: too many bytes = " << numBytes << std::endl;
+    else {
+        ret = Parse(text, len);
+        if (!ret)
+            std::cerr << "mcsFile: failed to parse " << fileName << std::endl;
+        else if (useCache && !WriteCache(cacheName, hash, len))
+            std::cerr << "mcsFile: could not write cache file " << cacheName << std::endl;
+    }
+
+#ifndef _WIN32
+    if (map)
+        munmap(map, len);
+    close(fd);
+#endif
+    if (!ret) {
+        sectors.clear();
+        image.clear();
+        return false;
+    }
+    mcsName = fileName;
+    Rewind();
+    return true;
+}
+
+bool mcsFile::ReadNextSector()
+{
+    if (nextSector >= sectors.size())
+        return false;
+    startAddr = sectors[nextSector].startAddr;
+    numBytes = sectors[nextSector].numBytes;
+    curSector = &image[nextSector*SECTOR_SIZE];
+    nextSector++;
     return true;
 }
 
 bool mcsFile::VerifySector(const unsigned char *data, unsigned long len) const
 {
-    unsigned int lim = (len < sizeof(curSector)) ? len : sizeof(curSector);
+    if (!curSector) return false;
+    unsigned long lim = (len < static_cast<unsigned long>(SECTOR_SIZE)) ? len : static_cast<unsigned long>(SECTOR_SIZE);
     int num = 0;  // number of mismatches
-    unsigned int i;
+    unsigned long i;
     for (i = 0; i < lim; i++) {
         if (curSector[i] != data[i]) {
             std::cout << std::hex << "Mismatch at address " << startAddr+i
@@ -159,14 +352,20 @@ bool mcsFile::VerifySector(const unsigned char *data, unsigned long len) const
 
 void mcsFile::Rewind()
 {
-    file.clear();
-    file.seekg(0, std::ios_base::beg);
+    nextSector = 0;
+    curSector = 0;
+    startAddr = 0L;
+    numBytes = 0L;
 }
 
 void mcsFile::CloseFile()
 {
-    std::cout << "Processed " << line_num << " lines" << std::endl;
-    file.close();
+    if (!mcsName.empty())
+        std::cout << "Processed " << line_num << " lines" << std::endl;
+    mcsName.clear();
+    sectors.clear();
+    image.clear();
+    Rewind();
 }
 
 void mcsFile::WriteSectorHeader(std::ofstream &file, unsigned int num)
@@ -9,16 +9,36 @@
 // This class reads an Intel MCS-86 format file, which is produced by the Xilinx
 // ISE software. It is not a complete implementation, and probably will not work
 // for MCS-86 files produced by other software packages.
+//
+// OpenFile memory-maps the file and parses it once into a list of sectors and a
+// contiguous binary image (each sector padded to 64K with 0xff); ReadNextSector and
+// Rewind then iterate over the in-memory sectors, so that programming and verification
+// do not parse the file again. If enabled (SetCacheEnabled), the parsed image is saved
+// to a binary cache file (fileName + ".bin"), which is used instead of parsing the next
+// time, as long as the hash and size of the MCS file match.
 
 #include <string>
+#include <vector>
 #include <fstream>
+#include <stdint.h>
 
 class mcsFile {
-    std::ifstream file;
-    int line_num;                    // current line number
+    enum { SECTOR_SIZE = 65536 };
+
+    std::string mcsName;             // name of MCS file
+    int line_num;                    // current line number (number of lines after parsing)
+    bool useCache;                   // whether to use binary cache file
     unsigned long startAddr;         // start address
     unsigned long numBytes;          // number of bytes in sector
-    unsigned char curSector[65536];  // current sector
+    const unsigned char *curSector;  // current sector (in image)
+
+    struct SectorInfo {
+        uint32_t startAddr;
+        uint32_t numBytes;
+    };
+    std::vector<SectorInfo> sectors;
+    std::vector<unsigned char> image;    // all sectors, each SECTOR_SIZE bytes
+    size_t nextSector;                   // index of next sector returned by ReadNextSector
 
     struct RecInfo {
         enum { DATA_MAX = 16 };
@@ -28,8 +48,27 @@ class mcsFile {
         unsigned char data[DATA_MAX];
     };
 
-    bool ProcessNextLine(RecInfo &rec);
+    // Result of ProcessNextLine
+    enum LineStatus {
+        LINE_OK,        // record parsed (rec is valid)
+        LINE_BLANK,     // empty line (ignored)
+        LINE_END,       // no more lines
+        LINE_ERROR      // malformed line or checksum error (message written to std::cerr)
+    };
+
+    LineStatus ProcessNextLine(const char *&p, const char *end, RecInfo &rec);
     bool toHex(const char *p2, unsigned char &result) const;
+    // Report invalid hex digit on current line; returns LINE_ERROR
+    LineStatus InvalidHex(void) const;
+
+    // Parse MCS file contents into sectors and image. Returns false if any line is invalid or
+    // if the EOF record is missing (e.g., truncated file).
+    bool Parse(const char *text, size_t len);
+
+    // Binary cache file (see above)
+    static uint64_t ComputeHash(const char *text, size_t len);
+    bool ReadCache(const std::string &cacheName, uint64_t hash, uint64_t len);
+    bool WriteCache(const std::string &cacheName, uint64_t hash, uint64_t len) const;
 
     enum RecordTypes {
         RECORD_DATA = 0,
@@ -41,16 +80,20 @@ class mcsFile {
 public:
     mcsFile();
     ~mcsFile();
-    // Open file
+    // Enable binary cache file (default false); call before OpenFile
+    void SetCacheEnabled(bool enable) { useCache = enable; }
+    // Open (and parse) file
     bool OpenFile(const std::string &fileName);
     // Read next sector
     bool ReadNextSector();
     unsigned long GetSectorAddress() const { return startAddr; }
     unsigned long GetSectorNumBytes() const { return numBytes; }
     const unsigned char *GetSectorData() const { return curSector; }
+    // Number of sectors in file
+    size_t GetNumSectors() const { return sectors.size(); }
     // Compare current sector to specified data
     bool VerifySector(const unsigned char *data, unsigned long len) const;
-    // Seek back to beginning of file
+    // Go back to first sector
     void Rewind();
     void CloseFile();
 
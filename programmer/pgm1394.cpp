@@ -3,9 +3,11 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <vector>
 #ifdef _MSC_VER
 #include <conio.h>
 #else
@@ -22,6 +24,7 @@
 #include "EthRawPort.h"
 #endif
 #include "EthUdpPort.h"
+#include "EthLoopbackPort.h"
 #include "AmpIO.h"
 #include "Amp1394Time.h"
 
@@ -127,6 +130,36 @@ bool PromProgramCallback(const char *msg)
     return true;   // continue
 }
 
+// State for PromProgramDataCallback, which shows the progress and throughput
+// when programming a sector with FpgaIO::PromProgramData
+static FpgaIO::PromProgramStats Program_Stats;
+static unsigned long Program_SectorAddr = 0;
+static unsigned long Program_SectorStart = 0;   // Program_Stats.numBytes at start of sector
+static unsigned long Program_SectorBytes = 0;
+
+void PromPrintProgramProgress(void)
+{
+    unsigned long done = Program_Stats.numBytes - Program_SectorStart;
+    std::ostringstream rate;
+    rate << std::fixed << std::setprecision(1) << Program_Stats.GetThroughput()/1024.0;
+    std::cout << "\rProgramming sector " << std::hex << Program_SectorAddr << std::dec << ": "
+              << (Program_SectorBytes ? (100*done)/Program_SectorBytes : 100) << "% ("
+              << rate.str() << " KB/s)   " << std::flush;
+}
+
+bool PromProgramDataCallback(const char *msg)
+{
+    if (msg) std::cout << std::endl << msg << std::endl;
+    else {
+        double t = Amp1394_GetTime();
+        if ((t - Callback_StartTime) > 0.1) {
+            PromPrintProgramProgress();
+            Callback_StartTime = t;
+        }
+    }
+    return true;   // continue
+}
+
 // Test ability to program the PROM by programming a page/sector not
 // currently used by the firmware (0x1E0000).
 bool PromProgramTest(AmpIO &Board)
@@ -164,13 +197,68 @@ bool PromProgramTest(AmpIO &Board)
     return true;
 }
 
-bool PromProgram(AmpIO &Board, mcsFile &promFile)
+// Check whether the PROM sector at addr already contains the specified data (numBytes),
+// followed by blank (FF) entries to the end of the sector (i.e., same as after programming).
+// Returns false if the sector could not be read.
+bool PromSectorMatches(AmpIO &Board, unsigned long addr, const unsigned char *sectorData,
+                       unsigned long numBytes, bool &match)
+{
+    unsigned char promSector[SECTOR_SIZE];
+    match = false;
+    if (numBytes > SECTOR_SIZE)
+        return true;
+    if (!Board.PromReadDataFast(addr, promSector, SECTOR_SIZE)) {
+        std::cerr << "Error reading PROM data, sector " << std::hex << addr << std::dec << std::endl;
+        return false;
+    }
+    if (memcmp(promSector, sectorData, numBytes) != 0)
+        return true;
+    for (unsigned long i = numBytes; i < SECTOR_SIZE; i++) {
+        if (promSector[i] != 0xFF)
+            return true;
+    }
+    match = true;
+    return true;
+}
+
+// Print the number of sectors skipped (unchanged) by differential programming, and an estimate
+// of the time saved (based on the average time to program the other sectors).
+void PromPrintSkipped(unsigned int numSkipped, unsigned int numSectors, double programTime)
 {
-    std::cout << "Starting PROM programming" << std::endl;
+    std::cout << "Skipped " << numSkipped << " of " << numSectors << " sectors (unchanged)";
+    if ((numSkipped > 0) && (numSkipped < numSectors)) {
+        std::ostringstream saved;
+        saved << std::fixed << std::setprecision(1) << numSkipped*programTime/(numSectors-numSkipped);
+        std::cout << ", saved about " << saved.str() << " seconds";
+    }
+    std::cout << std::endl;
+}
+
+// Program the PROM. If diffOnly is true, each sector is first read back and is only
+// erased and programmed if it differs from the PROM file.
+bool PromProgram(AmpIO &Board, mcsFile &promFile, bool diffOnly = false)
+{
+    std::cout << "Starting PROM programming" << (diffOnly ? " (changed sectors only)" : "") << std::endl;
     double startTime = Amp1394_GetTime();
+    double programTime = 0.0;      // Time spent erasing and programming sectors
+    unsigned int numSectors = 0;
+    unsigned int numSkipped = 0;
+    Program_Stats = FpgaIO::PromProgramStats();
     promFile.Rewind();
     while (promFile.ReadNextSector()) {
         unsigned long addr = promFile.GetSectorAddress();
+        numSectors++;
+        if (diffOnly) {
+            bool match;
+            if (!PromSectorMatches(Board, addr, promFile.GetSectorData(), promFile.GetSectorNumBytes(), match))
+                return false;
+            if (match) {
+                std::cout << "Skipping sector " << std::hex << addr << std::dec << " (unchanged)" << std::endl;
+                numSkipped++;
+                continue;
+            }
+        }
+        double sectorStartTime = Amp1394_GetTime();
         std::cout << "Erasing sector " << std::hex << addr << std::dec << std::flush;
         Callback_StartTime = Amp1394_GetTime();
         if (!Board.PromSectorErase(addr, PromProgramCallback)) {
@@ -178,33 +266,176 @@ bool PromProgram(AmpIO &Board, mcsFile &promFile)
             std::cerr << "Failed to erase sector " << addr << std::endl;
             return false;
         }
+        std::cout << std::endl;
+        const unsigned char *sectorData = promFile.GetSectorData();
+        unsigned long numBytes = promFile.GetSectorNumBytes();
+        Program_SectorAddr = addr;
+        Program_SectorStart = Program_Stats.numBytes;
+        Program_SectorBytes = numBytes;
+        PromPrintProgramProgress();
+        Callback_StartTime = Amp1394_GetTime();
+        int nRet = Board.PromProgramData(addr, sectorData, numBytes, PromProgramDataCallback, &Program_Stats);
+        if ((nRet < 0) || (static_cast<unsigned long>(nRet) != numBytes)) {
+            std::cout << std::endl;
+            std::cerr << "Failed to program sector " << std::hex << addr << std::dec << ", rc = " << nRet << std::endl;
+            return false;
+        }
+        PromPrintProgramProgress();
+        std::cout << std::endl;
+        programTime += Amp1394_GetTime() - sectorStartTime;
+    }
+    std::cout << "PROM programming time = " << Amp1394_GetTime() - startTime << " seconds"
+              << std::endl;
+    if (Program_Stats.numPages > 0) {
+        std::ostringstream rate;
+        rate << std::fixed << std::setprecision(1) << Program_Stats.GetThroughput()/1024.0 << " KB/s, "
+             << Program_Stats.elapsedTime*1.0e6/Program_Stats.numPages << " usec/page, "
+             << static_cast<double>(Program_Stats.numPolls)/Program_Stats.numPages << " status reads/page";
+        std::cout << "Page programming throughput = " << rate.str() << std::endl;
+    }
+    if (diffOnly)
+        PromPrintSkipped(numSkipped, numSectors, programTime);
+    return true;
+}
+
+// Wait for the erase or program command to finish on all boards, i.e., until the PROM status register
+// (masked by mask) is 0, broadcasting the read status command so that all boards are polled at the
+// same time. A board that does not finish within the timeout is marked as failed in ok.
+// Returns the number of boards that are still ok.
+size_t PromWaitMulti(BasePort *Port, std::vector<AmpIO *> &Boards, std::vector<bool> &ok,
+                     uint32_t mask, double timeoutSec)
+{
+    std::vector<bool> busy(ok);
+    size_t numBusy = 0;
+    size_t bd;
+    for (bd = 0; bd < Boards.size(); bd++)
+        if (busy[bd]) numBusy++;
+    double startTime = Amp1394_GetTime();
+    while (numBusy > 0) {
+        if (!FpgaIO::PromGetStatusAll(Port))
+            break;
+        for (bd = 0; bd < Boards.size(); bd++) {
+            uint32_t status;
+            if (busy[bd] && Boards[bd]->PromGetResult(status) && !(status&mask)) {
+                busy[bd] = false;
+                numBusy--;
+            }
+        }
+        if (numBusy == 0)
+            break;
+        if ((Amp1394_GetTime() - startTime) > timeoutSec)
+            break;
+        PromProgramCallback(0);
+    }
+    size_t numOk = 0;
+    for (bd = 0; bd < Boards.size(); bd++) {
+        if (busy[bd]) {
+            std::cout << std::endl;
+            std::cerr << "Board " << (unsigned int)Boards[bd]->GetBoardId() << ": PROM did not finish" << std::endl;
+            ok[bd] = false;
+        }
+        if (ok[bd]) numOk++;
+    }
+    return numOk;
+}
+
+// Program the same PROM file on multiple boards at the same time (Firmware Rev 4+), by broadcasting
+// each sector erase and page program command and then waiting for each board to finish (see
+// FpgaIO::PromSectorEraseAll and FpgaIO::PromProgramPageAll, and PromWaitMulti). Since the commands
+// are broadcast, Boards must be all of the boards on the port and all must have passed the
+// programming test (see IsAllBoardsOnPort). If a board does not complete a command (e.g., because
+// it missed the broadcast), it is marked as failed in ok and the broadcast programming stops, so that
+// no board is written without being checked; the caller should then program the boards individually.
+// If diffOnly is true, the sector is compared on every board and is skipped if it matches on all of
+// them. Returns true if all sectors were programmed on all boards.
+bool PromProgramMulti(BasePort *Port, std::vector<AmpIO *> &Boards, mcsFile &promFile,
+                      std::vector<bool> &ok, bool diffOnly = false)
+{
+    size_t bd;
+    size_t numBoards = Boards.size();
+    size_t numOk = numBoards;
+    std::cout << "Starting PROM programming of " << numBoards << " boards"
+              << (diffOnly ? " (changed sectors only)" : "") << std::endl;
+    double startTime = Amp1394_GetTime();
+    double programTime = 0.0;
+    unsigned int numSectors = 0;
+    unsigned int numSkipped = 0;
+    promFile.Rewind();
+    while ((numOk == numBoards) && promFile.ReadNextSector()) {
+        unsigned long addr = promFile.GetSectorAddress();
+        numSectors++;
+        if (diffOnly) {
+            // Compare every board, since the changed sector is written to all of them
+            bool allMatch = true;
+            for (bd = 0; bd < numBoards; bd++) {
+                bool match = false;
+                if (!PromSectorMatches(*Boards[bd], addr, promFile.GetSectorData(),
+                                       promFile.GetSectorNumBytes(), match) || !match)
+                    allMatch = false;
+            }
+            if (allMatch) {
+                std::cout << "Skipping sector " << std::hex << addr << std::dec << " (unchanged)" << std::endl;
+                numSkipped++;
+                continue;
+            }
+        }
+        double sectorStartTime = Amp1394_GetTime();
+        std::cout << "Erasing sector " << std::hex << addr << std::dec << std::flush;
+        Callback_StartTime = Amp1394_GetTime();
+        if (!FpgaIO::PromSectorEraseAll(Port, addr)) {
+            std::cout << std::endl;
+            std::cerr << "Failed to broadcast erase of sector " << std::hex << addr << std::dec << std::endl;
+            return false;
+        }
+        // Sector erase typically takes 0.6 sec (max 3 sec)
+        numOk = PromWaitMulti(Port, Boards, ok, 0xff, 5.0);
+        if (numOk < numBoards)
+            break;
         std::cout << std::endl << "Programming sector " << std::hex << addr
                   << std::dec << std::flush;
         const unsigned char *sectorData = promFile.GetSectorData();
         unsigned long numBytes = promFile.GetSectorNumBytes();
         unsigned long page = 0;
         Callback_StartTime = Amp1394_GetTime();
-        while (page < numBytes) {
+        while ((numOk == numBoards) && (page < numBytes)) {
             unsigned int bytesToProgram = ((numBytes-page)<256UL) ? (numBytes-page) : 256UL;
-            int nRet = Board.PromProgramPage(addr+page, sectorData+page, bytesToProgram, PromProgramCallback);
-            if ((nRet < 0) || (static_cast<unsigned int>(nRet) != bytesToProgram)) {
+            if (!FpgaIO::PromProgramPageAll(Port, addr+page, sectorData+page, bytesToProgram)) {
                 std::cout << std::endl;
-                std::cerr << "Failed to program page " << addr << ", rc = " << nRet << std::endl;
+                std::cerr << "Failed to broadcast page " << std::hex << addr+page << std::dec << std::endl;
                 return false;
             }
+            for (bd = 0; bd < numBoards; bd++) {
+                int nRet = Boards[bd]->PromProgramPageWait(bytesToProgram, PromProgramCallback, false);
+                if ((nRet < 0) || (static_cast<unsigned int>(nRet) != bytesToProgram)) {
+                    std::cout << std::endl;
+                    std::cerr << "Board " << (unsigned int)Boards[bd]->GetBoardId() << ": failed to program page "
+                              << std::hex << addr+page << std::dec << ", rc = " << nRet << std::endl;
+                    ok[bd] = false;
+                }
+            }
+            // Page program typically takes 0.64 msec (max 5 msec)
+            numOk = PromWaitMulti(Port, Boards, ok, FpgaIO::MASK_WIP, 0.1);
             page += bytesToProgram;
         }
         std::cout << std::endl;
+        programTime += Amp1394_GetTime() - sectorStartTime;
+    }
+    if (numOk < numBoards) {
+        std::cerr << "Stopped broadcast programming at sector " << std::hex << promFile.GetSectorAddress()
+                  << std::dec << std::endl;
+        return false;
     }
     std::cout << "PROM programming time = " << Amp1394_GetTime() - startTime << " seconds"
               << std::endl;
+    if (diffOnly)
+        PromPrintSkipped(numSkipped, numSectors, programTime);
     return true;
 }
 
-
 bool PromVerify(AmpIO &Board, mcsFile &promFile)
 {
     double startTime = Amp1394_GetTime();
+    unsigned long totalBytes = 0;
     unsigned char DownloadedSector[SECTOR_SIZE];
     promFile.Rewind();
     while (promFile.ReadNextSector()) {
@@ -215,10 +446,11 @@ bool PromVerify(AmpIO &Board, mcsFile &promFile)
             std::cerr << "Error: sector too large = " << numBytes << std::endl;
             return false;
         }
-        if (!Board.PromReadData(addr, DownloadedSector, numBytes)) {
+        if (!Board.PromReadDataFast(addr, DownloadedSector, numBytes)) {
             std::cerr << "Error reading PROM data" << std::endl;
             return false;
         }
+        totalBytes += numBytes;
         if (!promFile.VerifySector(DownloadedSector, numBytes)) {
             std::cerr << "Error verifying sector" << std::endl;
             return false;
@@ -226,8 +458,14 @@ bool PromVerify(AmpIO &Board, mcsFile &promFile)
         std::cout << std::endl;
     }
     std::cout << std::dec;
-    std::cout << "PROM verification time = " << Amp1394_GetTime() - startTime << " seconds"
-              << std::endl;
+    double elapsed = Amp1394_GetTime() - startTime;
+    std::cout << "PROM verification time = " << elapsed << " seconds";
+    if (elapsed > 0.0) {
+        std::ostringstream rate;
+        rate << std::fixed << std::setprecision(3) << totalBytes/elapsed/1.0e6;
+        std::cout << " (" << rate.str() << " MB/s)";
+    }
+    std::cout << std::endl;
     return true;
 }
 
@@ -243,10 +481,13 @@ bool PromDownload(AmpIO&Board)
     std::ofstream file(mcsName.c_str());
     unsigned char DownloadedSector[SECTOR_SIZE];
     unsigned long addr = 0L;
+    unsigned long bytesRead = 0L;
     bool done = false;
     unsigned int i;
+    double startTime = Amp1394_GetTime();
     for (i = 0; !done; i++) {
-        if (!Board.PromReadData(addr, DownloadedSector, SECTOR_SIZE)) {
+        bytesRead += SECTOR_SIZE;
+        if (!Board.PromReadDataFast(addr, DownloadedSector, SECTOR_SIZE)) {
             std::cerr << "Error reading PROM data, sector " << i << std::endl;
             file.close();
             return false;
@@ -264,7 +505,8 @@ bool PromDownload(AmpIO&Board)
             // reasonably confident that this is the end.
             if (numTrailingFF < 256) {
                 unsigned char nextSector[SECTOR_SIZE];
-                if (!Board.PromReadData(addr+SECTOR_SIZE, nextSector, SECTOR_SIZE)) {
+                bytesRead += SECTOR_SIZE;
+                if (!Board.PromReadDataFast(addr+SECTOR_SIZE, nextSector, SECTOR_SIZE)) {
                     std::cerr << "Error reading PROM data, sector " << i+1 << std::endl;
                     file.close();
                     return false;
@@ -299,7 +541,15 @@ bool PromDownload(AmpIO&Board)
     // Write EOF record
     mcsFile::WriteEOF(file);
     file.close();
-    std::cout << "Downloaded " << i << " sectors (" << addr << " bytes) to " << mcsName << std::endl;
+    double elapsed = Amp1394_GetTime() - startTime;
+    std::cout << "Downloaded " << i << " sectors (" << addr << " bytes) to " << mcsName
+              << " in " << elapsed << " seconds";
+    if (elapsed > 0.0) {
+        std::ostringstream rate;
+        rate << std::fixed << std::setprecision(3) << bytesRead/elapsed/1.0e6;
+        std::cout << " (read " << bytesRead << " bytes, " << rate.str() << " MB/s)";
+    }
+    std::cout << std::endl;
     return true;
 }
 
@@ -470,6 +720,132 @@ bool PromQLASerialNumberProgram(AmpIO &Board, unsigned char chan = 0)
     return success;
 }
 
+// Read and display QLA identity (chan is 0 for QLA, 1 or 2 for DQLA)
+void PrintQLAIdentity(AmpIO &Board, unsigned char chan)
+{
+    AmpIO::QLAIdentity id;
+    std::string qlaName("QLA");
+    if (chan != 0) {
+        qlaName.append(" ");
+        qlaName.push_back('0'+chan);
+    }
+    if (!Board.ReadQLAIdentity(id, chan))
+        std::cerr << "Failed to read " << qlaName << " PROM" << std::endl;
+    else if (id.serialNumber.empty())
+        std::cout << qlaName << " serial number not programmed" << std::endl;
+    else
+        std::cout << qlaName << " serial number: " << id.serialNumber
+                  << " (" << id.boardType << ")" << std::endl;
+}
+
+// Returns true if Boards are all of the boards found on the port, so that a broadcast command
+// does not reach any other board.
+bool IsAllBoardsOnPort(BasePort *Port, const std::vector<AmpIO *> &Boards)
+{
+    size_t numFound = 0;
+    for (unsigned int id = 0; id < BoardIO::MAX_BOARDS; id++) {
+        if (Port->GetNodeId(id) < BasePort::MAX_NODES)
+            numFound++;
+    }
+    if (numFound != Boards.size())
+        return false;
+    for (size_t bd = 0; bd < Boards.size(); bd++) {
+        if (Port->GetNodeId(Boards[bd]->GetBoardId()) >= BasePort::MAX_NODES)
+            return false;
+    }
+    return true;
+}
+
+// Test, program and verify multiple boards (with the same PROM file). If the boards are all of the
+// boards on the port and all pass the programming test, they are programmed at the same time (see
+// PromProgramMulti) and then verified; otherwise, or if broadcast programming or verification fails,
+// the boards that passed the test are programmed and verified individually. Boards that fail the test
+// are not programmed. Returns RESULT_OK if all boards were successfully programmed, or
+// RESULT_UNKNOWN_BOARD (without programming any board) if the boards do not all have the same FPGA
+// version. If diffOnly is true, only changed sectors are programmed.
+int ProgramMultipleBoards(BasePort *Port, std::vector<AmpIO *> &Boards, const std::string &mcsName,
+                          mcsFile &promFile, bool diffOnly)
+{
+    size_t bd;
+    int result = RESULT_OK;
+    unsigned int fpgaVer = Boards[0]->GetFpgaVersionMajor();
+    for (bd = 1; bd < Boards.size(); bd++) {
+        if (Boards[bd]->GetFpgaVersionMajor() != fpgaVer) {
+            std::cerr << "Error: board " << (unsigned int)Boards[bd]->GetBoardId() << " has FPGA V"
+                      << Boards[bd]->GetFpgaVersionMajor() << ", expected V" << fpgaVer << std::endl;
+            return RESULT_UNKNOWN_BOARD;
+        }
+    }
+    if (mcsName.empty()) {
+        std::cout << "Skipping FPGA V3" << std::endl;
+        return RESULT_OK;
+    }
+    std::cout << "MCS file: " << mcsName << std::endl;
+    std::vector<bool> ok(Boards.size(), true);
+    bool useBroadcast = true;
+    for (bd = 0; bd < Boards.size(); bd++) {
+        unsigned int boardId = Boards[bd]->GetBoardId();
+        std::cout << std::endl << "Board: " << boardId << std::endl;
+        if (Boards[bd]->GetFirmwareVersion() < 4)
+            useBroadcast = false;
+        if (!PromProgramTest(*Boards[bd])) {
+            std::cerr << "Error: programming test failed for board: " << boardId << std::endl;
+            ok[bd] = false;
+            useBroadcast = false;
+            result = RESULT_PROGRAM_FAILED;
+        }
+    }
+    if (useBroadcast && !IsAllBoardsOnPort(Port, Boards)) {
+        std::cout << "Not all boards on port selected, programming boards individually" << std::endl;
+        useBroadcast = false;
+    }
+    else if (!useBroadcast) {
+        std::cout << "Programming test failed or firmware older than Rev 4, programming boards individually"
+                  << std::endl;
+    }
+    // Boards that should be programmed individually (tested OK, but failed during broadcast programming)
+    std::vector<bool> retry(Boards.size(), false);
+    std::vector<bool> bcOk(ok);
+    if (useBroadcast) {
+        std::cout << std::endl;
+        PromProgramMulti(Port, Boards, promFile, bcOk, diffOnly);
+        for (bd = 0; bd < Boards.size(); bd++) {
+            std::cout << std::endl << "Board: " << (unsigned int)Boards[bd]->GetBoardId() << std::endl;
+            if (!bcOk[bd] || !PromVerify(*Boards[bd], promFile)) {
+                std::cout << "Reprogramming board " << (unsigned int)Boards[bd]->GetBoardId()
+                          << " individually" << std::endl;
+                retry[bd] = true;
+            }
+        }
+    }
+    else {
+        retry = ok;
+    }
+    for (bd = 0; bd < Boards.size(); bd++) {
+        if (!retry[bd]) continue;
+        unsigned int boardId = Boards[bd]->GetBoardId();
+        std::cout << std::endl << "Board: " << boardId << std::endl;
+        if (!PromProgram(*Boards[bd], promFile, diffOnly)) {
+            std::cerr << "Error: programming failed for board: " << boardId << std::endl;
+            ok[bd] = false;
+            result = RESULT_PROGRAM_FAILED;
+        }
+        else if (!PromVerify(*Boards[bd], promFile)) {
+            std::cerr << "Error: verification failed for board: " << boardId << std::endl;
+            ok[bd] = false;
+            if (result == RESULT_OK)
+                result = RESULT_VERIFY_FAILED;
+        }
+    }
+    std::cout << std::endl << "Summary:" << std::endl;
+    for (bd = 0; bd < Boards.size(); bd++) {
+        std::cout << "  Board " << (unsigned int)Boards[bd]->GetBoardId() << ": "
+                  << (ok[bd] ? "OK" : "FAILED")
+                  << ((ok[bd] && retry[bd] && useBroadcast) ? " (programmed individually)" : "") << std::endl;
+    }
+    return result;
+}
+
 int main(int argc, char** argv)
 {
     int i;
@@ -481,10 +857,13 @@ int main(int argc, char** argv)
 #endif
     int port = 0;
     int board = BoardIO::MAX_BOARDS;
+    std::vector<int> boardList;       // all boards specified on command line
     std::string mcsName;
     std::string mcsNameAlt;
     std::string sn;
     bool auto_mode = false;
+    bool diff_mode = false;
+    bool mcs_cache = false;
     std::string IPaddr(ETH_UDP_DEFAULT_IP);
     std::string hwList;
 
@@ -508,20 +887,42 @@ int main(int argc, char** argv)
                 std::cerr << "Running in auto mode" << std::endl;
                 auto_mode = true;
             }
+            else if (argv[i][1] == 'd') {
+                std::cerr << "Programming changed sectors only" << std::endl;
+                diff_mode = true;
+            }
+            else if (argv[i][1] == 'c') {
+                std::cerr << "Using binary cache for MCS file" << std::endl;
+                mcs_cache = true;
+            }
         }
         else {
-            if (args_found == 0)
-                board = atoi(argv[i]);
+            if (args_found == 0) {
+                // Board number, or comma-separated list of board numbers (e.g., 0,1,6,7)
+                const char *str = argv[i];
+                while (*str) {
+                    boardList.push_back(atoi(str));
+                    while (*str && (*str != ',')) str++;
+                    if (*str == ',') str++;
+                }
+                if (!boardList.empty())
+                    board = boardList[0];
+            }
             else if (args_found == 1)
                 mcsName = std::string(argv[i]);
             args_found++;
         }
     }
     if (args_found < 1) {
-        std::cerr << "Usage: pgm1394 <board-num> [<mcs-file>] [-pP] [-hH]" << std::endl
+        std::cerr << "Usage: pgm1394 <board-num> [<mcs-file>] [-pP] [-hH] [-a] [-d] [-c]" << std::endl
                   << "       P = port number (default 0)" << std::endl
-                  << "       can also specify -pfwP, -pethP or -pudp" << std::endl
-                  << "       H = additional supported hardware versions" << std::endl;
+                  << "       can also specify -pfwP, -pethP, -pudp or -ploop:N" << std::endl
+                  << "       H = additional supported hardware versions" << std::endl
+                  << "       -a = auto mode (test, program and verify)" << std::endl
+                  << "       -d = only erase/program sectors that differ from the PROM" << std::endl
+                  << "       -c = use (or create) binary cache of MCS file (<mcs-file>.bin)" << std::endl
+                  << "       board-num can be a list (e.g., 0,1,6,7) to program all boards" << std::endl
+                  << "       at the same time (auto mode)" << std::endl;
         return 0;
     }
 
@@ -549,12 +950,34 @@ int main(int argc, char** argv)
         return -1;
 #endif
     }
+    else if (desiredPort == BasePort::PORT_ETH_LOOPBACK) {
+        // Emulated boards (for testing)
+        Port = new EthLoopbackPort(port, std::cerr);
+    }
     if (!Port || !Port->IsOK()) {
         std::cerr << "Failed to initialize " << BasePort::PortTypeString(desiredPort) << std::endl;
         return RESULT_NO_BOARD;
     }
     AmpIO Board(board);
     Port->AddBoard(&Board);
+    // Additional boards (multi-board mode)
+    std::vector<AmpIO *> Boards;
+    Boards.push_back(&Board);
+    for (size_t bd = 1; bd < boardList.size(); bd++) {
+        AmpIO *extraBoard = new AmpIO(boardList[bd]);
+        if (!Port->AddBoard(extraBoard)) {
+            std::cerr << "Failed to add board " << boardList[bd] << std::endl;
+            delete extraBoard;
+            for (size_t k = 1; k < Boards.size(); k++) {
+                Port->RemoveBoard(Boards[k]);
+                delete Boards[k];
+            }
+            Port->RemoveBoard(board);
+            delete Port;
+            return RESULT_NO_BOARD;
+        }
+        Boards.push_back(extraBoard);
+    }
 
     if (mcsName.empty()) {
         unsigned int fpgaVer = Board.GetFpgaVersionMajor();
@@ -572,6 +995,7 @@ int main(int argc, char** argv)
         }
     }
     mcsFile promFile;
+    promFile.SetCacheEnabled(mcs_cache);
     if (!mcsName.empty()) {
         bool fileOk = promFile.OpenFile(mcsName);
         if ((!fileOk) && (!mcsNameAlt.empty())) {
@@ -595,6 +1019,12 @@ int main(int argc, char** argv)
     bool fpgaV3 = mcsName.empty();
     uint32_t hver = Board.GetHardwareVersion();
 
+    if (Boards.size() > 1) {
+        // Multi-board mode (always auto)
+        result = ProgramMultipleBoards(Port, Boards, mcsName, promFile, diff_mode);
+        goto cleanup;
+    }
+
     if (auto_mode) {
         std::cout << std::endl
                   << "Board: " << (unsigned int)Board.GetBoardId() << std::endl;
@@ -607,7 +1037,7 @@ int main(int argc, char** argv)
             if (!PromProgramTest(Board)) {
                 std::cerr << "Error: programming test failed for board: " << (unsigned int)Board.GetBoardId() << std::endl;
                 result = RESULT_PROGRAM_FAILED;
-            } else if (!PromProgram(Board, promFile)) { // ... then program
+            } else if (!PromProgram(Board, promFile, diff_mode)) { // ... then program
                 std::cerr << "Error: programming failed for board: " << (unsigned int)Board.GetBoardId() << std::endl;
                 result = RESULT_PROGRAM_FAILED;
             } else if (!PromVerify(Board, promFile)) { // ... and verify
@@ -629,7 +1059,7 @@ int main(int argc, char** argv)
             if (!fpgaV3) {
                 if (PromProgramTest(Board)) {
                     std::cout << std::endl;
-                    result = PromProgram(Board, promFile) ? RESULT_OK : RESULT_PROGRAM_FAILED;
+                    result = PromProgram(Board, promFile, diff_mode) ? RESULT_OK : RESULT_PROGRAM_FAILED;
                 }
                 else {
                     std::cout << "Programming not started. Try power-cycling the FPGA" << std::endl;
@@ -668,17 +1098,11 @@ int main(int argc, char** argv)
             break;
         case 7:
             if (hver == DQLA_String) {
-                sn = Board.GetQLASerialNumber(1);
-                if (!sn.empty())
-                    std::cout << "QLA 1 serial number: " << sn << std::endl;
-                sn = Board.GetQLASerialNumber(2);
-                if (!sn.empty())
-                    std::cout << "QLA 2 serial number: " << sn << std::endl;
+                PrintQLAIdentity(Board, 1);
+                PrintQLAIdentity(Board, 2);
             }
             else {
-                sn = Board.GetQLASerialNumber();
-                if (!sn.empty())
-                    std::cout << "QLA serial number: " << sn << std::endl;
+                PrintQLAIdentity(Board, 0);
             }
             break;
         case 8:
@@ -702,6 +1126,10 @@ cleanup:
     if (!mcsName.empty())
         promFile.CloseFile();
     Port->RemoveBoard(board);
+    for (size_t bd = 1; bd < Boards.size(); bd++) {
+        Port->RemoveBoard(Boards[bd]);
+        delete Boards[bd];
+    }
     delete Port;
     return result;
 }
@@ -6,19 +6,41 @@
 
 boards="$@"
 
-for boardId in $boards
-do
-    echo "Programming board $boardId"
-    pgm1394 $boardId -a
-    result=$?
-    echo "Result: $result (0 is good)"
-    if [[ "$result" -ne 0 ]]; then
-       echo "------> pgm1394 -a failed for board $boardId"
-       echo "------> DO NOT REBOOT OR POWER OFF this board"
-       echo "------> Try to reprogram this board using pgm1394"
-       exit $result
-    fi
-done
+# All boards are programmed at the same time (using broadcast, if they are all
+# of the boards on the port), so pass them as a comma-separated list
+boardList=$(echo $boards | tr ' ' ',')
+
+echo "Programming boards $boards"
+pgm1394 $boardList -a
+result=$?
+echo "Result: $result (0 is good)"
+
+# Boards with different FPGA versions (e.g., a mixed rack) cannot be programmed
+# with the same PROM file (pgm1394 returns RESULT_UNKNOWN_BOARD, -5, without
+# programming any board), so program each board individually
+if [[ "$result" -eq 251 ]]; then
+    echo "Boards have different FPGA versions, programming each board individually"
+    for boardId in $boards
+    do
+        echo "Programming board $boardId"
+        pgm1394 $boardId -a
+        result=$?
+        echo "Result: $result (0 is good)"
+        if [[ "$result" -ne 0 ]]; then
+           echo "------> pgm1394 -a failed for board $boardId"
+           echo "------> DO NOT REBOOT OR POWER OFF this board"
+           echo "------> Try to reprogram this board using pgm1394"
+           exit $result
+        fi
+    done
+fi
+
+if [[ "$result" -ne 0 ]]; then
+   echo "------> pgm1394 -a failed (see summary above for failed boards)"
+   echo "------> DO NOT REBOOT OR POWER OFF the failed boards"
+   echo "------> Try to reprogram these boards using pgm1394"
+   exit $result
+fi
 
 echo "------> You now need to reboot your controllers.  You can either"
 echo "------> power cycle them or use: qlacommand -c reboot"
@@ -0,0 +1,484 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Cycle-latency benchmark: runs ReadAllBoards/WriteAllBoards cycles for each
+ * protocol (ProtocolType) on each specified port and reports the latency
+ * distribution, cycle rate and per-phase breakdown (see BasePort::TimingPhase)
+ * as text (stdout) and, optionally, as JSON.
+ *
+ * By default, the loopback port (EthLoopbackPort) is used, so that the benchmark
+ * can run without any hardware. A telemetry recording can be replayed (-preplay:file)
+ * to profile the host-side processing with real data; the recording is looped and is
+ * run only once, with the recorded protocol (labelled "recorded").
+ *
+ * For Ethernet ports, faults (packet loss, late/duplicate/reordered responses, response
+ * delays, bus resets) can be injected (-x, see FaultInjector::ParseSpec) to measure how the
+ * cycle timing and the board read validity respond.
+ *
+ ******************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+#include <math.h>
+
+#include "PortFactory.h"
+#include "EthLoopbackPort.h"
+#include "ReplayPort.h"
+#include "AmpIO.h"
+#include "Amp1394Time.h"
+
+// Latency statistics (seconds)
+struct LatencyStats {
+    double min, median, p99, p999, max, mean;
+
+    LatencyStats() : min(0.0), median(0.0), p99(0.0), p999(0.0), max(0.0), mean(0.0) {}
+
+    // Note: sorts the data
+    void Compute(std::vector<double> &data)
+    {
+        if (data.empty())
+            return;
+        std::sort(data.begin(), data.end());
+        min = data.front();
+        max = data.back();
+        median = Percentile(data, 0.5);
+        p99 = Percentile(data, 0.99);
+        p999 = Percentile(data, 0.999);
+        double sum = 0.0;
+        for (size_t i = 0; i < data.size(); i++)
+            sum += data[i];
+        mean = sum/data.size();
+    }
+
+    // Nearest-rank percentile of sorted data
+    static double Percentile(const std::vector<double> &sorted, double p)
+    {
+        size_t rank = static_cast<size_t>(ceil(p*sorted.size()));
+        if (rank < 1) rank = 1;
+        if (rank > sorted.size()) rank = sorted.size();
+        return sorted[rank-1];
+    }
+};
+
+const char *LatencyNames[] = { "read", "write", "cycle" };
+enum { LAT_READ, LAT_WRITE, LAT_CYCLE, LAT_NUM };
+
+const char *PhaseNames[BasePort::PHASE_NUM] = { "send", "wait", "receive", "decode" };
+
+struct BenchResult {
+    std::string portName;
+    std::string protocolName;
+    unsigned int numBoards;
+    unsigned int numCycles;
+    unsigned int numErrors;
+    unsigned int numInvalid;                      // number of board reads that were not valid
+    bool hasFaults;                               // whether fault injection was enabled
+    unsigned long faults[FaultInjector::FAULT_NUM];
+    unsigned long faultsFlushed;
+    double rate;                                  // cycles per second
+    LatencyStats latency[LAT_NUM];
+    LatencyStats phase[BasePort::PHASE_NUM];      // per cycle
+};
+
+void PrintDebugStream(std::stringstream &debugStream)
+{
+    char line[256];
+    while (debugStream.getline(line, sizeof(line)))
+        std::cerr << line << std::endl;
+    debugStream.clear();
+    debugStream.str("");
+}
+
+void PrintStatsLine(std::ostream &out, const char *name, const LatencyStats &stats)
+{
+    out << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+        << std::setw(10) << stats.min*1e6 << std::setw(10) << stats.median*1e6
+        << std::setw(10) << stats.p99*1e6 << std::setw(10) << stats.p999*1e6
+        << std::setw(10) << stats.max*1e6 << std::setw(10) << stats.mean*1e6 << std::endl;
+}
+
+void PrintText(std::ostream &out, const BenchResult &res)
+{
+    out << std::endl << res.portName << " (" << res.numBoards << " boards), " << res.protocolName
+        << ": " << res.numCycles << " cycles, " << res.numErrors << " errors, "
+        << res.numInvalid << " invalid board reads, "
+        << std::fixed << std::setprecision(1) << res.rate << " Hz" << std::endl;
+    if (res.hasFaults) {
+        out << "  faults:";
+        for (unsigned int f = 0; f < FaultInjector::FAULT_NUM; f++)
+            out << " " << FaultInjector::FaultName(static_cast<FaultInjector::FaultType>(f)) << " " << res.faults[f];
+        out << ", flushed " << res.faultsFlushed << std::endl;
+    }
+    out << "  " << std::left << std::setw(10) << "(usec)" << std::right
+        << std::setw(10) << "min" << std::setw(10) << "median" << std::setw(10) << "p99"
+        << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::setw(10) << "mean" << std::endl;
+    unsigned int i;
+    for (i = 0; i < LAT_NUM; i++)
+        PrintStatsLine(out, LatencyNames[i], res.latency[i]);
+    for (i = 0; i < BasePort::PHASE_NUM; i++)
+        PrintStatsLine(out, PhaseNames[i], res.phase[i]);
+}
+
+void PrintJsonStats(std::ostream &out, const LatencyStats &stats)
+{
+    out << "{\"min\": " << stats.min*1e6 << ", \"median\": " << stats.median*1e6
+        << ", \"p99\": " << stats.p99*1e6 << ", \"p99.9\": " << stats.p999*1e6
+        << ", \"max\": " << stats.max*1e6 << ", \"mean\": " << stats.mean*1e6 << "}";
+}
+
+void PrintJson(std::ostream &out, const std::vector<BenchResult> &results)
+{
+    unsigned int i;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"units\": \"usec\", \"results\": [";
+    for (size_t r = 0; r < results.size(); r++) {
+        const BenchResult &res = results[r];
+        out << ((r == 0) ? "" : ",") << std::endl
+            << "  {\"port\": \"" << res.portName << "\", \"protocol\": \"" << res.protocolName
+            << "\", \"boards\": " << res.numBoards << ", \"cycles\": " << res.numCycles
+            << ", \"errors\": " << res.numErrors << ", \"invalid_reads\": " << res.numInvalid
+            << ", \"rate_hz\": " << res.rate << "," << std::endl;
+        if (res.hasFaults) {
+            out << "   \"faults\": {";
+            for (i = 0; i < FaultInjector::FAULT_NUM; i++)
+                out << "\"" << FaultInjector::FaultName(static_cast<FaultInjector::FaultType>(i)) << "\": " << res.faults[i] << ", ";
+            out << "\"flushed\": " << res.faultsFlushed << "}," << std::endl;
+        }
+        out
+            << "   \"latency\": {";
+        for (i = 0; i < LAT_NUM; i++) {
+            out << ((i == 0) ? "" : ", ") << "\"" << LatencyNames[i] << "\": ";
+            PrintJsonStats(out, res.latency[i]);
+        }
+        out << "}," << std::endl << "   \"phases\": {";
+        for (i = 0; i < BasePort::PHASE_NUM; i++) {
+            out << ((i == 0) ? "" : ", ") << "\"" << PhaseNames[i] << "\": ";
+            PrintJsonStats(out, res.phase[i]);
+        }
+        out << "}}";
+    }
+    out << std::endl << "]}" << std::endl;
+}
+
+// Run the benchmark on the specified port, for all supported protocols
+void RunBenchmark(BasePort *port, unsigned int numCycles, unsigned int numWarmup,
+                  std::stringstream &debugStream, bool verbose, std::vector<BenchResult> &results)
+{
+    std::vector<BasePort::ProtocolType> protocols;
+    BasePort::ProtocolType origProtocol = port->GetProtocol();
+    // A replay port always uses the recorded protocol (see ReplayPort::ReadAllBoards)
+    bool isReplay = (dynamic_cast<ReplayPort *>(port) != 0);
+    if (isReplay) {
+        protocols.push_back(origProtocol);
+    }
+    else {
+        protocols.push_back(BasePort::PROTOCOL_SEQ_RW);
+        protocols.push_back(BasePort::PROTOCOL_SEQ_R_BC_W);
+        protocols.push_back(BasePort::PROTOCOL_BC_QRW);
+    }
+
+    std::vector<double> latency[LAT_NUM];
+    std::vector<double> phase[BasePort::PHASE_NUM];
+    unsigned int i, j;
+    for (i = 0; i < LAT_NUM; i++)
+        latency[i].resize(numCycles);
+    for (i = 0; i < BasePort::PHASE_NUM; i++)
+        phase[i].resize(numCycles);
+
+    for (size_t p = 0; p < protocols.size(); p++) {
+        if (!port->SetProtocol(protocols[p])) {
+            std::cout << std::endl << port->GetPortTypeString() << ": protocol "
+                      << BasePort::ProtocolString(protocols[p]) << " not supported, skipping" << std::endl;
+            PrintDebugStream(debugStream);
+            continue;
+        }
+        port->SetPhaseTiming(false);
+        for (i = 0; i < numWarmup; i++) {
+            port->ReadAllBoards();
+            port->WriteAllBoards();
+        }
+        port->SetPhaseTiming(true);
+        if (verbose)
+            PrintDebugStream(debugStream);
+        debugStream.str("");
+
+        BenchResult res;
+        res.portName = port->GetPortTypeString();
+        res.protocolName = BasePort::ProtocolString(protocols[p]);
+        if (isReplay)
+            res.protocolName.append(" (recorded)");
+        res.numBoards = port->GetNumOfBoards();
+        res.numCycles = numCycles;
+        res.numErrors = 0;
+        res.numInvalid = 0;
+
+        // Count only the faults injected during the measured cycles
+        EthBasePort *ethPort = dynamic_cast<EthBasePort *>(port);
+        FaultInjector *faults = ethPort ? ethPort->GetFaultInjector() : 0;
+        if (faults)
+            faults->ResetCounts();
+
+        port->ResetLatencyHistograms();
+        port->ResetFpgaTimingStats();
+        double tStart = Amp1394_GetMonotonicTime();
+        for (i = 0; i < numCycles; i++) {
+            port->ResetPhaseTimes();
+            double t0 = Amp1394_GetMonotonicTime();
+            bool readOK = port->ReadAllBoards();
+            double t1 = Amp1394_GetMonotonicTime();
+            bool writeOK = port->WriteAllBoards();
+            double t2 = Amp1394_GetMonotonicTime();
+            latency[LAT_READ][i] = t1-t0;
+            latency[LAT_WRITE][i] = t2-t1;
+            latency[LAT_CYCLE][i] = t2-t0;
+            for (j = 0; j < BasePort::PHASE_NUM; j++)
+                phase[j][i] = port->GetPhaseTime(static_cast<BasePort::TimingPhase>(j));
+            if (!readOK || !writeOK)
+                res.numErrors++;
+            for (j = 0; j < BoardIO::MAX_BOARDS; j++) {
+                BoardIO *board = port->GetBoard(j);
+                if (board && !board->ValidRead())
+                    res.numInvalid++;
+            }
+        }
+        double tEnd = Amp1394_GetMonotonicTime();
+        port->SetPhaseTiming(false);
+        res.rate = (tEnd > tStart) ? numCycles/(tEnd-tStart) : 0.0;
+        res.hasFaults = (faults != 0);
+        for (j = 0; j < FaultInjector::FAULT_NUM; j++)
+            res.faults[j] = faults ? faults->GetCount(static_cast<FaultInjector::FaultType>(j)) : 0;
+        res.faultsFlushed = faults ? faults->GetNumFlushed() : 0;
+
+        for (i = 0; i < LAT_NUM; i++)
+            res.latency[i].Compute(latency[i]);
+        for (i = 0; i < BasePort::PHASE_NUM; i++)
+            res.phase[i].Compute(phase[i]);
+
+        if (verbose || (res.numErrors > 0))
+            PrintDebugStream(debugStream);
+        debugStream.str("");
+
+        PrintText(std::cout, res);
+        if (verbose) {
+            // Histograms maintained by BasePort, for comparison
+            for (i = 0; i < BasePort::HIST_NUM; i++) {
+                std::cout << "  hist " << std::setw(8) << std::left << LatencyNames[i] << std::right;
+                port->GetLatencyHistogram(static_cast<BasePort::HistogramType>(i))->PrintSummary(std::cout);
+                std::cout << std::endl;
+            }
+            port->PrintFpgaTiming(std::cout);
+        }
+        results.push_back(res);
+    }
+    port->SetProtocol(origProtocol);
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+    std::vector<std::string> portArgs;
+    unsigned int numCycles = 10000;
+    unsigned int numWarmup = 100;
+    unsigned long loopFirmware = 8;
+    double loopDelay = 0.0;
+    std::string jsonFile;
+    std::string traceFile;
+    std::string telemetryFile;
+    std::string faultSpec;
+    bool verbose = false;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'p') {
+                portArgs.push_back(argv[i]+2);
+            }
+            else if (argv[i][1] == 'n') {
+                numCycles = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'w') {
+                numWarmup = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'f') {
+                loopFirmware = strtoul(argv[i]+2, 0, 10);
+            }
+            else if (argv[i][1] == 'd') {
+                loopDelay = atof(argv[i]+2)*1e-6;
+            }
+            else if (argv[i][1] == 'j') {
+                jsonFile = argv[i]+2;
+                if (jsonFile.empty())
+                    jsonFile = "-";
+            }
+            else if (argv[i][1] == 't') {
+                traceFile = argv[i]+2;
+            }
+            else if (argv[i][1] == 'r') {
+                telemetryFile = argv[i]+2;
+            }
+            else if (argv[i][1] == 'x') {
+                faultSpec = argv[i]+2;
+            }
+            else if (argv[i][1] == 'v') {
+                verbose = true;
+            }
+            else {
+                std::cerr << "Usage: " << argv[0] << " [-pP] [-nN] [-wN] [-fV] [-dT] [-j[file]] [-tfile] [-rfile] [-xF] [-v]" << std::endl
+                          << "       where P = port (can be repeated), default is loop:4 (emulated boards)" << std::endl
+                          << "                 -pfw[:P], -peth:P, -pudp[:xx.xx.xx.xx], -ploop[:B], -preplay:file" << std::endl
+                          << "             N = number of cycles (-n, default 10000) or warmup cycles (-w, default 100)" << std::endl
+                          << "             V = firmware version of emulated boards (7 or 8, default 8)" << std::endl
+                          << "             T = response delay of emulated boards, in microseconds (default 0)" << std::endl
+                          << "            -j writes JSON results to file (or stdout, if no file specified)" << std::endl
+                          << "            -t writes packet trace of last cycles to file (Ethernet only, see trace1394)" << std::endl
+                          << "            -r records telemetry of all cycles to file-NNN.tlm (see telemetry1394)" << std::endl
+                          << "            -x injects faults (Ethernet only), F = comma-separated list of settings:" << std::endl
+                          << "               reqdrop=P, drop=P, dup=P, late=P, reorder=P, reset=P (probability per packet)," << std::endl
+                          << "               delay=min:max, tail=P:mean (microseconds), seed=S" << std::endl
+                          << "            -v specifies verbose mode" << std::endl;
+                return 0;
+            }
+        }
+    }
+    if (portArgs.empty())
+        portArgs.push_back("loop:4");
+    if (numCycles == 0) {
+        std::cerr << "Number of cycles must be greater than 0" << std::endl;
+        return -1;
+    }
+
+    FaultConfig faultConfig;
+    if (!faultSpec.empty() && !FaultInjector::ParseSpec(faultSpec, faultConfig, std::cerr))
+        return -1;
+
+    std::vector<BenchResult> results;
+    std::stringstream debugStream(std::stringstream::out|std::stringstream::in);
+
+    for (size_t p = 0; p < portArgs.size(); p++) {
+        BasePort::PortType portType;
+        int portNum = 0;
+        std::string IPaddr(ETH_UDP_DEFAULT_IP);
+        if (!BasePort::ParseOptions(portArgs[p].c_str(), portType, portNum, IPaddr)) {
+            std::cerr << "Failed to parse port option: " << portArgs[p] << std::endl;
+            continue;
+        }
+        BasePort *port = 0;
+        if (portType == BasePort::PORT_ETH_LOOPBACK) {
+            EthLoopbackPort *loopPort = new EthLoopbackPort(portNum, debugStream, loopFirmware);
+            loopPort->SetResponseDelay(loopDelay);
+            port = loopPort;
+        }
+        else {
+            port = PortFactory(portArgs[p].c_str(), debugStream);
+        }
+        if (!port || !port->IsOK()) {
+            PrintDebugStream(debugStream);
+            std::cerr << "Failed to initialize port " << portArgs[p] << std::endl;
+            delete port;
+            continue;
+        }
+        if (verbose)
+            PrintDebugStream(debugStream);
+
+        ReplayPort *replayPort = dynamic_cast<ReplayPort *>(port);
+        if (replayPort)
+            replayPort->SetLoop(true);
+
+        EthBasePort *ethPort = dynamic_cast<EthBasePort *>(port);
+        if (!traceFile.empty() && ethPort)
+            ethPort->EnablePacketTrace();
+
+        std::vector<AmpIO *> boards;
+        for (unsigned int bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+            if (port->GetNodeId(bd) < BasePort::MAX_NODES) {
+                AmpIO *board = new AmpIO(bd);
+                port->AddBoard(board);
+                boards.push_back(board);
+            }
+        }
+        if (boards.empty()) {
+            std::cerr << "No boards found on port " << portArgs[p] << std::endl;
+        }
+        else {
+            // Enable fault injection after the boards have been found
+            if (!faultSpec.empty()) {
+                if (ethPort)
+                    ethPort->EnableFaultInjection(faultConfig);
+                else
+                    std::cerr << "Fault injection not supported on port " << portArgs[p] << std::endl;
+            }
+            std::stringstream telemetryBase;
+            if (!telemetryFile.empty()) {
+                telemetryBase << telemetryFile;
+                if (portArgs.size() > 1)
+                    telemetryBase << "." << p;
+                if (!port->StartTelemetry(telemetryBase.str()))
+                    PrintDebugStream(debugStream);
+            }
+            RunBenchmark(port, numCycles, numWarmup, debugStream, verbose, results);
+            const TelemetryRecorder *telemetry = port->GetTelemetryRecorder();
+            if (telemetry && telemetry->IsRunning()) {
+                port->StopTelemetry();
+                std::cout << "Telemetry written to " << telemetryBase.str() << ": " << telemetry->GetNumWritten()
+                          << " frames in " << telemetry->GetNumSegments() << " segment(s), "
+                          << telemetry->GetNumDropped() << " dropped (buffer full), "
+                          << telemetry->GetNumFileDropped() << " dropped (file)" << std::endl;
+            }
+        }
+
+        if (!traceFile.empty() && ethPort) {
+            std::stringstream fileName;
+            fileName << traceFile;
+            if (portArgs.size() > 1)
+                fileName << "." << p;
+            if (ethPort->DumpPacketTrace(fileName.str()))
+                std::cout << "Packet trace written to " << fileName.str() << std::endl;
+            else
+                PrintDebugStream(debugStream);
+        }
+
+        for (size_t bd = 0; bd < boards.size(); bd++) {
+            port->RemoveBoard(boards[bd]);
+            delete boards[bd];
+        }
+        delete port;
+        debugStream.str("");
+    }
+
+    if (!jsonFile.empty()) {
+        if (jsonFile == "-") {
+            std::cout << std::endl;
+            PrintJson(std::cout, results);
+        }
+        else {
+            std::ofstream jsonStream(jsonFile.c_str());
+            if (!jsonStream.good()) {
+                std::cerr << "Failed to open JSON file " << jsonFile << std::endl;
+                return -1;
+            }
+            PrintJson(jsonStream, results);
+            std::cout << std::endl << "JSON results written to " << jsonFile << std::endl;
+        }
+    }
+
+    return results.empty() ? -1 : 0;
+}
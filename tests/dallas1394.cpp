@@ -0,0 +1,248 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Test for the background Dallas (DS2505) tool reader (AmpIO::DallasReaderStart), using
+ * the loopback port with emulated tools (EthLoopbackPort::SetEmulatedTool). All boards
+ * except the last one have a tool. The test runs ReadAllBoards/WriteAllBoards, which
+ * advances the readers (see BasePort::BackgroundStep), and checks:
+ *
+ *   1) the model, version and name read by each board (the last board, which has no tool,
+ *      must not report DALLAS_OK)
+ *   2) with repeated reads, that a tool change and tool removal on the first board are
+ *      detected (DallasReaderGetChangeCount)
+ *   3) that the blocking read (AmpIO::DallasReadTool) returns the same result
+ *
+ * Usage: dallas1394 [-bN] [-fF] [-v]
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+
+#include "EthLoopbackPort.h"
+#include "AmpIO.h"
+#include "Amp1394Time.h"
+
+struct ToolInfo {
+    bool present;
+    uint32_t model;      // Only 3 bytes are stored (see AmpIO::DallasParseTool)
+    uint8_t version;
+    std::string name;
+};
+
+static ToolInfo MakeTool(unsigned int bd)
+{
+    ToolInfo tool;
+    std::ostringstream name;
+    name << "TEST TOOL " << bd;
+    tool.present = true;
+    tool.model = 400006 + 10*bd;
+    tool.version = static_cast<uint8_t>(bd+1);
+    tool.name = name.str();
+    return tool;
+}
+
+static bool CheckTool(const char *test, unsigned int bd, AmpIO::DallasStatus status, uint32_t model,
+                      uint8_t version, const std::string &name, const ToolInfo &expected)
+{
+    bool ok;
+    if (expected.present)
+        ok = (status == AmpIO::DALLAS_OK) && (model == expected.model) && (version == expected.version)
+             && (name == expected.name);
+    else
+        ok = (status != AmpIO::DALLAS_OK) && (status != AmpIO::DALLAS_WAIT);
+    std::cout << test << ": board " << bd << ", status " << status;
+    if (status == AmpIO::DALLAS_OK)
+        std::cout << ", model " << model << ", version " << static_cast<unsigned int>(version)
+                  << ", name \"" << name << "\"";
+    if (!expected.present)
+        std::cout << " (no tool)";
+    std::cout << (ok ? "" : " -- ERROR") << std::endl;
+    return ok;
+}
+
+// Runs the real-time loop until cond returns true for all boards, up to timeoutSec.
+// Returns the number of cycles, or 0 on timeout.
+typedef bool (*DoneFunc)(const AmpIO *board, unsigned long arg);
+
+static unsigned long RunUntil(BasePort *port, const std::vector<AmpIO *> &boards, DoneFunc cond,
+                              unsigned long arg, double timeoutSec)
+{
+    double startTime = Amp1394_GetTime();
+    for (unsigned long cycle = 1; ; cycle++) {
+        port->ReadAllBoards();
+        port->WriteAllBoards();
+        bool done = true;
+        for (size_t i = 0; i < boards.size(); i++)
+            done = done && cond(boards[i], arg);
+        if (done)
+            return cycle;
+        if (Amp1394_GetTime()-startTime > timeoutSec)
+            return 0;
+        Amp1394_Sleep(0.0002);
+    }
+}
+
+static bool ReaderIdle(const AmpIO *board, unsigned long)
+{
+    return !board->DallasReaderIsActive();
+}
+
+static bool ReaderChanged(const AmpIO *board, unsigned long numChanged)
+{
+    return board->DallasReaderGetChangeCount() > numChanged;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int numBoards = 3;
+    unsigned long fwVersion = 8;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'b') {
+                numBoards = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'f') {
+                fwVersion = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'v') {
+                verbose = true;
+            }
+            else {
+                std::cerr << "Usage: " << argv[0] << " [-bN] [-fF] [-v]" << std::endl
+                          << "       where N = number of emulated boards (2-16, default 3)" << std::endl
+                          << "             F = emulated firmware version (7 or 8, default 8)" << std::endl
+                          << "            -v specifies verbose mode" << std::endl;
+                return 0;
+            }
+        }
+    }
+    if ((numBoards < 2) || (numBoards > BoardIO::MAX_BOARDS) || (fwVersion < 7) || (fwVersion > 8)) {
+        std::cerr << "Invalid number of boards or firmware version" << std::endl;
+        return -1;
+    }
+
+    std::stringstream debugStream(std::stringstream::out|std::stringstream::in);
+    EthLoopbackPort *port = new EthLoopbackPort(numBoards, debugStream, fwVersion);
+    if (!port->IsOK()) {
+        std::cerr << debugStream.str();
+        std::cerr << "Failed to initialize loopback port" << std::endl;
+        delete port;
+        return -1;
+    }
+    if (verbose)
+        std::cerr << debugStream.str();
+
+    std::vector<AmpIO *> boards;
+    std::vector<ToolInfo> tools;
+    for (unsigned int bd = 0; bd < numBoards; bd++) {
+        AmpIO *board = new AmpIO(static_cast<uint8_t>(bd));
+        port->AddBoard(board);
+        boards.push_back(board);
+        ToolInfo tool = MakeTool(bd);
+        if (bd == numBoards-1)
+            tool.present = false;
+        else
+            port->SetEmulatedTool(bd, tool.model, tool.version, tool.name);
+        tools.push_back(tool);
+    }
+
+    bool ok = true;
+    const double timeoutSec = 5.0;
+    unsigned int bd;
+
+    // 1) Read the tools of all boards in the background
+    for (bd = 0; bd < numBoards; bd++) {
+        if (!boards[bd]->DallasReaderStart(0.0, timeoutSec)) {
+            std::cout << "DallasReaderStart failed for board " << bd << std::endl;
+            ok = false;
+        }
+    }
+    unsigned long cycles = RunUntil(port, boards, ReaderIdle, 0, 2*timeoutSec);
+    if (cycles == 0) {
+        std::cout << "Background read: timeout" << std::endl;
+        ok = false;
+    }
+    else {
+        std::cout << "Background read: finished after " << cycles << " cycles" << std::endl;
+    }
+    for (bd = 0; bd < numBoards; bd++) {
+        const AmpIO::DallasToolInfo &info = boards[bd]->DallasReaderGetTool();
+        ok = CheckTool("Background read", bd, info.status, info.model, info.version, info.name, tools[bd]) && ok;
+        if (boards[bd]->DallasReaderGetReadCount() != 1) {
+            std::cout << "Background read: board " << bd << ", read count "
+                      << boards[bd]->DallasReaderGetReadCount() << " -- ERROR" << std::endl;
+            ok = false;
+        }
+    }
+
+    // 2) Repeated reads on the first board: change the tool, then remove it
+    std::vector<AmpIO *> first(1, boards[0]);
+    boards[0]->DallasReaderStart(0.01, timeoutSec);
+    for (unsigned int step = 0; step < 2; step++) {
+        if (step == 0) {
+            tools[0].model += 1;
+            tools[0].version += 1;
+            tools[0].name = "CHANGED TOOL";
+            port->SetEmulatedTool(0, tools[0].model, tools[0].version, tools[0].name);
+        }
+        else {
+            tools[0].present = false;
+            port->ClearEmulatedTool(0);
+        }
+        const char *test = (step == 0) ? "Tool change" : "Tool removal";
+        if (RunUntil(port, first, ReaderChanged, boards[0]->DallasReaderGetChangeCount(), 2*timeoutSec) == 0) {
+            std::cout << test << ": not detected -- ERROR" << std::endl;
+            ok = false;
+            continue;
+        }
+        const AmpIO::DallasToolInfo &info = boards[0]->DallasReaderGetTool();
+        ok = CheckTool(test, 0, info.status, info.model, info.version, info.name, tools[0]) && ok;
+    }
+    boards[0]->DallasReaderStop();
+    tools[0] = MakeTool(0);
+    port->SetEmulatedTool(0, tools[0].model, tools[0].version, tools[0].name);
+
+    // 3) Blocking read (DallasReadTool), for comparison
+    for (bd = 0; bd < numBoards; bd++) {
+        uint32_t model = 0;
+        uint8_t version = 0;
+        std::string name;
+        AmpIO::DallasStatus status;
+        double startTime = Amp1394_GetTime();
+        do {
+            status = boards[bd]->DallasReadTool(model, version, name, timeoutSec);
+            if (status == AmpIO::DALLAS_WAIT)
+                Amp1394_Sleep(0.001);
+        } while ((status == AmpIO::DALLAS_WAIT) && (Amp1394_GetTime()-startTime < 2*timeoutSec));
+        ok = CheckTool("Blocking read", bd, status, model, version, name, tools[bd]) && ok;
+    }
+
+    std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+
+    for (bd = 0; bd < numBoards; bd++) {
+        port->RemoveBoard(boards[bd]);
+        delete boards[bd];
+    }
+    delete port;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Prints the identity of all boards on the port (or the specified boards): hardware
+ * and firmware version, FPGA and QLA serial numbers, tool and (for dRA1) robot serial
+ * number. The identity of all boards is read concurrently (see BoardIdentity). With the
+ * -s option, the identity is also read sequentially (one board and one operation at a
+ * time, using the AmpIO methods), to compare the elapsed time.
+ *
+ * Usage: identity1394 [-pP] [-bN[,N...]] [-n] [-tT] [-s] [-v]
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+
+#include "PortFactory.h"
+#include "AmpIO.h"
+#include "BoardIdentity.h"
+#include "Amp1394Time.h"
+
+// Read identity sequentially, as done by calling the AmpIO methods for each board
+static double ReadSequential(const std::vector<AmpIO *> &boards, bool readTool, double dallasTimeout)
+{
+    double startTime = Amp1394_GetTime();
+    for (size_t i = 0; i < boards.size(); i++) {
+        AmpIO *board = boards[i];
+        board->GetFPGASerialNumber();
+        if (board->GetHardwareVersion() == DQLA_String) {
+            board->GetQLASerialNumber(1);
+            board->GetQLASerialNumber(2);
+        }
+        else {
+            board->GetQLASerialNumber();
+        }
+        if (readTool) {
+            uint32_t model;
+            uint8_t version;
+            std::string name;
+            double toolStart = Amp1394_GetTime();
+            AmpIO::DallasStatus status;
+            do {
+                status = board->DallasReadTool(model, version, name, dallasTimeout);
+                if (status == AmpIO::DALLAS_WAIT)
+                    Amp1394_Sleep(0.001);
+            } while ((status == AmpIO::DALLAS_WAIT) && (Amp1394_GetTime()-toolStart < dallasTimeout));
+            if (board->GetHardwareVersion() == dRA1_String)
+                board->ReadRobotSerialNumber();
+        }
+    }
+    return Amp1394_GetTime()-startTime;
+}
+
+int main(int argc, char** argv)
+{
+    std::string portArg = BasePort::DefaultPort();
+    std::vector<unsigned int> boardList;
+    bool readTool = true;
+    double dallasTimeout = 10.0;
+    bool compare = false;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'p') {
+                portArg = argv[i]+2;
+            }
+            else if (argv[i][1] == 'b') {
+                // Comma-separated list of boards
+                std::stringstream ss(argv[i]+2);
+                std::string item;
+                while (std::getline(ss, item, ','))
+                    boardList.push_back(atoi(item.c_str()));
+            }
+            else if (argv[i][1] == 'n') {
+                readTool = false;
+            }
+            else if (argv[i][1] == 't') {
+                dallasTimeout = atof(argv[i]+2);
+            }
+            else if (argv[i][1] == 's') {
+                compare = true;
+            }
+            else if (argv[i][1] == 'v') {
+                verbose = true;
+            }
+            else {
+                std::cerr << "Usage: " << argv[0] << " [-pP] [-bN[,N...]] [-n] [-tT] [-s] [-v]" << std::endl
+                          << "       where P = port, default is " << BasePort::DefaultPort() << std::endl
+                          << "                 -pfw[:P], -peth:P, -pudp[:xx.xx.xx.xx], -ploop[:B]" << std::endl
+                          << "             N = board number(s), default is all boards found" << std::endl
+                          << "            -n does not read tool or robot serial number" << std::endl
+                          << "             T = Dallas (tool) timeout in seconds (default 10)" << std::endl
+                          << "            -s also reads identity sequentially, to compare time" << std::endl
+                          << "            -v specifies verbose mode" << std::endl;
+                return 0;
+            }
+        }
+    }
+
+    std::stringstream debugStream(std::stringstream::out|std::stringstream::in);
+    BasePort *port = PortFactory(portArg.c_str(), debugStream);
+    if (!port || !port->IsOK()) {
+        std::cerr << debugStream.str();
+        std::cerr << "Failed to initialize port " << portArg << std::endl;
+        delete port;
+        return -1;
+    }
+    if (verbose)
+        std::cerr << debugStream.str();
+
+    if (boardList.empty()) {
+        for (unsigned int bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+            if ((port->GetNodeId(bd) < BasePort::MAX_NODES) && (port->GetHardwareVersion(bd) != BCFG_String))
+                boardList.push_back(bd);
+        }
+    }
+
+    std::vector<AmpIO *> boards;
+    for (size_t i = 0; i < boardList.size(); i++) {
+        if ((boardList[i] >= BoardIO::MAX_BOARDS) || (port->GetNodeId(boardList[i]) >= BasePort::MAX_NODES)) {
+            std::cerr << "Board " << boardList[i] << " not found" << std::endl;
+            continue;
+        }
+        AmpIO *board = new AmpIO(static_cast<uint8_t>(boardList[i]));
+        port->AddBoard(board);
+        boards.push_back(board);
+    }
+    if (boards.empty()) {
+        std::cerr << "No boards found" << std::endl;
+        delete port;
+        return -1;
+    }
+
+    BoardIdentity identity(port);
+    identity.SetReadTool(readTool);
+    identity.SetReadRobot(readTool);
+    identity.SetDallasTimeout(dallasTimeout);
+    for (size_t i = 0; i < boards.size(); i++)
+        identity.AddBoard(boards[i]);
+    bool ok = identity.Run(dallasTimeout+5.0);
+    identity.PrintTable(std::cout);
+
+    if (compare) {
+        double seqTime = ReadSequential(boards, readTool, dallasTimeout);
+        std::ostringstream times;
+        times << std::fixed << std::setprecision(3) << seqTime << " sec (concurrent "
+              << identity.GetElapsedTime() << " sec)";
+        std::cout << "Sequential time: " << times.str() << std::endl;
+    }
+
+    for (size_t i = 0; i < boards.size(); i++) {
+        port->RemoveBoard(boards[i]);
+        delete boards[i];
+    }
+    delete port;
+    return ok ? 0 : 1;
+}
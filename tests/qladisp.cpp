@@ -396,7 +396,7 @@ int main(int argc, char** argv)
         console.Print(1, lm, "Sensor Feedback for Board %d", board1);
     }
     console.Print(2, lm, "Press ESC to quit, r to reset port, 0-3 to toggle digital output bit, p to enable/disable power,");
-    console.Print(3, lm, "+/- to increase/decrease commanded current (DAC) by 0x100");
+    console.Print(3, lm, "+/- to increase/decrease commanded current (DAC) by 0x100, t to show timing (T to reset)");
 
     for (i = 1; i <= numAxes; i++) {
         unsigned int dx = lm+8+(i-1)*13;
@@ -460,6 +460,8 @@ int main(int argc, char** argv)
         timeLines++;
     const int DEBUG_START_LINE = fullvel ? (23+timeLines) : (20+timeLines);
     unsigned int last_debug_line = DEBUG_START_LINE;
+    bool showTiming = false;          // show timing panel (see BasePort::PrintFpgaTiming)
+    unsigned int timingLines = 0;     // number of lines in timing panel (debug output starts after panel)
     const int ESC_CHAR = 0x1b;
     int c;
 
@@ -478,7 +480,25 @@ int main(int argc, char** argv)
         unsigned int startIndex = (curAxis == 0) ? 0 : curBoardIndex;
         unsigned int endIndex = (curAxis == 0) ? numDisp : curBoardIndex+1;
 
-        if (c == 'r') {
+        if ((c == 't') || (c == 'T')) {
+            if (c == 't') {
+                showTiming = !showTiming;
+                // Clear timing panel and debug output
+                char line[120];
+                memset(line, ' ', sizeof(line)-1);
+                line[sizeof(line)-1] = 0;
+                unsigned int lastLine = std::max(last_debug_line, DEBUG_START_LINE+timingLines);
+                for (i = DEBUG_START_LINE; i < lastLine; i++)
+                    console.Print(i, lm, line);
+                last_debug_line = DEBUG_START_LINE;
+                timingLines = 0;
+            }
+            else {
+                Port->ResetLatencyHistograms();
+                Port->ResetFpgaTimingStats();
+            }
+        }
+        else if (c == 'r') {
             Port->Reset();
             Port->SetProtocol(protocol);
         }
@@ -681,7 +701,7 @@ int main(int argc, char** argv)
         }
 
         if (!debugStream.str().empty()) {
-            int cur_line = DEBUG_START_LINE;
+            int cur_line = DEBUG_START_LINE+timingLines;
             char line[120];
             memset(line, ' ', sizeof(line)-1);
             line[sizeof(line)-1] = 0;
@@ -866,6 +886,15 @@ int main(int argc, char** argv)
             console.Print(STATUS_LINE+5, lm+12, "%s   StateError: %3d   PacketError: %3d",
                           flagStr, fpgaStatus.numStateInvalid, fpgaStatus.numPacketError);
         }
+        if (showTiming) {
+            std::stringstream timingStr;
+            Port->PrintFpgaTiming(timingStr);
+            unsigned int cur_line = DEBUG_START_LINE;
+            std::string stringLine;
+            while (std::getline(timingStr, stringLine))
+                console.Print(cur_line++, lm, stringLine.c_str());
+            timingLines = cur_line-DEBUG_START_LINE;
+        }
         Port->WriteAllBoards();
 
         unsigned int readErrors = 0;
@@ -0,0 +1,333 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Stress test for the side channel (see BasePort::EnableSideChannel). The main
+ * thread runs ReadAllBoards/WriteAllBoards, while other threads perform transactions
+ * on the first board and check the results:
+ *
+ *   Phase 1: implicit requests (ReadQuadlet, WriteQuadlet, ReadBlock, WriteBlock),
+ *            which are submitted to the side channel because they are called from
+ *            other threads, and explicit requests (SubmitRequest)
+ *   Phase 2: explicit requests only, while the main thread repeatedly disables and
+ *            enables the side channel; requests may fail while it is disabled, but
+ *            must not be left pending
+ *
+ * The written values are read back, and the number of requests processed by the side
+ * channel is checked, since a transaction that is not performed by the I/O thread races
+ * with ReadAllBoards/WriteAllBoards for the packet buffers (which is not necessarily
+ * visible in the data, in particular with the loopback port). Intended for the loopback
+ * port (-ploop), which emulates the registers that are used (scratch register 14 and the
+ * QLA PROM block buffer at 0x3100).
+ *
+ * Usage: side1394 [-pP] [-nN] [-v]
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "PortFactory.h"
+#include "AmpIO.h"
+#include "Amp1394Time.h"
+
+const nodeaddr_t SCRATCH_REG = 14;        // Emulated register that is not otherwise used
+const nodeaddr_t BLOCK_ADDR = 0x3100;     // QLA PROM block buffer
+const unsigned int BLOCK_QUADS = 4;
+
+enum WorkerType { WORK_QUADLET, WORK_BLOCK, WORK_EXPLICIT };
+
+struct Worker {
+    BasePort *port;
+    unsigned char boardId;
+    WorkerType type;
+    unsigned int numIter;
+    quadlet_t fwVersion;              // Expected firmware version (WORK_EXPLICIT)
+    volatile bool done;
+    unsigned long numOK;
+    unsigned long numFailed;          // Transaction failed (e.g., side channel disabled)
+    unsigned long numErrors;          // Wrong data, or request left pending
+};
+
+static void RunQuadlet(Worker *w, unsigned int iter)
+{
+    quadlet_t wdata = 0x5a000000 | iter;
+    quadlet_t rdata = 0;
+    if (!w->port->WriteQuadlet(w->boardId, SCRATCH_REG, wdata) ||
+        !w->port->ReadQuadlet(w->boardId, SCRATCH_REG, rdata))
+        w->numFailed++;
+    else if (rdata != wdata)
+        w->numErrors++;
+    else
+        w->numOK++;
+}
+
+static void RunBlock(Worker *w, unsigned int iter)
+{
+    quadlet_t wdata[BLOCK_QUADS];
+    quadlet_t rdata[BLOCK_QUADS];
+    for (unsigned int i = 0; i < BLOCK_QUADS; i++)
+        wdata[i] = (iter << 8) | i;
+    memset(rdata, 0, sizeof(rdata));
+    if (!w->port->WriteBlock(w->boardId, BLOCK_ADDR, wdata, sizeof(wdata)) ||
+        !w->port->ReadBlock(w->boardId, BLOCK_ADDR, rdata, sizeof(rdata)))
+        w->numFailed++;
+    else if (memcmp(rdata, wdata, sizeof(wdata)) != 0)
+        w->numErrors++;
+    else
+        w->numOK++;
+}
+
+static void RunExplicit(Worker *w)
+{
+    SideRequest req;
+    req.SetReadQuadlet(w->boardId, BoardIO::FIRMWARE_VERSION);
+    if (!w->port->SubmitRequest(req)) {
+        // Not enabled (phase 2) or queue full
+        w->numFailed++;
+        Amp1394_Sleep(0.0005);
+        return;
+    }
+    if (!req.IsDone() && !req.Wait(2.0) && !req.IsDone()) {
+        // Still pending after much longer than the side channel timeout
+        w->port->GetSideChannel()->Cancel(req);
+        w->numErrors++;
+    }
+    else if (!req.Succeeded())
+        w->numFailed++;
+    else if (req.GetQuadlet() != w->fwVersion)
+        w->numErrors++;
+    else
+        w->numOK++;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI WorkerEntry(LPVOID arg)
+#else
+static void *WorkerEntry(void *arg)
+#endif
+{
+    Worker *w = static_cast<Worker *>(arg);
+    for (unsigned int iter = 0; iter < w->numIter; iter++) {
+        if (w->type == WORK_QUADLET)
+            RunQuadlet(w, iter);
+        else if (w->type == WORK_BLOCK)
+            RunBlock(w, iter);
+        else
+            RunExplicit(w);
+    }
+    AMP1394_MEMORY_BARRIER();
+    w->done = true;
+    return 0;
+}
+
+static void *StartWorker(Worker *w)
+{
+#ifdef _WIN32
+    return CreateThread(0, 0, WorkerEntry, w, 0, 0);
+#else
+    pthread_t *thread = new pthread_t;
+    if (pthread_create(thread, 0, WorkerEntry, w) != 0) {
+        delete thread;
+        return 0;
+    }
+    return thread;
+#endif
+}
+
+static void JoinWorker(void *handle)
+{
+#ifdef _WIN32
+    WaitForSingleObject(static_cast<HANDLE>(handle), INFINITE);
+    CloseHandle(static_cast<HANDLE>(handle));
+#else
+    pthread_t *thread = static_cast<pthread_t *>(handle);
+    pthread_join(*thread, 0);
+    delete thread;
+#endif
+}
+
+// Runs the real-time loop until all workers are done; if toggle is non-zero, disables and
+// enables the side channel every toggle cycles. Returns false if the workers did not finish.
+static bool RunPhase(BasePort *port, Worker *workers, unsigned int num, unsigned int toggle)
+{
+    void *handles[3];
+    unsigned int i;
+    for (i = 0; i < num; i++) {
+        workers[i].done = false;
+        workers[i].numOK = workers[i].numFailed = workers[i].numErrors = 0;
+        handles[i] = StartWorker(&workers[i]);
+        if (!handles[i]) {
+            std::cerr << "Failed to create thread" << std::endl;
+            break;
+        }
+    }
+    unsigned int numStarted = i;
+    double startTime = Amp1394_GetMonotonicTime();
+    bool allDone = false;
+    for (unsigned long cycle = 0; !allDone; cycle++) {
+        port->ReadAllBoards();
+        port->WriteAllBoards();
+        if (toggle && ((cycle%toggle) == 0)) {
+            if ((cycle/toggle)%2)
+                port->DisableSideChannel();
+            else
+                port->EnableSideChannel();
+        }
+        allDone = true;
+        for (i = 0; i < numStarted; i++)
+            allDone = allDone && workers[i].done;
+        if (Amp1394_GetMonotonicTime()-startTime > 60.0)
+            break;
+        Amp1394_Sleep(0.0001);
+    }
+    // Make sure that the workers can finish (e.g., if stopped by the timeout above)
+    port->EnableSideChannel();
+    while (!allDone) {
+        port->ReadAllBoards();
+        port->WriteAllBoards();
+        allDone = true;
+        for (i = 0; i < numStarted; i++)
+            allDone = allDone && workers[i].done;
+    }
+    for (i = 0; i < numStarted; i++)
+        JoinWorker(handles[i]);
+    return (numStarted == num);
+}
+
+static bool PrintResults(const char *phase, const Worker *workers, unsigned int num)
+{
+    static const char *names[] = { "quadlet", "block", "explicit" };
+    bool ok = true;
+    for (unsigned int i = 0; i < num; i++) {
+        std::cout << phase << ": " << names[workers[i].type] << " ok = " << workers[i].numOK
+                  << ", failed = " << workers[i].numFailed << ", errors = " << workers[i].numErrors << std::endl;
+        if (workers[i].numErrors != 0)
+            ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    std::string portArg = BasePort::DefaultPort();
+    unsigned int numIter = 2000;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'p') {
+                portArg = argv[i]+2;
+            }
+            else if (argv[i][1] == 'n') {
+                numIter = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'v') {
+                verbose = true;
+            }
+            else {
+                std::cerr << "Usage: " << argv[0] << " [-pP] [-nN] [-v]" << std::endl
+                          << "       where P = port, default is " << BasePort::DefaultPort() << std::endl
+                          << "                 -pfw[:P], -peth:P, -pudp[:xx.xx.xx.xx], -ploop[:B]" << std::endl
+                          << "             N = transactions per thread (default 2000)" << std::endl
+                          << "            -v specifies verbose mode" << std::endl;
+                return 0;
+            }
+        }
+    }
+
+    std::stringstream debugStream(std::stringstream::out|std::stringstream::in);
+    BasePort *port = PortFactory(portArg.c_str(), debugStream);
+    if (!port || !port->IsOK()) {
+        std::cerr << debugStream.str();
+        std::cerr << "Failed to initialize port " << portArg << std::endl;
+        delete port;
+        return -1;
+    }
+    if (verbose)
+        std::cerr << debugStream.str();
+
+    unsigned int bd;
+    for (bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+        if ((port->GetNodeId(bd) < BasePort::MAX_NODES) && (port->GetHardwareVersion(bd) == QLA1_String))
+            break;
+    }
+    if (bd == BoardIO::MAX_BOARDS) {
+        std::cerr << "No QLA board found" << std::endl;
+        delete port;
+        return -1;
+    }
+    AmpIO *board = new AmpIO(static_cast<uint8_t>(bd));
+    port->AddBoard(board);
+
+    quadlet_t fwVersion = 0;
+    port->ReadQuadlet(board->GetBoardId(), BoardIO::FIRMWARE_VERSION, fwVersion);
+    port->EnableSideChannel();
+
+    Worker workers[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        workers[i].port = port;
+        workers[i].boardId = board->GetBoardId();
+        workers[i].type = static_cast<WorkerType>(i);
+        workers[i].numIter = numIter;
+        workers[i].fwVersion = fwVersion;
+    }
+
+    const SideChannel *side = port->GetSideChannel();
+
+    // Phase 1: all workers, side channel enabled. Each iteration of the quadlet and block
+    // workers performs two transactions, and of the explicit worker one transaction.
+    unsigned long numProcessed = side->GetNumProcessed();
+    bool ok = RunPhase(port, workers, 3, 0);
+    ok = PrintResults("Phase 1", workers, 3) && ok;
+    for (unsigned int i = 0; i < 3; i++) {
+        if (workers[i].numFailed != 0)
+            ok = false;
+    }
+    numProcessed = side->GetNumProcessed()-numProcessed;
+    if (numProcessed != 5UL*numIter) {
+        std::cout << "Phase 1: side channel processed " << numProcessed << " requests, expected "
+                  << 5UL*numIter << std::endl;
+        ok = false;
+    }
+
+    // Phase 2: explicit requests only, while disabling and enabling the side channel
+    ok = RunPhase(port, &workers[WORK_EXPLICIT], 1, 50) && ok;
+    ok = PrintResults("Phase 2", &workers[WORK_EXPLICIT], 1) && ok;
+
+    std::cout << "Side channel: processed = " << side->GetNumProcessed()
+              << ", failed = " << side->GetNumFailed()
+              << ", rejected = " << side->GetNumRejected()
+              << ", timed out = " << side->GetNumTimedOut()
+              << ", max queued = " << side->GetMaxQueued()
+              << ", over budget = " << side->GetNumOverBudget() << std::endl;
+    std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+
+    port->DisableSideChannel();
+    port->RemoveBoard(board);
+    delete board;
+    delete port;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Transport throughput sweep: extends block1394eth (one transfer of one size)
+ * to measure the throughput (MB/s, transactions/s) and latency of quadlet and
+ * block reads and writes, for transfer sizes from 4 bytes to the maximum supported
+ * by the port (GetMaxReadDataSize/GetMaxWriteDataSize), on each specified port
+ * (created by PortFactory, so any port type can be used).
+ *
+ * For each size, "block" transfers the data with one block transaction and "quad"
+ * transfers it with consecutive quadlet transactions (one per quadlet). Writes are
+ * measured as a batch of <depth> writes (pipelined, since the write methods do not
+ * wait for a response on Ethernet) followed by one quadlet read, so that the time
+ * includes the completion of the writes. Reads are always synchronous (depth 1).
+ *
+ * The default address is the waveform table (0x8000, QLA with Firmware Rev 7+), which can
+ * be read and written without side effects when no waveform is active. With the default
+ * address, the write sweep is skipped for other boards (e.g., dRA1, DQLA) and older
+ * firmware; a different address can be specified (-a), in which case it is the user's
+ * responsibility that it can be written. The write sweep only writes back the data that
+ * was read from the specified address before the sweep.
+ *
+ ******************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PortFactory.h"
+#include "BoardIO.h"
+#include "Amp1394BSwap.h"
+#include "Amp1394Time.h"
+#include "LatencyHistogram.h"
+
+struct SweepPoint {
+    std::string portName;
+    std::string op;               // "read" or "write"
+    std::string mode;             // "quad" or "block"
+    unsigned int nbytes;          // bytes per transfer
+    unsigned int depth;           // transfers per operation (writes only)
+    unsigned int numOps;          // number of operations
+    unsigned int numErrors;       // number of failed operations
+    double mbps;                  // MB/s (1e6 bytes per second)
+    double tps;                   // transactions per second (excluding the write completion read)
+    // Latency per operation (seconds)
+    double latMin, latMedian, latP99, latMax, latMean;
+};
+
+void PrintDebugStream(std::stringstream &debugStream)
+{
+    char line[256];
+    while (debugStream.getline(line, sizeof(line)))
+        std::cerr << line << std::endl;
+    debugStream.clear();
+    debugStream.str("");
+}
+
+// Transfer sizes: powers of 2 from minSize to maxSize, and maxSize
+void GetSizes(unsigned int minSize, unsigned int maxSize, std::vector<unsigned int> &sizes)
+{
+    sizes.clear();
+    for (unsigned int n = minSize; n < maxSize; n *= 2)
+        sizes.push_back(n);
+    if (maxSize >= minSize)
+        sizes.push_back(maxSize);
+}
+
+// Perform one operation (see above); data is in bus (big endian) byte order
+bool DoOperation(BasePort *port, unsigned char boardId, nodeaddr_t addr, bool isWrite, bool isQuad,
+                 quadlet_t *data, unsigned int nbytes, unsigned int depth)
+{
+    unsigned int nquads = nbytes/sizeof(quadlet_t);
+    unsigned int i, d;
+    bool ret = true;
+    if (!isWrite) {
+        if (isQuad) {
+            for (i = 0; i < nquads; i++)
+                ret &= port->ReadQuadlet(boardId, addr+i, data[i]);
+        }
+        else {
+            ret = port->ReadBlock(boardId, addr, data, nbytes);
+        }
+        return ret;
+    }
+    for (d = 0; d < depth; d++) {
+        if (isQuad) {
+            for (i = 0; i < nquads; i++)
+                ret &= port->WriteQuadlet(boardId, addr+i, bswap_32(data[i]));
+        }
+        else {
+            ret &= port->WriteBlock(boardId, addr, data, nbytes);
+        }
+    }
+    // Wait for completion
+    quadlet_t status;
+    ret &= port->ReadQuadlet(boardId, BoardIO::BOARD_STATUS, status);
+    return ret;
+}
+
+void RunPoint(BasePort *port, unsigned char boardId, nodeaddr_t addr, bool isWrite, bool isQuad,
+              quadlet_t *data, unsigned int nbytes, unsigned int depth, unsigned int numOps,
+              std::vector<SweepPoint> &results)
+{
+    SweepPoint pt;
+    pt.portName = port->GetPortTypeString();
+    pt.op = isWrite ? "write" : "read";
+    pt.mode = isQuad ? "quad" : "block";
+    pt.nbytes = nbytes;
+    pt.depth = depth;
+    pt.numOps = numOps;
+    pt.numErrors = 0;
+
+    LatencyHistogram hist;
+    double tStart = Amp1394_GetMonotonicTime();
+    for (unsigned int i = 0; i < numOps; i++) {
+        double t0 = Amp1394_GetMonotonicTime();
+        if (!DoOperation(port, boardId, addr, isWrite, isQuad, data, nbytes, depth))
+            pt.numErrors++;
+        hist.Record(Amp1394_GetMonotonicTime()-t0);
+    }
+    double elapsed = Amp1394_GetMonotonicTime()-tStart;
+
+    unsigned int transPerOp = (isQuad ? nbytes/sizeof(quadlet_t) : 1)*depth;
+    pt.mbps = (elapsed > 0.0) ? (static_cast<double>(nbytes)*depth*numOps)/elapsed/1.0e6 : 0.0;
+    pt.tps = (elapsed > 0.0) ? (static_cast<double>(transPerOp)*numOps)/elapsed : 0.0;
+    pt.latMin = hist.GetMin();
+    pt.latMedian = hist.GetPercentile(50.0);
+    pt.latP99 = hist.GetPercentile(99.0);
+    pt.latMax = hist.GetMax();
+    pt.latMean = hist.GetMean();
+    results.push_back(pt);
+}
+
+void PrintTextHeader(std::ostream &out)
+{
+    out << std::left << std::setw(18) << "port" << std::setw(6) << "op" << std::setw(6) << "mode" << std::right
+        << std::setw(6) << "bytes" << std::setw(6) << "depth" << std::setw(7) << "errors"
+        << std::setw(9) << "MB/s" << std::setw(10) << "trans/s"
+        << std::setw(10) << "min(us)" << std::setw(10) << "med(us)" << std::setw(10) << "p99(us)"
+        << std::setw(10) << "max(us)" << std::endl;
+}
+
+void PrintText(std::ostream &out, const SweepPoint &pt)
+{
+    out << std::left << std::setw(18) << pt.portName << std::setw(6) << pt.op << std::setw(6) << pt.mode << std::right
+        << std::setw(6) << pt.nbytes << std::setw(6) << pt.depth << std::setw(7) << pt.numErrors
+        << std::fixed << std::setprecision(3) << std::setw(9) << pt.mbps
+        << std::setprecision(0) << std::setw(10) << pt.tps << std::setprecision(2)
+        << std::setw(10) << pt.latMin*1e6 << std::setw(10) << pt.latMedian*1e6
+        << std::setw(10) << pt.latP99*1e6 << std::setw(10) << pt.latMax*1e6 << std::endl;
+}
+
+void PrintCsv(std::ostream &out, const std::vector<SweepPoint> &results)
+{
+    out << "port,op,mode,bytes,depth,ops,errors,mb_per_s,trans_per_s,lat_min_us,lat_median_us,lat_p99_us,lat_max_us,lat_mean_us" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < results.size(); i++) {
+        const SweepPoint &pt = results[i];
+        out << pt.portName << "," << pt.op << "," << pt.mode << "," << pt.nbytes << "," << pt.depth
+            << "," << pt.numOps << "," << pt.numErrors << "," << pt.mbps << "," << pt.tps
+            << "," << pt.latMin*1e6 << "," << pt.latMedian*1e6 << "," << pt.latP99*1e6
+            << "," << pt.latMax*1e6 << "," << pt.latMean*1e6 << std::endl;
+    }
+}
+
+void PrintJson(std::ostream &out, const std::vector<SweepPoint> &results)
+{
+    out << std::fixed << std::setprecision(3);
+    out << "{\"units\": {\"throughput\": \"MB/s\", \"latency\": \"usec\"}, \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SweepPoint &pt = results[i];
+        out << ((i == 0) ? "" : ",") << std::endl
+            << "  {\"port\": \"" << pt.portName << "\", \"op\": \"" << pt.op << "\", \"mode\": \"" << pt.mode
+            << "\", \"bytes\": " << pt.nbytes << ", \"depth\": " << pt.depth << ", \"ops\": " << pt.numOps
+            << ", \"errors\": " << pt.numErrors << ", \"mb_per_s\": " << pt.mbps << ", \"trans_per_s\": " << pt.tps
+            << ", \"latency\": {\"min\": " << pt.latMin*1e6 << ", \"median\": " << pt.latMedian*1e6
+            << ", \"p99\": " << pt.latP99*1e6 << ", \"max\": " << pt.latMax*1e6
+            << ", \"mean\": " << pt.latMean*1e6 << "}}";
+    }
+    out << std::endl << "]}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+    std::vector<std::string> portArgs;
+    int boardArg = -1;
+    nodeaddr_t addr = 0x8000;
+    bool addrSpecified = false;
+    unsigned int numOps = 1000;
+    unsigned int maxDepth = 1;
+    unsigned int maxQuadBytes = 256;
+    bool doRead = true;
+    bool doWrite = true;
+    bool csv = false;
+    std::string jsonFile;
+    bool verbose = false;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'p') {
+                portArgs.push_back(argv[i]+2);
+            }
+            else if (argv[i][1] == 'b') {
+                boardArg = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'a') {
+                addr = strtoull(argv[i]+2, 0, 16);
+                addrSpecified = true;
+            }
+            else if (argv[i][1] == 'n') {
+                numOps = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'd') {
+                maxDepth = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'q') {
+                maxQuadBytes = atoi(argv[i]+2);
+            }
+            else if (argv[i][1] == 'r') {
+                doWrite = false;
+            }
+            else if (argv[i][1] == 'w') {
+                doRead = false;
+            }
+            else if (argv[i][1] == 'c') {
+                csv = true;
+            }
+            else if (argv[i][1] == 'j') {
+                jsonFile = argv[i]+2;
+                if (jsonFile.empty())
+                    jsonFile = "-";
+            }
+            else if (argv[i][1] == 'v') {
+                verbose = true;
+            }
+            else {
+                std::cerr << "Usage: " << argv[0] << " [-pP] [-bN] [-aA] [-nN] [-dD] [-qQ] [-r|-w] [-c] [-j[file]] [-v]" << std::endl
+                          << "       where P = port (can be repeated), default is " << BasePort::DefaultPort() << std::endl
+                          << "                 -pfw[:P], -peth:P, -pudp[:xx.xx.xx.xx], -ploop[:B]" << std::endl
+                          << "             N = board number (-b, default is first board found)" << std::endl
+                          << "                 or number of operations per point (-n, default 1000)" << std::endl
+                          << "             A = address in hex (default 8000, waveform table, QLA Rev 7+ only)" << std::endl
+                          << "             D = maximum write pipeline depth (1, 2, 4, ..., D; default 1)" << std::endl
+                          << "             Q = maximum size for quadlet transfers, in bytes (default 256)" << std::endl
+                          << "            -r sweeps reads only, -w sweeps writes only" << std::endl
+                          << "            -c prints CSV instead of text" << std::endl
+                          << "            -j writes JSON results to file (or stdout, if no file specified)" << std::endl
+                          << "            -v specifies verbose mode" << std::endl;
+                return 0;
+            }
+        }
+    }
+    if (portArgs.empty())
+        portArgs.push_back(BasePort::DefaultPort());
+    if ((numOps == 0) || (maxDepth == 0)) {
+        std::cerr << "Number of operations and depth must be greater than 0" << std::endl;
+        return -1;
+    }
+
+    std::vector<SweepPoint> results;
+    std::stringstream debugStream(std::stringstream::out|std::stringstream::in);
+    quadlet_t data[MAX_POSSIBLE_DATA_SIZE/sizeof(quadlet_t)];
+
+    if (!csv)
+        PrintTextHeader(std::cout);
+
+    for (size_t p = 0; p < portArgs.size(); p++) {
+        BasePort *port = PortFactory(portArgs[p].c_str(), debugStream);
+        if (!port || !port->IsOK()) {
+            PrintDebugStream(debugStream);
+            std::cerr << "Failed to initialize port " << portArgs[p] << std::endl;
+            delete port;
+            continue;
+        }
+        if (verbose)
+            PrintDebugStream(debugStream);
+        debugStream.str("");
+
+        int boardId = boardArg;
+        if (boardId < 0) {
+            for (unsigned int bd = 0; bd < BoardIO::MAX_BOARDS; bd++) {
+                if (port->GetNodeId(bd) < BasePort::MAX_NODES) {
+                    boardId = bd;
+                    break;
+                }
+            }
+        }
+        if ((boardId < 0) || (boardId >= static_cast<int>(BoardIO::MAX_BOARDS)) ||
+            (port->GetNodeId(boardId) >= BasePort::MAX_NODES)) {
+            std::cerr << "No board found on port " << portArgs[p] << std::endl;
+            delete port;
+            continue;
+        }
+        unsigned char bid = static_cast<unsigned char>(boardId);
+
+        size_t first = results.size();
+        std::vector<unsigned int> sizes;
+        // Maximum sizes (multiple of a quadlet)
+        unsigned int maxRead = port->GetMaxReadDataSize() & ~(sizeof(quadlet_t)-1);
+        unsigned int maxWrite = port->GetMaxWriteDataSize() & ~(sizeof(quadlet_t)-1);
+        unsigned int s, d;
+
+        if (doRead) {
+            GetSizes(sizeof(quadlet_t), std::min(maxQuadBytes, maxRead), sizes);
+            for (s = 0; s < sizes.size(); s++)
+                RunPoint(port, bid, addr, false, true, data, sizes[s], 1, numOps, results);
+            GetSizes(sizeof(quadlet_t), maxRead, sizes);
+            for (s = 0; s < sizes.size(); s++)
+                RunPoint(port, bid, addr, false, false, data, sizes[s], 1, numOps, results);
+        }
+
+        if (doWrite && !addrSpecified &&
+            ((port->GetHardwareVersion(bid) != QLA1_String) || (port->GetFirmwareVersion(bid) < 7))) {
+            std::cerr << "Board " << boardId << " is not a QLA with Firmware Rev 7+ (no waveform table), "
+                      << "skipping write sweep (use -a to specify a writable address)" << std::endl;
+        }
+        else if (doWrite) {
+            // Read the current contents, which are then written back
+            bool readOK = true;
+            memset(data, 0, sizeof(data));
+            for (unsigned int offset = 0; readOK && (offset < maxWrite); offset += maxRead) {
+                unsigned int nbytes = std::min(maxRead, maxWrite-offset);
+                readOK = port->ReadBlock(bid, addr+offset/sizeof(quadlet_t), data+offset/sizeof(quadlet_t), nbytes);
+            }
+            if (!readOK) {
+                PrintDebugStream(debugStream);
+                std::cerr << "Failed to read data at address " << std::hex << addr << std::dec
+                          << ", skipping write sweep" << std::endl;
+            }
+            else {
+                for (d = 1; d <= maxDepth; d *= 2) {
+                    GetSizes(sizeof(quadlet_t), std::min(maxQuadBytes, maxWrite), sizes);
+                    for (s = 0; s < sizes.size(); s++)
+                        RunPoint(port, bid, addr, true, true, data, sizes[s], d, numOps, results);
+                    GetSizes(sizeof(quadlet_t), maxWrite, sizes);
+                    for (s = 0; s < sizes.size(); s++)
+                        RunPoint(port, bid, addr, true, false, data, sizes[s], d, numOps, results);
+                }
+            }
+        }
+
+        if (verbose)
+            PrintDebugStream(debugStream);
+        debugStream.str("");
+        if (!csv) {
+            for (size_t r = first; r < results.size(); r++)
+                PrintText(std::cout, results[r]);
+        }
+        delete port;
+    }
+
+    if (csv)
+        PrintCsv(std::cout, results);
+
+    if (!jsonFile.empty()) {
+        if (jsonFile == "-") {
+            std::cout << std::endl;
+            PrintJson(std::cout, results);
+        }
+        else {
+            std::ofstream jsonStream(jsonFile.c_str());
+            if (!jsonStream.good()) {
+                std::cerr << "Failed to open JSON file " << jsonFile << std::endl;
+                return -1;
+            }
+            PrintJson(jsonStream, results);
+            std::cout << std::endl << "JSON results written to " << jsonFile << std::endl;
+        }
+    }
+
+    return results.empty() ? -1 : 0;
+}
@@ -0,0 +1,284 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Decoder for the binary telemetry files written by BasePort::StartTelemetry
+ * (see TelemetryRecorder). Prints the board configuration and one line per frame
+ * (cycle), as text or CSV, followed by a summary of the read, write and cycle times.
+ * For each board, the line contains the validity flags and the first two quadlets of
+ * the feedback (timestamp and status).
+ *
+ * With -a, the recording is instead played back via ReplayPort, and the feedback
+ * is decoded by AmpIO (i.e., encoder position and velocity, motor current).
+ *
+ * Usage: telemetry1394 [-a] [-c] [-nN] [-s] <file>
+ *    -a     decode feedback using AmpIO (via ReplayPort)
+ *    -c     print CSV instead of text
+ *    -nN    print only the first N frames
+ *    -s     print summary only
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "TelemetryRecorder.h"
+#include "BasePort.h"
+#include "Amp1394BSwap.h"
+#include "LatencyHistogram.h"
+#include "ReplayPort.h"
+#include "AmpIO.h"
+
+static std::string VersionString(uint32_t hver)
+{
+    std::string str;
+    for (int i = 3; i >= 0; i--) {
+        char c = static_cast<char>((hver >> (8*i)) & 0xff);
+        str.push_back(isprint(c) ? c : '?');
+    }
+    return str;
+}
+
+// Play back the recording via ReplayPort and print the feedback decoded by AmpIO
+static int DecodeAmpIO(const std::string &fileName, bool csv, long maxFrames)
+{
+    std::stringstream debugStream(std::stringstream::out|std::stringstream::in);
+    ReplayPort port(fileName, debugStream);
+    if (!port.IsOK()) {
+        std::cerr << debugStream.str();
+        return -1;
+    }
+
+    std::vector<AmpIO *> boards;
+    unsigned int board, i;
+    for (board = 0; board < BoardIO::MAX_BOARDS; board++) {
+        if (port.GetBoardMask() & (1 << board)) {
+            AmpIO *ampio = new AmpIO(board);
+            port.AddBoard(ampio);
+            boards.push_back(ampio);
+        }
+    }
+
+    if (csv) {
+        std::cout << "frame";
+        for (i = 0; i < boards.size(); i++) {
+            board = boards[i]->GetBoardId();
+            std::cout << ",b" << board << "_valid,b" << board << "_timestamp,b" << board << "_status";
+            for (unsigned int j = 0; j < boards[i]->GetNumEncoders(); j++)
+                std::cout << ",b" << board << "_pos" << j << ",b" << board << "_vel" << j;
+            for (unsigned int j = 0; j < boards[i]->GetNumMotors(); j++)
+                std::cout << ",b" << board << "_cur" << j;
+        }
+        std::cout << std::endl;
+    }
+
+    while (((maxFrames < 0) || (port.GetNumPlayed() < static_cast<uint32_t>(maxFrames))) && !port.IsEndOfFile()) {
+        port.ReadAllBoards();
+        const TelemetryFrameHeader *frame = port.GetCurrentFrame();
+        if (port.IsEndOfFile() || !frame)
+            break;
+        if (csv)
+            std::cout << frame->frameNum;
+        else
+            std::cout << "Frame " << frame->frameNum << std::endl;
+        for (i = 0; i < boards.size(); i++) {
+            AmpIO *ampio = boards[i];
+            bool valid = ampio->ValidRead();
+            if (csv) {
+                std::cout << "," << valid << "," << ampio->GetTimestamp() << "," << ampio->GetStatus();
+                for (unsigned int j = 0; j < ampio->GetNumEncoders(); j++)
+                    std::cout << "," << ampio->GetEncoderPosition(j) << "," << ampio->GetEncoderVelocityPredicted(j);
+                for (unsigned int j = 0; j < ampio->GetNumMotors(); j++)
+                    std::cout << "," << ampio->GetMotorCurrent(j);
+                continue;
+            }
+            std::cout << "  Board " << std::setw(2) << static_cast<unsigned int>(ampio->GetBoardId());
+            if (!valid) {
+                std::cout << ": invalid" << std::endl;
+                continue;
+            }
+            std::cout << ": timestamp " << ampio->GetTimestamp() << ", status " << std::hex
+                      << ampio->GetStatus() << std::dec << std::endl << "    pos:";
+            for (unsigned int j = 0; j < ampio->GetNumEncoders(); j++)
+                std::cout << " " << std::setw(9) << ampio->GetEncoderPosition(j);
+            std::cout << std::endl << "    vel:";
+            for (unsigned int j = 0; j < ampio->GetNumEncoders(); j++)
+                std::cout << " " << std::setw(9) << ampio->GetEncoderVelocityPredicted(j);
+            std::cout << std::endl << "    cur:";
+            for (unsigned int j = 0; j < ampio->GetNumMotors(); j++)
+                std::cout << " " << std::setw(9) << ampio->GetMotorCurrent(j);
+            std::cout << std::endl;
+        }
+        if (csv)
+            std::cout << std::endl;
+    }
+    if (!csv)
+        std::cout << "Frames played: " << port.GetNumPlayed() << std::endl;
+
+    for (i = 0; i < boards.size(); i++) {
+        port.RemoveBoard(boards[i]);
+        delete boards[i];
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    bool decode = false;
+    bool summaryOnly = false;
+    long maxFrames = -1;
+    std::string fileName;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'a')
+                decode = true;
+            else if (argv[i][1] == 'c')
+                csv = true;
+            else if (argv[i][1] == 's')
+                summaryOnly = true;
+            else if (argv[i][1] == 'n')
+                maxFrames = atol(argv[i]+2);
+            else {
+                std::cerr << "Invalid option: " << argv[i] << std::endl;
+                return -1;
+            }
+        }
+        else {
+            fileName = argv[i];
+        }
+    }
+
+    if (fileName.empty()) {
+        std::cerr << "Usage: telemetry1394 [-a] [-c] [-nN] [-s] <file>" << std::endl
+                  << "       where <file> is the base name or a segment file (<base>-NNN.tlm)" << std::endl
+                  << "             -a decodes feedback using AmpIO (via ReplayPort)" << std::endl
+                  << "             -c prints CSV instead of text" << std::endl
+                  << "             -nN prints only the first N frames" << std::endl
+                  << "             -s prints summary only" << std::endl;
+        return 0;
+    }
+
+    if (decode)
+        return DecodeAmpIO(fileName, csv, maxFrames);
+
+    TelemetryReader reader;
+    if (!reader.Open(fileName))
+        return -1;
+
+    const TelemetrySegmentHeader &config = reader.GetConfig();
+    unsigned int board;
+    if (!csv) {
+        std::cout << fileName << ": port " << BasePort::PortTypeString(static_cast<BasePort::PortType>(config.portType))
+                  << ", protocol " << BasePort::ProtocolString(static_cast<BasePort::ProtocolType>(config.protocol))
+                  << std::endl;
+        for (board = 0; board < BoardIO::MAX_BOARDS; board++) {
+            if (config.boardMask & (1 << board)) {
+                std::cout << "  Board " << std::setw(2) << board << ": " << VersionString(config.hardwareVersion[board])
+                          << ", firmware " << config.firmwareVersion[board]
+                          << ", FPGA V" << config.fpgaVersion[board]
+                          << ", read " << config.readNumBytes[board] << " bytes, write "
+                          << config.writeNumBytes[board] << " bytes" << std::endl;
+            }
+        }
+    }
+
+    if (!summaryOnly) {
+        if (csv) {
+            std::cout << "frame,time_us,read_us,write_us,flags";
+            for (board = 0; board < BoardIO::MAX_BOARDS; board++) {
+                if (config.boardMask & (1 << board))
+                    std::cout << ",b" << board << "_flags,b" << board << "_timestamp,b" << board << "_status";
+            }
+            std::cout << std::endl;
+        }
+        else {
+            std::cout << "     frame     time(us)  read(us) write(us) flags  boards (flags:timestamp:status)" << std::endl;
+        }
+    }
+
+    LatencyHistogram readHist, writeHist, periodHist;
+    double t0 = -1.0;
+    double lastStart = 0.0;
+    unsigned int numReadFail = 0;
+    unsigned int numWriteFail = 0;
+    const TelemetryFrameHeader *frame;
+    std::cout << std::fixed << std::setprecision(1);
+    while ((frame = reader.NextFrame()) != 0) {
+        double start = (frame->flags & TelemetryRecorder::FRAME_READ) ? frame->readStartTime : frame->writeStartTime;
+        if (t0 < 0.0)
+            t0 = start;
+        else
+            periodHist.Record(start-lastStart);
+        lastStart = start;
+        double readTime = (frame->flags & TelemetryRecorder::FRAME_READ) ? frame->readEndTime-frame->readStartTime : 0.0;
+        double writeTime = (frame->flags & TelemetryRecorder::FRAME_WRITE) ? frame->writeEndTime-frame->writeStartTime : 0.0;
+        if (frame->flags & TelemetryRecorder::FRAME_READ) {
+            readHist.Record(readTime);
+            if (!(frame->flags & TelemetryRecorder::FRAME_READ_OK))
+                numReadFail++;
+        }
+        if (frame->flags & TelemetryRecorder::FRAME_WRITE) {
+            writeHist.Record(writeTime);
+            if (!(frame->flags & TelemetryRecorder::FRAME_WRITE_OK))
+                numWriteFail++;
+        }
+        if (summaryOnly || ((maxFrames >= 0) && (reader.GetNumRead() > static_cast<uint32_t>(maxFrames))))
+            continue;
+
+        if (csv)
+            std::cout << frame->frameNum << "," << (start-t0)*1e6 << "," << readTime*1e6 << "," << writeTime*1e6
+                      << "," << frame->flags;
+        else
+            std::cout << std::setw(10) << frame->frameNum << " " << std::setw(12) << (start-t0)*1e6
+                      << " " << std::setw(9) << readTime*1e6 << " " << std::setw(9) << writeTime*1e6
+                      << "    " << std::hex << std::setw(2) << std::setfill('0') << frame->flags
+                      << std::setfill(' ') << std::dec << " ";
+        for (board = 0; board < BoardIO::MAX_BOARDS; board++) {
+            if (!(config.boardMask & (1 << board)))
+                continue;
+            const quadlet_t *data = TelemetryReader::GetReadData(frame, board);
+            quadlet_t timestamp = data ? bswap_32(data[0]) : 0;
+            quadlet_t status = data ? bswap_32(data[1]) : 0;
+            if (csv)
+                std::cout << "," << static_cast<unsigned int>(frame->board[board].flags) << "," << timestamp << "," << status;
+            else
+                std::cout << " " << std::hex << static_cast<unsigned int>(frame->board[board].flags) << ":"
+                          << std::setw(8) << std::setfill('0') << timestamp << ":" << std::setw(8) << status
+                          << std::setfill(' ') << std::dec;
+        }
+        std::cout << std::endl;
+    }
+
+    if (!csv) {
+        std::cout << "Frames: " << reader.GetNumRead() << ", missing (dropped): " << reader.GetNumMissing()
+                  << ", read failures: " << numReadFail << ", write failures: " << numWriteFail << std::endl;
+        std::cout << "  Read   ";
+        readHist.PrintSummary(std::cout);
+        std::cout << std::endl << "  Write  ";
+        writeHist.PrintSummary(std::cout);
+        std::cout << std::endl << "  Period ";
+        periodHist.PrintSummary(std::cout);
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-    */
+/* ex: set filetype=cpp softtabstop=4 shiftwidth=4 tabstop=4 cindent expandtab: */
+
+/*
+  (C) Copyright 2024 Johns Hopkins University (JHU), All Rights Reserved.
+
+--- begin cisst license - do not edit ---
+
+This software is provided "as is" under an open source license, with
+no warranty.  The complete license can be found in license.txt and
+http://www.cisst.org/cisst/license.txt.
+
+--- end cisst license ---
+*/
+
+/******************************************************************************
+ *
+ * Decoder for the binary packet trace files written by EthBasePort::DumpPacketTrace
+ * (see PacketTrace). Prints one line per packet, as text or CSV, followed by a
+ * summary of the host round-trip and FPGA times.
+ *
+ * Usage: trace1394 [-c] [-nN] [-s] <file>
+ *    -c     print CSV instead of text
+ *    -nN    print only the N packets before and after the trigger (if any)
+ *    -s     print summary only
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+
+#include "PacketTrace.h"
+#include "EthBasePort.h"
+
+static const char *TcodeString(uint8_t tcode)
+{
+    switch (tcode) {
+        case EthBasePort::QWRITE: return "QWRITE";
+        case EthBasePort::BWRITE: return "BWRITE";
+        case EthBasePort::QREAD:  return "QREAD";
+        case EthBasePort::BREAD:  return "BREAD";
+    }
+    return "?";
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    bool summaryOnly = false;
+    long window = -1;
+    std::string fileName;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (argv[i][1] == 'c')
+                csv = true;
+            else if (argv[i][1] == 's')
+                summaryOnly = true;
+            else if (argv[i][1] == 'n')
+                window = atol(argv[i]+2);
+            else {
+                std::cerr << "Invalid option: " << argv[i] << std::endl;
+                return -1;
+            }
+        }
+        else {
+            fileName = argv[i];
+        }
+    }
+
+    if (fileName.empty()) {
+        std::cerr << "Usage: trace1394 [-c] [-nN] [-s] <file>" << std::endl
+                  << "       where -c prints CSV instead of text" << std::endl
+                  << "             -nN prints only N packets before and after the trigger" << std::endl
+                  << "             -s prints summary only" << std::endl;
+        return 0;
+    }
+
+    PacketTraceFileHeader header;
+    std::vector<PacketTraceRecord> records;
+    if (!PacketTrace::ReadFile(fileName, header, records, std::cerr))
+        return -1;
+
+    bool hasTrigger = (header.triggerIndex != PacketTrace::NO_TRIGGER);
+    if (!csv) {
+        std::cout << fileName << ": " << header.numRecords << " packets, port type " << header.portType;
+        if (hasTrigger)
+            std::cout << ", trigger at packet " << header.triggerIndex;
+        std::cout << std::endl;
+    }
+    if (records.empty())
+        return 0;
+
+    double t0 = records[0].sendTime;
+    if (!summaryOnly) {
+        if (csv)
+            std::cout << "index,time_us,tcode,node,tl,addr,nbytes,host_us,fpga_recv_us,fpga_total_us,status,flags,bus_gen"
+                      << std::endl;
+        else
+            std::cout << "     index     time(us)  tcode  node  tl      addr  bytes   host(us)  fpga-rx(us)  fpga(us)  status" << std::endl;
+    }
+
+    unsigned int numFail = 0;
+    unsigned int numReads = 0;
+    double maxHost = 0.0;
+    uint32_t maxHostIndex = 0;
+    double sumHost = 0.0;
+    double maxFpga = 0.0;
+    double sumFpga = 0.0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const PacketTraceRecord &rec = records[i];
+        double hostTime = (rec.recvTime > 0.0) ? rec.recvTime-rec.sendTime : 0.0;
+        if (rec.status != PacketTrace::STATUS_OK)
+            numFail++;
+        if (rec.recvTime > 0.0) {
+            numReads++;
+            sumHost += hostTime;
+            sumFpga += rec.fpgaTotalTime;
+            if (hostTime > maxHost) {
+                maxHost = hostTime;
+                maxHostIndex = rec.index;
+            }
+            if (rec.fpgaTotalTime > maxFpga)
+                maxFpga = rec.fpgaTotalTime;
+        }
+        if (summaryOnly)
+            continue;
+        if (hasTrigger && (window >= 0)) {
+            // Signed difference handles wrap-around of index
+            long diff = static_cast<int32_t>(rec.index-header.triggerIndex);
+            if ((diff < -window) || (diff > window))
+                continue;
+        }
+        if (csv) {
+            std::cout << rec.index << "," << std::fixed << std::setprecision(3) << (rec.sendTime-t0)*1e6 << ","
+                      << TcodeString(rec.tcode) << "," << static_cast<unsigned int>(rec.node) << ","
+                      << static_cast<unsigned int>(rec.tl) << ",0x" << std::hex << rec.addr << std::dec << ","
+                      << rec.nbytes << "," << hostTime*1e6 << "," << rec.fpgaRecvTime*1e6 << ","
+                      << rec.fpgaTotalTime*1e6 << "," << PacketTrace::StatusString(rec.status) << ","
+                      << static_cast<unsigned int>(rec.flags) << "," << static_cast<unsigned int>(rec.busGeneration)
+                      << std::endl;
+        }
+        else {
+            std::cout << ((rec.flags&PacketTrace::FLAG_TRIGGER) ? "T " : "  ")
+                      << std::setw(8) << rec.index << std::fixed << std::setprecision(2)
+                      << std::setw(13) << (rec.sendTime-t0)*1e6 << std::setw(7) << TcodeString(rec.tcode)
+                      << std::setw(6) << static_cast<unsigned int>(rec.node)
+                      << std::setw(4) << static_cast<unsigned int>(rec.tl)
+                      << std::hex << std::setw(10) << rec.addr << std::dec
+                      << std::setw(7) << rec.nbytes;
+            if (rec.recvTime > 0.0)
+                std::cout << std::setw(11) << hostTime*1e6;
+            else
+                std::cout << std::setw(11) << "-";
+            if (rec.fpgaTotalTime > 0.0)
+                std::cout << std::setw(13) << rec.fpgaRecvTime*1e6 << std::setw(10) << rec.fpgaTotalTime*1e6;
+            else
+                std::cout << std::setw(13) << "-" << std::setw(10) << "-";
+            std::cout << "  " << PacketTrace::StatusString(rec.status)
+                      << ((rec.flags&PacketTrace::FLAG_ETH_BROADCAST) ? " (eth-bc)" : "") << std::endl;
+        }
+    }
+
+    if (!csv) {
+        std::cout << std::endl << "Summary: " << records.size() << " packets, " << numFail << " failed, "
+                  << (records.back().sendTime-t0)*1e3 << " ms" << std::endl;
+        if (numReads > 0) {
+            std::cout << std::fixed << std::setprecision(2)
+                      << "  host round trip (us): mean " << sumHost/numReads*1e6 << ", max " << maxHost*1e6
+                      << " (packet " << maxHostIndex << ")" << std::endl
+                      << "  fpga total (us):      mean " << sumFpga/numReads*1e6 << ", max " << maxFpga*1e6
+                      << std::endl;
+        }
+    }
+    return 0;
+}